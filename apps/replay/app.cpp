@@ -0,0 +1,105 @@
+#include "gft/args.hpp"
+#include "gft/log.hpp"
+#include "gft/stats.hpp"
+#include "gft/util.hpp"
+#include "gft/vk.hpp"
+#include "gft/hal/capture.hpp"
+
+using namespace liong;
+using namespace vk;
+
+struct AppConfig {
+  std::string capture_path = "";
+  uint32_t dev_idx = 0;
+  uint32_t niter = 16;
+} CFG;
+
+void initialize(int argc, const char** argv) {
+  args::init_arg_parse("Replay", "Replay and time an invocation captured with "
+    "`InvocationSubmitTransactionConfig::capture_path`.");
+  args::reg_arg<args::StringParser>("-i", "--input", CFG.capture_path,
+    "Path to the capture archive.");
+  args::reg_arg<args::UintParser>("-d", "--device", CFG.dev_idx,
+    "Index of the device to replay on.");
+  args::reg_arg<args::UintParser>("-n", "--niter", CFG.niter,
+    "Number of times the invocation is replayed.");
+  args::parse_args(argc, argv);
+}
+
+void dbg_enum_dev_descs() {
+  uint32_t ndev = 0;
+  for (;;) {
+    auto desc = desc_dev(ndev);
+    if (desc.empty()) { break; }
+    L_INFO("device #", ndev, ": ", desc);
+    ++ndev;
+  }
+}
+
+void guarded_main() {
+  scoped::GcScope scope;
+
+  if (CFG.capture_path.empty()) {
+    args::print_help();
+    return;
+  }
+
+  dbg_enum_dev_descs();
+
+  scoped::Context ctxt = scoped::ContextBuilder("replay")
+    .dev_idx(CFG.dev_idx)
+    .build();
+  L_INFO("replaying on device #", CFG.dev_idx, ": ", desc_dev(CFG.dev_idx));
+
+  std::vector<uint8_t> archive_data = util::load_file(CFG.capture_path.c_str());
+  scoped::Replay replay(ctxt, std::move(archive_data));
+
+  stats::AvgStats<double> avg_host_time, avg_dev_time;
+  stats::MinStats<double> min_host_time, min_dev_time;
+  stats::MaxStats<double> max_host_time, max_dev_time;
+  for (uint32_t i = 0; i < CFG.niter; ++i) {
+    // Every iteration starts with the captured content so it does the same
+    // work.
+    replay.restore();
+
+    util::Timer timer {};
+    timer.tic();
+    replay.get_invoke().submit(false).wait();
+    timer.toc();
+
+    double host_time = timer.us();
+    double dev_time = replay.get_invoke().get_time_us();
+    avg_host_time.push(host_time);
+    min_host_time.push(host_time);
+    max_host_time.push(host_time);
+    avg_dev_time.push(dev_time);
+    min_dev_time.push(dev_time);
+    max_dev_time.push(dev_time);
+  }
+
+  L_INFO("replayed '", replay.record.label, "' for ", CFG.niter, " times");
+  L_INFO("host time (us): avg=", avg_host_time, "; min=", min_host_time,
+    "; max=", max_host_time);
+  L_INFO("device time (us): avg=", avg_dev_time, "; min=", min_dev_time,
+    "; max=", max_dev_time);
+}
+
+
+int main(int argc, const char** argv) {
+  try {
+    initialize(argc, argv);
+    vk::initialize();
+
+    guarded_main();
+  } catch (const std::exception& e) {
+    L_ERROR("application threw an exception");
+    L_ERROR(e.what());
+    L_ERROR("application cannot continue");
+    return -1;
+  } catch (...) {
+    L_ERROR("application threw an illiterate exception");
+    return -1;
+  }
+
+  return 0;
+}
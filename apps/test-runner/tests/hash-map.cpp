@@ -0,0 +1,85 @@
+#include <map>
+#include "gft/assert.hpp"
+#include "gft/log.hpp"
+#include "gft/test.hpp"
+#include "gft/hash-map.hpp"
+#include "gft/pool.hpp"
+
+using namespace liong;
+
+L_TEST(HashMapInsertFindErase) {
+  hash_map::HashMap<uint32_t, uint32_t> map;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    map[i] = i * 3;
+  }
+  L_ASSERT(map.size() == 1000);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    L_ASSERT(map.find(i) != nullptr && *map.find(i) == i * 3);
+  }
+  L_ASSERT(map.find(1000) == nullptr);
+
+  for (uint32_t i = 0; i < 1000; i += 2) {
+    L_ASSERT(map.erase(i));
+  }
+  L_ASSERT(!map.erase(0));
+  L_ASSERT(map.size() == 500);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    L_ASSERT((map.find(i) != nullptr) == (i % 2 == 1));
+  }
+}
+
+struct CollidingKey {
+  uint32_t x;
+
+  inline uint64_t hash() const {
+    // Every key shares few home slots so erasure has to shift clusters.
+    return x % 3;
+  }
+  friend inline bool operator==(const CollidingKey& a, const CollidingKey& b) {
+    return a.x == b.x;
+  }
+};
+
+L_TEST(HashMapMatchesStdMap) {
+  hash_map::HashMap<CollidingKey, uint32_t> map;
+  std::map<uint32_t, uint32_t> ref;
+
+  // Deterministic pseudo-random sequence of insertions and erasures.
+  uint32_t seed = 123;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t x = (seed >> 16) % 64;
+    if ((seed >> 8) % 3 == 0) {
+      L_ASSERT(map.erase(CollidingKey { x }) == (ref.erase(x) != 0));
+    } else {
+      map[CollidingKey { x }] = i;
+      ref[x] = i;
+    }
+  }
+
+  L_ASSERT(map.size() == ref.size());
+  for (uint32_t x = 0; x < 64; ++x) {
+    const uint32_t* value = map.find(CollidingKey { x });
+    auto it = ref.find(x);
+    if (it == ref.end()) {
+      L_ASSERT(value == nullptr);
+    } else {
+      L_ASSERT(value != nullptr && *value == it->second);
+    }
+  }
+}
+
+L_TEST(PoolRecyclesItemsByKey) {
+  pool::Pool<int, int> pool;
+  L_ASSERT(!pool.has_free_item(1));
+  {
+    pool::PoolItem<int, int> item = pool.create(1, 123);
+    L_ASSERT(!pool.has_free_item(1));
+  }
+  L_ASSERT(pool.has_free_item(1));
+  L_ASSERT(!pool.has_free_item(2));
+
+  pool::PoolItem<int, int> item = pool.acquire(1);
+  L_ASSERT(item.value() == 123);
+  L_ASSERT(!pool.has_free_item(1));
+}
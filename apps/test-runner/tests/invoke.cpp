@@ -0,0 +1,56 @@
+#include "gft/assert.hpp"
+#include "gft/log.hpp"
+#include "gft/test.hpp"
+#include "vk-test.hpp"
+
+using namespace liong;
+using namespace liong::vk;
+using namespace liong::vk_test;
+
+namespace {
+
+void rebind_and_check(bool is_baked) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("invocation_rebind_rsc");
+
+  scoped::Buffer buf0 = create_storage_buf(ctxt, "buf0", sizeof(uint32_t));
+  scoped::Buffer buf1 = create_storage_buf(ctxt, "buf1", sizeof(uint32_t));
+  ctxt.build_upload_invoke("init")
+    .write(buf0.view(), std::vector<uint32_t> { 0 })
+    .write(buf1.view(), std::vector<uint32_t> { 0 })
+    .build()
+    .submit()
+    .wait();
+
+  scoped::Task task = create_add_task(ctxt, "add");
+  scoped::Invocation invoke = task.build_comp_invoke("add")
+    .rsc(buf0.view())
+    .push_const((uint32_t)1)
+    .build();
+  if (is_baked) {
+    invoke.bake();
+  }
+
+  // The first submission might still be pending when the invocation is rebound
+  // so it must keep adding to the old buffer.
+  invoke.submit();
+  invoke.rebind_rsc(0, buf1.view());
+  invoke.submit();
+  invoke.rebind_push_const((uint32_t)2);
+  invoke.submit();
+
+  std::vector<uint32_t> data0 = read_buf<uint32_t>(ctxt, buf0, 1);
+  std::vector<uint32_t> data1 = read_buf<uint32_t>(ctxt, buf1, 1);
+  L_ASSERT(data0[0] == 1);
+  L_ASSERT(data1[0] == 1 + 2);
+}
+
+} // namespace
+
+L_TEST(InvocationRebindResource) {
+  rebind_and_check(false);
+}
+
+L_TEST(InvocationRebindBakedResource) {
+  rebind_and_check(true);
+}
@@ -0,0 +1,156 @@
+#include "gft/assert.hpp"
+#include "gft/log.hpp"
+#include "gft/test.hpp"
+#include "gft/vk.hpp"
+#include "gft/hal/render-graph.hpp"
+
+using namespace liong;
+using namespace liong::vk::scoped;
+
+namespace {
+
+RenderGraphResource add_rsc(RenderGraphConfig& cfg, bool is_transient) {
+  RenderGraphResourceConfig rsc {};
+  rsc.rsc_view_ty = L_RESOURCE_VIEW_TYPE_BUFFER;
+  rsc.is_transient = is_transient;
+  cfg.rscs.emplace_back(std::move(rsc));
+  return (RenderGraphResource)(cfg.rscs.size() - 1);
+}
+void add_pass(
+  RenderGraphConfig& cfg,
+  std::vector<RenderGraphResource>&& reads,
+  std::vector<RenderGraphResource>&& writes,
+  bool is_kept = false
+) {
+  RenderGraphPassConfig pass {};
+  pass.reads = std::move(reads);
+  pass.writes = std::move(writes);
+  pass.is_kept = is_kept;
+  cfg.passes.emplace_back(std::move(pass));
+}
+std::vector<uint32_t> schedule(const RenderGraphConfig& cfg) {
+  std::vector<std::set<uint32_t>> deps;
+  std::vector<std::set<uint32_t>> producers;
+  detail::collect_pass_deps(cfg, deps, producers);
+  std::vector<bool> is_alive = detail::cull_passes(cfg, producers);
+  return detail::schedule_passes(is_alive, deps, producers);
+}
+detail::RenderGraphTransientDetail make_transient(
+  uint32_t first_pos,
+  uint32_t last_pos,
+  size_t size,
+  uint32_t mem_ty_bits = 1
+) {
+  detail::RenderGraphTransientDetail out {};
+  out.first_pos = first_pos;
+  out.last_pos = last_pos;
+  out.size = size;
+  out.align = 16;
+  out.mem_ty_bits = mem_ty_bits;
+  return out;
+}
+
+} // namespace
+
+L_TEST(RenderGraphCullPasses) {
+  RenderGraphConfig cfg {};
+  RenderGraphResource t0 = add_rsc(cfg, true);
+  RenderGraphResource t1 = add_rsc(cfg, true);
+  RenderGraphResource t2 = add_rsc(cfg, true);
+  RenderGraphResource out = add_rsc(cfg, false);
+  // Produces what the output pass consumes.
+  add_pass(cfg, {}, { t0 });
+  // Nobody reads its result.
+  add_pass(cfg, {}, { t1 });
+  add_pass(cfg, { t0 }, { out });
+  // Has undeclared side effects.
+  add_pass(cfg, {}, { t2 }, true);
+
+  std::vector<std::set<uint32_t>> deps;
+  std::vector<std::set<uint32_t>> producers;
+  detail::collect_pass_deps(cfg, deps, producers);
+  std::vector<bool> is_alive = detail::cull_passes(cfg, producers);
+  L_ASSERT(is_alive.size() == 4);
+  L_ASSERT(is_alive[0]);
+  L_ASSERT(!is_alive[1]);
+  L_ASSERT(is_alive[2]);
+  L_ASSERT(is_alive[3]);
+}
+
+L_TEST(RenderGraphSchedulePasses) {
+  RenderGraphConfig cfg {};
+  RenderGraphResource t0 = add_rsc(cfg, true);
+  RenderGraphResource t1 = add_rsc(cfg, true);
+  RenderGraphResource out0 = add_rsc(cfg, false);
+  RenderGraphResource out1 = add_rsc(cfg, false);
+  add_pass(cfg, {}, { t0 });
+  add_pass(cfg, {}, { t1 });
+  add_pass(cfg, { t0 }, { out0 });
+  add_pass(cfg, { t1 }, { out1 });
+
+  // Results are consumed right after they are produced.
+  std::vector<uint32_t> ipasses = schedule(cfg);
+  L_ASSERT(ipasses == std::vector<uint32_t>({ 0, 2, 1, 3 }));
+}
+
+L_TEST(RenderGraphScheduleWriteAfterRead) {
+  RenderGraphConfig cfg {};
+  RenderGraphResource t0 = add_rsc(cfg, true);
+  RenderGraphResource out0 = add_rsc(cfg, false);
+  RenderGraphResource out1 = add_rsc(cfg, false);
+  add_pass(cfg, {}, { t0 });
+  add_pass(cfg, { t0 }, { out0 });
+  // Overwrites the resource the previous pass reads.
+  add_pass(cfg, {}, { t0 });
+  add_pass(cfg, { t0 }, { out1 });
+
+  std::vector<uint32_t> ipasses = schedule(cfg);
+  L_ASSERT(ipasses == std::vector<uint32_t>({ 0, 1, 2, 3 }));
+}
+
+L_TEST(RenderGraphPlaceTransients) {
+  std::vector<detail::RenderGraphTransientDetail> transients {
+    make_transient(0, 1, 256),
+    make_transient(2, 3, 128),
+    make_transient(1, 2, 64),
+  };
+  std::vector<detail::RenderGraphHeapDetail> heaps =
+    detail::place_transients(transients, 1);
+
+  L_ASSERT(heaps.size() == 1);
+  // Resources alive at different times share memory.
+  L_ASSERT(transients[0].offset == 0);
+  L_ASSERT(transients[1].offset == 0);
+  // Resources alive at the same time don't overlap.
+  L_ASSERT(transients[2].offset == 256);
+  L_ASSERT(heaps[0].size == 320);
+  L_ASSERT(heaps[0].align == 16);
+}
+
+L_TEST(RenderGraphPlaceTransientsIncompatibleMemoryTypes) {
+  std::vector<detail::RenderGraphTransientDetail> transients {
+    make_transient(0, 0, 256, 0b01),
+    make_transient(1, 1, 256, 0b10),
+  };
+  std::vector<detail::RenderGraphHeapDetail> heaps =
+    detail::place_transients(transients, 1);
+
+  L_ASSERT(heaps.size() == 2);
+  L_ASSERT(transients[0].iheap != transients[1].iheap);
+  L_ASSERT(heaps[transients[0].iheap].mem_ty_bits == 0b01);
+  L_ASSERT(heaps[transients[1].iheap].mem_ty_bits == 0b10);
+}
+
+L_TEST(RenderGraphPlaceTransientsGranularity) {
+  std::vector<detail::RenderGraphTransientDetail> transients {
+    make_transient(0, 1, 100),
+    make_transient(0, 1, 100),
+  };
+  std::vector<detail::RenderGraphHeapDetail> heaps =
+    detail::place_transients(transients, 1024);
+
+  L_ASSERT(heaps.size() == 1);
+  L_ASSERT(transients[0].offset == 0);
+  L_ASSERT(transients[1].offset == 1024);
+  L_ASSERT(heaps[0].size == 1124);
+}
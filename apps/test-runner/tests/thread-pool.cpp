@@ -0,0 +1,48 @@
+#include <atomic>
+#include <stdexcept>
+#include "gft/assert.hpp"
+#include "gft/log.hpp"
+#include "gft/test.hpp"
+#include "gft/thread-pool.hpp"
+
+using namespace liong;
+using namespace liong::thread_pool;
+
+L_TEST(ThreadPoolConcurrentCallers) {
+  ThreadPool pool(3);
+
+  // Two threads dispatching to the same pool are run one after another.
+  std::atomic<uint32_t> sum0 { 0 };
+  std::atomic<uint32_t> sum1 { 0 };
+  std::thread caller([&]() {
+    for (uint32_t i = 0; i < 16; ++i) {
+      pool.parallel_for(64, [&](size_t ijob) { sum0 += (uint32_t)ijob; });
+    }
+  });
+  for (uint32_t i = 0; i < 16; ++i) {
+    pool.parallel_for(64, [&](size_t ijob) { sum1 += (uint32_t)ijob; });
+  }
+  caller.join();
+
+  L_ASSERT(sum0 == 16 * 2016);
+  L_ASSERT(sum1 == 16 * 2016);
+}
+
+L_TEST(ThreadPoolRethrowJobException) {
+  ThreadPool pool(3);
+
+  bool is_thrown = false;
+  try {
+    pool.parallel_for(64, [](size_t ijob) {
+      if (ijob == 7) { throw std::runtime_error("job failed"); }
+    });
+  } catch (const std::runtime_error&) {
+    is_thrown = true;
+  }
+  L_ASSERT(is_thrown);
+
+  // The pool is still usable.
+  std::atomic<uint32_t> njob { 0 };
+  pool.parallel_for(64, [&](size_t ijob) { njob += 1; });
+  L_ASSERT(njob == 64);
+}
@@ -0,0 +1,237 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include "gft/assert.hpp"
+#include "gft/log.hpp"
+#include "gft/test.hpp"
+#include "vk-test.hpp"
+
+using namespace liong;
+using namespace liong::vk;
+using namespace liong::vk_test;
+
+L_TEST(TransactionTimelineProgression) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("transaction_timeline_progression");
+  const vk::Context& ctxt2 = ctxt;
+
+  scoped::Buffer buf = create_storage_buf(ctxt, "buf", sizeof(uint32_t));
+  scoped::Task task = create_add_task(ctxt, "add");
+  scoped::Invocation invoke = task.build_comp_invoke("add")
+    .rsc(buf.view())
+    .push_const((uint32_t)1)
+    .build();
+
+  const ContextSubmitDetail& submit_detail =
+    ctxt2.submit_details.at(L_SUBMIT_TYPE_COMPUTE);
+  std::map<SubmitType, uint64_t> last_values;
+  for (const auto& pair : ctxt2.submit_details) {
+    last_values[pair.first] = pair.second.timeline->last_value;
+  }
+
+  // Each submission to a queue signals the next value of its timeline.
+  uint64_t last_value = submit_detail.timeline->last_value;
+  for (uint32_t i = 0; i < 3; ++i) {
+    invoke.submit().wait();
+    ++last_value;
+    L_ASSERT(submit_detail.timeline->last_value == last_value);
+
+    uint64_t value = 0;
+    VK_ASSERT << ctxt2.timeline_detail.get_sema_counter_value(ctxt2.dev->dev,
+      submit_detail.timeline->sema->sema, &value);
+    L_ASSERT(value >= last_value);
+  }
+
+  // Queues not submitted to are left where they were.
+  for (const auto& pair : ctxt2.submit_details) {
+    if (pair.second.timeline == submit_detail.timeline) { continue; }
+    L_ASSERT(pair.second.timeline->last_value == last_values.at(pair.first));
+  }
+}
+
+L_TEST(TransactionRecycleCommandPools) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("transaction_recycle_cmd_pools");
+
+  scoped::Buffer buf = create_storage_buf(ctxt, "buf", sizeof(uint32_t));
+  scoped::Task task = create_add_task(ctxt, "add");
+  scoped::Invocation invoke = task.build_comp_invoke("add")
+    .rsc(buf.view())
+    .push_const((uint32_t)1)
+    .build();
+
+  ctxt.build_fill_invoke("clear")
+    .dst(buf.view())
+    .value(0)
+    .build()
+    .submit()
+    .wait();
+
+  // Transactions are dropped right after they are waited so their command
+  // pools return to the pool.
+  invoke.submit(false).wait();
+  ContextQueueStatistics stats0 = ctxt.get_queue_stats();
+  for (uint32_t i = 0; i < 4; ++i) {
+    invoke.submit(false).wait();
+  }
+  ContextQueueStatistics stats1 = ctxt.get_queue_stats();
+
+  // The device has passed the last submission of each pool so they are all
+  // reused.
+  L_ASSERT(stats1.nsubmit == stats0.nsubmit + 4);
+  L_ASSERT(stats1.ncmd_pool_create == stats0.ncmd_pool_create);
+  L_ASSERT(stats1.ncmdbuf_alloc == stats0.ncmdbuf_alloc);
+  L_ASSERT(stats1.nsema_create == stats0.nsema_create);
+
+  std::vector<uint32_t> data = read_buf<uint32_t>(ctxt, buf, 1);
+  L_ASSERT(data[0] == 5);
+}
+
+L_TEST(TransactionCrossQueueOrdering) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("transaction_cross_queue_ordering");
+
+  scoped::Buffer buf0 = create_storage_buf(ctxt, "buf0", 4 * sizeof(uint32_t));
+  scoped::Buffer buf1 = create_storage_buf(ctxt, "buf1", 4 * sizeof(uint32_t));
+  scoped::Task task = create_add_task(ctxt, "add");
+
+  scoped::Invocation add1 = task.build_comp_invoke("add1")
+    .rsc(buf0.view())
+    .workgrp_count(4, 1, 1)
+    .push_const((uint32_t)1)
+    .build();
+  scoped::Invocation add2_async = task.build_comp_invoke("add2_async")
+    .rsc(buf0.view())
+    .workgrp_count(4, 1, 1)
+    .push_const((uint32_t)2)
+    .is_async()
+    .build();
+  // Independent subinvocations of an async composite, recorded in parallel.
+  scoped::Invocation add4 = task.build_comp_invoke("add4")
+    .rsc(buf0.view())
+    .workgrp_count(4, 1, 1)
+    .push_const((uint32_t)4)
+    .build();
+  scoped::Invocation add8 = task.build_comp_invoke("add8")
+    .rsc(buf1.view())
+    .workgrp_count(4, 1, 1)
+    .push_const((uint32_t)8)
+    .build();
+  scoped::Invocation composite = ctxt.build_composite_invoke("composite")
+    .invoke(add4)
+    .invoke(add8)
+    .is_async()
+    .build();
+
+  // Nothing is waited until the results are read back, so each write must be
+  // ordered after the previous one by the transactions themselves.
+  ctxt.build_upload_invoke("init")
+    .write(buf0.view(), std::vector<uint32_t>(4, 0))
+    .write(buf1.view(), std::vector<uint32_t>(4, 0))
+    .build()
+    .submit();
+  add1.submit();
+  add2_async.submit();
+  scoped::InvocationSubmitTransactionBuilder(composite)
+    .is_parallel()
+    .build();
+  add1.submit();
+
+  std::vector<uint32_t> data0 = read_buf<uint32_t>(ctxt, buf0, 4);
+  std::vector<uint32_t> data1 = read_buf<uint32_t>(ctxt, buf1, 4);
+  for (uint32_t i = 0; i < 4; ++i) {
+    L_ASSERT(data0[i] == 1 + 2 + 4 + 1);
+    L_ASSERT(data1[i] == 8);
+  }
+}
+
+L_TEST(TransactionWaitAll) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("transaction_wait_all");
+
+  scoped::Buffer buf0 = create_storage_buf(ctxt, "buf0", sizeof(uint32_t));
+  scoped::Buffer buf1 = create_storage_buf(ctxt, "buf1", sizeof(uint32_t));
+  scoped::Task task = create_add_task(ctxt, "add");
+  scoped::Invocation add0 = task.build_comp_invoke("add0")
+    .rsc(buf0.view())
+    .push_const((uint32_t)1)
+    .build();
+  scoped::Invocation add1 = task.build_comp_invoke("add1")
+    .rsc(buf1.view())
+    .push_const((uint32_t)1)
+    .build();
+
+  scoped::Transaction transact0 = add0.submit();
+  scoped::Transaction transact1 = add1.submit();
+  L_ASSERT(scoped::wait_all({ &transact0, &transact1 }));
+  L_ASSERT(transact0.is_done());
+  L_ASSERT(transact1.is_done());
+  // Done transactions return immediately even without time to wait.
+  L_ASSERT(scoped::wait_all({ &transact0, &transact1 }, 0.0));
+}
+
+L_TEST(TransactionWaitAny) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("transaction_wait_any");
+
+  scoped::Buffer buf0 = create_storage_buf(ctxt, "buf0", sizeof(uint32_t));
+  scoped::Buffer buf1 = create_storage_buf(ctxt, "buf1", sizeof(uint32_t));
+  scoped::Task task = create_add_task(ctxt, "add");
+  scoped::Invocation add0 = task.build_comp_invoke("add0")
+    .rsc(buf0.view())
+    .push_const((uint32_t)1)
+    .build();
+  scoped::Invocation add1 = task.build_comp_invoke("add1")
+    .rsc(buf1.view())
+    .push_const((uint32_t)1)
+    .is_async()
+    .build();
+
+  scoped::Transaction transact0 = add0.submit();
+  scoped::Transaction transact1 = add1.submit();
+  std::vector<const scoped::Transaction*> transacts {
+    &transact0,
+    &transact1,
+  };
+  size_t i = scoped::wait_any(transacts);
+  L_ASSERT(i < transacts.size());
+  L_ASSERT(transacts[i]->is_done());
+
+  // The remaining one is waited alone.
+  const scoped::Transaction* rest = transacts[1 - i];
+  L_ASSERT(scoped::wait_any({ rest }) == 0);
+  L_ASSERT(rest->is_done());
+  // The first done transaction is returned.
+  L_ASSERT(scoped::wait_any(transacts, 0.0) == 0);
+}
+
+L_TEST(TransactionOnDone) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("transaction_on_done");
+
+  scoped::Buffer buf = create_storage_buf(ctxt, "buf", sizeof(uint32_t));
+  scoped::Task task = create_add_task(ctxt, "add");
+  scoped::Invocation add = task.build_comp_invoke("add")
+    .rsc(buf.view())
+    .push_const((uint32_t)1)
+    .build();
+
+  // Callbacks are called on the reaper thread, either after the transaction
+  // is finished or right away if it has already been.
+  std::atomic<uint32_t> ncallback { 0 };
+  scoped::Transaction transact = add.submit();
+  transact.on_done([&]() { ncallback += 1; });
+  std::future<void> future = transact.get_future();
+  L_ASSERT(future.wait_for(std::chrono::seconds(10)) ==
+    std::future_status::ready);
+  L_ASSERT(transact.is_done());
+
+  transact.on_done([&]() { ncallback += 1; });
+  std::future<void> future2 = transact.get_future();
+  L_ASSERT(future2.wait_for(std::chrono::seconds(10)) ==
+    std::future_status::ready);
+
+  // Callbacks of a transaction are called in the order they were pushed, so
+  // both have been called once the second future is ready.
+  L_ASSERT(ncallback == 2);
+}
@@ -0,0 +1,104 @@
+#include "gft/assert.hpp"
+#include "gft/log.hpp"
+#include "gft/test.hpp"
+#include "vk-test.hpp"
+
+using namespace liong;
+using namespace liong::vk;
+using namespace liong::vk_test;
+
+L_TEST(UploadPackedWrites) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("upload_packed_writes");
+
+  scoped::Buffer a = create_storage_buf(ctxt, "a", 128);
+  scoped::Buffer b = create_storage_buf(ctxt, "b", 16);
+
+  // Sizes are not multiples of the staging alignment so writes after the first
+  // one are packed at padded offsets.
+  std::vector<uint32_t> data0 { 1, 2, 3 };
+  std::vector<uint32_t> data1 { 4, 5, 6, 7, 8 };
+  std::vector<uint32_t> data2 { 9 };
+  ctxt.build_upload_invoke("upload")
+    .write(a.view(0, 12), data0)
+    .write(a.view(64, 20), data1)
+    .write(b.view(4, 4), data2)
+    .build()
+    .submit()
+    .wait();
+
+  std::vector<uint32_t> a2 = read_buf<uint32_t>(ctxt, a, 32);
+  std::vector<uint32_t> b2 = read_buf<uint32_t>(ctxt, b, 4);
+  L_ASSERT(a2[0] == 1 && a2[1] == 2 && a2[2] == 3);
+  L_ASSERT(a2[16] == 4 && a2[17] == 5 && a2[18] == 6 && a2[19] == 7 &&
+    a2[20] == 8);
+  L_ASSERT(b2[1] == 9);
+}
+
+L_TEST(UploadStridedWrite) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("upload_strided_write");
+
+  scoped::Buffer a = create_storage_buf(ctxt, "a", 64);
+
+  // Each element is written at the start of a 16-byte slot.
+  std::vector<uint32_t> data { 1, 2, 3, 4 };
+  ctxt.build_upload_invoke("upload")
+    .write(make_rsc_view(a.view()), data.data(), data.size(),
+      sizeof(uint32_t), 16)
+    .build()
+    .submit()
+    .wait();
+
+  std::vector<uint32_t> a2 = read_buf<uint32_t>(ctxt, a, 16);
+  for (size_t i = 0; i < data.size(); ++i) {
+    L_ASSERT(a2[i * 4] == data[i]);
+  }
+}
+
+L_TEST(UploadStatistics) {
+  scoped::GcScope scope;
+  scoped::Context ctxt = create_ctxt("upload_statistics");
+
+  scoped::Buffer a = create_storage_buf(ctxt, "a", 64);
+  uint64_t upload_size = ctxt.get_rsc_stats().upload_size;
+
+  // Only the bytes of host data are counted, not the padding between strided
+  // elements.
+  std::vector<uint32_t> data { 1, 2, 3, 4 };
+  scoped::Invocation upload = ctxt.build_upload_invoke("upload")
+    .write(make_rsc_view(a.view()), data.data(), data.size(),
+      sizeof(uint32_t), 16)
+    .build();
+  scoped::Invocation update = ctxt.build_update_invoke("update")
+    .dst(a.view(4, 8))
+    .data(std::vector<uint32_t> { 5, 6 })
+    .build();
+  scoped::Invocation baked_upload = ctxt.build_upload_invoke("baked_upload")
+    .write(a.view(8, 4), std::vector<uint32_t> { 7 })
+    .build();
+  // Baking records the copies but doesn't count them.
+  baked_upload.bake();
+  L_ASSERT(ctxt.get_rsc_stats().upload_size == upload_size);
+
+  // Invocations are counted each time they are submitted.
+  upload.submit().wait();
+  upload_size += 16;
+  L_ASSERT(ctxt.get_rsc_stats().upload_size == upload_size);
+  upload.submit().wait();
+  upload_size += 16;
+  L_ASSERT(ctxt.get_rsc_stats().upload_size == upload_size);
+
+  update.submit().wait();
+  upload_size += 8;
+  L_ASSERT(ctxt.get_rsc_stats().upload_size == upload_size);
+
+  baked_upload.submit().wait();
+  baked_upload.submit().wait();
+  upload_size += 2 * 4;
+  L_ASSERT(ctxt.get_rsc_stats().upload_size == upload_size);
+
+  // Readbacks are not uploads.
+  read_buf<uint32_t>(ctxt, a, 16);
+  L_ASSERT(ctxt.get_rsc_stats().upload_size == upload_size);
+}
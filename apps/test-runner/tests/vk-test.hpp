@@ -0,0 +1,89 @@
+// Helpers shared by tests running on a Vulkan device.
+// @PENGUINLIONG
+#pragma once
+#include "gft/vk.hpp"
+#include "gft/glslang.hpp"
+
+namespace liong {
+
+namespace vk_test {
+
+using namespace vk;
+
+// Backends are initialized on first use so tests not touching the device can
+// still run on machines without one.
+inline scoped::Context create_ctxt(
+  const std::string& label,
+  bool is_single_queue = false
+) {
+  static bool is_initialized = false;
+  if (!is_initialized) {
+    vk::initialize();
+    glslang::initialize();
+    is_initialized = true;
+  }
+  return scoped::ContextBuilder(label)
+    .is_single_queue(is_single_queue)
+    .build();
+}
+
+inline scoped::Buffer create_storage_buf(
+  const scoped::Context& ctxt,
+  const std::string& label,
+  size_t size
+) {
+  return ctxt.build_buf(label)
+    .size(size)
+    .storage()
+    .build();
+}
+
+// Copy the first `n` elements of `buf` back to the host.
+template<typename T>
+std::vector<T> read_buf(
+  const scoped::Context& ctxt,
+  const scoped::Buffer& buf,
+  size_t n
+) {
+  scoped::Buffer read_back = ctxt.build_buf("read_back")
+    .size(n * sizeof(T))
+    .read_back()
+    .build();
+  ctxt.build_trans_invoke("read_back")
+    .src(buf.view(0, n * sizeof(T)))
+    .dst(read_back.view())
+    .build()
+    .submit()
+    .wait();
+
+  std::vector<T> out(n);
+  read_back.map_read().read(out);
+  return out;
+}
+
+// Compute task adding `value` in push constants to each `uint` in the storage
+// buffer bound at binding 0. Dispatch one workgroup per element.
+inline scoped::Task create_add_task(
+  const scoped::Context& ctxt,
+  const std::string& label
+) {
+  static const char* ADD_GLSL = R"(
+    #version 450
+    layout(local_size_x=1) in;
+    layout(binding=0) buffer Data { uint data[]; };
+    layout(push_constant) uniform PushConstants { uint value; };
+    void main() {
+      data[gl_GlobalInvocationID.x] += value;
+    }
+  )";
+  glslang::ComputeSpirvArtifact art = glslang::compile_comp(ADD_GLSL, "main");
+  return ctxt.build_comp_task(label)
+    .comp(art.comp_spv)
+    .rsc(L_RESOURCE_TYPE_STORAGE_BUFFER)
+    .push_const_size(sizeof(uint32_t))
+    .build();
+}
+
+} // namespace vk_test
+
+} // namespace liong
@@ -0,0 +1,249 @@
+// # Invocation capture and replay
+// @PENGUINLIONG
+//
+// A captured invocation is a zip archive of a `capture.json` describing the
+// resources, render passes, tasks and invocations, and binary files of task
+// code and resource content it refers to. Objects refer to each other by
+// indices in the `CaptureRecord` lists. Invocations are listed after their
+// subinvocations so they can be created in order, and the last one is the
+// captured invocation.
+//
+// A `Replay` reconstructs the capture on any device, so that device-side
+// regressions can be reproduced and timed without the host application.
+#pragma once
+#include <array>
+#include <optional>
+#include "gft/hal/scoped-hal.hpp"
+#include "gft/json-serde.hpp"
+#include "gft/zip.hpp"
+
+#ifndef HAL_IMPL_NAMESPACE
+static_assert(false, "please specify the implementation namespace (e.g. `vk`)");
+#endif
+
+namespace liong {
+namespace HAL_IMPL_NAMESPACE {
+
+// Bumped when the archive layout is changed incompatibly.
+constexpr uint32_t CAPTURE_VERSION = 1;
+
+struct CaptureBufferRecord {
+  std::string label;
+  uint32_t host_access;
+  uint64_t size;
+  uint64_t align;
+  uint32_t usage;
+  // Archive file of the content; empty if the content was not captured.
+  std::string data_file;
+
+  L_JSON_SERDE_FIELDS(label, host_access, size, align, usage, data_file);
+};
+struct CaptureImageRecord {
+  std::string label;
+  uint32_t width;
+  uint32_t height;
+  uint32_t depth;
+  fmt::Format fmt;
+  fmt::ColorSpace cspace;
+  uint32_t usage;
+  // Tightly packed texels; empty if the content was not captured.
+  std::string data_file;
+
+  L_JSON_SERDE_FIELDS(label, width, height, depth, fmt, cspace, usage,
+    data_file);
+};
+// Content of depth images is not captured.
+struct CaptureDepthImageRecord {
+  std::string label;
+  uint32_t width;
+  uint32_t height;
+  fmt::DepthFormat fmt;
+  uint32_t usage;
+
+  L_JSON_SERDE_FIELDS(label, width, height, fmt, usage);
+};
+struct CaptureAttachmentRecord {
+  AttachmentAccess attm_access;
+  AttachmentType attm_ty;
+  fmt::Format color_fmt;
+  fmt::ColorSpace cspace;
+  fmt::DepthFormat depth_fmt;
+
+  L_JSON_SERDE_FIELDS(attm_access, attm_ty, color_fmt, cspace, depth_fmt);
+};
+struct CaptureRenderPassRecord {
+  std::string label;
+  uint32_t width;
+  uint32_t height;
+  std::vector<CaptureAttachmentRecord> attms;
+
+  L_JSON_SERDE_FIELDS(label, width, height, attms);
+};
+struct CaptureTaskRecord {
+  std::string label;
+  // Render pass of a graphics task; empty for compute tasks.
+  std::optional<uint32_t> ipass;
+  // Compute task code.
+  std::string entry_name;
+  std::string code_file;
+  // Graphics task code.
+  std::string vert_entry_name;
+  std::string vert_code_file;
+  std::string frag_entry_name;
+  std::string frag_code_file;
+  Topology topo;
+  std::vector<ResourceType> rsc_tys;
+  std::array<uint32_t, 3> workgrp_size;
+  bool is_bindless;
+  uint32_t push_const_size;
+
+  L_JSON_SERDE_FIELDS(label, ipass, entry_name, code_file, vert_entry_name,
+    vert_code_file, frag_entry_name, frag_code_file, topo, rsc_tys,
+    workgrp_size, is_bindless, push_const_size);
+};
+// View of the `irsc`-th buffer, image or depth image depending on the view
+// type. Offsets and extents not applicable to the view type are zeros.
+struct CaptureResourceViewRecord {
+  ResourceViewType rsc_view_ty;
+  uint32_t irsc;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t x_offset;
+  uint32_t y_offset;
+  uint32_t z_offset;
+  uint32_t width;
+  uint32_t height;
+  uint32_t depth;
+  // `ImageSampler` or `DepthImageSampler`.
+  uint32_t sampler;
+
+  L_JSON_SERDE_FIELDS(rsc_view_ty, irsc, offset, size, x_offset, y_offset,
+    z_offset, width, height, depth, sampler);
+};
+struct CaptureTransferRegionRecord {
+  CaptureResourceViewRecord src;
+  CaptureResourceViewRecord dst;
+
+  L_JSON_SERDE_FIELDS(src, dst);
+};
+struct CaptureUploadWriteRecord {
+  CaptureResourceViewRecord dst;
+  uint64_t nelem;
+  uint64_t elem_size;
+  uint64_t elem_stride;
+  // Tightly packed elements.
+  std::string data_file;
+
+  L_JSON_SERDE_FIELDS(dst, nelem, elem_size, elem_stride, data_file);
+};
+enum CaptureInvocationType {
+  L_CAPTURE_INVOCATION_TYPE_TRANSFER,
+  L_CAPTURE_INVOCATION_TYPE_FILL,
+  L_CAPTURE_INVOCATION_TYPE_UPDATE,
+  L_CAPTURE_INVOCATION_TYPE_UPLOAD,
+  L_CAPTURE_INVOCATION_TYPE_COMPUTE,
+  L_CAPTURE_INVOCATION_TYPE_GRAPHICS,
+  L_CAPTURE_INVOCATION_TYPE_RENDER_PASS,
+  L_CAPTURE_INVOCATION_TYPE_COMPOSITE,
+};
+// Fields not applicable to the invocation type are left empty.
+struct CaptureInvocationRecord {
+  std::string label;
+  CaptureInvocationType invoke_ty;
+  bool is_timed;
+  // Transfer, fill and update invocations. Fill and update invocations only
+  // have destinations.
+  std::optional<CaptureResourceViewRecord> src;
+  std::optional<CaptureResourceViewRecord> dst;
+  std::vector<CaptureTransferRegionRecord> regions;
+  uint32_t buf_row_len;
+  uint32_t buf_img_height;
+  bool is_blit;
+  uint32_t value;
+  std::string data_file;
+  std::vector<CaptureUploadWriteRecord> writes;
+  // Compute and graphics invocations.
+  std::optional<uint32_t> itask;
+  std::vector<CaptureResourceViewRecord> rsc_views;
+  std::vector<CaptureResourceViewRecord> bindless_rsc_views;
+  std::vector<ResourceType> bindless_rsc_tys;
+  std::vector<uint8_t> push_consts;
+  std::array<uint32_t, 3> workgrp_count;
+  std::optional<CaptureResourceViewRecord> indirect_buf;
+  bool is_async;
+  uint32_t ninst;
+  std::vector<CaptureResourceViewRecord> vert_bufs;
+  uint32_t nvert;
+  std::optional<CaptureResourceViewRecord> idx_buf;
+  IndexType idx_ty;
+  uint32_t nidx;
+  uint32_t ndraw;
+  std::optional<CaptureResourceViewRecord> count_buf;
+  // Render pass and composite invocations.
+  std::optional<uint32_t> ipass;
+  std::vector<CaptureResourceViewRecord> attms;
+  std::vector<uint32_t> subinvokes;
+  std::vector<CaptureResourceViewRecord> discard_rsc_views;
+
+  L_JSON_SERDE_FIELDS(label, invoke_ty, is_timed, src, dst, regions,
+    buf_row_len, buf_img_height, is_blit, value, data_file, writes, itask,
+    rsc_views, bindless_rsc_views, bindless_rsc_tys, push_consts,
+    workgrp_count, indirect_buf, is_async, ninst, vert_bufs, nvert, idx_buf,
+    idx_ty, nidx, ndraw, count_buf, ipass, attms, subinvokes,
+    discard_rsc_views);
+};
+struct CaptureRecord {
+  uint32_t version;
+  std::string label;
+  // Name of the device the invocation was captured on.
+  std::string dev_desc;
+  std::vector<CaptureBufferRecord> bufs;
+  std::vector<CaptureImageRecord> imgs;
+  std::vector<CaptureDepthImageRecord> depth_imgs;
+  std::vector<CaptureRenderPassRecord> passes;
+  std::vector<CaptureTaskRecord> tasks;
+  std::vector<CaptureInvocationRecord> invokes;
+
+  L_JSON_SERDE_FIELDS(version, label, dev_desc, bufs, imgs, depth_imgs,
+    passes, tasks, invokes);
+};
+
+namespace scoped {
+
+// Objects reconstructed from a capture archive. Resources are created with
+// transfer usages so that their captured content can be restored, and
+// presentable images are created as offscreen images.
+struct Replay {
+  scoped::Context ctxt;
+  // Archive bytes referred to by `archive`.
+  std::vector<uint8_t> archive_data;
+  zip::ZipArchive archive;
+  CaptureRecord record;
+  std::vector<scoped::Buffer> bufs;
+  std::vector<scoped::Image> imgs;
+  std::vector<scoped::DepthImage> depth_imgs;
+  std::vector<scoped::RenderPass> passes;
+  std::vector<scoped::Task> tasks;
+  std::vector<scoped::Invocation> invokes;
+  // Upload of the captured resource content; invalid if no content was
+  // captured.
+  scoped::Invocation restore_invoke;
+
+  Replay(const scoped::Context& ctxt, std::vector<uint8_t>&& archive_data);
+
+  // Reset the resources to the content they had when captured, and wait for
+  // completion.
+  void restore();
+
+  // The captured invocation.
+  inline const scoped::Invocation& get_invoke() const {
+    return invokes.back();
+  }
+  inline scoped::Invocation& get_invoke() {
+    return invokes.back();
+  }
+};
+
+} // namespace scoped
+} // namespace HAL_IMPL_NAMESPACE
+} // namespace liong
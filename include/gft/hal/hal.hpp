@@ -8,6 +8,8 @@
 // your header.
 #pragma once
 #include <array>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <string>
@@ -45,6 +47,17 @@ L_IMPL_FN std::string desc_dev(uint32_t idx);
 
 struct InvocationSubmitTransactionConfig {
   std::string label;
+  // Set `true` to record independent subinvocations of composite and render
+  // pass invocations into secondary command buffers on multiple threads.
+  bool is_parallel;
+  // If not empty, the invocation tree, the code of its tasks and the content
+  // of the resources it references are captured to a zip archive at this path
+  // before the invocation is submitted. Capturing waits for the device to be
+  // idle. The context MUST be capturable.
+  std::string capture_path;
+  // If set, the invocation tree is timed in the current frame of the
+  // profiler. Lifetime bound.
+  struct Profiler* profiler;
 };
 L_IMPL_STRUCT struct Transaction;
 // A batch of works dispatched to the device.
@@ -54,9 +67,29 @@ struct Transaction_ {
   // Check whether the transaction is finished. `true` is returned if so.
   virtual bool is_done() const = 0;
   // Wait the invocation submitted to device for execution. Returns immediately
-  // if the invocation has already been waited.
+  // if the invocation has already been waited. The calling thread sleeps
+  // until the device signals completion.
   virtual void wait() const = 0;
-};
+  // Wait at most `timeout_us` microseconds. `true` is returned if the
+  // transaction is finished.
+  virtual bool wait_for(double timeout_us) const = 0;
+  // Call `callback` on the context's reaper thread once the transaction is
+  // finished. Callbacks MUST NOT block for long because they are served by a
+  // single thread. Transactions of presentation MUST outlive their callbacks.
+  virtual void on_done(std::function<void()>&& callback) const = 0;
+};
+// Wait until any of `transacts` is finished and return its index. The number
+// of transactions is returned if none is finished in `timeout_us`
+// microseconds. All transactions MUST be submitted on the same context.
+L_IMPL_FN size_t wait_any(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us = std::numeric_limits<double>::infinity());
+// Wait until all of `transacts` are finished. `false` is returned if they are
+// not finished in `timeout_us` microseconds. All transactions MUST be
+// submitted on the same context.
+L_IMPL_FN bool wait_all(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us = std::numeric_limits<double>::infinity());
 
 
 
@@ -65,6 +98,18 @@ struct ContextConfig {
   std::string label;
   // Index of the device.
   uint32_t dev_idx;
+  // Soft limit of memory allocated by buffers and images in bytes. Allocations
+  // exceeding the limit fail early. Zero means no limit.
+  size_t mem_soft_limit;
+  // Set `true` to submit transfers to the same queue as compute and graphics
+  // work even if a dedicated transfer queue is available, e.g., to compare
+  // transfer throughput.
+  bool is_single_queue;
+  // Set `true` to keep task code and invocation configs so that submitted
+  // invocations can be captured (see `capture_path` of
+  // `InvocationSubmitTransactionConfig`). Buffers and images are created with
+  // transfer source usage so that their content can be read back.
+  bool is_capturable;
 };
 struct ContextWindowsConfig {
   std::string label;
@@ -74,6 +119,9 @@ struct ContextWindowsConfig {
   const void* hinst;
   // Window handle, aka `HWND`.
   const void* hwnd;
+  size_t mem_soft_limit;
+  bool is_single_queue;
+  bool is_capturable;
 };
 struct ContextAndroidConfig {
   std::string label;
@@ -81,16 +129,171 @@ struct ContextAndroidConfig {
   uint32_t dev_idx;
   // Android native window, `ANativeWindow`.
   const void* native_wnd;
+  size_t mem_soft_limit;
+  bool is_single_queue;
+  bool is_capturable;
 };
 struct ContextMetalConfig {
   std::string label;
   uint32_t dev_idx;
   const void* metal_layer;
+  size_t mem_soft_limit;
+  bool is_single_queue;
+  bool is_capturable;
+};
+
+struct MemoryHeapStatistics {
+  // `true` if the heap is device-local.
+  bool is_dev_local;
+  // Bytes of memory used by the current process on this heap.
+  size_t usage;
+  // Estimated bytes of memory available to the current process on this heap.
+  // Allocations beyond this budget might fail or degrade performance.
+  size_t budget;
+  // Number of allocations and their total size made by the context.
+  uint64_t nalloc;
+  size_t alloc_size;
+};
+struct MemoryCategoryStatistics {
+  // Number of live allocations.
+  uint64_t nalloc;
+  // Number of allocations ever made.
+  uint64_t nalloc_total;
+  // Bytes of live allocations. Always zero for descriptors because descriptor
+  // memory is opaque.
+  size_t size;
+  // Number of live descriptors. Only counted for descriptor pools.
+  uint64_t ndesc;
+};
+struct ContextMemoryStatistics {
+  std::vector<MemoryHeapStatistics> heaps;
+  // Device-side buffers.
+  MemoryCategoryStatistics bufs;
+  // Images and depth images.
+  MemoryCategoryStatistics imgs;
+  // Host-accessed buffers only used as transfer sources and destinations.
+  MemoryCategoryStatistics stage_bufs;
+  // Descriptor pools.
+  MemoryCategoryStatistics descs;
+  // Memory shared by aliasing buffers and images.
+  MemoryCategoryStatistics aliased;
+  // Bytes allocated by buffers and images, and its peak value.
+  size_t size;
+  size_t peak_size;
+  // Number of allocations per second since last query, and its average over
+  // all queries.
+  double alloc_rate;
+  double avg_alloc_rate;
+};
+struct DefragmentationStatistics {
+  // Fragmentation of device memory before and after this call, in [0, 1]. It's
+  // the portion of free bytes outside the largest free range.
+  double frag_before;
+  double frag_after;
+  // Number of memory blocks before and after this call.
+  uint32_t nblock_before;
+  uint32_t nblock_after;
+  // Allocations and bytes relocated in this call.
+  uint32_t nmove;
+  size_t move_size;
+  // Allocations that could have been moved but were in use.
+  uint32_t nskip;
+  // `true` if defragmentation completed; otherwise it resumes on the next call.
+  bool is_done;
+};
+struct ContextQueueStatistics {
+  // `true` if transfers are submitted to a dedicated transfer-only queue.
+  bool is_transfer_dedicated;
+  // `true` if async compute invocations are submitted to a queue of their
+  // own.
+  bool is_async_compute_dedicated;
+  // Number of command buffers submitted to all queues, to the transfer queue
+  // and to the async compute queue.
+  uint64_t nsubmit;
+  uint64_t ntransfer_submit;
+  uint64_t nasync_submit;
+  // Bytes written by transfers submitted to the transfer queue, and the rate
+  // in bytes per second since the last query. Submissions of a transaction are
+  // chained one after another, so transfers only overlap with the work of
+  // other transactions.
+  size_t transfer_size;
+  double transfer_rate;
+  // Number of resource ownership transfers between queue families.
+  uint64_t nownership_transfer;
+  // Number of command pools, command buffers, fences and binary semaphores
+  // created for submissions. Recycled objects are not counted so the numbers
+  // stop growing in steady state.
+  uint64_t ncmd_pool_create;
+  uint64_t ncmdbuf_alloc;
+  uint64_t nfence_create;
+  uint64_t nsema_create;
+};
+struct ContextBarrierStatistics {
+  // Number of `vkCmdPipelineBarrier` calls and the memory barriers batched in
+  // them.
+  uint64_t nbarrier_call;
+  uint64_t nbarrier;
+  // Number of resource transitions dropped because there is no hazard to
+  // resolve, e.g. reads after reads.
+  uint64_t nbarrier_elide;
+};
+struct ContextCacheStatistics {
+  // Lookups of cached objects that were reused (hits) and that had to create
+  // new objects (misses).
+  uint64_t ndesc_set_hit;
+  uint64_t ndesc_set_miss;
+  uint64_t ndesc_set_layout_hit;
+  uint64_t ndesc_set_layout_miss;
+  uint64_t nframebuf_hit;
+  uint64_t nframebuf_miss;
+};
+struct ContextRecordStatistics {
+  // Number of primary and secondary command buffers recorded, including those
+  // recorded for baking.
+  uint64_t ncmdbuf_record;
+  // Number of pipelines bound in recorded command buffers.
+  uint64_t npipe_bind;
+  // Number of descriptors written, bindless descriptors included.
+  uint64_t ndesc_write;
+};
+struct ContextResourceStatistics {
+  // Number of buffers, images and depth images created, including those in
+  // aliased memory.
+  uint64_t nbuf_create;
+  uint64_t nimg_create;
+  uint64_t ndepth_img_create;
+  // Number of buffer mappings.
+  uint64_t nmap;
+  // Bytes of host data written by submitted upload and update invocations.
+  // Invocations submitted more than once are counted each time.
+  uint64_t upload_size;
 };
 
 L_IMPL_STRUCT struct Context;
 struct Context_ {
   virtual ~Context_() {}
+
+  // Query memory usage and budgets of the context.
+  virtual ContextMemoryStatistics get_mem_stats() const = 0;
+  // Incrementally compact device memory by relocating buffers and images not
+  // referenced by any invocation. Each call returns after `budget_us`
+  // microseconds, so it can be called once per frame until `is_done`. The
+  // copies are ordered after all work submitted earlier; copies overrunning
+  // the budget are picked up by the next call.
+  virtual DefragmentationStatistics defrag(double budget_us) = 0;
+  // Query queue usage of the context.
+  virtual ContextQueueStatistics get_queue_stats() const = 0;
+  // Query pipeline barriers recorded by the context.
+  virtual ContextBarrierStatistics get_barrier_stats() const = 0;
+  // Query lookups of cached descriptor sets and framebuffers.
+  virtual ContextCacheStatistics get_cache_stats() const = 0;
+  // Query command recording done by the context.
+  virtual ContextRecordStatistics get_record_stats() const = 0;
+  // Query resources created and host data uploaded by the context.
+  virtual ContextResourceStatistics get_rsc_stats() const = 0;
+  // Zero the counters of all the statistics above except memory usage, e.g.
+  // at the beginning of a frame to get per-frame counts.
+  virtual void reset_stats() = 0;
 };
 
 
@@ -109,6 +312,8 @@ enum BufferUsageBits {
   L_BUFFER_USAGE_STORAGE_BIT = (1 << 3),
   L_BUFFER_USAGE_VERTEX_BIT = (1 << 4),
   L_BUFFER_USAGE_INDEX_BIT = (1 << 5),
+  L_BUFFER_USAGE_DEVICE_ADDRESS_BIT = (1 << 6),
+  L_BUFFER_USAGE_INDIRECT_BIT = (1 << 7),
 };
 typedef uint32_t BufferUsage;
 // Describes a buffer.
@@ -124,6 +329,13 @@ struct BufferConfig {
   size_t align;
   // Usage of the buffer.
   BufferUsage usage;
+  // Host memory imported as the backing memory of the buffer, or `nullptr` if
+  // memory should be allocated. The memory MUST outlive the buffer and any
+  // invocation referencing it until the invocation completes, and MUST be
+  // accessible up to `size` rounded up to the import alignment (see
+  // `util::alloc_aligned`). If import is unsupported, the content is copied to
+  // a host-visible buffer instead. Access the content by mapping the buffer.
+  void* host_ptr;
 };
 L_IMPL_STRUCT struct Buffer;
 struct BufferView {
@@ -140,6 +352,15 @@ struct Buffer_ {
   virtual void unmap(void* mapped) = 0;
 
   virtual BufferView view(size_t offset, size_t size) const = 0;
+
+  // Index of the entire buffer in the global bindless storage buffer array.
+  // The buffer is registered on the first call and the index is stable until
+  // the buffer is destroyed. The buffer MUST have storage usage.
+  virtual uint32_t get_bindless_idx() const = 0;
+  // 64-bit device address of the buffer base for pointer access in kernels.
+  // The address is stable until the buffer is destroyed. The buffer MUST have
+  // device address usage.
+  virtual uint64_t get_dev_addr() const = 0;
 };
 
 
@@ -205,6 +426,13 @@ struct Image_ {
     uint32_t depth,
     ImageSampler sampler
   ) const = 0;
+
+  // Indices of the entire image in the global bindless sampled image and
+  // storage image arrays. The image is registered on the first call and the
+  // index is stable until the image is destroyed. Sampled images are bound
+  // with `L_IMAGE_SAMPLER_LINEAR`.
+  virtual uint32_t get_bindless_sampled_idx() const = 0;
+  virtual uint32_t get_bindless_storage_idx() const = 0;
 };
 
 
@@ -308,6 +536,12 @@ struct ComputeTaskConfig {
   std::vector<ResourceType> rsc_tys;
   // Local group size; number of threads in a workgroup.
   DispatchSize workgrp_size;
+  // Set `true` if the task indexes resources in the global bindless arrays at
+  // descriptor set 1.
+  bool is_bindless;
+  // Size of push constants in bytes, at most 128 bytes. Zero if the task has
+  // no push constant.
+  uint32_t push_const_size;
 };
 
 enum AttachmentType {
@@ -394,6 +628,12 @@ struct GraphicsTaskConfig {
   Topology topo;
   // Resources to be allocated.
   std::vector<ResourceType> rsc_tys;
+  // Set `true` if the task indexes resources in the global bindless arrays at
+  // descriptor set 1.
+  bool is_bindless;
+  // Size of push constants in bytes, at most 128 bytes. Zero if the task has
+  // no push constant.
+  uint32_t push_const_size;
 };
 
 L_IMPL_STRUCT struct Task;
@@ -432,12 +672,74 @@ inline ResourceView make_rsc_view(const DepthImageView& depth_img_view) {
   rsc_view.depth_img_view = depth_img_view;
   return rsc_view;
 }
+// An additional region of a transfer invocation. The views MUST be of the
+// same resources as the source and destination of the invocation.
+struct TransferRegionConfig {
+  ResourceView src_rsc_view;
+  ResourceView dst_rsc_view;
+};
 struct TransferInvocationConfig {
   std::string label;
   // Data transfer source.
   ResourceView src_rsc_view;
   // Data transfer destination.
   ResourceView dst_rsc_view;
+  // More regions copied in the same transfer command.
+  std::vector<TransferRegionConfig> regions;
+  // Layout of the buffer side of buffer-image transfers in texels. Zero row
+  // length means rows are tightly packed; zero image height means slices are
+  // as tall as the image.
+  uint32_t buf_row_len;
+  uint32_t buf_img_height;
+  // Set `true` to scale source image views to destination image views,
+  // filtered by the sampler of the source view. Blits are submitted to the
+  // graphics queue. Creation fails if the image formats don't support blits,
+  // or linear filtering when it's used.
+  bool is_blit;
+  // Set `true` if the device-side execution time is wanted.
+  bool is_timed;
+};
+// Fill a buffer view with a repeated 32-bit value without staging. The offset
+// and size of the view MUST be multiples of 4.
+struct FillInvocationConfig {
+  std::string label;
+  BufferView dst_buf_view;
+  uint32_t value;
+  // Set `true` if the device-side execution time is wanted.
+  bool is_timed;
+};
+// Write host data to a buffer view inline in the command buffer without
+// staging. The data is copied when the invocation is created. The offset and
+// size of the view MUST be multiples of 4, and the size MUST NOT exceed 65536
+// bytes.
+struct UpdateInvocationConfig {
+  std::string label;
+  BufferView dst_buf_view;
+  std::vector<uint8_t> data;
+  // Set `true` if the device-side execution time is wanted.
+  bool is_timed;
+};
+// A host-to-device write in an upload invocation.
+struct UploadWriteConfig {
+  // Destination of the write, a buffer or color image view. Destinations of
+  // writes in the same upload MUST NOT overlap.
+  ResourceView dst_rsc_view;
+  // Host data to be written. The data is packed into staging memory when the
+  // invocation is created so it only needs to live until then.
+  const void* data;
+  // Number of elements in `data`. Texels are elements of images.
+  size_t nelem;
+  // Size of each element in `data` in bytes.
+  size_t elem_size;
+  // Distance between elements in the destination in bytes. Zero is treated as
+  // `elem_size`. MUST be `elem_size` or zero for images.
+  size_t elem_stride;
+};
+// Batched host-to-device writes. All writes are packed into a few large staging
+// chunks and copied with multi-region copies in a single submission.
+struct UploadInvocationConfig {
+  std::string label;
+  std::vector<UploadWriteConfig> writes;
   // Set `true` if the device-side execution time is wanted.
   bool is_timed;
 };
@@ -446,10 +748,31 @@ struct ComputeInvocationConfig {
   std::string label;
   // Resources bound to this invocation.
   std::vector<ResourceView> rsc_views;
+  // Resources accessed through bindless indices or device addresses and how
+  // they are accessed. They are only transitioned, no descriptor is updated
+  // for them.
+  std::vector<ResourceView> bindless_rsc_views;
+  std::vector<ResourceType> bindless_rsc_tys;
+  // Push constant data, e.g. a table of buffer device addresses. The size MUST
+  // match the push constant size of the task.
+  std::vector<uint8_t> push_consts;
   // Number of workgroups dispatched in this invocation.
   DispatchSize workgrp_count;
+  // Buffer of a `VkDispatchIndirectCommand`, usually written by a previous
+  // invocation. If set, the workgroup count is read from this buffer on the
+  // device side and `workgrp_count` is ignored. The buffer MUST be created
+  // with `L_BUFFER_USAGE_INDIRECT_BIT`.
+  BufferView indirect_buf;
   // Set `true` if the device-side execution time is wanted.
   bool is_timed;
+  // Set `true` if the number of shader invocations is wanted.
+  bool is_pipe_stats_collected;
+  // Names of the device performance counters wanted. Counters unavailable on
+  // the device are ignored.
+  std::vector<std::string> perf_counter_names;
+  // Set `true` to submit the invocation to the async compute queue so that it
+  // overlaps with work on other queues. Depth images cannot be accessed.
+  bool is_async;
 };
 enum IndexType {
   L_INDEX_TYPE_UINT16,
@@ -460,6 +783,14 @@ struct GraphicsInvocationConfig {
   std::string label;
   // Resources bound to this invocation.
   std::vector<ResourceView> rsc_views;
+  // Resources accessed through bindless indices or device addresses and how
+  // they are accessed. They are only transitioned, no descriptor is updated
+  // for them.
+  std::vector<ResourceView> bindless_rsc_views;
+  std::vector<ResourceType> bindless_rsc_tys;
+  // Push constant data, e.g. a table of buffer device addresses. The size MUST
+  // match the push constant size of the task.
+  std::vector<uint8_t> push_consts;
   // Number of instances to be drawn.
   uint32_t ninst;
   // Vertex buffer for drawing.
@@ -474,8 +805,26 @@ struct GraphicsInvocationConfig {
   // Number of indices to be drawn in this draw. If `nvert` is non-zero, `nidx`
   // MUST be zero.
   uint32_t nidx;
+  // Buffer of tightly packed `VkDrawIndirectCommand`s, or
+  // `VkDrawIndexedIndirectCommand`s if `idx_buf` is set. If set, the draw
+  // parameters are read from this buffer on the device side and `ninst`,
+  // `nvert` and `nidx` are ignored. The buffer MUST be created with
+  // `L_BUFFER_USAGE_INDIRECT_BIT`.
+  BufferView indirect_buf;
+  // Number of draws in `indirect_buf`, or the maximal number of draws if
+  // `count_buf` is set. Zero is treated as one.
+  uint32_t ndraw;
+  // Buffer of a `uint32_t` draw count, optional. The number of draws is the
+  // minimum of the count and `ndraw`.
+  BufferView count_buf;
   // Set `true` if the device-side execution time is wanted.
   bool is_timed;
+  // Set `true` if the number of shader invocations and primitives processed
+  // at each stage is wanted.
+  bool is_pipe_stats_collected;
+  // Names of the device performance counters wanted. Counters unavailable on
+  // the device are ignored.
+  std::vector<std::string> perf_counter_names;
 };
 struct RenderPassInvocationConfig {
   std::string label;
@@ -491,20 +840,135 @@ struct CompositeInvocationConfig {
   // Compute or render pass invocations within this composite invocation. Note
   // that graphics invocations cannot be called outside of render passes.
   std::vector<const struct Invocation*> invokes; // Lifetime bound.
+  // Resources whose content is discarded at the beginning of the invocation,
+  // e.g. transient resources placed in memory shared with others. Their first
+  // use waits for all previous device work and images are transitioned from
+  // an undefined layout.
+  std::vector<ResourceView> discard_rsc_views;
   // Set `true` if the device-side execution time is wanted.
   bool is_timed;
+  // Set `true` to submit all subinvocations to the async compute queue. Only
+  // compute and transfer subinvocations are allowed.
+  bool is_async;
 };
 struct PresentInvocationConfig {
 };
+// Amount of work done by a compute or graphics invocation on the device side.
+// Counts of stages the invocation doesn't go through are zeros.
+struct InvocationPipelineStatistics {
+  uint64_t ninput_vert;
+  uint64_t ninput_prim;
+  uint64_t nvert_shader_invoke;
+  uint64_t ngeom_shader_invoke;
+  uint64_t ngeom_shader_prim;
+  // Primitives processed by the clipping stage, and those output by it.
+  uint64_t nclip_invoke;
+  uint64_t nclip_prim;
+  uint64_t nfrag_shader_invoke;
+  uint64_t ntess_ctrl_shader_patch;
+  uint64_t ntess_eval_shader_invoke;
+  uint64_t ncomp_shader_invoke;
+};
+struct InvocationPerformanceCounter {
+  std::string name;
+  std::string category;
+  // Unit of `value`, e.g. `cycles`, `bytes` or `percentage`.
+  std::string unit;
+  double value;
+};
 struct Invocation_ {
   // Get the execution time of the last WAITED invocation.
   virtual double get_time_us() const = 0;
+  // Get the time async compute subinvocations of the last WAITED composite
+  // invocation ran concurrently with other subinvocations. Only timed
+  // subinvocations are measured.
+  virtual double get_async_overlap_us() const = 0;
+  // Get the pipeline statistics of the last WAITED compute or graphics
+  // invocation. All zeros if the statistics are not collected or unsupported
+  // by the device.
+  virtual InvocationPipelineStatistics get_pipe_stats() const = 0;
+  // Get the performance counters of the last WAITED compute or graphics
+  // invocation. Empty if the device doesn't support performance queries, or
+  // if the invocation was baked with `bake` or recorded in parallel.
+  // Invocations collecting performance counters MUST NOT be submitted again
+  // before the previous submission is done.
+  virtual std::vector<InvocationPerformanceCounter> get_perf_counters() const = 0;
   // Pre-encode the invocation commands to reduce host-side overhead on constant
-  // device-side procedures.
+  // device-side procedures. Timed and queried invocations are not baked.
   virtual void bake() = 0;
+  // Pre-encode the entire invocation tree, render passes included, into
+  // primary command buffers submitted as they are, so that submitting the
+  // invocation again costs a single queue submission per queue. The commands
+  // are baked again when resources are not in the states they were baked
+  // with. Presentation, timed and queried invocations cannot be baked.
+  virtual void bake_primary() = 0;
+
+  // Replace the `i`-th resource of a compute or graphics invocation. The new
+  // view MUST be of the same view type as the old one. Resources are written
+  // to another descriptor set, so pending transactions keep using the old
+  // one. Baked invocations, and those containing them, are baked again when
+  // they are recorded next time.
+  virtual void rebind_rsc(uint32_t i, const ResourceView& rsc_view) = 0;
+  // Replace the workgroup count of a directly dispatched compute invocation.
+  virtual void rebind_workgrp_count(const DispatchSize& workgrp_count) = 0;
+  // Replace the push constants of a compute or graphics invocation. The size
+  // MUST match the push constant size of the task.
+  virtual void rebind_push_consts(const std::vector<uint8_t>& push_consts) = 0;
 };
 L_IMPL_STRUCT struct Invocation;
 
+
+
+struct ProfilerConfig {
+  std::string label;
+  // Number of frames whose timestamps are in flight. Results of a frame are
+  // read back when its query pool is reused this many frames later, so the
+  // host only waits if the device falls behind by more than that.
+  uint32_t nframe_in_flight;
+  // Maximal number of scopes timed in a frame. Invocation trees submitted
+  // after the limit is reached are not timed.
+  uint32_t max_nscope;
+};
+struct ProfilerScopeStatistics {
+  // Labels of the invocations from the outermost one to this scope, joined by
+  // `/`.
+  std::string path;
+  // Number of enclosing scopes.
+  uint32_t depth;
+  // Number of frames the scope was timed in, and its device-side execution
+  // time in microseconds.
+  uint64_t nsample;
+  double avg_time_us;
+  double min_time_us;
+  double max_time_us;
+};
+struct ProfilerStatistics {
+  // Number of frames whose results have been read back.
+  uint64_t nframe;
+  // Number of scopes not timed because frames ran out of queries.
+  uint64_t nscope_dropped;
+  // Scopes in the order they were first timed.
+  std::vector<ProfilerScopeStatistics> scopes;
+};
+L_IMPL_STRUCT struct Profiler;
+// Device-side timing of submitted invocation trees. Every invocation recorded
+// in a profiled transaction is a scope nested in the scope of its parent
+// invocation, and is timed with a pair of timestamps in a query pool shared
+// by the entire frame. Baked invocations and presentation are not timed.
+struct Profiler_ {
+  virtual ~Profiler_() {}
+
+  virtual const ProfilerConfig& cfg() const = 0;
+
+  // End the current frame and begin the next one. The results of the frame
+  // `nframe_in_flight` frames ago are aggregated into the statistics.
+  virtual void next_frame() = 0;
+  // Get the statistics aggregated so far.
+  virtual ProfilerStatistics get_stats() const = 0;
+  // Clear the statistics aggregated so far.
+  virtual void reset_stats() = 0;
+};
+
 } // namespace HAL_IMPL_NAMESPACE
 
 } // namespace liong
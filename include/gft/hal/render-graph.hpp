@@ -0,0 +1,247 @@
+// # Render graph over the scoped HAL
+// @PENGUINLIONG
+//
+// Passes declare the resources they read and write, and the graph derives
+// their execution order from the declarations. Passes that contribute nothing
+// to imported resources are culled. Transient resources are created by the
+// graph and placed in shared memory when their lifetimes don't overlap.
+#pragma once
+#include <functional>
+#include <set>
+#include "gft/hal/scoped-hal.hpp"
+
+#ifndef HAL_IMPL_NAMESPACE
+static_assert(false, "please specify the implementation namespace (e.g. `vk`)");
+#endif
+
+namespace liong {
+namespace HAL_IMPL_NAMESPACE {
+namespace scoped {
+
+struct RenderGraph;
+
+// Index of a resource declared in a render graph.
+typedef uint32_t RenderGraphResource;
+
+struct RenderGraphResourceConfig {
+  ResourceViewType rsc_view_ty;
+  // `true` if the resource is created by the graph. Transient resources only
+  // live through the passes using them. Their content is undefined before the
+  // first pass writing them, and is lost after the graph executes.
+  bool is_transient;
+  // Configuration of a transient buffer or image. Transient buffers MUST NOT
+  // be host-accessible. Transient depth images are not supported.
+  BufferConfig buf_cfg;
+  ImageConfig img_cfg;
+  // Externally created resources. Imported resources are the outputs of the
+  // graph, so passes writing them are never culled.
+  const HAL_IMPL_NAMESPACE::Buffer* buf; // Lifetime bound.
+  const HAL_IMPL_NAMESPACE::Image* img; // Lifetime bound.
+  const HAL_IMPL_NAMESPACE::DepthImage* depth_img; // Lifetime bound.
+};
+struct RenderGraphPassConfig {
+  std::string label;
+  // Resources accessed by the pass. A resource both read and written by the
+  // pass should be in both lists.
+  std::vector<RenderGraphResource> reads;
+  std::vector<RenderGraphResource> writes;
+  // Set `true` if the pass has side effects not declared in `writes`, e.g.
+  // writes through bindless indices or device addresses. Kept passes are never
+  // culled and are executed in the order they are declared.
+  bool is_kept;
+  // Build the invocation of the pass with resources got from `graph`. It's
+  // called in execution order when the graph is built, and the returned
+  // invocation SHOULD be built with the same `gc` as the graph.
+  std::function<Invocation(const RenderGraph& graph)> build_invoke;
+};
+struct RenderGraphConfig {
+  std::string label;
+  std::vector<RenderGraphResourceConfig> rscs;
+  std::vector<RenderGraphPassConfig> passes;
+  // Set `true` if the device-side execution time is wanted.
+  bool is_timed;
+};
+
+struct RenderGraphStatistics {
+  // Number of executed and culled passes.
+  uint32_t npass;
+  uint32_t npass_culled;
+  // Number of transient resources created.
+  uint32_t ntransient;
+  // Bytes of memory required by transient resources if they were allocated
+  // separately, and bytes of memory actually allocated for them.
+  size_t transient_size;
+  size_t aliased_size;
+};
+
+struct RenderGraph {
+  scoped::Context ctxt;
+  RenderGraphConfig cfg;
+  // Indices of the executed passes in execution order.
+  std::vector<uint32_t> ipasses;
+  // Realized resources indexed by `RenderGraphResource`. Only the entry of the
+  // matching type is valid; unused transient resources are never created.
+  std::vector<scoped::Buffer> bufs;
+  std::vector<scoped::Image> imgs;
+  std::vector<scoped::DepthImage> depth_imgs;
+  // Invocations of the executed passes, and the composite invocation running
+  // all of them in execution order.
+  std::vector<scoped::Invocation> pass_invokes;
+  scoped::Invocation invoke;
+  RenderGraphStatistics stats;
+
+  RenderGraph(const scoped::Context& ctxt, RenderGraphConfig&& cfg, bool gc);
+
+  const scoped::Buffer& buf(RenderGraphResource rsc) const;
+  const scoped::Image& img(RenderGraphResource rsc) const;
+  const scoped::DepthImage& depth_img(RenderGraphResource rsc) const;
+
+  inline const scoped::Invocation& get_invoke() const {
+    return invoke;
+  }
+  inline const RenderGraphStatistics& get_stats() const {
+    return stats;
+  }
+
+  Transaction submit(bool gc = true);
+};
+struct RenderGraphBuilder {
+  using Self = RenderGraphBuilder;
+
+  const Context& parent;
+  RenderGraphConfig inner;
+
+  inline RenderGraphBuilder(
+    const Context& ctxt,
+    const std::string& label = ""
+  ) : parent(ctxt), inner() {
+    inner.label = label;
+  }
+
+  inline RenderGraphResource import_buf(const Buffer& buf) {
+    RenderGraphResourceConfig rsc {};
+    rsc.rsc_view_ty = L_RESOURCE_VIEW_TYPE_BUFFER;
+    rsc.buf = &(const HAL_IMPL_NAMESPACE::Buffer&)buf;
+    inner.rscs.emplace_back(std::move(rsc));
+    return (RenderGraphResource)(inner.rscs.size() - 1);
+  }
+  inline RenderGraphResource import_img(const Image& img) {
+    RenderGraphResourceConfig rsc {};
+    rsc.rsc_view_ty = L_RESOURCE_VIEW_TYPE_IMAGE;
+    rsc.img = &(const HAL_IMPL_NAMESPACE::Image&)img;
+    inner.rscs.emplace_back(std::move(rsc));
+    return (RenderGraphResource)(inner.rscs.size() - 1);
+  }
+  inline RenderGraphResource import_depth_img(const DepthImage& depth_img) {
+    RenderGraphResourceConfig rsc {};
+    rsc.rsc_view_ty = L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE;
+    rsc.depth_img = &(const HAL_IMPL_NAMESPACE::DepthImage&)depth_img;
+    inner.rscs.emplace_back(std::move(rsc));
+    return (RenderGraphResource)(inner.rscs.size() - 1);
+  }
+  inline RenderGraphResource create_buf(const BufferConfig& buf_cfg) {
+    RenderGraphResourceConfig rsc {};
+    rsc.rsc_view_ty = L_RESOURCE_VIEW_TYPE_BUFFER;
+    rsc.is_transient = true;
+    rsc.buf_cfg = buf_cfg;
+    inner.rscs.emplace_back(std::move(rsc));
+    return (RenderGraphResource)(inner.rscs.size() - 1);
+  }
+  inline RenderGraphResource create_img(const ImageConfig& img_cfg) {
+    RenderGraphResourceConfig rsc {};
+    rsc.rsc_view_ty = L_RESOURCE_VIEW_TYPE_IMAGE;
+    rsc.is_transient = true;
+    rsc.img_cfg = img_cfg;
+    inner.rscs.emplace_back(std::move(rsc));
+    return (RenderGraphResource)(inner.rscs.size() - 1);
+  }
+
+  // Declare a new pass. The following calls to `read`, `write`, `keep` and
+  // `build_invoke` apply to this pass.
+  inline Self& pass(const std::string& label = "") {
+    RenderGraphPassConfig pass {};
+    pass.label = label;
+    inner.passes.emplace_back(std::move(pass));
+    return *this;
+  }
+  inline Self& read(RenderGraphResource rsc) {
+    L_ASSERT(!inner.passes.empty(), "no pass is declared");
+    inner.passes.back().reads.emplace_back(rsc);
+    return *this;
+  }
+  inline Self& write(RenderGraphResource rsc) {
+    L_ASSERT(!inner.passes.empty(), "no pass is declared");
+    inner.passes.back().writes.emplace_back(rsc);
+    return *this;
+  }
+  inline Self& keep(bool is_kept = true) {
+    L_ASSERT(!inner.passes.empty(), "no pass is declared");
+    inner.passes.back().is_kept = is_kept;
+    return *this;
+  }
+  inline Self& build_invoke(
+    std::function<Invocation(const RenderGraph& graph)>&& build_invoke
+  ) {
+    L_ASSERT(!inner.passes.empty(), "no pass is declared");
+    inner.passes.back().build_invoke = std::move(build_invoke);
+    return *this;
+  }
+  inline Self& is_timed(bool is_timed = true) {
+    inner.is_timed = is_timed;
+    return *this;
+  }
+
+  RenderGraph build(bool gc = true);
+};
+
+namespace detail {
+
+// Steps of building a render graph that only depend on the declarations.
+// They are exposed so they can be tested without a device.
+
+// Lifetime and placement of a transient resource used by executed passes.
+struct RenderGraphTransientDetail {
+  RenderGraphResource rsc;
+  // Positions of the first and the last passes using the resource in execution
+  // order.
+  uint32_t first_pos;
+  uint32_t last_pos;
+  // Memory requirements of the resource.
+  size_t size;
+  size_t align;
+  uint32_t mem_ty_bits;
+  // Aliased memory the resource is placed in, and the offset in it.
+  uint32_t iheap;
+  size_t offset;
+};
+struct RenderGraphHeapDetail {
+  // Memory types compatible with all resources placed in the heap.
+  uint32_t mem_ty_bits;
+  size_t size;
+  size_t align;
+  std::vector<uint32_t> itransients;
+};
+
+void collect_pass_deps(
+  const RenderGraphConfig& cfg,
+  std::vector<std::set<uint32_t>>& deps,
+  std::vector<std::set<uint32_t>>& producers);
+std::vector<bool> cull_passes(
+  const RenderGraphConfig& cfg,
+  const std::vector<std::set<uint32_t>>& producers);
+std::vector<uint32_t> schedule_passes(
+  const std::vector<bool>& is_alive,
+  const std::vector<std::set<uint32_t>>& deps,
+  const std::vector<std::set<uint32_t>>& producers);
+std::vector<RenderGraphTransientDetail> collect_transients(
+  const RenderGraphConfig& cfg,
+  const std::vector<uint32_t>& ipasses);
+std::vector<RenderGraphHeapDetail> place_transients(
+  std::vector<RenderGraphTransientDetail>& transients,
+  size_t granularity);
+
+} // namespace detail
+
+} // namespace scoped
+} // namespace HAL_IMPL_NAMESPACE
+} // namespace liong
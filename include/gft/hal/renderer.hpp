@@ -13,6 +13,7 @@ namespace HAL_IMPL_NAMESPACE {
 namespace scoped {
 
 struct MeshGpu {
+  scoped::Context ctxt;
   const uint32_t nvert;
   scoped::Buffer poses;
   scoped::Buffer uvs;
@@ -22,6 +23,8 @@ struct MeshGpu {
   MeshGpu(const scoped::Context& ctxt, const mesh::Mesh& mesh, bool gc = true);
 
   void write(const mesh::Mesh& mesh);
+  // Batch the writes in `uib`. `mesh` MUST live until `uib` is built.
+  void write(scoped::UploadInvocationBuilder& uib, const mesh::Mesh& mesh);
 };
 struct IndexedMeshGpu {
   MeshGpu mesh;
@@ -32,6 +35,7 @@ struct IndexedMeshGpu {
   IndexedMeshGpu(const scoped::Context& ctxt, const mesh::IndexedMesh& idxmesh, bool gc = true);
 
   void write(const mesh::IndexedMesh& idxmesh);
+  void write(scoped::UploadInvocationBuilder& uib, const mesh::IndexedMesh& idxmesh);
 };
 struct SkinnedMeshGpu {
   scoped::Context ctxt;
@@ -51,6 +55,7 @@ struct SkinnedMeshGpu {
   SkinnedMeshGpu(const scoped::Context& ctxt, const mesh::SkinnedMesh& skinmesh, bool gc = true);
 
   void write(const mesh::SkinnedMesh& skinmesh);
+  void write(scoped::UploadInvocationBuilder& uib, const mesh::SkinnedMesh& skinmesh);
 
   scoped::Invocation animate(const std::string& anim_name, float tick);
   scoped::Invocation animate(float tick);
@@ -58,13 +63,13 @@ struct SkinnedMeshGpu {
 
 struct TextureGpu {
   scoped::Context ctxt;
-  scoped::Buffer stage_buf;
   scoped::Image tex;
 
   TextureGpu(const scoped::Context& ctxt, uint32_t width, uint32_t height, bool streaming = true, bool gc = true);
   TextureGpu(const scoped::Context& ctxt, uint32_t width, uint32_t height, const std::vector<uint32_t>& pxs, bool gc = true);
 
   void write(const std::vector<uint32_t>& pxs);
+  void write(scoped::UploadInvocationBuilder& uib, const std::vector<uint32_t>& pxs);
 };
 
 struct RendererInvocationDetail {
@@ -27,6 +27,7 @@ enum ObjectType {
   L_OBJECT_TYPE_TASK,
   L_OBJECT_TYPE_INVOCATION,
   L_OBJECT_TYPE_TRANSACTION,
+  L_OBJECT_TYPE_PROFILER,
 };
 void _destroy_obj(ObjectType obj_ty, void* obj) {
   switch (obj_ty) {
@@ -45,6 +46,7 @@ void _destroy_obj(ObjectType obj_ty, void* obj) {
   L_CASE_DESTROY_OBJ(L_OBJECT_TYPE_TASK, Task);
   L_CASE_DESTROY_OBJ(L_OBJECT_TYPE_INVOCATION, Invocation);
   L_CASE_DESTROY_OBJ(L_OBJECT_TYPE_TRANSACTION, Transaction);
+  L_CASE_DESTROY_OBJ(L_OBJECT_TYPE_PROFILER, Profiler);
 
 #undef L_CASE_DESTROY_OBJ
 
@@ -62,6 +64,7 @@ const char* _obj_ty2str(ObjectType obj_ty) {
   case L_OBJECT_TYPE_TASK: return "task";
   case L_OBJECT_TYPE_INVOCATION: return "invocation";
   case L_OBJECT_TYPE_TRANSACTION: return "transaction";
+  case L_OBJECT_TYPE_PROFILER: return "profiler";
   default: unreachable();
   }
 }
@@ -161,6 +164,7 @@ L_DEF_REG_GC(RenderPass, L_OBJECT_TYPE_RENDER_PASS);
 L_DEF_REG_GC(Task, L_OBJECT_TYPE_TASK);
 L_DEF_REG_GC(Invocation, L_OBJECT_TYPE_INVOCATION);
 L_DEF_REG_GC(Transaction, L_OBJECT_TYPE_TRANSACTION);
+L_DEF_REG_GC(Profiler, L_OBJECT_TYPE_PROFILER);
 
 #undef L_DEF_REG_GC
 
@@ -353,6 +357,15 @@ L_DEF_CTOR_DTOR(Invocation);
 Invocation TransferInvocationBuilder::build(bool gc) {
   return L_BUILD_WITH_CFG(Invocation);
 }
+Invocation FillInvocationBuilder::build(bool gc) {
+  return L_BUILD_WITH_CFG(Invocation);
+}
+Invocation UpdateInvocationBuilder::build(bool gc) {
+  return L_BUILD_WITH_CFG(Invocation);
+}
+Invocation UploadInvocationBuilder::build(bool gc) {
+  return L_BUILD_WITH_CFG(Invocation);
+}
 Invocation ComputeInvocationBuilder::build(bool gc) {
   return L_BUILD_WITH_CFG(Invocation);
 }
@@ -372,9 +385,35 @@ Invocation PresentInvocationBuilder::build(bool gc) {
 double Invocation::get_time_us() const {
   return inner->get_time_us();
 }
+double Invocation::get_async_overlap_us() const {
+  return inner->get_async_overlap_us();
+}
+InvocationPipelineStatistics Invocation::get_pipe_stats() const {
+  return inner->get_pipe_stats();
+}
+std::vector<InvocationPerformanceCounter> Invocation::get_perf_counters() const {
+  return inner->get_perf_counters();
+}
 void Invocation::bake() {
   inner->bake();
 }
+void Invocation::bake_primary() {
+  inner->bake_primary();
+}
+void Invocation::rebind_rsc(uint32_t i, const ResourceView& rsc_view) {
+  inner->rebind_rsc(i, rsc_view);
+}
+void Invocation::rebind_workgrp_count(uint32_t x, uint32_t y, uint32_t z) {
+  DispatchSize workgrp_count {};
+  workgrp_count.x = x;
+  workgrp_count.y = y;
+  workgrp_count.z = z;
+  inner->rebind_workgrp_count(workgrp_count);
+}
+void Invocation::rebind_push_const(const void* data, size_t size) {
+  const uint8_t* beg = (const uint8_t*)data;
+  inner->rebind_push_consts(std::vector<uint8_t>(beg, beg + size));
+}
 Transaction Invocation::submit(bool gc) {
   return InvocationSubmitTransactionBuilder(*this).build(gc);
 }
@@ -382,6 +421,12 @@ Transaction Invocation::submit(bool gc) {
 
 
 L_DEF_CTOR_DTOR(Transaction);
+InvocationSubmitTransactionBuilder& InvocationSubmitTransactionBuilder::profile(
+  Profiler& profiler
+) {
+  inner.profiler = profiler.inner;
+  return *this;
+}
 Transaction InvocationSubmitTransactionBuilder::build(bool gc) {
   return L_BUILD_WITH_CFG(Transaction);
 }
@@ -392,6 +437,51 @@ bool Transaction::is_done() const {
 void Transaction::wait() {
   inner->wait();
 }
+bool Transaction::wait_for(double timeout_us) const {
+  return inner->wait_for(timeout_us);
+}
+void Transaction::on_done(std::function<void()>&& callback) const {
+  inner->on_done(std::move(callback));
+}
+std::future<void> Transaction::get_future() const {
+  auto promise = std::make_shared<std::promise<void>>();
+  std::future<void> out = promise->get_future();
+  inner->on_done([promise]() { promise->set_value(); });
+  return out;
+}
+
+std::vector<const HAL_IMPL_NAMESPACE::Transaction*> _get_inner_transacts(
+  const std::vector<const Transaction*>& transacts
+) {
+  std::vector<const HAL_IMPL_NAMESPACE::Transaction*> out;
+  out.reserve(transacts.size());
+  for (const Transaction* transact : transacts) {
+    out.emplace_back(&(const HAL_IMPL_NAMESPACE::Transaction&)*transact);
+  }
+  return out;
+}
+size_t wait_any(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us
+) {
+  return HAL_IMPL_NAMESPACE::wait_any(_get_inner_transacts(transacts),
+    timeout_us);
+}
+bool wait_all(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us
+) {
+  return HAL_IMPL_NAMESPACE::wait_all(_get_inner_transacts(transacts),
+    timeout_us);
+}
+
+
+
+
+L_DEF_CTOR_DTOR(Profiler);
+Profiler ProfilerBuilder::build(bool gc) {
+  return L_BUILD_WITH_CFG(Profiler);
+}
 
 
 
@@ -1,4 +1,5 @@
 #pragma once
+#include <future>
 #include "gft/hal/hal.hpp"
 
 #ifndef HAL_IMPL_NAMESPACE
@@ -20,6 +21,7 @@ struct Task;
 struct RenderPass;
 struct Invocation;
 struct Transaction;
+struct Profiler;
 
 
 // Enter a scope of garbage collection so the resources created after this call
@@ -90,7 +92,18 @@ struct Transaction {
 
   bool is_done() const;
   void wait();
+  bool wait_for(double timeout_us) const;
+  void on_done(std::function<void()>&& callback) const;
+  // Get a future satisfied on the reaper thread when the transaction is
+  // finished.
+  std::future<void> get_future() const;
 };
+size_t wait_any(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us = std::numeric_limits<double>::infinity());
+bool wait_all(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us = std::numeric_limits<double>::infinity());
 struct InvocationSubmitTransactionBuilder {
   using Self = InvocationSubmitTransactionBuilder;
 
@@ -104,6 +117,16 @@ struct InvocationSubmitTransactionBuilder {
     inner.label = label;
   }
 
+  inline Self& is_parallel(bool is_parallel = true) {
+    inner.is_parallel = is_parallel;
+    return *this;
+  }
+  inline Self& capture(const std::string& path) {
+    inner.capture_path = path;
+    return *this;
+  }
+  Self& profile(Profiler& profiler);
+
   Transaction build(bool gc = true);
 };
 
@@ -113,7 +136,31 @@ struct Invocation {
   L_DECLR_SCOPED_OBJ(Invocation);
 
   double get_time_us() const;
+  double get_async_overlap_us() const;
+  InvocationPipelineStatistics get_pipe_stats() const;
+  std::vector<InvocationPerformanceCounter> get_perf_counters() const;
   void bake();
+  void bake_primary();
+
+  // Reuse the invocation with different resources, workgroup count or push
+  // constants.
+  void rebind_rsc(uint32_t i, const ResourceView& rsc_view);
+  void rebind_workgrp_count(uint32_t x, uint32_t y, uint32_t z);
+  void rebind_push_const(const void* data, size_t size);
+
+  inline void rebind_rsc(uint32_t i, const BufferView& buf_view) {
+    rebind_rsc(i, make_rsc_view(buf_view));
+  }
+  inline void rebind_rsc(uint32_t i, const ImageView& img_view) {
+    rebind_rsc(i, make_rsc_view(img_view));
+  }
+  inline void rebind_rsc(uint32_t i, const DepthImageView& depth_img_view) {
+    rebind_rsc(i, make_rsc_view(depth_img_view));
+  }
+  template<typename T>
+  inline void rebind_push_const(const T& data) {
+    rebind_push_const(&data, sizeof(T));
+  }
 
   Transaction submit(bool gc = true);
 };
@@ -162,6 +209,161 @@ struct TransferInvocationBuilder {
     return dst(make_rsc_view(depth_img_view));
   }
 
+  // Copy another region between the same resources in the same command.
+  inline Self& region(const ResourceView& src, const ResourceView& dst) {
+    TransferRegionConfig region {};
+    region.src_rsc_view = src;
+    region.dst_rsc_view = dst;
+    inner.regions.emplace_back(std::move(region));
+    return *this;
+  }
+  inline Self& region(const BufferView& src, const BufferView& dst) {
+    return region(make_rsc_view(src), make_rsc_view(dst));
+  }
+  inline Self& region(const BufferView& src, const ImageView& dst) {
+    return region(make_rsc_view(src), make_rsc_view(dst));
+  }
+  inline Self& region(const ImageView& src, const BufferView& dst) {
+    return region(make_rsc_view(src), make_rsc_view(dst));
+  }
+  inline Self& region(const ImageView& src, const ImageView& dst) {
+    return region(make_rsc_view(src), make_rsc_view(dst));
+  }
+  inline Self& buf_row_len(uint32_t buf_row_len) {
+    inner.buf_row_len = buf_row_len;
+    return *this;
+  }
+  inline Self& buf_img_height(uint32_t buf_img_height) {
+    inner.buf_img_height = buf_img_height;
+    return *this;
+  }
+  inline Self& is_blit(bool is_blit = true) {
+    inner.is_blit = is_blit;
+    return *this;
+  }
+
+  Invocation build(bool gc = true);
+};
+struct FillInvocationBuilder {
+  using Self = FillInvocationBuilder;
+
+  const Context& parent;
+  FillInvocationConfig inner;
+
+  inline FillInvocationBuilder(
+    const Context& ctxt,
+    const std::string& label = ""
+  ) : parent(ctxt), inner() {
+    inner.label = label;
+  }
+
+  inline Self& dst(const BufferView& buf_view) {
+    inner.dst_buf_view = buf_view;
+    return *this;
+  }
+  inline Self& value(uint32_t value) {
+    inner.value = value;
+    return *this;
+  }
+  inline Self& is_timed(bool is_timed = true) {
+    inner.is_timed = is_timed;
+    return *this;
+  }
+
+  Invocation build(bool gc = true);
+};
+struct UpdateInvocationBuilder {
+  using Self = UpdateInvocationBuilder;
+
+  const Context& parent;
+  UpdateInvocationConfig inner;
+
+  inline UpdateInvocationBuilder(
+    const Context& ctxt,
+    const std::string& label = ""
+  ) : parent(ctxt), inner() {
+    inner.label = label;
+  }
+
+  inline Self& dst(const BufferView& buf_view) {
+    inner.dst_buf_view = buf_view;
+    return *this;
+  }
+  inline Self& data(const void* data, size_t size) {
+    inner.data.assign((const uint8_t*)data, (const uint8_t*)data + size);
+    return *this;
+  }
+  template<typename T>
+  inline Self& data(const std::vector<T>& data) {
+    return this->data(data.data(), data.size() * sizeof(T));
+  }
+  inline Self& is_timed(bool is_timed = true) {
+    inner.is_timed = is_timed;
+    return *this;
+  }
+
+  Invocation build(bool gc = true);
+};
+struct UploadInvocationBuilder {
+  using Self = UploadInvocationBuilder;
+
+  const Context& parent;
+  UploadInvocationConfig inner;
+
+  inline UploadInvocationBuilder(
+    const Context& ctxt,
+    const std::string& label = ""
+  ) : parent(ctxt), inner() {
+    inner.label = label;
+  }
+
+  inline Self& write(const UploadWriteConfig& write) {
+    inner.writes.emplace_back(write);
+    return *this;
+  }
+  inline Self& is_timed(bool is_timed = true) {
+    inner.is_timed = is_timed;
+    return *this;
+  }
+
+  // Data MUST live until the invocation is built.
+  inline Self& write(
+    const ResourceView& rsc_view,
+    const void* data,
+    size_t nelem,
+    size_t elem_size,
+    size_t elem_stride = 0
+  ) {
+    UploadWriteConfig write_cfg {};
+    write_cfg.dst_rsc_view = rsc_view;
+    write_cfg.data = data;
+    write_cfg.nelem = nelem;
+    write_cfg.elem_size = elem_size;
+    write_cfg.elem_stride = elem_stride;
+    return write(write_cfg);
+  }
+  template<typename T>
+  inline Self& write(const BufferView& buf_view, const std::vector<T>& data) {
+    return write(make_rsc_view(buf_view), data.data(), data.size(), sizeof(T));
+  }
+  template<typename T>
+  inline Self& write_aligned(
+    const BufferView& buf_view,
+    const std::vector<T>& data,
+    size_t align
+  ) {
+    return write(make_rsc_view(buf_view), data.data(), data.size(), sizeof(T),
+      align);
+  }
+  template<typename T>
+  inline Self& write(const ImageView& img_view, const std::vector<T>& data) {
+    return write(make_rsc_view(img_view), data.data(), data.size(), sizeof(T));
+  }
+
+  inline bool empty() const {
+    return inner.writes.empty();
+  }
+
   Invocation build(bool gc = true);
 };
 struct ComputeInvocationBuilder {
@@ -190,10 +392,40 @@ struct ComputeInvocationBuilder {
     inner.workgrp_count.z = z;
     return *this;
   }
+  inline Self& indirect_buf(const BufferView& indirect_buf) {
+    inner.indirect_buf = indirect_buf;
+    return *this;
+  }
   inline Self& is_timed(bool is_timed = true) {
     inner.is_timed = is_timed;
     return *this;
   }
+  inline Self& is_async(bool is_async = true) {
+    inner.is_async = is_async;
+    return *this;
+  }
+  inline Self& is_pipe_stats_collected(bool is_pipe_stats_collected = true) {
+    inner.is_pipe_stats_collected = is_pipe_stats_collected;
+    return *this;
+  }
+  inline Self& perf_counter(const std::string& name) {
+    inner.perf_counter_names.emplace_back(name);
+    return *this;
+  }
+  inline Self& bindless_rsc(const ResourceView& rsc_view, ResourceType rsc_ty) {
+    inner.bindless_rsc_views.emplace_back(rsc_view);
+    inner.bindless_rsc_tys.emplace_back(rsc_ty);
+    return *this;
+  }
+  inline Self& push_const(const void* data, size_t size) {
+    const uint8_t* beg = (const uint8_t*)data;
+    inner.push_consts.assign(beg, beg + size);
+    return *this;
+  }
+  template<typename T>
+  inline Self& push_const(const T& data) {
+    return push_const(&data, sizeof(T));
+  }
 
   inline Self& rsc(const BufferView& buf_view) {
     return rsc(make_rsc_view(buf_view));
@@ -245,10 +477,41 @@ struct GraphicsInvocationBuilder {
     inner.nidx = nidx;
     return *this;
   }
+  inline Self& indirect_buf(const BufferView& indirect_buf, uint32_t ndraw = 1) {
+    inner.indirect_buf = indirect_buf;
+    inner.ndraw = ndraw;
+    return *this;
+  }
+  inline Self& count_buf(const BufferView& count_buf) {
+    inner.count_buf = count_buf;
+    return *this;
+  }
   inline Self& is_timed(bool is_timed = true) {
     inner.is_timed = is_timed;
     return *this;
   }
+  inline Self& is_pipe_stats_collected(bool is_pipe_stats_collected = true) {
+    inner.is_pipe_stats_collected = is_pipe_stats_collected;
+    return *this;
+  }
+  inline Self& perf_counter(const std::string& name) {
+    inner.perf_counter_names.emplace_back(name);
+    return *this;
+  }
+  inline Self& bindless_rsc(const ResourceView& rsc_view, ResourceType rsc_ty) {
+    inner.bindless_rsc_views.emplace_back(rsc_view);
+    inner.bindless_rsc_tys.emplace_back(rsc_ty);
+    return *this;
+  }
+  inline Self& push_const(const void* data, size_t size) {
+    const uint8_t* beg = (const uint8_t*)data;
+    inner.push_consts.assign(beg, beg + size);
+    return *this;
+  }
+  template<typename T>
+  inline Self& push_const(const T& data) {
+    return push_const(&data, sizeof(T));
+  }
 
   inline Self& rsc(const BufferView& buf_view) {
     inner.rsc_views.emplace_back(make_rsc_view(buf_view));
@@ -317,10 +580,28 @@ struct CompositeInvocationBuilder {
     inner.invokes.emplace_back(&(const HAL_IMPL_NAMESPACE::Invocation&)invoke);
     return *this;
   }
+  inline Self& discard(const ResourceView& rsc_view) {
+    inner.discard_rsc_views.emplace_back(rsc_view);
+    return *this;
+  }
   inline Self& is_timed(bool is_timed = true) {
     inner.is_timed = is_timed;
     return *this;
   }
+  inline Self& is_async(bool is_async = true) {
+    inner.is_async = is_async;
+    return *this;
+  }
+
+  inline Self& discard(const BufferView& buf_view) {
+    return discard(make_rsc_view(buf_view));
+  }
+  inline Self& discard(const ImageView& img_view) {
+    return discard(make_rsc_view(img_view));
+  }
+  inline Self& discard(const DepthImageView& depth_img_view) {
+    return discard(make_rsc_view(depth_img_view));
+  }
 
   Invocation build(bool gc = true);
 };
@@ -385,6 +666,14 @@ struct ComputeTaskBuilder {
     inner.workgrp_size.z = z;
     return *this;
   }
+  inline Self& is_bindless(bool is_bindless = true) {
+    inner.is_bindless = is_bindless;
+    return *this;
+  }
+  inline Self& push_const_size(uint32_t push_const_size) {
+    inner.push_const_size = push_const_size;
+    return *this;
+  }
 
   template<typename T>
   inline Self& comp(const std::vector<T>& buf) {
@@ -435,6 +724,14 @@ struct GraphicsTaskBuilder {
     inner.rsc_tys.emplace_back(rsc_ty);
     return *this;
   }
+  inline Self& is_bindless(bool is_bindless = true) {
+    inner.is_bindless = is_bindless;
+    return *this;
+  }
+  inline Self& push_const_size(uint32_t push_const_size) {
+    inner.push_const_size = push_const_size;
+    return *this;
+  }
 
   template<typename T>
   inline Self& vert(const std::vector<T>& buf) {
@@ -508,6 +805,13 @@ struct Image {
   inline ImageView view() const {
     return view(L_IMAGE_SAMPLER_LINEAR);
   }
+
+  inline uint32_t get_bindless_sampled_idx() const {
+    return proto().get_bindless_sampled_idx();
+  }
+  inline uint32_t get_bindless_storage_idx() const {
+    return proto().get_bindless_storage_idx();
+  }
 };
 struct ImageBuilder {
   using Self = ImageBuilder;
@@ -817,6 +1121,13 @@ struct Buffer {
   inline MappedBuffer map_write() const {
     return map(L_MEMORY_ACCESS_WRITE_BIT);
   }
+
+  inline uint32_t get_bindless_idx() const {
+    return proto().get_bindless_idx();
+  }
+  inline uint64_t get_dev_addr() const {
+    return proto().get_dev_addr();
+  }
 };
 struct BufferBuilder {
   using Self = BufferBuilder;
@@ -885,6 +1196,18 @@ struct BufferBuilder {
     return usage(L_BUFFER_USAGE_TRANSFER_DST_BIT)
       .usage(L_BUFFER_USAGE_INDEX_BIT);
   }
+  inline Self& dev_addr() {
+    return usage(L_BUFFER_USAGE_DEVICE_ADDRESS_BIT);
+  }
+  inline Self& indirect() {
+    return usage(L_BUFFER_USAGE_TRANSFER_DST_BIT)
+      .usage(L_BUFFER_USAGE_INDIRECT_BIT);
+  }
+  // Wrap host memory as the buffer without copying, if the device allows.
+  inline Self& import_host(void* host_ptr) {
+    inner.host_ptr = host_ptr;
+    return host_access(L_MEMORY_ACCESS_READ_BIT | L_MEMORY_ACCESS_WRITE_BIT);
+  }
 
   template<typename T>
   inline Self& size_like(const std::vector<T>& data) {
@@ -998,6 +1321,51 @@ struct RenderPassBuilder {
 
 
 
+struct Profiler {
+  L_DECLR_SCOPED_OBJ(Profiler);
+
+  inline const ProfilerConfig& cfg() const {
+    return proto().cfg();
+  }
+  inline void next_frame() {
+    proto().next_frame();
+  }
+  inline ProfilerStatistics get_stats() const {
+    return proto().get_stats();
+  }
+  inline void reset_stats() {
+    proto().reset_stats();
+  }
+};
+struct ProfilerBuilder {
+  using Self = ProfilerBuilder;
+
+  const HAL_IMPL_NAMESPACE::Context& parent;
+  ProfilerConfig inner;
+
+  inline ProfilerBuilder(
+    const HAL_IMPL_NAMESPACE::Context& ctxt,
+    const std::string& label = ""
+  ) : parent(ctxt), inner() {
+    inner.label = label;
+    inner.nframe_in_flight = 3;
+    inner.max_nscope = 1024;
+  }
+
+  inline Self& nframe_in_flight(uint32_t nframe_in_flight) {
+    inner.nframe_in_flight = nframe_in_flight;
+    return *this;
+  }
+  inline Self& max_nscope(uint32_t max_nscope) {
+    inner.max_nscope = max_nscope;
+    return *this;
+  }
+
+  Profiler build(bool gc = true);
+};
+
+
+
 struct Context {
   L_DECLR_SCOPED_OBJ(Context);
 
@@ -1024,11 +1392,54 @@ struct Context {
   ) const {
     return TransferInvocationBuilder(*this, label);
   }
+  FillInvocationBuilder build_fill_invoke(
+    const std::string& label = ""
+  ) const {
+    return FillInvocationBuilder(*this, label);
+  }
+  UpdateInvocationBuilder build_update_invoke(
+    const std::string& label = ""
+  ) const {
+    return UpdateInvocationBuilder(*this, label);
+  }
+  UploadInvocationBuilder build_upload_invoke(
+    const std::string& label = ""
+  ) const {
+    return UploadInvocationBuilder(*this, label);
+  }
   CompositeInvocationBuilder build_composite_invoke(
     const std::string& label = ""
   ) const {
     return CompositeInvocationBuilder(*this, label);
   }
+  ProfilerBuilder build_profiler(const std::string& label = "") const {
+    return ProfilerBuilder(*this, label);
+  }
+
+  inline ContextMemoryStatistics get_mem_stats() const {
+    return proto().get_mem_stats();
+  }
+  inline DefragmentationStatistics defrag(double budget_us) {
+    return proto().defrag(budget_us);
+  }
+  inline ContextQueueStatistics get_queue_stats() const {
+    return proto().get_queue_stats();
+  }
+  inline ContextBarrierStatistics get_barrier_stats() const {
+    return proto().get_barrier_stats();
+  }
+  inline ContextCacheStatistics get_cache_stats() const {
+    return proto().get_cache_stats();
+  }
+  inline ContextRecordStatistics get_record_stats() const {
+    return proto().get_record_stats();
+  }
+  inline ContextResourceStatistics get_rsc_stats() const {
+    return proto().get_rsc_stats();
+  }
+  inline void reset_stats() {
+    proto().reset_stats();
+  }
 
   std::map<std::string, scoped::Task> global_tasks;
   inline bool try_get_global_task(const std::string& name, scoped::Task& out) const {
@@ -1061,6 +1472,23 @@ struct ContextBuilder {
     inner.label = label;
   }
 
+  Self& dev_idx(uint32_t dev_idx) {
+    inner.dev_idx = dev_idx;
+    return *this;
+  }
+  Self& mem_soft_limit(size_t mem_soft_limit) {
+    inner.mem_soft_limit = mem_soft_limit;
+    return *this;
+  }
+  Self& is_single_queue(bool is_single_queue = true) {
+    inner.is_single_queue = is_single_queue;
+    return *this;
+  }
+  Self& is_capturable(bool is_capturable = true) {
+    inner.is_capturable = is_capturable;
+    return *this;
+  }
+
   Context build(bool gc = true);
 };
 struct WindowsContextBuilder {
@@ -1083,6 +1511,18 @@ struct WindowsContextBuilder {
     inner.hwnd = hwnd;
     return *this;
   }
+  Self& mem_soft_limit(size_t mem_soft_limit) {
+    inner.mem_soft_limit = mem_soft_limit;
+    return *this;
+  }
+  Self& is_single_queue(bool is_single_queue = true) {
+    inner.is_single_queue = is_single_queue;
+    return *this;
+  }
+  Self& is_capturable(bool is_capturable = true) {
+    inner.is_capturable = is_capturable;
+    return *this;
+  }
 
   Context build(bool gc = true);
 };
@@ -1102,6 +1542,18 @@ struct AndroidContextBuilder {
     inner.native_wnd = native_wnd;
     return *this;
   }
+  Self& mem_soft_limit(size_t mem_soft_limit) {
+    inner.mem_soft_limit = mem_soft_limit;
+    return *this;
+  }
+  Self& is_single_queue(bool is_single_queue = true) {
+    inner.is_single_queue = is_single_queue;
+    return *this;
+  }
+  Self& is_capturable(bool is_capturable = true) {
+    inner.is_capturable = is_capturable;
+    return *this;
+  }
 
   Context build(bool gc = true);
 };
@@ -1119,6 +1571,18 @@ struct MetalContextBuilder {
     inner.metal_layer = metal_layer;
     return *this;
   }
+  Self& mem_soft_limit(size_t mem_soft_limit) {
+    inner.mem_soft_limit = mem_soft_limit;
+    return *this;
+  }
+  Self& is_single_queue(bool is_single_queue = true) {
+    inner.is_single_queue = is_single_queue;
+    return *this;
+  }
+  Self& is_capturable(bool is_capturable = true) {
+    inner.is_capturable = is_capturable;
+    return *this;
+  }
 
   Context build(bool gc = true);
 };
@@ -0,0 +1,165 @@
+// # Open-addressing hash map for small fixed-size keys
+// @PENGUINLIONG
+//
+// Items are stored inline in a power-of-two array and probed linearly, so
+// looking up an existing key never allocates. Keys are hashed with `hash_key`,
+// which is defined for integers, enums and types with a `hash()` method.
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "gft/assert.hpp"
+
+namespace liong {
+namespace hash_map {
+
+// FNV-1a hash of a byte sequence.
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  uint64_t out = 0xcbf29ce484222325ull ^ seed;
+  for (size_t i = 0; i < size; ++i) {
+    out ^= bytes[i];
+    out *= 0x100000001b3ull;
+  }
+  return out;
+}
+
+template<typename T>
+inline typename std::enable_if<
+  std::is_integral<T>::value || std::is_enum<T>::value, uint64_t>::type
+hash_key(const T& key) {
+  // Finalizer of SplitMix64 to spread consecutive integers over the table.
+  uint64_t x = (uint64_t)key;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+template<typename T>
+inline auto hash_key(const T& key) -> decltype(key.hash()) {
+  return key.hash();
+}
+
+template<typename TKey, typename TValue>
+struct HashMap {
+  struct Slot {
+    TKey key;
+    TValue value;
+    bool is_occupied;
+  };
+
+private:
+  std::vector<Slot> slots;
+  size_t nitem;
+
+  inline size_t mask() const {
+    return slots.size() - 1;
+  }
+  // Index of the slot holding `key`, or of the empty slot ending the probe
+  // sequence if the key is absent.
+  inline size_t probe(const TKey& key) const {
+    size_t i = (size_t)hash_key(key) & mask();
+    while (slots[i].is_occupied && !(slots[i].key == key)) {
+      i = (i + 1) & mask();
+    }
+    return i;
+  }
+  void rehash(size_t nslot) {
+    std::vector<Slot> old_slots(nslot);
+    std::swap(slots, old_slots);
+    for (Slot& slot : old_slots) {
+      if (!slot.is_occupied) { continue; }
+      Slot& dst = slots[probe(slot.key)];
+      dst.key = std::move(slot.key);
+      dst.value = std::move(slot.value);
+      dst.is_occupied = true;
+    }
+  }
+
+public:
+  HashMap() : slots(16), nitem(0) {}
+
+  inline size_t size() const {
+    return nitem;
+  }
+  inline bool empty() const {
+    return nitem == 0;
+  }
+
+  // Get the value of `key`; `nullptr` if the key is absent.
+  inline TValue* find(const TKey& key) {
+    Slot& slot = slots[probe(key)];
+    return slot.is_occupied ? &slot.value : nullptr;
+  }
+  inline const TValue* find(const TKey& key) const {
+    const Slot& slot = slots[probe(key)];
+    return slot.is_occupied ? &slot.value : nullptr;
+  }
+  inline TValue& at(const TKey& key) {
+    TValue* out = find(key);
+    L_ASSERT(out != nullptr, "hash map key is absent");
+    return *out;
+  }
+  inline const TValue& at(const TKey& key) const {
+    const TValue* out = find(key);
+    L_ASSERT(out != nullptr, "hash map key is absent");
+    return *out;
+  }
+
+  // Get the value of `key`, inserting a default value if the key is absent.
+  TValue& operator[](const TKey& key) {
+    size_t i = probe(key);
+    if (slots[i].is_occupied) { return slots[i].value; }
+
+    // Keep the load factor under 3/4 so probe sequences stay short.
+    if ((nitem + 1) * 4 > slots.size() * 3) {
+      rehash(slots.size() * 2);
+      i = probe(key);
+    }
+    Slot& slot = slots[i];
+    slot.key = key;
+    slot.value = TValue {};
+    slot.is_occupied = true;
+    ++nitem;
+    return slot.value;
+  }
+
+  // Remove `key` and return `true` if it was present. Following items in the
+  // same cluster are shifted back so no tombstone is left.
+  bool erase(const TKey& key) {
+    size_t i = probe(key);
+    if (!slots[i].is_occupied) { return false; }
+
+    size_t j = i;
+    for (;;) {
+      j = (j + 1) & mask();
+      if (!slots[j].is_occupied) { break; }
+      // An item can fill the hole only if its home slot is not cyclically in
+      // `(i, j]`.
+      size_t home = (size_t)hash_key(slots[j].key) & mask();
+      bool is_home_between = i <= j ?
+        (i < home && home <= j) : (i < home || home <= j);
+      if (is_home_between) { continue; }
+      slots[i].key = std::move(slots[j].key);
+      slots[i].value = std::move(slots[j].value);
+      i = j;
+    }
+    slots[i].key = TKey {};
+    slots[i].value = TValue {};
+    slots[i].is_occupied = false;
+    --nitem;
+    return true;
+  }
+
+  // Call `f(key, value)` on every item in unspecified order.
+  template<typename TFunc>
+  void for_each(TFunc&& f) {
+    for (Slot& slot : slots) {
+      if (slot.is_occupied) { f(slot.key, slot.value); }
+    }
+  }
+};
+
+} // namespace hash_map
+} // namespace liong
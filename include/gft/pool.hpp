@@ -1,17 +1,19 @@
 // General purpose object pool.
 // @PENGUINLIONG
 #pragma once
-#include <map>
 #include <memory>
 #include <vector>
 #include <array>
+#include "gft/hash-map.hpp"
 
 namespace liong {
 namespace pool {
 
+// Keys are small fixed-size values hashed with `hash_map::hash_key`, so
+// looking up free items doesn't allocate.
 template<typename TKey, typename TValue>
 struct PoolInner {
-    std::map<TKey, std::vector<TValue>> items;
+    hash_map::HashMap<TKey, std::vector<TValue>> items;
 };
 
 template<typename TKey, typename TValue>
@@ -23,7 +25,7 @@ struct PoolItemInner {
   PoolItemInner(PoolInner<TKey, TValue>* pool, TKey&& key, TValue&& value) :
     pool(pool), key(std::move(key)), value(std::move(value)) {}
   ~PoolItemInner() {
-    pool->items[std::move(key)].emplace_back(std::move(value));
+    pool->items[key].emplace_back(std::move(value));
   }
 };
 
@@ -57,11 +59,8 @@ struct Pool {
   PoolInner<TKey, TValue> inner;
 
   inline bool has_free_item(const TKey& key) const {
-    auto it = inner.items.find(key);
-    if (it != inner.items.end() && !it->second.empty()) {
-      return true;
-    }
-    return false;
+    const std::vector<TValue>* items = inner.items.find(key);
+    return items != nullptr && !items->empty();
   }
   inline PoolItem<TKey, TValue> create(TKey&& key, TValue&& value) {
     return PoolItem<TKey, TValue>(
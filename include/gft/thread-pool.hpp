@@ -0,0 +1,59 @@
+// # Fixed-size worker thread pool
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace liong {
+namespace thread_pool {
+
+struct ThreadPool {
+private:
+  std::vector<std::thread> workers;
+  // Serializes `parallel_for` calls from different threads.
+  std::mutex dispatch_mutex;
+  std::mutex mutex;
+  // Notified when jobs are dispatched or the pool is shutting down.
+  std::condition_variable job_cv;
+  // Notified when all dispatched jobs are completed.
+  std::condition_variable done_cv;
+
+  const std::function<void(size_t)>* job;
+  size_t njob;
+  size_t next_ijob;
+  size_t ndone;
+  // The first exception thrown by the dispatched jobs, rethrown on the calling
+  // thread.
+  std::exception_ptr exception;
+  bool should_exit;
+
+  // Take and run dispatched jobs until there are none left. `lock` is held on
+  // return.
+  void run_jobs(std::unique_lock<std::mutex>& lock);
+  void worker_main();
+
+public:
+  // `nthread` workers are created in addition to the calling thread; no worker
+  // is created if it's zero.
+  ThreadPool(uint32_t nthread);
+  ~ThreadPool();
+
+  inline uint32_t nthread() const {
+    return (uint32_t)workers.size();
+  }
+
+  // Run `job(i)` for each `i` in `[0, njob)` on the workers and the calling
+  // thread. Returns when all jobs are completed. Calls from different threads
+  // are run one after another. Jobs must not dispatch more jobs to the same
+  // pool. If a job throws, the jobs not yet started are skipped and the
+  // exception is rethrown here.
+  void parallel_for(size_t njob, const std::function<void(size_t)>& job);
+};
+
+} // namespace thread_pool
+} // namespace liong
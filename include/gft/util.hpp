@@ -11,6 +11,7 @@
 #include <functional>
 #include <chrono>
 #include <cstring>
+#include <new>
 
 namespace liong {
 
@@ -225,6 +226,46 @@ constexpr size_t pop_idx(size_t& aggr_idx, size_t dim_size) {
   return out;
 }
 
+// - [Aligned Host Memory] -----------------------------------------------------
+
+// Alignment of host memory that can be imported as device memory. It's the
+// page size on all major platforms.
+constexpr size_t HOST_IMPORT_ALIGN = 4096;
+
+// Allocate host memory of at least `size` bytes aligned to `align` bytes. The
+// size is rounded up to a multiple of `align` so that the entire allocation
+// can be imported as device memory. Returns `nullptr` on failure.
+void* alloc_aligned(size_t size, size_t align = HOST_IMPORT_ALIGN);
+void free_aligned(void* ptr);
+
+// STL allocator of host memory aligned to `HOST_IMPORT_ALIGN`, so that
+// container storage can be imported as device memory without copying.
+template<typename T>
+struct AlignedAllocator {
+  typedef T value_type;
+
+  AlignedAllocator() = default;
+  template<typename U>
+  constexpr AlignedAllocator(const AlignedAllocator<U>&) noexcept {}
+
+  inline T* allocate(size_t n) {
+    void* out = alloc_aligned(n * sizeof(T));
+    if (out == nullptr) { throw std::bad_alloc(); }
+    return (T*)out;
+  }
+  inline void deallocate(T* ptr, size_t n) noexcept {
+    free_aligned(ptr);
+  }
+};
+template<typename T, typename U>
+constexpr bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+  return true;
+}
+template<typename T, typename U>
+constexpr bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+  return false;
+}
+
 // - [CRC32] -------------------------------------------------------------------
 
 uint32_t crc32(const void* data, size_t size);
@@ -117,12 +117,40 @@ struct Allocator {
 typedef std::shared_ptr<Allocator> AllocatorRef;
 
 
+struct DeviceMemory {
+  typedef DeviceMemory Self;
+  VkDevice dev;
+  VkDeviceMemory devmem;
+  bool should_destroy;
+
+  DeviceMemory(VkDevice dev, VkDeviceMemory devmem, bool should_destroy) :
+    dev(dev), devmem(devmem), should_destroy(should_destroy) {}
+  ~DeviceMemory() { destroy(); }
+
+  operator VkDeviceMemory() const {
+    return devmem;
+  }
+
+  static std::shared_ptr<DeviceMemory> create(VkDevice dev, const VkMemoryAllocateInfo* mai) {
+    VkDeviceMemory devmem = VK_NULL_HANDLE;
+    VK_ASSERT << vkAllocateMemory(dev, mai, nullptr, &devmem);
+    return std::make_shared<DeviceMemory>(dev, devmem, true);
+  }
+  void destroy() {
+    vkFreeMemory(dev, devmem, nullptr);
+  }
+};
+typedef std::shared_ptr<DeviceMemory> DeviceMemoryRef;
+
 struct Buffer {
   typedef Device Self;
   VmaAllocator allocator;
   VkBuffer buf;
   VmaAllocation alloc;
   bool should_destroy;
+  // Imported host memory bound to the buffer, if any. It's released after the
+  // buffer by whoever drops the last reference to the buffer.
+  DeviceMemoryRef host_mem;
 
   Buffer(VmaAllocator allocator, VkBuffer buf, VmaAllocation alloc, bool should_destroy) :
     allocator(allocator), buf(buf), alloc(alloc), should_destroy(should_destroy) {}
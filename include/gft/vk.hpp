@@ -2,9 +2,14 @@
 // @PENGUINLIONG
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <chrono>
 #include <vulkan/vulkan.h>
 #include "vk_mem_alloc.h"
@@ -12,12 +17,13 @@
 #include "gft/hal/scoped-hal.hpp"
 #include "gft/vk-sys.hpp"
 #include "gft/pool.hpp"
+#include "gft/hash-map.hpp"
+#include "gft/thread-pool.hpp"
+#include "gft/stats.hpp"
 
 namespace liong {
 namespace vk {
 
-const uint32_t SPIN_INTERVAL = 30'000;
-
 inline VkFormat fmt2vk(fmt::Format fmt, fmt::ColorSpace cspace) {
   using namespace fmt;
   switch (fmt) {
@@ -59,11 +65,31 @@ inline VkColorSpaceKHR cspace2vk(fmt::ColorSpace cspace) {
   }
 }
 
+enum DeviceMemoryArchitecture {
+  // Device-local memory is invisible to the host, or only exposed through a
+  // small (usually 256MB) BAR aperture. Uploads go through staging buffers.
+  L_DEVICE_MEMORY_ARCHITECTURE_DISCRETE,
+  // Resizable BAR; the entire device-local heap is host-writable.
+  L_DEVICE_MEMORY_ARCHITECTURE_RESIZABLE_BAR,
+  // Memory is shared by host and device, e.g. integrated GPUs and software
+  // rasterizers.
+  L_DEVICE_MEMORY_ARCHITECTURE_UNIFIED,
+};
+struct InstancePhysicalDeviceMemoryDetail {
+  DeviceMemoryArchitecture mem_arch;
+  // Device-local, host-visible and host-coherent memory type the host can
+  // directly write to, or `VK_MAX_MEMORY_TYPES` if there is no such memory.
+  uint32_t direct_write_mem_ty_idx;
+  // Heap of `direct_write_mem_ty_idx`.
+  uint32_t direct_write_heap_idx;
+  VkDeviceSize direct_write_heap_size;
+};
 struct InstancePhysicalDeviceDetail {
   VkPhysicalDevice physdev;
   VkPhysicalDeviceProperties prop;
   VkPhysicalDeviceFeatures feat;
   VkPhysicalDeviceMemoryProperties mem_prop;
+  InstancePhysicalDeviceMemoryDetail mem_detail;
   std::vector<VkQueueFamilyProperties> qfam_props;
   std::map<std::string, uint32_t> ext_props;
   std::string desc;
@@ -85,53 +111,151 @@ enum SubmitType {
   L_SUBMIT_TYPE_GRAPHICS,
   L_SUBMIT_TYPE_TRANSFER,
   L_SUBMIT_TYPE_PRESENT,
+  // Compute work tagged to overlap with the other queues. It's submitted to a
+  // compute queue family without graphics capability if there is one;
+  // otherwise it shares the queue with `L_SUBMIT_TYPE_COMPUTE`.
+  L_SUBMIT_TYPE_ASYNC_COMPUTE,
 };
 
-typedef pool::Pool<SubmitType, sys::CommandPoolRef> CommandPoolPool;
-typedef pool::PoolItem<SubmitType, sys::CommandPoolRef> CommandPoolPoolItem;
+// Command pool recycled together with the command buffers allocated from it.
+// The command buffers are reset in bulk with the pool when it's reacquired.
+struct ContextCommandPool {
+  sys::CommandPoolRef cmd_pool;
+  // Indexed by `VkCommandBufferLevel`; `nullptr` if not allocated yet.
+  std::array<sys::CommandBufferRef, 2> cmdbufs;
+  // Timeline point reached when the recorded commands complete; `nullptr` if
+  // the commands have never been submitted.
+  sys::SemaphoreRef timeline_sema;
+  uint64_t timeline_value;
+};
+typedef pool::Pool<SubmitType, ContextCommandPool> CommandPoolPool;
+typedef pool::PoolItem<SubmitType, ContextCommandPool> CommandPoolPoolItem;
+
+typedef pool::Pool<SubmitType, sys::FenceRef> FencePool;
+typedef pool::PoolItem<SubmitType, sys::FenceRef> FencePoolItem;
+
+// Binary semaphores. Submissions are otherwise tracked by timelines.
+struct ContextSemaphore {
+  sys::SemaphoreRef sema;
+  // Signaled when the semaphore is no longer waited, e.g., when the image
+  // presented with it is acquired again; invalid if it's free right away.
+  FencePoolItem fence;
+};
+typedef pool::Pool<SubmitType, ContextSemaphore> SemaphorePool;
+typedef pool::PoolItem<SubmitType, ContextSemaphore> SemaphorePoolItem;
 
 struct TransactionSubmitDetail {
   SubmitType submit_ty;
   CommandPoolPoolItem cmd_pool;
   sys::CommandBufferRef cmdbuf;
   VkQueue queue;
-  sys::SemaphoreRef wait_sema;
-  sys::SemaphoreRef signal_sema;
+  // Timeline semaphore of the queue and the value it's signaled with when the
+  // command buffer completes. Secondary command buffers have no timeline.
+  // The command buffer waits for the previous submission in the transaction.
+  sys::SemaphoreRef timeline_sema;
+  uint64_t signal_value;
+  // Binary semaphore signaled for presentation, which doesn't accept timeline
+  // semaphores; invalid if the command buffer is not presented.
+  SemaphorePoolItem present_sema;
   bool is_submitted;
+  // `true` if the command buffer is submitted to a dedicated async compute
+  // queue. Later submissions on other queues don't wait for it unless it's
+  // joined, i.e., it releases resources to other queues.
+  bool is_async;
+  bool is_joined;
+  // Bytes written by transfer commands in the command buffer.
+  size_t transfer_size;
 };
+// Index of a scope in a profiler frame; the outermost scopes have no parent.
+constexpr uint32_t NO_PROFILER_SCOPE = ~uint32_t(0);
 struct TransactionLike {
   const Context* ctxt;
   std::vector<TransactionSubmitDetail> submit_details;
-  std::vector<sys::FenceRef> fences;
+  std::vector<FencePoolItem> fences;
+  // Command pools of secondary command buffers recorded in parallel and
+  // executed by the primary command buffers.
+  std::vector<CommandPoolPoolItem> secondary_cmd_pools;
   VkCommandBufferLevel level;
   // Some invocations cannot be followedby subsequent invocations, e.g.
   // presentation.
   bool is_frozen;
+  // Independent subinvocations are recorded on the context's recording
+  // threads.
+  bool is_parallel;
+  // Resource transitions are recorded by the parent transaction instead. It's
+  // the case when the commands are recorded in parallel or in a render pass.
+  bool is_transit_external;
+  // Compute subinvocations are recorded to the async compute queue. It's the
+  // case when an async composite invocation is being recorded.
+  bool is_async;
+  // Command buffers are recorded to be baked, so they are begun for
+  // simultaneous use, and primary command buffers are ended but not
+  // submitted.
+  bool is_baking;
+  // Profiler timing the recorded invocations, if any. Scopes are taken from
+  // `profile_iscope` to `profile_iscope_end`, reserved by the outermost
+  // invocation, and are nested in the scope `profile_iparent`.
+  Profiler* profiler;
+  uint32_t profile_iscope;
+  uint32_t profile_iscope_end;
+  uint32_t profile_iparent;
+  // Some devices can only use one performance query pool in a command buffer.
+  bool is_perf_query_used;
+  // Number of pipelines bound and bytes of host data uploaded. Counted here
+  // because the context is not accessed by recording threads.
+  uint64_t npipe_bind;
+  uint64_t upload_size;
 
   inline TransactionLike(const Context& ctxt, VkCommandBufferLevel level) :
-    ctxt(&ctxt), submit_details(), level(level), is_frozen(false) {}
+    ctxt(&ctxt), submit_details(), level(level), is_frozen(false),
+    is_parallel(false), is_transit_external(false), is_async(false),
+    is_baking(false), profiler(nullptr), profile_iscope(0),
+    profile_iscope_end(0), profile_iparent(NO_PROFILER_SCOPE),
+    is_perf_query_used(false), npipe_bind(0), upload_size(0) {}
 };
 struct Transaction : public Transaction_ {
   const Context* ctxt;
   std::vector<TransactionSubmitDetail> submit_details;
-  std::vector<sys::FenceRef> fences;
+  std::vector<CommandPoolPoolItem> secondary_cmd_pools;
+  // Fences of swapchain image acquisitions. Submissions are tracked by the
+  // timeline points of the last submitted command buffer of each queue.
+  std::vector<FencePoolItem> fences;
 
   static bool create(const Invocation& invoke, InvocationSubmitTransactionConfig& cfg, Transaction& out);
   ~Transaction();
 
   virtual bool is_done() const override final;
   virtual void wait() const override final;
+  virtual bool wait_for(double timeout_us) const override final;
+  virtual void on_done(std::function<void()>&& callback) const override final;
 };
 
 
 
+// Number of bindings kept inline in a descriptor set key. Keys of larger
+// descriptor sets keep the rest on the heap, so only their lookups allocate.
+constexpr uint32_t DESC_SET_KEY_NINLINE_BINDING = 32;
 struct DescriptorSetKey {
-  std::string inner;
+  // Resource type of each binding, one byte each. Bytes after `nbinding` are
+  // zeroed.
+  uint32_t nbinding;
+  std::array<uint8_t, DESC_SET_KEY_NINLINE_BINDING> rsc_tys;
+  // Resource types of the bindings after the inline ones.
+  std::vector<uint8_t> ext_rsc_tys;
 
   static DescriptorSetKey create(const std::vector<ResourceType>& rsc_tys);
 
-  inline friend bool operator<(const DescriptorSetKey& a, const DescriptorSetKey& b) {
-    return a.inner < b.inner;
+  inline uint64_t hash() const {
+    uint32_t ninline = std::min(nbinding, DESC_SET_KEY_NINLINE_BINDING);
+    uint64_t out = hash_map::hash_bytes(rsc_tys.data(), ninline, nbinding);
+    if (!ext_rsc_tys.empty()) {
+      out = hash_map::hash_bytes(ext_rsc_tys.data(), ext_rsc_tys.size(), out);
+    }
+    return out;
+  }
+  inline friend bool operator==(const DescriptorSetKey& a, const DescriptorSetKey& b) {
+    return a.nbinding == b.nbinding && a.rsc_tys == b.rsc_tys &&
+      a.ext_rsc_tys == b.ext_rsc_tys;
   }
 };
 typedef pool::Pool<DescriptorSetKey, sys::DescriptorSetRef> DescriptorSetPool;
@@ -140,12 +264,194 @@ typedef pool::PoolItem<DescriptorSetKey, sys::DescriptorSetRef> DescriptorSetPoo
 typedef pool::Pool<int, sys::QueryPoolRef> QueryPoolPool;
 typedef pool::PoolItem<int, sys::QueryPoolRef> QueryPoolPoolItem;
 
+// Submissions to a queue are tracked by a timeline semaphore counting up by one
+// on each submit. Submit types sharing a queue share the timeline.
+struct ContextQueueTimeline {
+  sys::SemaphoreRef sema;
+  // Value signaled by the last submission.
+  uint64_t last_value;
+};
 struct ContextSubmitDetail {
   uint32_t qfam_idx;
   VkQueue queue;
+  std::shared_ptr<ContextQueueTimeline> timeline;
+};
+enum MemoryCategory {
+  L_MEMORY_CATEGORY_BUFFER,
+  L_MEMORY_CATEGORY_IMAGE,
+  L_MEMORY_CATEGORY_STAGING,
+  L_MEMORY_CATEGORY_DESCRIPTOR,
+  L_MEMORY_CATEGORY_ALIASED,
+};
+struct ContextMemoryDetail {
+  // Soft limit of bytes allocated by buffers and images; zero if unlimited.
+  size_t soft_limit;
+  // Indexed by `MemoryCategory`.
+  std::array<MemoryCategoryStatistics, 5> cat_stats;
+  // Bytes allocated by buffers and images.
+  size_t size;
+  stats::MaxStats<int64_t> peak_size;
+  // Sampled by statistics queries.
+  mutable stats::AvgStats<double> alloc_rate;
+  // Total number of allocations and time at the last statistics query.
+  mutable uint64_t nalloc_total_last_query;
+  mutable std::chrono::high_resolution_clock::time_point last_query_time;
+};
+struct DefragmentationBufferMove {
+  Buffer* buf;
+  VkBuffer new_buf;
+  VkDeviceSize size;
+  // Index of the move in the pass.
+  uint32_t imove;
+};
+struct DefragmentationImageMove {
+  Image* img;
+  VkImage new_img;
+  VkDeviceSize size;
+  // Index of the move in the pass.
+  uint32_t imove;
+};
+struct ContextDefragmentationDetail {
+  // Defragmentation in progress; `VK_NULL_HANDLE` if there is none.
+  VmaDefragmentationContext defrag_ctxt;
+  // Resources that can be relocated, indexed by their allocations.
+  std::map<VmaAllocation, Buffer*> bufs;
+  std::map<VmaAllocation, Image*> imgs;
+  // Number of invocations referencing each allocation. Referenced resources
+  // are not relocated.
+  std::map<VmaAllocation, uint32_t> npins;
+  // `true` if a pass has begun and its copies might be in flight. The pass
+  // is ended by a later call if the copies overran the time budget.
+  bool is_pass_pending;
+  VmaDefragmentationPassMoveInfo pmi;
+  std::vector<DefragmentationBufferMove> buf_moves;
+  std::vector<DefragmentationImageMove> img_moves;
+  // Allocations pinned while the pass is pending. Their moves are cancelled
+  // because the copies might have missed the writes of the new references.
+  std::set<VmaAllocation> pending_pinned_allocs;
+  // Timeline point reached when the copies complete.
+  sys::SemaphoreRef timeline_sema;
+  uint64_t signal_value;
+  CommandPoolPoolItem cmd_pool;
+};
+struct ContextHostImportDetail {
+  // Alignment of imported host pointers and sizes; zero if the device cannot
+  // import host memory.
+  size_t align;
+  PFN_vkGetMemoryHostPointerPropertiesEXT get_mem_host_ptr_prop;
+};
+struct ContextTimelineDetail {
+  PFN_vkGetSemaphoreCounterValueKHR get_sema_counter_value;
+  PFN_vkWaitSemaphoresKHR wait_semas;
+  PFN_vkSignalSemaphoreKHR signal_sema;
+};
+// Completion callback of a transaction. It's called when all the timeline
+// points are reached and all the fences are signaled.
+struct ContextReaperEntry {
+  std::vector<VkSemaphore> semas;
+  std::vector<uint64_t> values;
+  // Held so that the fences are not recycled before the entry is done.
+  std::vector<FencePoolItem> fences;
+  std::function<void()> callback;
+};
+// Fences cannot be waited together with timeline semaphores, so they are
+// polled at this interval while timeline semaphores are being waited.
+constexpr uint64_t FENCE_POLL_INTERVAL_NS = 1000000;
+// A single thread serving completion callbacks of the context. It sleeps on
+// the timeline semaphores of pending entries, and is woken up by a semaphore
+// signaled from the host when entries are pushed or the reaper is stopped.
+struct ContextReaper {
+  const Context* ctxt;
+  std::mutex sync;
+  std::vector<ContextReaperEntry> entries;
+  // Fences of done entries. Fence pools are not thread-safe so they are
+  // returned to the pool by the thread owning the context.
+  std::vector<FencePoolItem> done_fences;
+  sys::SemaphoreRef wake_sema;
+  uint64_t wake_value;
+  bool is_stopping;
+  std::thread thread;
+
+  ContextReaper(const Context& ctxt);
+  ~ContextReaper();
+
+  void push(ContextReaperEntry&& entry);
+  // Take the fences of done entries. Only called by the thread owning the
+  // context.
+  std::vector<FencePoolItem> take_done_fences();
+  // Signal the wake semaphore. `sync` MUST be locked.
+  void wake();
+};
+// Destruction of resources dropped by the host while the device might still
+// be using them. Entries are tagged with the last value submitted to each queue
+// timeline at the time they are pushed, and are destroyed once the device has
+// reached all of them.
+struct ContextDeletionEntry {
+  // Indexed the same as `ContextDeletionQueue::timelines`.
+  std::vector<uint64_t> values;
+  std::function<void()> deleter;
+};
+struct ContextDeletionQueue {
+  std::mutex sync;
+  // Unique queue timelines of the context.
+  std::vector<std::shared_ptr<ContextQueueTimeline>> timelines;
+  // Timeline values only increase so entries are in the order of completion.
+  std::deque<ContextDeletionEntry> entries;
+};
+struct ContextDeviceAddressDetail {
+  // `nullptr` if buffer device address is unsupported.
+  PFN_vkGetBufferDeviceAddressKHR get_buf_dev_addr;
+};
+struct ContextDrawIndirectCountDetail {
+  // `nullptr` if draw counts cannot be sourced from buffers.
+  PFN_vkCmdDrawIndirectCountKHR draw_indirect_count;
+  PFN_vkCmdDrawIndexedIndirectCountKHR draw_idxed_indirect_count;
+};
+struct ContextPerformanceCounterDetail {
+  VkPerformanceCounterKHR counter;
+  VkPerformanceCounterDescriptionKHR desc;
+};
+struct ContextPerformanceQueryDetail {
+  // Whether performance counters can be collected. Queries are reset on the
+  // host because they cannot be reset in the command buffers they are used.
+  bool is_supported;
+  // Whether more than one performance query pool can be used in a command
+  // buffer.
+  bool is_multi_pool_supported;
+  PFN_vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR get_npass;
+  PFN_vkAcquireProfilingLockKHR acquire_profiling_lock;
+  PFN_vkReleaseProfilingLockKHR release_profiling_lock;
+  PFN_vkResetQueryPoolEXT reset_query_pool;
+  // Counters available on each allocated queue family.
+  std::map<uint32_t, std::vector<ContextPerformanceCounterDetail>> counters;
+  // The profiling lock is acquired on first use and held until the context is
+  // destroyed.
+  bool is_locked;
+};
+// Bindings of the global bindless descriptor set.
+enum BindlessBinding {
+  L_BINDLESS_BINDING_STORAGE_BUFFER,
+  L_BINDLESS_BINDING_SAMPLED_IMAGE,
+  L_BINDLESS_BINDING_STORAGE_IMAGE,
+};
+struct ContextBindlessArrayDetail {
+  // Array indices released by destroyed resources, reused first.
+  std::vector<uint32_t> free_idxs;
+  // Number of array indices ever allocated.
+  uint32_t nidx;
+};
+struct ContextBindlessDetail {
+  // Whether the device supports descriptor indexing well enough.
+  bool is_supported;
+  // Created on first use.
+  sys::DescriptorSetLayoutRef desc_set_layout;
+  sys::DescriptorPoolRef desc_pool;
+  sys::DescriptorSetRef desc_set;
+  // Indexed by `BindlessBinding`.
+  std::array<ContextBindlessArrayDetail, 3> arrs;
 };
 struct ContextDescriptorSetDetail {
-  std::map<DescriptorSetKey, sys::DescriptorSetLayoutRef> desc_set_layouts;
+  hash_map::HashMap<DescriptorSetKey, sys::DescriptorSetLayoutRef> desc_set_layouts;
   // Descriptor pools to hold references.
   std::vector<sys::DescriptorPoolRef> desc_pools;
   DescriptorSetPool desc_set_pool;
@@ -160,8 +466,33 @@ struct Context : public Context_ {
   std::map<DepthImageSampler, sys::SamplerRef> depth_img_samplers;
   ContextDescriptorSetDetail desc_set_detail;
   CommandPoolPool cmd_pool_pool;
+  FencePool fence_pool;
+  SemaphorePool sema_pool;
   QueryPoolPool query_pool_pool;
   sys::AllocatorRef allocator;
+  ContextMemoryDetail mem_detail;
+  ContextDefragmentationDetail defrag_detail;
+  ContextHostImportDetail host_import_detail;
+  ContextBindlessDetail bindless_detail;
+  ContextDeviceAddressDetail dev_addr_detail;
+  ContextDrawIndirectCountDetail draw_indirect_count_detail;
+  ContextTimelineDetail timeline_detail;
+  ContextPerformanceQueryDetail perf_query_detail;
+  ContextQueueStatistics queue_stats;
+  // Bytes transferred and time at the last queue statistics query.
+  mutable size_t transfer_size_last_query;
+  mutable std::chrono::high_resolution_clock::time_point queue_stats_last_query_time;
+  ContextBarrierStatistics barrier_stats;
+  ContextCacheStatistics cache_stats;
+  ContextRecordStatistics record_stats;
+  ContextResourceStatistics rsc_stats;
+  // Whether tasks and invocations keep their configs to be captured.
+  bool is_capturable;
+  // Threads recording commands in parallel, created on first use.
+  std::unique_ptr<thread_pool::ThreadPool> record_thread_pool;
+  // Thread calling transaction completion callbacks, created on first use.
+  std::unique_ptr<ContextReaper> reaper;
+  std::unique_ptr<ContextDeletionQueue> deletion_queue;
 
   static bool create(const Instance& inst, const ContextConfig& cfg, Context& out);
   static bool create(const Instance& inst, const ContextWindowsConfig& cfg, Context& out);
@@ -178,28 +509,144 @@ struct Context : public Context_ {
   inline const VkPhysicalDeviceFeatures& physdev_feat() const {
     return get_inst().physdev_details.at(iphysdev).feat;
   }
+  inline const VkPhysicalDeviceMemoryProperties& physdev_mem_prop() const {
+    return get_inst().physdev_details.at(iphysdev).mem_prop;
+  }
+  inline const InstancePhysicalDeviceMemoryDetail& physdev_mem_detail() const {
+    return get_inst().physdev_details.at(iphysdev).mem_detail;
+  }
+  // Whether the host can write to device-local memory without staging. Only
+  // `true` when memory of `size` bytes can still fit in the budget of the
+  // direct-write heap.
+  bool can_write_directly(VkDeviceSize size) const;
 
   sys::DescriptorSetLayoutRef get_desc_set_layout(const std::vector<ResourceType>& rsc_tys);
   DescriptorSetPoolItem acquire_desc_set(const std::vector<ResourceType>& rsc_tys);
 
+  // Submission objects are recycled once the device has finished with them.
   CommandPoolPoolItem acquire_cmd_pool(SubmitType submit_ty);
-
+  sys::CommandBufferRef get_cmdbuf(
+    CommandPoolPoolItem& cmd_pool,
+    VkCommandBufferLevel level);
+  FencePoolItem acquire_fence(SubmitType submit_ty);
+  SemaphorePoolItem acquire_sema(SubmitType submit_ty);
+
+  thread_pool::ThreadPool& get_record_thread_pool();
+  ContextReaper& get_reaper();
+
+  // Call `deleter` once the device has finished all the work submitted so
+  // far. Resources are released this way so that the host never has to wait
+  // for the device before dropping them.
+  void defer_deletion(std::function<void()>&& deleter);
+  // Call the deleters the device has passed by. If `is_blocking` is `true`,
+  // wait for the device to pass all of them.
+  void reap_deletions(bool is_blocking);
+
+  // Global bindless descriptor set, created on first use.
+  const ContextBindlessDetail& get_bindless_detail();
+  uint32_t alloc_bindless_idx(BindlessBinding binding);
+  void free_bindless_idx(BindlessBinding binding, uint32_t idx);
+  // Point the descriptor at `idx` of `binding` to the entire resource.
+  void write_bindless_desc(BindlessBinding binding, uint32_t idx, const Buffer& buf);
+  void write_bindless_desc(BindlessBinding binding, uint32_t idx, const Image& img);
+
+  sys::QueryPoolRef create_query_pool(
+    VkQueryType query_ty,
+    uint32_t nquery,
+    VkQueryPipelineStatisticFlags pipe_stats_flags = 0,
+    const void* pnext = nullptr) const;
   QueryPoolPoolItem acquire_query_pool();
+  // Returns `false` if the profiling lock cannot be acquired.
+  bool acquire_profiling_lock();
+
+  // Values the queue timelines will reach once the work submitted so far is
+  // finished, in the order of `ContextDeletionQueue::timelines`.
+  std::vector<uint64_t> get_timeline_values() const;
+  // Check whether the device has passed `values` from `get_timeline_values`.
+  // If `is_blocking` is `true`, wait for it to.
+  bool is_timeline_passed(const std::vector<uint64_t>& values, bool is_blocking) const;
+
+  // Account for an allocation of `size` bytes. Returns `false` if the
+  // allocation would exceed the memory soft limit.
+  bool alloc_mem(MemoryCategory mem_cat, size_t size);
+  void free_mem(MemoryCategory mem_cat, size_t size);
+  // Descriptor memory is opaque so descriptor pools are counted by the number
+  // of descriptors instead of bytes.
+  void alloc_descs(size_t ndesc);
+
+  virtual ContextMemoryStatistics get_mem_stats() const override final;
+  virtual DefragmentationStatistics defrag(double budget_us) override final;
+  // Wait for the copies of the pending defragmentation pass, if any, and end
+  // it. Relocated resources can only be destroyed after this.
+  void flush_defrag_pass();
+  virtual ContextQueueStatistics get_queue_stats() const override final;
+  virtual ContextBarrierStatistics get_barrier_stats() const override final;
+  virtual ContextCacheStatistics get_cache_stats() const override final;
+  virtual ContextRecordStatistics get_record_stats() const override final;
+  virtual ContextResourceStatistics get_rsc_stats() const override final;
+  virtual void reset_stats() override final;
 };
 
 
 
+// Device memory shared by buffers and images placed in it. Resources placed in
+// overlapping ranges alias each other so they MUST NOT be in use at the same
+// time; their content is discarded on first use after another (see
+// `CompositeInvocationConfig::discard_rsc_views`).
+struct AliasedMemory {
+  const Context* ctxt; // Lifetime bound.
+  VmaAllocation alloc;
+  size_t size;
+
+  static bool create(
+    const Context& ctxt,
+    const std::string& label,
+    const VkMemoryRequirements& mr,
+    AliasedMemory& out);
+  ~AliasedMemory();
+};
+typedef std::shared_ptr<AliasedMemory> AliasedMemoryRef;
+
+
+
 struct BufferDynamicDetail {
   VkPipelineStageFlags stage;
   VkAccessFlags access;
+  // Queue family owning the resource, or `VK_QUEUE_FAMILY_IGNORED` if it has
+  // never been used on the device.
+  uint32_t qfam_idx;
 };
 struct Buffer : public Buffer_ {
   const Context* ctxt; // Lifetime bound.
   sys::BufferRef buf;
   BufferConfig buf_cfg;
+  // Property flags of the memory type the buffer is allocated from.
+  VkMemoryPropertyFlags mem_prop_flags;
+  MemoryCategory mem_cat;
+  // Size of the underlying allocation in bytes, or zero if the memory is not
+  // owned by the buffer.
+  size_t mem_size;
+  // Kept to re-create the buffer when it's relocated by defragmentation.
+  VkBufferCreateInfo bci;
+  // Memory shared with other resources the buffer is placed in, if any.
+  AliasedMemoryRef aliased_mem;
+  // Indices in the global bindless arrays the buffer is registered to.
+  std::map<BindlessBinding, uint32_t> bindless_idxs;
   BufferDynamicDetail dyn_detail;
 
   static bool create(const Context& ctxt, const BufferConfig& cfg, Buffer& out);
+  // Memory requirements of a buffer to be placed in aliased memory.
+  static bool get_aliased_mem_req(
+    const Context& ctxt,
+    const BufferConfig& cfg,
+    VkMemoryRequirements& out);
+  // Create a device-only buffer placed in `mem` at `offset`.
+  static bool create_aliased(
+    const Context& ctxt,
+    const BufferConfig& cfg,
+    const AliasedMemoryRef& mem,
+    size_t offset,
+    Buffer& out);
   ~Buffer();
 
   virtual const BufferConfig& cfg() const override final;
@@ -208,6 +655,9 @@ struct Buffer : public Buffer_ {
   virtual void unmap(void* mapped) override final;
 
   virtual BufferView view(size_t offset, size_t size) const override final;
+
+  virtual uint32_t get_bindless_idx() const override final;
+  virtual uint64_t get_dev_addr() const override final;
 };
 
 
@@ -216,15 +666,38 @@ struct ImageDynamicDetail {
   VkPipelineStageFlags stage;
   VkAccessFlags access;
   VkImageLayout layout;
+  uint32_t qfam_idx;
 };
 struct Image : public Image_ {
   const Context* ctxt; // Lifetime bound.
   sys::ImageRef img;
   sys::ImageViewRef img_view;
   ImageConfig img_cfg;
+  // Size of the underlying allocation in bytes, or zero if the memory is not
+  // owned by the image.
+  size_t mem_size;
+  // Memory shared with other resources the image is placed in, if any.
+  AliasedMemoryRef aliased_mem;
+  // Kept to re-create the image when it's relocated by defragmentation.
+  VkImageCreateInfo ici;
+  VkImageViewCreateInfo ivci;
+  // Indices in the global bindless arrays the image is registered to.
+  std::map<BindlessBinding, uint32_t> bindless_idxs;
   ImageDynamicDetail dyn_detail;
 
   static bool create(const Context& ctxt, const ImageConfig& cfg, Image& out);
+  // Memory requirements of an image to be placed in aliased memory.
+  static bool get_aliased_mem_req(
+    const Context& ctxt,
+    const ImageConfig& cfg,
+    VkMemoryRequirements& out);
+  // Create an image placed in `mem` at `offset`.
+  static bool create_aliased(
+    const Context& ctxt,
+    const ImageConfig& cfg,
+    const AliasedMemoryRef& mem,
+    size_t offset,
+    Image& out);
   ~Image();
 
   virtual const ImageConfig& cfg() const override final;
@@ -237,6 +710,9 @@ struct Image : public Image_ {
     uint32_t depth,
     ImageSampler sampler
   ) const override final;
+
+  virtual uint32_t get_bindless_sampled_idx() const override final;
+  virtual uint32_t get_bindless_storage_idx() const override final;
 };
 
 
@@ -245,15 +721,23 @@ struct DepthImageDynamicDetail {
   VkPipelineStageFlags stage;
   VkAccessFlags access;
   VkImageLayout layout;
+  uint32_t qfam_idx;
 };
 struct DepthImage : public DepthImage_ {
   const Context* ctxt; // Lifetime bound.
   sys::ImageRef img;
   sys::ImageViewRef img_view;
   DepthImageConfig depth_img_cfg;
+  // Size of the underlying allocation in bytes.
+  size_t mem_size;
   DepthImageDynamicDetail dyn_detail;
 
   static bool create(const Context& ctxt, const DepthImageConfig& cfg, DepthImage& out);
+  // Memory requirements of a depth image to be placed in aliased memory.
+  static bool get_aliased_mem_req(
+    const Context& ctxt,
+    const DepthImageConfig& cfg,
+    VkMemoryRequirements& out);
   ~DepthImage();
 
   virtual const DepthImageConfig& cfg() const override final;
@@ -273,6 +757,8 @@ struct SwapchainDynamicDetail {
   uint32_t height;
   std::vector<Image> imgs;
   std::unique_ptr<uint32_t> img_idx;
+  // Semaphores waited by the last presentation of each image.
+  std::vector<SemaphorePoolItem> present_semas;
 };
 struct Swapchain : public Swapchain_ {
   const Context* ctxt;
@@ -290,15 +776,24 @@ struct Swapchain : public Swapchain_ {
 
 
 
+// Maximal number of attachments of a framebuffer.
+constexpr uint32_t MAX_FRAMEBUF_NATTM = 16;
 struct FramebufferKey {
-  std::string inner;
+  VkRenderPass pass;
+  // Attachment image views. Handles after `nattm` are null.
+  uint32_t nattm;
+  std::array<VkImageView, MAX_FRAMEBUF_NATTM> attms;
 
   static FramebufferKey create(
     const RenderPass& pass,
     const std::vector<ResourceView>& rsc_views);
 
-  friend inline bool operator<(const FramebufferKey& a, const FramebufferKey& b) {
-    return a.inner < b.inner;
+  inline uint64_t hash() const {
+    return hash_map::hash_bytes(attms.data(), nattm * sizeof(VkImageView),
+      hash_map::hash_bytes(&pass, sizeof(VkRenderPass)));
+  }
+  friend inline bool operator==(const FramebufferKey& a, const FramebufferKey& b) {
+    return a.pass == b.pass && a.nattm == b.nattm && a.attms == b.attms;
   }
 };
 
@@ -324,6 +819,19 @@ struct RenderPass {
 struct TaskResourceDetail {
   sys::PipelineLayoutRef pipe_layout;
   std::vector<ResourceType> rsc_tys;
+  // Whether the global bindless descriptor set is bound at set 1.
+  bool is_bindless;
+  uint32_t push_const_size;
+  VkShaderStageFlags push_const_stage;
+};
+// Configs of a capturable task. Code pointers in the configs are cleared and
+// the code is owned here instead.
+struct TaskCaptureDetail {
+  ComputeTaskConfig comp_cfg;
+  GraphicsTaskConfig graph_cfg;
+  std::vector<uint8_t> code;
+  std::vector<uint8_t> vert_code;
+  std::vector<uint8_t> frag_code;
 };
 struct Task {
   std::string label;
@@ -333,6 +841,8 @@ struct Task {
   sys::PipelineRef pipe;
   DispatchSize workgrp_size; // Only for compute task.
   TaskResourceDetail rsc_detail;
+  // Only if the context is capturable.
+  std::unique_ptr<TaskCaptureDetail> capture_detail;
 
   static bool create(const Context& ctxt, const ComputeTaskConfig& cfg, Task& out);
   static bool create(const RenderPass& pass, const GraphicsTaskConfig& cfg, Task& out);
@@ -341,17 +851,70 @@ struct Task {
 
 
 
+// Reference to a resource held by an invocation. The resource is not relocated
+// by defragmentation while any reference to it lives.
+template<typename TRef>
+struct DefragmentationPin {
+  Context* ctxt; // Lifetime bound.
+  TRef rsc;
+
+  DefragmentationPin() : ctxt(nullptr), rsc(nullptr) {}
+  DefragmentationPin(const Context& ctxt, TRef rsc) :
+    ctxt(const_cast<Context*>(&ctxt)), rsc(std::move(rsc))
+  {
+    pin();
+  }
+  DefragmentationPin(const DefragmentationPin& b) : ctxt(b.ctxt), rsc(b.rsc) {
+    pin();
+  }
+  DefragmentationPin(DefragmentationPin&& b) :
+    ctxt(std::exchange(b.ctxt, nullptr)), rsc(std::move(b.rsc)) {}
+  ~DefragmentationPin() { unpin(); }
+
+  DefragmentationPin& operator=(DefragmentationPin b) {
+    std::swap(ctxt, b.ctxt);
+    std::swap(rsc, b.rsc);
+    return *this;
+  }
+
+  inline void pin() {
+    if (ctxt == nullptr || rsc == nullptr || rsc->alloc == VK_NULL_HANDLE) {
+      return;
+    }
+    ContextDefragmentationDetail& defrag_detail = ctxt->defrag_detail;
+    defrag_detail.npins[rsc->alloc] += 1;
+    if (defrag_detail.is_pass_pending) {
+      defrag_detail.pending_pinned_allocs.insert(rsc->alloc);
+    }
+  }
+  inline void unpin() {
+    if (ctxt == nullptr || rsc == nullptr || rsc->alloc == VK_NULL_HANDLE) {
+      return;
+    }
+    auto it = ctxt->defrag_detail.npins.find(rsc->alloc);
+    if (--it->second == 0) {
+      ctxt->defrag_detail.npins.erase(it);
+    }
+  }
+};
+
 struct InvocationTransitionDetail {
   std::vector<std::pair<BufferView, BufferUsage>> buf_transit;
   std::vector<std::pair<ImageView, ImageUsage>> img_transit;
   std::vector<std::pair<DepthImageView, DepthImageUsage>> depth_img_transit;
+  // Hold the resources so they are not relocated by defragmentation while
+  // being referenced.
+  std::vector<DefragmentationPin<sys::BufferRef>> buf_refs;
+  std::vector<DefragmentationPin<sys::ImageRef>> img_refs;
 
   inline void reg(BufferView buf_view, BufferUsage usage) {
+    buf_refs.emplace_back(*buf_view.buf->ctxt, buf_view.buf->buf);
     buf_transit.emplace_back(
       std::make_pair<BufferView, BufferUsage>(
         std::move(buf_view), std::move(usage)));
   }
   inline void reg(ImageView img_view, ImageUsage usage) {
+    img_refs.emplace_back(*img_view.img->ctxt, img_view.img->img);
     img_transit.emplace_back(
       std::make_pair<ImageView, ImageUsage>(
         std::move(img_view), std::move(usage)));
@@ -363,35 +926,79 @@ struct InvocationTransitionDetail {
   }
 };
 struct InvocationCopyBufferToBufferDetail {
-  VkBufferCopy bc;
+  std::vector<VkBufferCopy> bcs;
   sys::BufferRef src;
   sys::BufferRef dst;
 };
 struct InvocationCopyBufferToImageDetail {
-  VkBufferImageCopy bic;
+  std::vector<VkBufferImageCopy> bics;
   sys::BufferRef src;
   sys::ImageRef dst;
 };
 struct InvocationCopyImageToBufferDetail {
-  VkBufferImageCopy bic;
+  std::vector<VkBufferImageCopy> bics;
   sys::ImageRef src;
   sys::BufferRef dst;
 };
 struct InvocationCopyImageToImageDetail {
-  VkImageCopy ic;
+  std::vector<VkImageCopy> ics;
   sys::ImageRef src;
   sys::ImageRef dst;
 };
+struct InvocationBlitImageDetail {
+  std::vector<VkImageBlit> ibs;
+  VkFilter filter;
+  sys::ImageRef src;
+  sys::ImageRef dst;
+};
+struct InvocationFillBufferDetail {
+  sys::BufferRef dst;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+  uint32_t value;
+};
+struct InvocationUpdateBufferDetail {
+  sys::BufferRef dst;
+  VkDeviceSize offset;
+  std::vector<uint8_t> data;
+};
+struct InvocationUploadBufferDetail {
+  sys::BufferRef src;
+  sys::BufferRef dst;
+  std::vector<VkBufferCopy> bcs;
+};
+struct InvocationUploadImageDetail {
+  sys::BufferRef src;
+  sys::ImageRef dst;
+  std::vector<VkBufferImageCopy> bics;
+};
+struct InvocationUploadDetail {
+  // Staging chunks holding packed host data.
+  std::vector<std::unique_ptr<Buffer>> stage_bufs;
+  // Copy regions grouped by staging chunk and destination, so that each group
+  // is copied in a single command.
+  std::vector<InvocationUploadBufferDetail> buf_uploads;
+  std::vector<InvocationUploadImageDetail> img_uploads;
+};
 struct InvocationComputeDetail {
   const Task* task;
   VkPipelineBindPoint bind_pt;
   DescriptorSetPoolItem desc_set;
+  // Resources bound to `desc_set`, kept to write descriptors on rebinding.
+  std::vector<ResourceView> rsc_views;
+  std::vector<uint8_t> push_consts;
   DispatchSize workgrp_count;
+  // Indirect dispatch parameters; `nullptr` if dispatched directly.
+  sys::BufferRef indirect_buf;
+  VkDeviceSize indirect_buf_offset;
 };
 struct InvocationGraphicsDetail {
   const Task* task;
   VkPipelineBindPoint bind_pt;
   DescriptorSetPoolItem desc_set;
+  // Resources bound to `desc_set`, kept to write descriptors on rebinding.
+  std::vector<ResourceView> rsc_views;
+  std::vector<uint8_t> push_consts;
   std::vector<sys::BufferRef> vert_bufs;
   std::vector<VkDeviceSize> vert_buf_offsets;
   sys::BufferRef idx_buf;
@@ -400,24 +1007,103 @@ struct InvocationGraphicsDetail {
   uint32_t nvert;
   IndexType idx_ty;
   uint32_t nidx;
+  // Indirect draw parameters; `nullptr` if drawn directly.
+  sys::BufferRef indirect_buf;
+  VkDeviceSize indirect_buf_offset;
+  uint32_t ndraw;
+  sys::BufferRef count_buf;
+  VkDeviceSize count_buf_offset;
 };
 struct InvocationRenderPassDetail {
   const RenderPass* pass;
   FramebufferPoolItem framebuf;
   std::vector<sys::ImageViewRef> attms;
-  bool is_baked;
   std::vector<const Invocation*> subinvokes;
+  // Transitions of the attachments alone, to which subinvocation transitions
+  // are merged again when subinvocations are rebound.
+  InvocationTransitionDetail attm_transit_detail;
 };
 struct InvocationPresentDetail {
   const Swapchain* swapchain;
 };
 struct InvocationCompositeDetail {
   std::vector<const Invocation*> subinvokes;
+  // Resources whose previous content and access states are discarded before
+  // the invocation is recorded.
+  std::vector<const Buffer*> discard_bufs;
+  std::vector<const Image*> discard_imgs;
+  std::vector<const DepthImage*> discard_depth_imgs;
+  // `true` if the subinvocations are recorded to the async compute queue.
+  bool is_async;
 };
 struct InvocationBakingDetail {
   CommandPoolPoolItem cmd_pool;
   sys::CommandBufferRef cmdbuf;
 };
+// Access state of a resource referenced by baked primary command buffers, and
+// the handle the commands were recorded with.
+struct InvocationBufferState {
+  const Buffer* buf;
+  VkBuffer handle;
+  BufferDynamicDetail dyn_detail;
+};
+struct InvocationImageState {
+  const Image* img;
+  VkImageView handle;
+  ImageDynamicDetail dyn_detail;
+};
+struct InvocationDepthImageState {
+  const DepthImage* depth_img;
+  VkImageView handle;
+  DepthImageDynamicDetail dyn_detail;
+};
+struct InvocationResourceStateDetail {
+  std::vector<InvocationBufferState> buf_states;
+  std::vector<InvocationImageState> img_states;
+  std::vector<InvocationDepthImageState> depth_img_states;
+};
+struct InvocationPrimaryBakingDetail {
+  // Primary command buffers submitted in order when the invocation is
+  // submitted.
+  std::vector<TransactionSubmitDetail> submit_details;
+  std::vector<CommandPoolPoolItem> secondary_cmd_pools;
+  // Resource states before and after the baked commands. The commands are
+  // baked again if the resources are not in the initial states, or have been
+  // recreated, by the time the invocation is submitted.
+  InvocationResourceStateDetail init_states;
+  InvocationResourceStateDetail final_states;
+};
+// Config a capturable invocation is created with. Only the one of the
+// invocation type is set. Upload data is copied since it only lives until the
+// invocation is created. Resources, workgroup counts and push constants are
+// captured from the invocation details as they might have been rebound.
+struct InvocationCaptureDetail {
+  TransferInvocationConfig transfer_cfg;
+  FillInvocationConfig fill_cfg;
+  UpdateInvocationConfig update_cfg;
+  UploadInvocationConfig upload_cfg;
+  std::vector<std::vector<uint8_t>> upload_data;
+  ComputeInvocationConfig comp_cfg;
+  GraphicsInvocationConfig graph_cfg;
+  RenderPassInvocationConfig pass_cfg;
+  CompositeInvocationConfig composite_cfg;
+};
+struct InvocationPipelineStatisticsDetail {
+  sys::QueryPoolRef query_pool;
+  // Statistics are written in the order of the flag bits.
+  VkQueryPipelineStatisticFlags flags;
+};
+struct InvocationPerformanceQueryDetail {
+  sys::QueryPoolRef query_pool;
+  uint32_t qfam_idx;
+  // Queue timeline values when the queries were last submitted; empty if they
+  // have never been submitted. The pool is reset on the host only after the
+  // device has passed them.
+  std::vector<uint64_t> timeline_values;
+  // Indices of the counters in `ContextPerformanceQueryDetail::counters` of
+  // the queue family.
+  std::vector<uint32_t> icounters;
+};
 struct Invocation : public Invocation_ {
   std::string label;
   // Execution context of the invocation.
@@ -428,6 +1114,10 @@ struct Invocation : public Invocation_ {
   std::unique_ptr<InvocationCopyBufferToImageDetail> b2i_detail;
   std::unique_ptr<InvocationCopyImageToBufferDetail> i2b_detail;
   std::unique_ptr<InvocationCopyImageToImageDetail> i2i_detail;
+  std::unique_ptr<InvocationBlitImageDetail> blit_detail;
+  std::unique_ptr<InvocationFillBufferDetail> fill_detail;
+  std::unique_ptr<InvocationUpdateBufferDetail> update_detail;
+  std::unique_ptr<InvocationUploadDetail> upload_detail;
   std::unique_ptr<InvocationComputeDetail> comp_detail;
   std::unique_ptr<InvocationGraphicsDetail> graph_detail;
   std::unique_ptr<InvocationRenderPassDetail> pass_detail;
@@ -437,11 +1127,36 @@ struct Invocation : public Invocation_ {
   InvocationTransitionDetail transit_detail;
   // Query pool for device-side timing, if required.
   QueryPoolPoolItem query_pool;
-  // Baking artifacts. Currently we don't support baking render pass invocations
-  // and those with switching submit types.
+  // Query pools of compute and graphics invocations for device-side counters,
+  // if required.
+  std::unique_ptr<InvocationPipelineStatisticsDetail> pipe_stats_detail;
+  std::unique_ptr<InvocationPerformanceQueryDetail> perf_query_detail;
+  // Secondary command buffer the invocation is baked into with `bake`. Render
+  // passes cannot begin in secondary command buffers, so they are only baked
+  // into primary command buffers with `bake_primary`. Composites switching
+  // submit types are not baked.
   std::unique_ptr<InvocationBakingDetail> bake_detail;
+  // Primary command buffers of the entire invocation tree, including render
+  // passes, if it's baked with `bake_primary`.
+  std::unique_ptr<InvocationPrimaryBakingDetail> primary_bake_detail;
+  // Bytes written by the transfer commands of the invocation and its
+  // subinvocations.
+  size_t transfer_size;
+  // Bytes of host data the invocation and its subinvocations write to the
+  // device each time they are submitted.
+  size_t upload_size;
+  // Number of times the invocation has been rebound, and the sum of the
+  // generations of the invocation and its subinvocations when transitions
+  // and baking artifacts were last updated.
+  uint64_t gen;
+  uint64_t synced_gen;
+  // Only if the context is capturable.
+  std::unique_ptr<InvocationCaptureDetail> capture_detail;
 
   static bool create(const Context& ctxt, const TransferInvocationConfig& cfg, Invocation& out);
+  static bool create(const Context& ctxt, const FillInvocationConfig& cfg, Invocation& out);
+  static bool create(const Context& ctxt, const UpdateInvocationConfig& cfg, Invocation& out);
+  static bool create(const Context& ctxt, const UploadInvocationConfig& cfg, Invocation& out);
   static bool create(const Task& task, const ComputeInvocationConfig& cfg, Invocation& out);
   static bool create(const Task& task, const GraphicsInvocationConfig& cfg, Invocation& out);
   static bool create(const RenderPass& pass, const RenderPassInvocationConfig& cfg, Invocation& out);
@@ -452,8 +1167,81 @@ struct Invocation : public Invocation_ {
   void record(TransactionLike& transact) const;
 
   virtual double get_time_us() const override final;
+  virtual double get_async_overlap_us() const override final;
+  virtual InvocationPipelineStatistics get_pipe_stats() const override final;
+  virtual std::vector<InvocationPerformanceCounter> get_perf_counters() const override final;
   virtual void bake() override final;
+  virtual void bake_primary() override final;
+
+  virtual void rebind_rsc(uint32_t i, const ResourceView& rsc_view) override final;
+  virtual void rebind_workgrp_count(const DispatchSize& workgrp_count) override final;
+  virtual void rebind_push_consts(const std::vector<uint8_t>& push_consts) override final;
+};
+
+struct ProfilerScopeDetail {
+  std::string label;
+  uint32_t iparent;
 };
+// Timestamps of a frame. Scope `i` is timed by queries `2 * i` and
+// `2 * i + 1`.
+struct ProfilerFrameDetail {
+  sys::QueryPoolRef query_pool;
+  // Sized to the maximal number of scopes so that scopes can be written from
+  // multiple recording threads.
+  std::vector<ProfilerScopeDetail> scopes;
+  // Number of scopes reserved in this frame.
+  uint32_t nscope;
+  // Timeline values to pass before the results are available.
+  std::vector<uint64_t> timeline_values;
+};
+struct ProfilerScopeStatisticsDetail {
+  std::string path;
+  uint32_t depth;
+  uint64_t nsample;
+  stats::AvgStats<double> avg_time_us;
+  stats::MinStats<double> min_time_us;
+  stats::MaxStats<double> max_time_us;
+};
+struct Profiler : public Profiler_ {
+  const Context* ctxt;
+  ProfilerConfig profiler_cfg;
+  // Ring of frames; `iframe` is the one being recorded.
+  std::vector<ProfilerFrameDetail> frames;
+  uint32_t iframe;
+  double ns_per_tick;
+  uint64_t nframe;
+  uint64_t nscope_dropped;
+  std::vector<ProfilerScopeStatisticsDetail> scope_stats;
+  // Statistics index of each scope keyed by the index of the parent scope's
+  // statistics and the scope label.
+  std::map<std::pair<uint32_t, std::string>, uint32_t> scope_stat_idxs;
+
+  static bool create(const Context& ctxt, const ProfilerConfig& cfg, Profiler& out);
+  ~Profiler();
+
+  // Reserve `nscope` consecutive scopes in the current frame and return the
+  // first one; `NO_PROFILER_SCOPE` if the frame has run out of queries. The
+  // queries are reset in `cmdbuf`, which MUST NOT be in a render pass.
+  uint32_t reserve_scopes(VkCommandBuffer cmdbuf, uint32_t nscope);
+  // Write the begin and end timestamps of a reserved scope. Different scopes
+  // can be written from different threads.
+  void begin_scope(
+    VkCommandBuffer cmdbuf,
+    uint32_t iscope,
+    uint32_t iparent,
+    const std::string& label);
+  void end_scope(VkCommandBuffer cmdbuf, uint32_t iscope);
+
+  virtual const ProfilerConfig& cfg() const override final;
+  virtual void next_frame() override final;
+  virtual ProfilerStatistics get_stats() const override final;
+  virtual void reset_stats() override final;
+};
+
+// Write the invocation tree, the code of its tasks and the content of the
+// resources it references to a zip archive at `path`. The archive layout is
+// described in `gft/hal/capture.hpp`.
+bool capture_invoke(const Invocation& invoke, const std::string& path);
 
 } // namespace vk
 } // namespace liong
@@ -0,0 +1,103 @@
+#include "gft/thread-pool.hpp"
+#include <utility>
+
+namespace liong {
+namespace thread_pool {
+
+ThreadPool::ThreadPool(uint32_t nthread) :
+  workers(),
+  dispatch_mutex(),
+  mutex(),
+  job_cv(),
+  done_cv(),
+  job(nullptr),
+  njob(0),
+  next_ijob(0),
+  ndone(0),
+  exception(),
+  should_exit(false)
+{
+  workers.reserve(nthread);
+  for (uint32_t i = 0; i < nthread; ++i) {
+    workers.emplace_back([this]() { worker_main(); });
+  }
+}
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    should_exit = true;
+  }
+  job_cv.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::run_jobs(std::unique_lock<std::mutex>& lock) {
+  while (next_ijob < njob) {
+    size_t ijob = next_ijob++;
+    const std::function<void(size_t)>& job2 = *job;
+
+    lock.unlock();
+    std::exception_ptr e;
+    try {
+      job2(ijob);
+    } catch (...) {
+      e = std::current_exception();
+    }
+    lock.lock();
+
+    if (e != nullptr) {
+      if (exception == nullptr) {
+        exception = std::move(e);
+      }
+      // Skip the jobs not yet started.
+      ndone += njob - next_ijob;
+      next_ijob = njob;
+    }
+    if (++ndone == njob) {
+      done_cv.notify_all();
+    }
+  }
+}
+void ThreadPool::worker_main() {
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    job_cv.wait(lock, [this]() { return should_exit || next_ijob < njob; });
+    if (should_exit) { return; }
+    run_jobs(lock);
+  }
+}
+
+void ThreadPool::parallel_for(
+  size_t njob,
+  const std::function<void(size_t)>& job
+) {
+  if (njob == 0) { return; }
+
+  std::lock_guard<std::mutex> dispatch_guard(dispatch_mutex);
+  std::unique_lock<std::mutex> lock(mutex);
+  this->job = &job;
+  this->njob = njob;
+  next_ijob = 0;
+  ndone = 0;
+  job_cv.notify_all();
+
+  // The calling thread takes part in the work too.
+  run_jobs(lock);
+  done_cv.wait(lock, [this]() { return ndone == this->njob; });
+
+  this->job = nullptr;
+  this->njob = 0;
+  next_ijob = 0;
+  ndone = 0;
+  std::exception_ptr e = std::exchange(exception, nullptr);
+  lock.unlock();
+
+  if (e != nullptr) {
+    std::rethrow_exception(e);
+  }
+}
+
+} // namespace thread_pool
+} // namespace liong
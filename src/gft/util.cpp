@@ -2,6 +2,9 @@
 #include "gft/assert.hpp"
 #include <chrono>
 #include <thread>
+#ifdef _WIN32
+#include <malloc.h>
+#endif // _WIN32
 
 namespace liong {
 
@@ -97,6 +100,23 @@ void sleep_for_us(uint64_t t) {
   std::this_thread::sleep_for(std::chrono::microseconds(t));
 }
 
+void* alloc_aligned(size_t size, size_t align) {
+  size = align_up(size, align);
+#ifdef _WIN32
+  return _aligned_malloc(size, align);
+#else
+  void* out = nullptr;
+  return posix_memalign(&out, align, size) == 0 ? out : nullptr;
+#endif // _WIN32
+}
+void free_aligned(void* ptr) {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif // _WIN32
+}
+
 bool starts_with(const std::string& start, const std::string& str) {
   if (str.size() < start.size()) { return false; }
   for (size_t i = 0; i < start.size(); ++i) {
@@ -0,0 +1,48 @@
+#include "gft/vk.hpp"
+#include "gft/log.hpp"
+
+namespace liong {
+namespace vk {
+
+bool AliasedMemory::create(
+  const Context& ctxt,
+  const std::string& label,
+  const VkMemoryRequirements& mr,
+  AliasedMemory& out
+) {
+  if (!const_cast<Context&>(ctxt).alloc_mem(L_MEMORY_CATEGORY_ALIASED,
+    mr.size)
+  ) {
+    L_ERROR("failed to create aliased memory '", label, "'");
+    return false;
+  }
+
+  VmaAllocationCreateInfo aci {};
+  aci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+  VmaAllocation alloc = VK_NULL_HANDLE;
+  VkResult res = vmaAllocateMemory(*ctxt.allocator, &mr, &aci, &alloc,
+    nullptr);
+  if (res != VK_SUCCESS) {
+    const_cast<Context&>(ctxt).free_mem(L_MEMORY_CATEGORY_ALIASED, mr.size);
+    L_ERROR("failed to allocate ", mr.size, " bytes of aliased memory '",
+      label, "'");
+    return false;
+  }
+
+  out.ctxt = &ctxt;
+  out.alloc = alloc;
+  out.size = mr.size;
+  L_DEBUG("created aliased memory '", label, "' of ", mr.size, " bytes");
+  return true;
+}
+AliasedMemory::~AliasedMemory() {
+  if (alloc != VK_NULL_HANDLE) {
+    vmaFreeMemory(*ctxt->allocator, alloc);
+    const_cast<Context*>(ctxt)->free_mem(L_MEMORY_CATEGORY_ALIASED, size);
+    L_DEBUG("destroyed aliased memory of ", size, " bytes");
+  }
+}
+
+} // namespace vk
+} // namespace liong
@@ -0,0 +1,159 @@
+#include "gft/vk.hpp"
+#include "gft/log.hpp"
+
+namespace liong {
+namespace vk {
+
+// Number of descriptors in each bindless array. It's well below the minimal
+// update-after-bind limits required by descriptor indexing.
+constexpr uint32_t BINDLESS_ARRAY_SIZE = 16384;
+
+constexpr VkDescriptorType BINDLESS_DESC_TYS[] = {
+  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+  VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+  VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+};
+
+const ContextBindlessDetail& Context::get_bindless_detail() {
+  if (bindless_detail.desc_set != nullptr) { return bindless_detail; }
+  L_ASSERT(bindless_detail.is_supported, "context '", label, "' doesn't "
+    "support bindless resources");
+
+  const uint32_t nbinding = (uint32_t)bindless_detail.arrs.size();
+  std::vector<VkDescriptorSetLayoutBinding> dslbs(nbinding);
+  std::vector<VkDescriptorBindingFlagsEXT> dbfs(nbinding);
+  std::vector<VkDescriptorPoolSize> dpss(nbinding);
+  for (uint32_t i = 0; i < nbinding; ++i) {
+    VkDescriptorSetLayoutBinding& dslb = dslbs[i];
+    dslb.binding = i;
+    dslb.descriptorType = BINDLESS_DESC_TYS[i];
+    dslb.descriptorCount = BINDLESS_ARRAY_SIZE;
+    dslb.stageFlags = VK_SHADER_STAGE_ALL;
+
+    dbfs[i] =
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+
+    VkDescriptorPoolSize& dps = dpss[i];
+    dps.type = BINDLESS_DESC_TYS[i];
+    dps.descriptorCount = BINDLESS_ARRAY_SIZE;
+  }
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfoEXT dslbfci {};
+  dslbfci.sType =
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+  dslbfci.bindingCount = nbinding;
+  dslbfci.pBindingFlags = dbfs.data();
+
+  VkDescriptorSetLayoutCreateInfo dslci {};
+  dslci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  dslci.pNext = &dslbfci;
+  dslci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+  dslci.bindingCount = nbinding;
+  dslci.pBindings = dslbs.data();
+  sys::DescriptorSetLayoutRef desc_set_layout =
+    sys::DescriptorSetLayout::create(*dev, &dslci);
+
+  VkDescriptorPoolCreateInfo dpci {};
+  dpci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  dpci.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+  dpci.maxSets = 1;
+  dpci.poolSizeCount = nbinding;
+  dpci.pPoolSizes = dpss.data();
+  sys::DescriptorPoolRef desc_pool = sys::DescriptorPool::create(*dev, &dpci);
+
+  VkDescriptorSetAllocateInfo dsai {};
+  dsai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  dsai.descriptorPool = desc_pool->desc_pool;
+  dsai.descriptorSetCount = 1;
+  dsai.pSetLayouts = &desc_set_layout->desc_set_layout;
+  sys::DescriptorSetRef desc_set = sys::DescriptorSet::create(*dev, &dsai);
+
+  alloc_descs(nbinding * BINDLESS_ARRAY_SIZE);
+
+  bindless_detail.desc_set_layout = std::move(desc_set_layout);
+  bindless_detail.desc_pool = std::move(desc_pool);
+  bindless_detail.desc_set = std::move(desc_set);
+  L_DEBUG("created bindless descriptor set for context '", label, "'");
+  return bindless_detail;
+}
+
+uint32_t Context::alloc_bindless_idx(BindlessBinding binding) {
+  get_bindless_detail();
+  ContextBindlessArrayDetail& arr = bindless_detail.arrs.at(binding);
+
+  if (!arr.free_idxs.empty()) {
+    uint32_t idx = arr.free_idxs.back();
+    arr.free_idxs.pop_back();
+    return idx;
+  }
+  L_ASSERT(arr.nidx < BINDLESS_ARRAY_SIZE, "bindless array #", binding,
+    " of context '", label, "' is full");
+  return arr.nidx++;
+}
+void Context::free_bindless_idx(BindlessBinding binding, uint32_t idx) {
+  // The stale descriptor is never accessed because the array is partially
+  // bound.
+  bindless_detail.arrs.at(binding).free_idxs.emplace_back(idx);
+}
+
+void Context::write_bindless_desc(
+  BindlessBinding binding,
+  uint32_t idx,
+  const Buffer& buf
+) {
+  L_ASSERT(binding == L_BINDLESS_BINDING_STORAGE_BUFFER);
+
+  VkDescriptorBufferInfo dbi {};
+  dbi.buffer = buf.buf->buf;
+  dbi.offset = 0;
+  dbi.range = VK_WHOLE_SIZE;
+
+  VkWriteDescriptorSet wds {};
+  wds.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  wds.dstSet = bindless_detail.desc_set->desc_set;
+  wds.dstBinding = binding;
+  wds.dstArrayElement = idx;
+  wds.descriptorCount = 1;
+  wds.descriptorType = BINDLESS_DESC_TYS[binding];
+  wds.pBufferInfo = &dbi;
+  vkUpdateDescriptorSets(*dev, 1, &wds, 0, nullptr);
+  record_stats.ndesc_write += 1;
+
+  L_DEBUG("bound bindless resource #", idx, " to buffer '",
+    buf.buf_cfg.label, "'");
+}
+void Context::write_bindless_desc(
+  BindlessBinding binding,
+  uint32_t idx,
+  const Image& img
+) {
+  VkDescriptorImageInfo dii {};
+  dii.imageView = img.img_view->img_view;
+  if (binding == L_BINDLESS_BINDING_SAMPLED_IMAGE) {
+    dii.sampler = img_samplers.at(L_IMAGE_SAMPLER_LINEAR)->sampler;
+    dii.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  } else if (binding == L_BINDLESS_BINDING_STORAGE_IMAGE) {
+    dii.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  } else {
+    unreachable();
+  }
+
+  VkWriteDescriptorSet wds {};
+  wds.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  wds.dstSet = bindless_detail.desc_set->desc_set;
+  wds.dstBinding = binding;
+  wds.dstArrayElement = idx;
+  wds.descriptorCount = 1;
+  wds.descriptorType = BINDLESS_DESC_TYS[binding];
+  wds.pImageInfo = &dii;
+  vkUpdateDescriptorSets(*dev, 1, &wds, 0, nullptr);
+  record_stats.ndesc_write += 1;
+
+  L_DEBUG("bound bindless resource #", idx, " to image '",
+    img.img_cfg.label, "'");
+}
+
+} // namespace vk
+} // namespace liong
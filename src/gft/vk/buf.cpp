@@ -15,10 +15,162 @@ constexpr VmaMemoryUsage _host_access2vma_usage(MemoryAccess host_access) {
     return VMA_MEMORY_USAGE_CPU_ONLY;
   }
 }
-bool Buffer::create(
+VmaAllocationCreateInfo _make_buf_aci(
+  const Context& ctxt,
+  const BufferConfig& buf_cfg
+) {
+  const InstancePhysicalDeviceMemoryDetail& mem_detail =
+    ctxt.physdev_mem_detail();
+
+  // Staging buffers are only read once by transfers so they don't deserve the
+  // scarce device-local host-visible heap.
+  const BufferUsage transfer_usage =
+    L_BUFFER_USAGE_TRANSFER_SRC_BIT | L_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bool is_staging = (buf_cfg.usage & ~transfer_usage) == 0;
+
+  VmaAllocationCreateInfo aci {};
+  if (buf_cfg.host_access == L_MEMORY_ACCESS_WRITE_BIT && !is_staging &&
+    ctxt.can_write_directly(buf_cfg.size)
+  ) {
+    // Host writes land in device-local memory directly so the device reads
+    // at full speed and no staging copy is needed.
+    aci.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    aci.requiredFlags =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  } else if (buf_cfg.host_access == 0 &&
+    mem_detail.mem_arch == L_DEVICE_MEMORY_ARCHITECTURE_UNIFIED
+  ) {
+    // On unified memory architectures device-local memory is host-visible
+    // anyway; prefer such memory so the buffer can be written in place.
+    aci.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    aci.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    aci.preferredFlags =
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  } else {
+    aci.usage = _host_access2vma_usage(buf_cfg.host_access);
+  }
+  return aci;
+}
+// Wrap host memory as the buffer. Returns `false` if the host memory cannot be
+// imported, in which case the caller should fall back to a copy.
+bool _create_imported_buf(
   const Context& ctxt,
   const BufferConfig& buf_cfg,
+  const VkBufferCreateInfo& bci,
   Buffer& out
+) {
+  const ContextHostImportDetail& host_import_detail = ctxt.host_import_detail;
+  size_t align = host_import_detail.align;
+  if (align == 0) { return false; }
+  if ((size_t)buf_cfg.host_ptr % align != 0) {
+    L_WARN("host memory of buffer '", buf_cfg.label, "' is not aligned to ",
+      align, " bytes so it cannot be imported");
+    return false;
+  }
+
+  VkDevice dev = ctxt.dev->dev;
+  const VkExternalMemoryHandleTypeFlagBits handle_ty =
+    VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+  VkMemoryHostPointerPropertiesEXT mhpp {};
+  mhpp.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+  VkResult err = host_import_detail.get_mem_host_ptr_prop(dev, handle_ty,
+    buf_cfg.host_ptr, &mhpp);
+  if (err != VK_SUCCESS) {
+    L_WARN("host memory of buffer '", buf_cfg.label, "' cannot be imported");
+    return false;
+  }
+
+  VkExternalMemoryBufferCreateInfoKHR embci {};
+  embci.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO_KHR;
+  embci.handleTypes = handle_ty;
+  VkBufferCreateInfo bci2 = bci;
+  bci2.pNext = &embci;
+
+  VkBuffer buf = VK_NULL_HANDLE;
+  VK_ASSERT << vkCreateBuffer(dev, &bci2, nullptr, &buf);
+
+  VkMemoryRequirements mr {};
+  vkGetBufferMemoryRequirements(dev, buf, &mr);
+  VkDeviceSize alloc_size = util::align_up(buf_cfg.size, align);
+
+  // Only coherent memory types so that mapping needs no flush.
+  const VkPhysicalDeviceMemoryProperties& mem_prop = ctxt.physdev_mem_prop();
+  const VkMemoryPropertyFlags host_flags =
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  uint32_t mem_ty_bits = mr.memoryTypeBits & mhpp.memoryTypeBits;
+  uint32_t mem_ty_idx = VK_MAX_MEMORY_TYPES;
+  for (uint32_t i = 0; i < mem_prop.memoryTypeCount; ++i) {
+    if ((mem_ty_bits & (1u << i)) == 0) { continue; }
+    if ((mem_prop.memoryTypes[i].propertyFlags & host_flags) == host_flags) {
+      mem_ty_idx = i;
+      break;
+    }
+  }
+  if (mem_ty_idx == VK_MAX_MEMORY_TYPES || mr.size > alloc_size) {
+    vkDestroyBuffer(dev, buf, nullptr);
+    L_WARN("host memory of buffer '", buf_cfg.label, "' has no compatible "
+      "memory type");
+    return false;
+  }
+
+  VkImportMemoryHostPointerInfoEXT imhpi {};
+  imhpi.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+  imhpi.handleType = handle_ty;
+  imhpi.pHostPointer = buf_cfg.host_ptr;
+
+  // Memory bound to device-addressed buffers must be allocated addressable.
+  VkMemoryAllocateFlagsInfoKHR mafi {};
+  mafi.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+  mafi.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+  if (bci.usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR) {
+    imhpi.pNext = &mafi;
+  }
+
+  VkMemoryAllocateInfo mai {};
+  mai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mai.pNext = &imhpi;
+  mai.allocationSize = alloc_size;
+  mai.memoryTypeIndex = mem_ty_idx;
+
+  VkDeviceMemory devmem = VK_NULL_HANDLE;
+  err = vkAllocateMemory(dev, &mai, nullptr, &devmem);
+  if (err != VK_SUCCESS) {
+    vkDestroyBuffer(dev, buf, nullptr);
+    L_WARN("failed to import host memory of buffer '", buf_cfg.label, "'");
+    return false;
+  }
+  VK_ASSERT << vkBindBufferMemory(dev, buf, devmem, 0);
+
+  BufferDynamicDetail dyn_detail {};
+  dyn_detail.access = 0;
+  dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
+  dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
+
+  // The memory is owned by the host so it's not accounted for.
+  out.ctxt = &ctxt;
+  out.buf = std::make_shared<sys::Buffer>(*ctxt.allocator, buf,
+    VK_NULL_HANDLE, true);
+  // Invocations in flight hold the buffer, so they hold the memory too.
+  out.buf->host_mem = std::make_shared<sys::DeviceMemory>(dev, devmem, true);
+  out.buf_cfg = buf_cfg;
+  out.mem_prop_flags = mem_prop.memoryTypes[mem_ty_idx].propertyFlags;
+  out.mem_cat = L_MEMORY_CATEGORY_STAGING;
+  out.mem_size = 0;
+  out.bci = bci;
+  out.dyn_detail = std::move(dyn_detail);
+  const_cast<Context&>(ctxt).rsc_stats.nbuf_create += 1;
+  L_DEBUG("created buffer '", buf_cfg.label, "' from imported host memory");
+  return true;
+}
+bool _make_bci(
+  const Context& ctxt,
+  const BufferConfig& buf_cfg,
+  VkBufferCreateInfo& out
 ) {
   VkBufferCreateInfo bci {};
   bci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -50,26 +202,191 @@ bool Buffer::create(
       VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
       VK_BUFFER_USAGE_TRANSFER_DST_BIT;
   }
+  if (buf_cfg.usage & L_BUFFER_USAGE_INDIRECT_BIT) {
+    bci.usage |=
+      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  }
+  if (buf_cfg.usage & L_BUFFER_USAGE_DEVICE_ADDRESS_BIT) {
+    if (ctxt.dev_addr_detail.get_buf_dev_addr == nullptr) {
+      L_ERROR("cannot create buffer '", buf_cfg.label, "' with device address "
+        "usage because buffer device address is unsupported");
+      return false;
+    }
+    bci.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+  }
+  // Captured buffers are read back before submission.
+  if (ctxt.is_capturable) {
+    bci.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  }
   bci.size = buf_cfg.size;
 
-  VmaAllocationCreateInfo aci {};
-  aci.usage = _host_access2vma_usage(buf_cfg.host_access);
+  out = bci;
+  return true;
+}
+bool Buffer::create(
+  const Context& ctxt,
+  const BufferConfig& buf_cfg,
+  Buffer& out
+) {
+  VkBufferCreateInfo bci {};
+  if (!_make_bci(ctxt, buf_cfg, bci)) { return false; }
+
+  if (buf_cfg.host_ptr != nullptr) {
+    if (_create_imported_buf(ctxt, buf_cfg, bci, out)) { return true; }
+
+    // Fall back to a host-visible copy of the host memory.
+    BufferConfig buf_cfg2 = buf_cfg;
+    buf_cfg2.host_access |= L_MEMORY_ACCESS_READ_BIT | L_MEMORY_ACCESS_WRITE_BIT;
+    buf_cfg2.host_ptr = nullptr;
+    if (!Buffer::create(ctxt, buf_cfg2, out)) { return false; }
+    void* mapped = out.map(L_MEMORY_ACCESS_WRITE_BIT);
+    std::memcpy(mapped, buf_cfg.host_ptr, buf_cfg.size);
+    out.unmap(mapped);
+    return true;
+  }
+
+  // Host-accessed buffers used for nothing but transfers are staging buffers.
+  const BufferUsage transfer_usage =
+    L_BUFFER_USAGE_TRANSFER_SRC_BIT | L_BUFFER_USAGE_TRANSFER_DST_BIT;
+  MemoryCategory mem_cat =
+    buf_cfg.host_access != 0 && (buf_cfg.usage & ~transfer_usage) == 0 ?
+      L_MEMORY_CATEGORY_STAGING : L_MEMORY_CATEGORY_BUFFER;
+  // Charge the memory requirement like images do; it includes the padding
+  // the device needs beyond the requested size.
+  VkMemoryRequirements mr {};
+  if (!Buffer::get_aliased_mem_req(ctxt, buf_cfg, mr)) { return false; }
+  size_t mem_size = mr.size;
+  if (!const_cast<Context&>(ctxt).alloc_mem(mem_cat, mem_size)) {
+    L_ERROR("failed to create buffer '", buf_cfg.label, "'");
+    return false;
+  }
+
+  VmaAllocationCreateInfo aci = _make_buf_aci(ctxt, buf_cfg);
 
   sys::BufferRef buf = sys::Buffer::create(*ctxt.allocator, &bci, &aci);
 
+  VmaAllocationInfo ai {};
+  vmaGetAllocationInfo(*ctxt.allocator, buf->alloc, &ai);
+  VkMemoryPropertyFlags mem_prop_flags =
+    ctxt.physdev_mem_prop().memoryTypes[ai.memoryType].propertyFlags;
+
   BufferDynamicDetail dyn_detail {};
   dyn_detail.access = 0;
   dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
+  dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
 
   out.ctxt = &ctxt;
   out.buf = std::move(buf);
   out.buf_cfg = buf_cfg;
+  out.mem_prop_flags = mem_prop_flags;
+  out.mem_cat = mem_cat;
+  out.mem_size = mem_size;
+  out.bci = bci;
   out.dyn_detail = std::move(dyn_detail);
+  // Host-accessed buffers might be mapped and device-addressed buffers might be
+  // referenced by pointers so they can't be relocated.
+  if (buf_cfg.host_access == 0 &&
+    (buf_cfg.usage & L_BUFFER_USAGE_DEVICE_ADDRESS_BIT) == 0
+  ) {
+    const_cast<Context&>(ctxt).defrag_detail.bufs[out.buf->alloc] = &out;
+  }
+  const_cast<Context&>(ctxt).rsc_stats.nbuf_create += 1;
   L_DEBUG("created buffer '", buf_cfg.label, "'");
   return true;
 }
+bool Buffer::get_aliased_mem_req(
+  const Context& ctxt,
+  const BufferConfig& buf_cfg,
+  VkMemoryRequirements& out
+) {
+  VkBufferCreateInfo bci {};
+  if (!_make_bci(ctxt, buf_cfg, bci)) { return false; }
+
+  VkBuffer buf = VK_NULL_HANDLE;
+  VK_ASSERT << vkCreateBuffer(ctxt.dev->dev, &bci, nullptr, &buf);
+  vkGetBufferMemoryRequirements(ctxt.dev->dev, buf, &out);
+  vkDestroyBuffer(ctxt.dev->dev, buf, nullptr);
+  return true;
+}
+bool Buffer::create_aliased(
+  const Context& ctxt,
+  const BufferConfig& buf_cfg,
+  const AliasedMemoryRef& mem,
+  size_t offset,
+  Buffer& out
+) {
+  if (buf_cfg.host_access != 0 || buf_cfg.host_ptr != nullptr) {
+    L_ERROR("cannot place buffer '", buf_cfg.label, "' in aliased memory "
+      "because it's host-accessible");
+    return false;
+  }
+
+  VkBufferCreateInfo bci {};
+  if (!_make_bci(ctxt, buf_cfg, bci)) { return false; }
+
+  VkBuffer buf = VK_NULL_HANDLE;
+  VK_ASSERT << vkCreateBuffer(ctxt.dev->dev, &bci, nullptr, &buf);
+
+  VkMemoryRequirements mr {};
+  vkGetBufferMemoryRequirements(ctxt.dev->dev, buf, &mr);
+  if (offset % mr.alignment != 0 || offset + mr.size > mem->size) {
+    vkDestroyBuffer(ctxt.dev->dev, buf, nullptr);
+    L_ERROR("buffer '", buf_cfg.label, "' cannot be placed in aliased memory "
+      "at offset ", offset);
+    return false;
+  }
+  VK_ASSERT << vmaBindBufferMemory2(*ctxt.allocator, mem->alloc, offset, buf,
+    nullptr);
+
+  VmaAllocationInfo ai {};
+  vmaGetAllocationInfo(*ctxt.allocator, mem->alloc, &ai);
+  VkMemoryPropertyFlags mem_prop_flags =
+    ctxt.physdev_mem_prop().memoryTypes[ai.memoryType].propertyFlags;
+
+  BufferDynamicDetail dyn_detail {};
+  dyn_detail.access = 0;
+  dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
+  dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
+
+  // The memory is accounted for by the aliased memory. Aliasing buffers are
+  // never relocated.
+  out.ctxt = &ctxt;
+  out.buf = std::make_shared<sys::Buffer>(*ctxt.allocator, buf,
+    VK_NULL_HANDLE, true);
+  out.buf_cfg = buf_cfg;
+  out.mem_prop_flags = mem_prop_flags;
+  out.mem_cat = L_MEMORY_CATEGORY_ALIASED;
+  out.mem_size = 0;
+  out.bci = bci;
+  out.aliased_mem = mem;
+  out.dyn_detail = std::move(dyn_detail);
+  const_cast<Context&>(ctxt).rsc_stats.nbuf_create += 1;
+  L_DEBUG("created buffer '", buf_cfg.label, "' in aliased memory at offset ",
+    offset);
+  return true;
+}
 Buffer::~Buffer() {
   if (buf) {
+    Context* ctxt2 = const_cast<Context*>(ctxt);
+    if (mem_size != 0) {
+      // The pending defragmentation pass might be relocating the buffer.
+      if (ctxt2->defrag_detail.is_pass_pending) {
+        ctxt2->flush_defrag_pass();
+      }
+      ctxt2->defrag_detail.bufs.erase(buf->alloc);
+    }
+    // The device might still be using the buffer and its bindless indices.
+    ctxt2->defer_deletion([ctxt2, mem_cat = mem_cat, mem_size = mem_size,
+      buf = std::move(buf), aliased_mem = std::move(aliased_mem),
+      bindless_idxs = bindless_idxs]() {
+      if (mem_size != 0) {
+        ctxt2->free_mem(mem_cat, mem_size);
+      }
+      for (const auto& pair : bindless_idxs) {
+        ctxt2->free_bindless_idx(pair.first, pair.second);
+      }
+    });
     L_DEBUG("destroyed buffer '", buf_cfg.label, "'");
   }
 }
@@ -81,18 +398,24 @@ const BufferConfig& Buffer::cfg() const {
 void* Buffer::map(MemoryAccess map_access) {
   L_ASSERT(map_access != 0, "memory map access must be read, write or both");
 
-  void* mapped = nullptr;
-  VK_ASSERT << vmaMapMemory(*ctxt->allocator, buf->alloc, &mapped);
+  // Imported host memory is always accessible.
+  void* mapped = buf_cfg.host_ptr;
+  if (buf->host_mem == nullptr) {
+    VK_ASSERT << vmaMapMemory(*ctxt->allocator, buf->alloc, &mapped);
+  }
 
   dyn_detail.access = map_access == L_MEMORY_ACCESS_READ_BIT ?
     VK_ACCESS_HOST_READ_BIT : VK_ACCESS_HOST_WRITE_BIT;
   dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
 
+  const_cast<Context*>(ctxt)->rsc_stats.nmap += 1;
   L_DEBUG("mapped buffer '", buf_cfg.label, "'");
   return (uint8_t*)mapped;
 }
 void Buffer::unmap(void* mapped) {
-  vmaUnmapMemory(*ctxt->allocator, buf->alloc);
+  if (buf->host_mem == nullptr) {
+    vmaUnmapMemory(*ctxt->allocator, buf->alloc);
+  }
   L_DEBUG("unmapped buffer '", buf_cfg.label, "'");
 }
 
@@ -104,5 +427,29 @@ BufferView Buffer::view(size_t offset, size_t size) const {
   return out;
 }
 
+uint32_t Buffer::get_bindless_idx() const {
+  L_ASSERT(buf_cfg.usage & L_BUFFER_USAGE_STORAGE_BIT, "buffer '",
+    buf_cfg.label, "' cannot be bindless without storage usage");
+  const BindlessBinding binding = L_BINDLESS_BINDING_STORAGE_BUFFER;
+
+  auto it = bindless_idxs.find(binding);
+  if (it != bindless_idxs.end()) { return it->second; }
+
+  Context& ctxt2 = const_cast<Context&>(*ctxt);
+  uint32_t idx = ctxt2.alloc_bindless_idx(binding);
+  ctxt2.write_bindless_desc(binding, idx, *this);
+  const_cast<Buffer*>(this)->bindless_idxs[binding] = idx;
+  return idx;
+}
+uint64_t Buffer::get_dev_addr() const {
+  L_ASSERT(buf_cfg.usage & L_BUFFER_USAGE_DEVICE_ADDRESS_BIT, "buffer '",
+    buf_cfg.label, "' has no device address without device address usage");
+
+  VkBufferDeviceAddressInfoKHR bdai {};
+  bdai.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+  bdai.buffer = buf->buf;
+  return ctxt->dev_addr_detail.get_buf_dev_addr(ctxt->dev->dev, &bdai);
+}
+
 } // namespace vk
 } // namespace liong
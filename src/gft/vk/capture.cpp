@@ -0,0 +1,827 @@
+#include <algorithm>
+#include "gft/vk.hpp"
+#include "gft/log.hpp"
+#include "gft/util.hpp"
+#include "gft/hal/capture.hpp"
+
+namespace liong {
+namespace vk {
+
+// Objects referenced by the captured invocation tree, indexed by their
+// positions in the capture record.
+struct CaptureContext {
+  const Context* ctxt;
+  CaptureRecord record;
+  std::map<const Buffer*, uint32_t> buf_idxs;
+  std::map<const Image*, uint32_t> img_idxs;
+  std::map<const DepthImage*, uint32_t> depth_img_idxs;
+  std::map<const RenderPass*, uint32_t> pass_idxs;
+  std::map<const Task*, uint32_t> task_idxs;
+  std::map<const Invocation*, uint32_t> invoke_idxs;
+  std::vector<const Buffer*> bufs;
+  std::vector<const Image*> imgs;
+  // Content of archive files, kept until the archive is written.
+  std::vector<std::pair<std::string, std::vector<uint8_t>>> files;
+};
+
+std::string _add_capture_file(
+  CaptureContext& cc,
+  const std::string& file_name,
+  std::vector<uint8_t>&& data
+) {
+  cc.files.emplace_back(file_name, std::move(data));
+  return file_name;
+}
+size_t _get_img_size(const ImageConfig& img_cfg) {
+  return fmt::get_fmt_size(img_cfg.fmt) * img_cfg.width *
+    std::max(img_cfg.height, 1u) * std::max(img_cfg.depth, 1u);
+}
+
+uint32_t _reg_capture_buf(CaptureContext& cc, const Buffer& buf) {
+  auto it = cc.buf_idxs.find(&buf);
+  if (it != cc.buf_idxs.end()) { return it->second; }
+
+  uint32_t idx = (uint32_t)cc.record.bufs.size();
+  CaptureBufferRecord rec {};
+  rec.label = buf.buf_cfg.label;
+  rec.host_access = buf.buf_cfg.host_access;
+  rec.size = buf.buf_cfg.size;
+  rec.align = buf.buf_cfg.align;
+  rec.usage = buf.buf_cfg.usage;
+  rec.data_file = util::format("bufs/", idx, ".bin");
+  cc.record.bufs.emplace_back(std::move(rec));
+  cc.bufs.emplace_back(&buf);
+  cc.buf_idxs[&buf] = idx;
+  return idx;
+}
+uint32_t _reg_capture_img(CaptureContext& cc, const Image& img) {
+  auto it = cc.img_idxs.find(&img);
+  if (it != cc.img_idxs.end()) { return it->second; }
+
+  uint32_t idx = (uint32_t)cc.record.imgs.size();
+  CaptureImageRecord rec {};
+  rec.label = img.img_cfg.label;
+  rec.width = img.img_cfg.width;
+  rec.height = img.img_cfg.height;
+  rec.depth = img.img_cfg.depth;
+  rec.fmt = img.img_cfg.fmt;
+  rec.cspace = img.img_cfg.cspace;
+  rec.usage = img.img_cfg.usage;
+  // Transient attachments are not readable.
+  if (!(img.img_cfg.usage & L_IMAGE_USAGE_SUBPASS_DATA_BIT)) {
+    rec.data_file = util::format("imgs/", idx, ".bin");
+  }
+  cc.record.imgs.emplace_back(std::move(rec));
+  cc.imgs.emplace_back(&img);
+  cc.img_idxs[&img] = idx;
+  return idx;
+}
+uint32_t _reg_capture_depth_img(CaptureContext& cc, const DepthImage& depth_img) {
+  auto it = cc.depth_img_idxs.find(&depth_img);
+  if (it != cc.depth_img_idxs.end()) { return it->second; }
+
+  uint32_t idx = (uint32_t)cc.record.depth_imgs.size();
+  CaptureDepthImageRecord rec {};
+  rec.label = depth_img.depth_img_cfg.label;
+  rec.width = depth_img.depth_img_cfg.width;
+  rec.height = depth_img.depth_img_cfg.height;
+  rec.fmt = depth_img.depth_img_cfg.fmt;
+  rec.usage = depth_img.depth_img_cfg.usage;
+  cc.record.depth_imgs.emplace_back(std::move(rec));
+  cc.depth_img_idxs[&depth_img] = idx;
+  return idx;
+}
+uint32_t _reg_capture_pass(CaptureContext& cc, const RenderPass& pass) {
+  auto it = cc.pass_idxs.find(&pass);
+  if (it != cc.pass_idxs.end()) { return it->second; }
+
+  uint32_t idx = (uint32_t)cc.record.passes.size();
+  CaptureRenderPassRecord rec {};
+  rec.label = pass.pass_cfg.label;
+  rec.width = pass.pass_cfg.width;
+  rec.height = pass.pass_cfg.height;
+  for (const AttachmentConfig& attm_cfg : pass.pass_cfg.attm_cfgs) {
+    CaptureAttachmentRecord attm {};
+    attm.attm_access = attm_cfg.attm_access;
+    attm.attm_ty = attm_cfg.attm_ty;
+    if (attm_cfg.attm_ty == L_ATTACHMENT_TYPE_COLOR) {
+      attm.color_fmt = attm_cfg.color_fmt;
+      attm.cspace = attm_cfg.cspace;
+    } else {
+      attm.depth_fmt = attm_cfg.depth_fmt;
+    }
+    rec.attms.emplace_back(std::move(attm));
+  }
+  cc.record.passes.emplace_back(std::move(rec));
+  cc.pass_idxs[&pass] = idx;
+  return idx;
+}
+uint32_t _reg_capture_task(CaptureContext& cc, const Task& task) {
+  auto it = cc.task_idxs.find(&task);
+  if (it != cc.task_idxs.end()) { return it->second; }
+  L_ASSERT(task.capture_detail != nullptr, "task '", task.label, "' is not "
+    "capturable");
+  const TaskCaptureDetail& capture_detail = *task.capture_detail;
+
+  uint32_t idx = (uint32_t)cc.record.tasks.size();
+  CaptureTaskRecord rec {};
+  rec.label = task.label;
+  rec.rsc_tys = task.rsc_detail.rsc_tys;
+  rec.is_bindless = task.rsc_detail.is_bindless;
+  rec.push_const_size = task.rsc_detail.push_const_size;
+  if (task.pass == nullptr) {
+    const ComputeTaskConfig& cfg = capture_detail.comp_cfg;
+    rec.entry_name = cfg.entry_name;
+    rec.code_file = _add_capture_file(cc,
+      util::format("tasks/", idx, ".comp.spv"),
+      std::vector<uint8_t>(capture_detail.code));
+    rec.workgrp_size = { cfg.workgrp_size.x, cfg.workgrp_size.y,
+      cfg.workgrp_size.z };
+  } else {
+    const GraphicsTaskConfig& cfg = capture_detail.graph_cfg;
+    rec.ipass = _reg_capture_pass(cc, *task.pass);
+    rec.vert_entry_name = cfg.vert_entry_name;
+    rec.vert_code_file = _add_capture_file(cc,
+      util::format("tasks/", idx, ".vert.spv"),
+      std::vector<uint8_t>(capture_detail.vert_code));
+    rec.frag_entry_name = cfg.frag_entry_name;
+    rec.frag_code_file = _add_capture_file(cc,
+      util::format("tasks/", idx, ".frag.spv"),
+      std::vector<uint8_t>(capture_detail.frag_code));
+    rec.topo = cfg.topo;
+  }
+  cc.record.tasks.emplace_back(std::move(rec));
+  cc.task_idxs[&task] = idx;
+  return idx;
+}
+
+CaptureResourceViewRecord _make_capture_view(
+  CaptureContext& cc,
+  const BufferView& buf_view
+) {
+  CaptureResourceViewRecord out {};
+  out.rsc_view_ty = L_RESOURCE_VIEW_TYPE_BUFFER;
+  out.irsc = _reg_capture_buf(cc, *buf_view.buf);
+  out.offset = buf_view.offset;
+  out.size = buf_view.size;
+  return out;
+}
+CaptureResourceViewRecord _make_capture_view(
+  CaptureContext& cc,
+  const ImageView& img_view
+) {
+  CaptureResourceViewRecord out {};
+  out.rsc_view_ty = L_RESOURCE_VIEW_TYPE_IMAGE;
+  out.irsc = _reg_capture_img(cc, *img_view.img);
+  out.x_offset = img_view.x_offset;
+  out.y_offset = img_view.y_offset;
+  out.z_offset = img_view.z_offset;
+  out.width = img_view.width;
+  out.height = img_view.height;
+  out.depth = img_view.depth;
+  out.sampler = img_view.sampler;
+  return out;
+}
+CaptureResourceViewRecord _make_capture_view(
+  CaptureContext& cc,
+  const DepthImageView& depth_img_view
+) {
+  CaptureResourceViewRecord out {};
+  out.rsc_view_ty = L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE;
+  out.irsc = _reg_capture_depth_img(cc, *depth_img_view.depth_img);
+  out.x_offset = depth_img_view.x_offset;
+  out.y_offset = depth_img_view.y_offset;
+  out.width = depth_img_view.width;
+  out.height = depth_img_view.height;
+  out.sampler = depth_img_view.sampler;
+  return out;
+}
+CaptureResourceViewRecord _make_capture_view(
+  CaptureContext& cc,
+  const ResourceView& rsc_view
+) {
+  switch (rsc_view.rsc_view_ty) {
+  case L_RESOURCE_VIEW_TYPE_BUFFER:
+    return _make_capture_view(cc, rsc_view.buf_view);
+  case L_RESOURCE_VIEW_TYPE_IMAGE:
+    return _make_capture_view(cc, rsc_view.img_view);
+  case L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE:
+    return _make_capture_view(cc, rsc_view.depth_img_view);
+  default: unreachable();
+  }
+}
+std::vector<CaptureResourceViewRecord> _make_capture_views(
+  CaptureContext& cc,
+  const std::vector<ResourceView>& rsc_views
+) {
+  std::vector<CaptureResourceViewRecord> out;
+  out.reserve(rsc_views.size());
+  for (const ResourceView& rsc_view : rsc_views) {
+    out.emplace_back(_make_capture_view(cc, rsc_view));
+  }
+  return out;
+}
+// Optional buffers like indirect buffers are null if not set.
+std::optional<CaptureResourceViewRecord> _make_opt_capture_view(
+  CaptureContext& cc,
+  const BufferView& buf_view
+) {
+  if (buf_view.buf == nullptr) { return std::nullopt; }
+  return _make_capture_view(cc, buf_view);
+}
+
+uint32_t _capture_invoke(CaptureContext& cc, const Invocation& invoke);
+std::vector<uint32_t> _capture_subinvokes(
+  CaptureContext& cc,
+  const std::vector<const Invocation*>& subinvokes
+) {
+  std::vector<uint32_t> out;
+  out.reserve(subinvokes.size());
+  for (const Invocation* subinvoke : subinvokes) {
+    out.emplace_back(_capture_invoke(cc, *subinvoke));
+  }
+  return out;
+}
+uint32_t _capture_invoke(CaptureContext& cc, const Invocation& invoke) {
+  auto it = cc.invoke_idxs.find(&invoke);
+  if (it != cc.invoke_idxs.end()) { return it->second; }
+
+  CaptureInvocationRecord rec {};
+  rec.label = invoke.label;
+
+  if (invoke.present_detail != nullptr) {
+    // Presentation cannot be replayed offscreen.
+    L_WARN("present invocation '", invoke.label, "' is captured as an empty "
+      "composite invocation");
+    rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_COMPOSITE;
+  } else {
+    L_ASSERT(invoke.capture_detail != nullptr, "invocation '", invoke.label,
+      "' is not capturable");
+    const InvocationCaptureDetail& capture_detail = *invoke.capture_detail;
+
+    if (invoke.b2b_detail || invoke.b2i_detail || invoke.i2b_detail ||
+      invoke.i2i_detail || invoke.blit_detail
+    ) {
+      const TransferInvocationConfig& cfg = capture_detail.transfer_cfg;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_TRANSFER;
+      rec.is_timed = cfg.is_timed;
+      rec.src = _make_capture_view(cc, cfg.src_rsc_view);
+      rec.dst = _make_capture_view(cc, cfg.dst_rsc_view);
+      for (const TransferRegionConfig& region : cfg.regions) {
+        CaptureTransferRegionRecord region2 {};
+        region2.src = _make_capture_view(cc, region.src_rsc_view);
+        region2.dst = _make_capture_view(cc, region.dst_rsc_view);
+        rec.regions.emplace_back(std::move(region2));
+      }
+      rec.buf_row_len = cfg.buf_row_len;
+      rec.buf_img_height = cfg.buf_img_height;
+      rec.is_blit = cfg.is_blit;
+
+    } else if (invoke.fill_detail != nullptr) {
+      const FillInvocationConfig& cfg = capture_detail.fill_cfg;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_FILL;
+      rec.is_timed = cfg.is_timed;
+      rec.dst = _make_capture_view(cc, cfg.dst_buf_view);
+      rec.value = cfg.value;
+
+    } else if (invoke.update_detail != nullptr) {
+      const UpdateInvocationConfig& cfg = capture_detail.update_cfg;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_UPDATE;
+      rec.is_timed = cfg.is_timed;
+      rec.dst = _make_capture_view(cc, cfg.dst_buf_view);
+      rec.data_file = _add_capture_file(cc,
+        util::format("invokes/", cc.record.invokes.size(), ".bin"),
+        std::vector<uint8_t>(cfg.data));
+
+    } else if (invoke.upload_detail != nullptr) {
+      const UploadInvocationConfig& cfg = capture_detail.upload_cfg;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_UPLOAD;
+      rec.is_timed = cfg.is_timed;
+      for (size_t i = 0; i < cfg.writes.size(); ++i) {
+        const UploadWriteConfig& write = cfg.writes[i];
+        CaptureUploadWriteRecord write2 {};
+        write2.dst = _make_capture_view(cc, write.dst_rsc_view);
+        write2.nelem = write.nelem;
+        write2.elem_size = write.elem_size;
+        write2.elem_stride = write.elem_stride;
+        write2.data_file = _add_capture_file(cc,
+          util::format("invokes/", cc.record.invokes.size(), "-", i, ".bin"),
+          std::vector<uint8_t>(capture_detail.upload_data.at(i)));
+        rec.writes.emplace_back(std::move(write2));
+      }
+
+    } else if (invoke.comp_detail != nullptr) {
+      const ComputeInvocationConfig& cfg = capture_detail.comp_cfg;
+      const InvocationComputeDetail& comp_detail = *invoke.comp_detail;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_COMPUTE;
+      rec.is_timed = cfg.is_timed;
+      rec.itask = _reg_capture_task(cc, *comp_detail.task);
+      rec.rsc_views = _make_capture_views(cc, comp_detail.rsc_views);
+      rec.bindless_rsc_views = _make_capture_views(cc, cfg.bindless_rsc_views);
+      rec.bindless_rsc_tys = cfg.bindless_rsc_tys;
+      rec.push_consts = comp_detail.push_consts;
+      rec.workgrp_count = { comp_detail.workgrp_count.x,
+        comp_detail.workgrp_count.y, comp_detail.workgrp_count.z };
+      rec.indirect_buf = _make_opt_capture_view(cc, cfg.indirect_buf);
+      rec.is_async = cfg.is_async;
+
+    } else if (invoke.graph_detail != nullptr) {
+      const GraphicsInvocationConfig& cfg = capture_detail.graph_cfg;
+      const InvocationGraphicsDetail& graph_detail = *invoke.graph_detail;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_GRAPHICS;
+      rec.is_timed = cfg.is_timed;
+      rec.itask = _reg_capture_task(cc, *graph_detail.task);
+      rec.rsc_views = _make_capture_views(cc, graph_detail.rsc_views);
+      rec.bindless_rsc_views = _make_capture_views(cc, cfg.bindless_rsc_views);
+      rec.bindless_rsc_tys = cfg.bindless_rsc_tys;
+      rec.push_consts = graph_detail.push_consts;
+      rec.ninst = cfg.ninst;
+      for (const BufferView& vert_buf : cfg.vert_bufs) {
+        rec.vert_bufs.emplace_back(_make_capture_view(cc, vert_buf));
+      }
+      rec.nvert = cfg.nvert;
+      rec.idx_buf = _make_opt_capture_view(cc, cfg.idx_buf);
+      rec.idx_ty = cfg.idx_ty;
+      rec.nidx = cfg.nidx;
+      rec.indirect_buf = _make_opt_capture_view(cc, cfg.indirect_buf);
+      rec.ndraw = cfg.ndraw;
+      rec.count_buf = _make_opt_capture_view(cc, cfg.count_buf);
+
+    } else if (invoke.pass_detail != nullptr) {
+      const RenderPassInvocationConfig& cfg = capture_detail.pass_cfg;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_RENDER_PASS;
+      rec.is_timed = cfg.is_timed;
+      rec.subinvokes = _capture_subinvokes(cc, invoke.pass_detail->subinvokes);
+      rec.ipass = _reg_capture_pass(cc, *invoke.pass_detail->pass);
+      rec.attms = _make_capture_views(cc, cfg.attms);
+
+    } else if (invoke.composite_detail != nullptr) {
+      const CompositeInvocationConfig& cfg = capture_detail.composite_cfg;
+      rec.invoke_ty = L_CAPTURE_INVOCATION_TYPE_COMPOSITE;
+      rec.is_timed = cfg.is_timed;
+      rec.subinvokes =
+        _capture_subinvokes(cc, invoke.composite_detail->subinvokes);
+      rec.discard_rsc_views = _make_capture_views(cc, cfg.discard_rsc_views);
+      rec.is_async = cfg.is_async;
+
+    } else {
+      unreachable();
+    }
+  }
+
+  // Subinvocations have been pushed so the index is taken after them.
+  uint32_t idx = (uint32_t)cc.record.invokes.size();
+  cc.record.invokes.emplace_back(std::move(rec));
+  cc.invoke_idxs[&invoke] = idx;
+  return idx;
+}
+
+// Copy the content of captured buffers and images to host-readable staging
+// buffers in a single submission, and store them as archive files.
+bool _read_back_capture_rscs(CaptureContext& cc) {
+  const Context& ctxt = *cc.ctxt;
+
+  std::vector<std::unique_ptr<Buffer>> stage_bufs;
+  std::vector<std::string> file_names;
+  std::vector<std::unique_ptr<Invocation>> copy_invokes;
+  auto add_copy = [&](
+    const std::string& file_name,
+    const ResourceView& src,
+    size_t size
+  ) {
+    BufferConfig buf_cfg {};
+    buf_cfg.label = util::format("capture staging '", file_name, "'");
+    buf_cfg.host_access = L_MEMORY_ACCESS_READ_BIT;
+    buf_cfg.size = size;
+    buf_cfg.usage = L_BUFFER_USAGE_TRANSFER_DST_BIT;
+    std::unique_ptr<Buffer> stage_buf = std::make_unique<Buffer>();
+    if (!Buffer::create(ctxt, buf_cfg, *stage_buf)) { return false; }
+
+    TransferInvocationConfig transfer_cfg {};
+    transfer_cfg.label = buf_cfg.label;
+    transfer_cfg.src_rsc_view = src;
+    transfer_cfg.dst_rsc_view = make_rsc_view(stage_buf->view(0, size));
+    std::unique_ptr<Invocation> copy_invoke = std::make_unique<Invocation>();
+    if (!Invocation::create(ctxt, transfer_cfg, *copy_invoke)) { return false; }
+
+    stage_bufs.emplace_back(std::move(stage_buf));
+    file_names.emplace_back(file_name);
+    copy_invokes.emplace_back(std::move(copy_invoke));
+    return true;
+  };
+
+  for (size_t i = 0; i < cc.bufs.size(); ++i) {
+    const Buffer& buf = *cc.bufs[i];
+    const CaptureBufferRecord& rec = cc.record.bufs[i];
+    if (!add_copy(rec.data_file, make_rsc_view(buf.view(0, rec.size)),
+      rec.size)) {
+      L_ERROR("failed to read back buffer '", rec.label, "'");
+      return false;
+    }
+  }
+  for (size_t i = 0; i < cc.imgs.size(); ++i) {
+    const Image& img = *cc.imgs[i];
+    const CaptureImageRecord& rec = cc.record.imgs[i];
+    if (rec.data_file.empty()) { continue; }
+    ImageView img_view = img.view(0, 0, 0, rec.width, rec.height, rec.depth,
+      L_IMAGE_SAMPLER_NEAREST);
+    if (!add_copy(rec.data_file, make_rsc_view(img_view),
+      _get_img_size(img.img_cfg))) {
+      L_ERROR("failed to read back image '", rec.label, "'");
+      return false;
+    }
+  }
+  if (copy_invokes.empty()) { return true; }
+
+  CompositeInvocationConfig composite_cfg {};
+  composite_cfg.label = "capture readback";
+  for (const auto& copy_invoke : copy_invokes) {
+    composite_cfg.invokes.emplace_back(copy_invoke.get());
+  }
+  Invocation composite_invoke {};
+  if (!Invocation::create(ctxt, composite_cfg, composite_invoke)) {
+    return false;
+  }
+  InvocationSubmitTransactionConfig submit_cfg {};
+  submit_cfg.label = composite_cfg.label;
+  Transaction transact {};
+  if (!Transaction::create(composite_invoke, submit_cfg, transact)) {
+    return false;
+  }
+  transact.wait();
+
+  for (size_t i = 0; i < stage_bufs.size(); ++i) {
+    Buffer& stage_buf = *stage_bufs[i];
+    const uint8_t* mapped =
+      (const uint8_t*)stage_buf.map(L_MEMORY_ACCESS_READ_BIT);
+    _add_capture_file(cc, file_names[i],
+      std::vector<uint8_t>(mapped, mapped + stage_buf.buf_cfg.size));
+    stage_buf.unmap((void*)mapped);
+  }
+  return true;
+}
+
+bool capture_invoke(const Invocation& invoke, const std::string& path) {
+  const Context& ctxt = *invoke.ctxt;
+  L_ASSERT(ctxt.is_capturable, "context '", ctxt.label, "' is not "
+    "capturable");
+
+  CaptureContext cc {};
+  cc.ctxt = &ctxt;
+  cc.record.version = CAPTURE_VERSION;
+  cc.record.label = invoke.label;
+  cc.record.dev_desc = get_inst().physdev_details.at(ctxt.iphysdev).desc;
+  _capture_invoke(cc, invoke);
+
+  // Resources might still be written by previous submissions on any queue.
+  VK_ASSERT << vkDeviceWaitIdle(ctxt.dev->dev);
+  if (!_read_back_capture_rscs(cc)) {
+    L_ERROR("failed to read back resources of invocation '", invoke.label,
+      "' for capture");
+    return false;
+  }
+
+  std::string json_lit = json::print(json::serialize(cc.record));
+  zip::ZipArchive archive {};
+  archive.add_file("capture.json", json_lit.data(), json_lit.size());
+  for (const auto& file : cc.files) {
+    archive.add_file(file.first, file.second.data(), file.second.size());
+  }
+  std::vector<uint8_t> archive_data;
+  archive.to_bytes(archive_data);
+  util::save_file(path.c_str(), archive_data.data(), archive_data.size());
+
+  L_INFO("captured invocation '", invoke.label, "' to '", path, "' (",
+    cc.record.invokes.size(), " invocations, ", cc.record.tasks.size(),
+    " tasks, ", cc.record.bufs.size(), " buffers, ", cc.record.imgs.size(),
+    " images)");
+  return true;
+}
+
+
+
+namespace scoped {
+
+ResourceView _make_replay_view(
+  const Replay& replay,
+  const CaptureResourceViewRecord& rec
+) {
+  switch (rec.rsc_view_ty) {
+  case L_RESOURCE_VIEW_TYPE_BUFFER:
+    return make_rsc_view(replay.bufs.at(rec.irsc).view(rec.offset, rec.size));
+  case L_RESOURCE_VIEW_TYPE_IMAGE:
+    return make_rsc_view(replay.imgs.at(rec.irsc).view(rec.x_offset,
+      rec.y_offset, rec.z_offset, rec.width, rec.height, rec.depth,
+      (ImageSampler)rec.sampler));
+  case L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE:
+    return make_rsc_view(replay.depth_imgs.at(rec.irsc).view(rec.x_offset,
+      rec.y_offset, rec.width, rec.height, (DepthImageSampler)rec.sampler));
+  default: unreachable();
+  }
+}
+std::vector<ResourceView> _make_replay_views(
+  const Replay& replay,
+  const std::vector<CaptureResourceViewRecord>& recs
+) {
+  std::vector<ResourceView> out;
+  out.reserve(recs.size());
+  for (const CaptureResourceViewRecord& rec : recs) {
+    out.emplace_back(_make_replay_view(replay, rec));
+  }
+  return out;
+}
+BufferView _make_replay_buf_view(
+  const Replay& replay,
+  const std::optional<CaptureResourceViewRecord>& rec
+) {
+  if (!rec.has_value()) { return BufferView {}; }
+  return _make_replay_view(replay, *rec).buf_view;
+}
+std::vector<const vk::Invocation*> _get_replay_subinvokes(
+  const Replay& replay,
+  const std::vector<uint32_t>& isubinvokes
+) {
+  std::vector<const vk::Invocation*> out;
+  out.reserve(isubinvokes.size());
+  for (uint32_t isubinvoke : isubinvokes) {
+    out.emplace_back(replay.invokes.at(isubinvoke).inner);
+  }
+  return out;
+}
+const zip::ZipFileRecord& _get_replay_file(
+  const Replay& replay,
+  const std::string& file_name
+) {
+  L_ASSERT(replay.archive.file_name2irecord.count(file_name) != 0,
+    "capture archive file '", file_name, "' is missing");
+  return replay.archive.get_file(file_name);
+}
+
+Invocation _create_replay_invoke(
+  const Replay& replay,
+  const CaptureInvocationRecord& rec
+) {
+  switch (rec.invoke_ty) {
+  case L_CAPTURE_INVOCATION_TYPE_TRANSFER:
+  {
+    TransferInvocationBuilder builder = replay.ctxt.build_trans_invoke(rec.label);
+    builder.inner.src_rsc_view = _make_replay_view(replay, rec.src.value());
+    builder.inner.dst_rsc_view = _make_replay_view(replay, rec.dst.value());
+    for (const CaptureTransferRegionRecord& region : rec.regions) {
+      TransferRegionConfig region2 {};
+      region2.src_rsc_view = _make_replay_view(replay, region.src);
+      region2.dst_rsc_view = _make_replay_view(replay, region.dst);
+      builder.inner.regions.emplace_back(std::move(region2));
+    }
+    builder.inner.buf_row_len = rec.buf_row_len;
+    builder.inner.buf_img_height = rec.buf_img_height;
+    builder.inner.is_blit = rec.is_blit;
+    builder.inner.is_timed = rec.is_timed;
+    return builder.build(false);
+  }
+  case L_CAPTURE_INVOCATION_TYPE_FILL:
+  {
+    FillInvocationBuilder builder = replay.ctxt.build_fill_invoke(rec.label);
+    builder.inner.dst_buf_view = _make_replay_buf_view(replay, rec.dst);
+    builder.inner.value = rec.value;
+    builder.inner.is_timed = rec.is_timed;
+    return builder.build(false);
+  }
+  case L_CAPTURE_INVOCATION_TYPE_UPDATE:
+  {
+    const zip::ZipFileRecord& data = _get_replay_file(replay, rec.data_file);
+    const uint8_t* beg = (const uint8_t*)data.data;
+    UpdateInvocationBuilder builder = replay.ctxt.build_update_invoke(rec.label);
+    builder.inner.dst_buf_view = _make_replay_buf_view(replay, rec.dst);
+    builder.inner.data.assign(beg, beg + data.size);
+    builder.inner.is_timed = rec.is_timed;
+    return builder.build(false);
+  }
+  case L_CAPTURE_INVOCATION_TYPE_UPLOAD:
+  {
+    UploadInvocationBuilder builder = replay.ctxt.build_upload_invoke(rec.label);
+    for (const CaptureUploadWriteRecord& write : rec.writes) {
+      UploadWriteConfig write2 {};
+      write2.dst_rsc_view = _make_replay_view(replay, write.dst);
+      write2.data = _get_replay_file(replay, write.data_file).data;
+      write2.nelem = write.nelem;
+      write2.elem_size = write.elem_size;
+      write2.elem_stride = write.elem_stride;
+      builder.inner.writes.emplace_back(std::move(write2));
+    }
+    builder.inner.is_timed = rec.is_timed;
+    return builder.build(false);
+  }
+  case L_CAPTURE_INVOCATION_TYPE_COMPUTE:
+  {
+    const Task& task = replay.tasks.at(rec.itask.value());
+    ComputeInvocationBuilder builder = task.build_comp_invoke(rec.label);
+    builder.inner.rsc_views = _make_replay_views(replay, rec.rsc_views);
+    builder.inner.bindless_rsc_views =
+      _make_replay_views(replay, rec.bindless_rsc_views);
+    builder.inner.bindless_rsc_tys = rec.bindless_rsc_tys;
+    builder.inner.push_consts = rec.push_consts;
+    builder.inner.workgrp_count.x = rec.workgrp_count[0];
+    builder.inner.workgrp_count.y = rec.workgrp_count[1];
+    builder.inner.workgrp_count.z = rec.workgrp_count[2];
+    builder.inner.indirect_buf = _make_replay_buf_view(replay, rec.indirect_buf);
+    builder.inner.is_timed = rec.is_timed;
+    builder.inner.is_async = rec.is_async;
+    return builder.build(false);
+  }
+  case L_CAPTURE_INVOCATION_TYPE_GRAPHICS:
+  {
+    const Task& task = replay.tasks.at(rec.itask.value());
+    GraphicsInvocationBuilder builder = task.build_graph_invoke(rec.label);
+    builder.inner.rsc_views = _make_replay_views(replay, rec.rsc_views);
+    builder.inner.bindless_rsc_views =
+      _make_replay_views(replay, rec.bindless_rsc_views);
+    builder.inner.bindless_rsc_tys = rec.bindless_rsc_tys;
+    builder.inner.push_consts = rec.push_consts;
+    builder.inner.ninst = rec.ninst;
+    for (const CaptureResourceViewRecord& vert_buf : rec.vert_bufs) {
+      builder.inner.vert_bufs.emplace_back(
+        _make_replay_view(replay, vert_buf).buf_view);
+    }
+    builder.inner.nvert = rec.nvert;
+    builder.inner.idx_buf = _make_replay_buf_view(replay, rec.idx_buf);
+    builder.inner.idx_ty = rec.idx_ty;
+    builder.inner.nidx = rec.nidx;
+    builder.inner.indirect_buf = _make_replay_buf_view(replay, rec.indirect_buf);
+    builder.inner.ndraw = rec.ndraw;
+    builder.inner.count_buf = _make_replay_buf_view(replay, rec.count_buf);
+    builder.inner.is_timed = rec.is_timed;
+    return builder.build(false);
+  }
+  case L_CAPTURE_INVOCATION_TYPE_RENDER_PASS:
+  {
+    const RenderPass& pass = replay.passes.at(rec.ipass.value());
+    RenderPassInvocationBuilder builder = pass.build_pass_invoke(rec.label);
+    builder.inner.attms = _make_replay_views(replay, rec.attms);
+    builder.inner.invokes = _get_replay_subinvokes(replay, rec.subinvokes);
+    builder.inner.is_timed = rec.is_timed;
+    return builder.build(false);
+  }
+  case L_CAPTURE_INVOCATION_TYPE_COMPOSITE:
+  {
+    CompositeInvocationBuilder builder =
+      replay.ctxt.build_composite_invoke(rec.label);
+    builder.inner.invokes = _get_replay_subinvokes(replay, rec.subinvokes);
+    builder.inner.discard_rsc_views =
+      _make_replay_views(replay, rec.discard_rsc_views);
+    builder.inner.is_timed = rec.is_timed;
+    builder.inner.is_async = rec.is_async;
+    return builder.build(false);
+  }
+  default: unreachable();
+  }
+}
+
+Replay::Replay(
+  const scoped::Context& ctxt,
+  std::vector<uint8_t>&& archive_data
+) :
+  ctxt(scoped::Context::borrow(ctxt)),
+  archive_data(std::move(archive_data)),
+  archive(),
+  record(),
+  bufs(),
+  imgs(),
+  depth_imgs(),
+  passes(),
+  tasks(),
+  invokes(),
+  restore_invoke()
+{
+  archive = zip::ZipArchive::from_bytes(this->archive_data);
+  const zip::ZipFileRecord& json_file = _get_replay_file(*this, "capture.json");
+  std::string json_lit((const char*)json_file.data, json_file.size);
+  json::deserialize(json::parse(json_lit), record);
+  L_ASSERT(record.version == CAPTURE_VERSION, "capture version mismatched "
+    "(expected=", CAPTURE_VERSION, "; actual=", record.version, ")");
+  L_ASSERT(!record.invokes.empty(), "capture has no invocation");
+  L_INFO("replaying invocation '", record.label, "' captured on ",
+    record.dev_desc);
+
+  for (const CaptureBufferRecord& rec : record.bufs) {
+    BufferBuilder builder = ctxt.build_buf(rec.label);
+    builder.inner.host_access = rec.host_access;
+    builder.inner.size = rec.size;
+    builder.inner.align = rec.align;
+    builder.inner.usage = rec.usage;
+    if (!rec.data_file.empty()) {
+      builder.inner.usage |= L_BUFFER_USAGE_TRANSFER_DST_BIT;
+    }
+    bufs.emplace_back(builder.build(false));
+  }
+  for (const CaptureImageRecord& rec : record.imgs) {
+    ImageBuilder builder = ctxt.build_img(rec.label);
+    builder.inner.width = rec.width;
+    builder.inner.height = rec.height;
+    builder.inner.depth = rec.depth;
+    builder.inner.fmt = rec.fmt;
+    builder.inner.cspace = rec.cspace;
+    builder.inner.usage = rec.usage & ~L_IMAGE_USAGE_PRESENT_BIT;
+    if (!rec.data_file.empty()) {
+      builder.inner.usage |= L_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    imgs.emplace_back(builder.build(false));
+  }
+  for (const CaptureDepthImageRecord& rec : record.depth_imgs) {
+    DepthImageBuilder builder = ctxt.build_depth_img(rec.label);
+    builder.inner.width = rec.width;
+    builder.inner.height = rec.height;
+    builder.inner.fmt = rec.fmt;
+    builder.inner.usage = rec.usage;
+    depth_imgs.emplace_back(builder.build(false));
+  }
+  for (const CaptureRenderPassRecord& rec : record.passes) {
+    RenderPassBuilder builder = ctxt.build_pass(rec.label);
+    builder.inner.width = rec.width;
+    builder.inner.height = rec.height;
+    for (const CaptureAttachmentRecord& attm : rec.attms) {
+      AttachmentConfig attm_cfg {};
+      attm_cfg.attm_access = attm.attm_access;
+      attm_cfg.attm_ty = attm.attm_ty;
+      if (attm.attm_ty == L_ATTACHMENT_TYPE_COLOR) {
+        attm_cfg.color_fmt = attm.color_fmt;
+        attm_cfg.cspace = attm.cspace;
+      } else {
+        attm_cfg.depth_fmt = attm.depth_fmt;
+      }
+      builder.inner.attm_cfgs.emplace_back(std::move(attm_cfg));
+    }
+    passes.emplace_back(builder.build(false));
+  }
+  for (const CaptureTaskRecord& rec : record.tasks) {
+    if (rec.ipass.has_value()) {
+      const zip::ZipFileRecord& vert_code =
+        _get_replay_file(*this, rec.vert_code_file);
+      const zip::ZipFileRecord& frag_code =
+        _get_replay_file(*this, rec.frag_code_file);
+      GraphicsTaskBuilder builder =
+        passes.at(rec.ipass.value()).build_graph_task(rec.label);
+      builder.inner.vert_entry_name = rec.vert_entry_name;
+      builder.inner.vert_code = vert_code.data;
+      builder.inner.vert_code_size = vert_code.size;
+      builder.inner.frag_entry_name = rec.frag_entry_name;
+      builder.inner.frag_code = frag_code.data;
+      builder.inner.frag_code_size = frag_code.size;
+      builder.inner.topo = rec.topo;
+      builder.inner.rsc_tys = rec.rsc_tys;
+      builder.inner.is_bindless = rec.is_bindless;
+      builder.inner.push_const_size = rec.push_const_size;
+      tasks.emplace_back(builder.build(false));
+    } else {
+      const zip::ZipFileRecord& code = _get_replay_file(*this, rec.code_file);
+      ComputeTaskBuilder builder = ctxt.build_comp_task(rec.label);
+      builder.inner.entry_name = rec.entry_name;
+      builder.inner.code = code.data;
+      builder.inner.code_size = code.size;
+      builder.inner.rsc_tys = rec.rsc_tys;
+      builder.inner.workgrp_size.x = rec.workgrp_size[0];
+      builder.inner.workgrp_size.y = rec.workgrp_size[1];
+      builder.inner.workgrp_size.z = rec.workgrp_size[2];
+      builder.inner.is_bindless = rec.is_bindless;
+      builder.inner.push_const_size = rec.push_const_size;
+      tasks.emplace_back(builder.build(false));
+    }
+  }
+  // Subinvocations precede the invocations containing them. The captured
+  // invocation is always timed for benchmarking.
+  record.invokes.back().is_timed = true;
+  for (const CaptureInvocationRecord& rec : record.invokes) {
+    invokes.emplace_back(_create_replay_invoke(*this, rec));
+  }
+
+  UploadInvocationBuilder builder = ctxt.build_upload_invoke("restore");
+  for (size_t i = 0; i < record.bufs.size(); ++i) {
+    const CaptureBufferRecord& rec = record.bufs[i];
+    if (rec.data_file.empty()) { continue; }
+    builder.write(make_rsc_view(bufs[i].view()),
+      _get_replay_file(*this, rec.data_file).data, rec.size, 1);
+  }
+  for (size_t i = 0; i < record.imgs.size(); ++i) {
+    const CaptureImageRecord& rec = record.imgs[i];
+    if (rec.data_file.empty()) { continue; }
+    const vk::Image& img = imgs[i];
+    size_t texel_size = fmt::get_fmt_size(rec.fmt);
+    builder.write(make_rsc_view(imgs[i].view(L_IMAGE_SAMPLER_NEAREST)),
+      _get_replay_file(*this, rec.data_file).data,
+      _get_img_size(img.img_cfg) / texel_size, texel_size);
+  }
+  if (!builder.empty()) {
+    restore_invoke = builder.build(false);
+  }
+}
+
+void Replay::restore() {
+  if (restore_invoke.is_valid()) {
+    restore_invoke.submit(false).wait();
+  }
+}
+
+} // namespace scoped
+
+} // namespace vk
+} // namespace liong
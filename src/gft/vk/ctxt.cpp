@@ -84,10 +84,247 @@ sys::SurfaceRef _create_surf_metal(const ContextMetalConfig& cfg) {
 #endif // VK_EXT_metal_surface
 }
 
-void _create_ctxt(
+ContextHostImportDetail _make_host_import_detail(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail,
+  VkDevice dev
+) {
+  ContextHostImportDetail out {};
+  if (physdev_detail.ext_props.count(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) {
+    return out;
+  }
+  // Extended properties are only available through
+  // `VK_KHR_get_physical_device_properties2` on Vulkan 1.0.
+  auto get_physdev_prop2 = (PFN_vkGetPhysicalDeviceProperties2KHR)
+    vkGetInstanceProcAddr(inst.inst->inst, "vkGetPhysicalDeviceProperties2KHR");
+  auto get_mem_host_ptr_prop = (PFN_vkGetMemoryHostPointerPropertiesEXT)
+    vkGetDeviceProcAddr(dev, "vkGetMemoryHostPointerPropertiesEXT");
+  if (get_physdev_prop2 == nullptr || get_mem_host_ptr_prop == nullptr) {
+    return out;
+  }
+
+  VkPhysicalDeviceExternalMemoryHostPropertiesEXT pemhp {};
+  pemhp.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+  VkPhysicalDeviceProperties2KHR pp2 {};
+  pp2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+  pp2.pNext = &pemhp;
+  get_physdev_prop2(physdev_detail.physdev, &pp2);
+
+  out.align = pemhp.minImportedHostPointerAlignment;
+  out.get_mem_host_ptr_prop = get_mem_host_ptr_prop;
+  return out;
+}
+
+// Query extended features chained in `pnext`. Returns `false` if extended
+// features cannot be queried.
+bool _get_physdev_feat2(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail,
+  void* pnext
+) {
+  auto get_physdev_feat2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)
+    vkGetInstanceProcAddr(inst.inst->inst, "vkGetPhysicalDeviceFeatures2KHR");
+  if (get_physdev_feat2 == nullptr) { return false; }
+
+  VkPhysicalDeviceFeatures2KHR pf2 {};
+  pf2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+  pf2.pNext = pnext;
+  get_physdev_feat2(physdev_detail.physdev, &pf2);
+  return true;
+}
+
+// Descriptor indexing features to enable for bindless resources. All features
+// are disabled if bindless resources are unsupported.
+VkPhysicalDeviceDescriptorIndexingFeaturesEXT _make_bindless_feat(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail
+) {
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT out {};
+  out.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  if (physdev_detail.ext_props.count(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0) {
+    return out;
+  }
+
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported {};
+  supported.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  if (!_get_physdev_feat2(inst, physdev_detail, &supported)) { return out; }
+
+  bool is_supported =
+    supported.runtimeDescriptorArray &&
+    supported.descriptorBindingPartiallyBound &&
+    supported.descriptorBindingUpdateUnusedWhilePending &&
+    supported.descriptorBindingStorageBufferUpdateAfterBind &&
+    supported.descriptorBindingSampledImageUpdateAfterBind &&
+    supported.descriptorBindingStorageImageUpdateAfterBind;
+  if (!is_supported) { return out; }
+
+  out.runtimeDescriptorArray = VK_TRUE;
+  out.descriptorBindingPartiallyBound = VK_TRUE;
+  out.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  out.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+  out.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  out.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+  // Non-uniform indexing is optional.
+  out.shaderStorageBufferArrayNonUniformIndexing =
+    supported.shaderStorageBufferArrayNonUniformIndexing;
+  out.shaderSampledImageArrayNonUniformIndexing =
+    supported.shaderSampledImageArrayNonUniformIndexing;
+  out.shaderStorageImageArrayNonUniformIndexing =
+    supported.shaderStorageImageArrayNonUniformIndexing;
+  return out;
+}
+
+// Buffer device address features to enable. All features are disabled if
+// buffer device address is unsupported.
+VkPhysicalDeviceBufferDeviceAddressFeaturesKHR _make_dev_addr_feat(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail
+) {
+  VkPhysicalDeviceBufferDeviceAddressFeaturesKHR out {};
+  out.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+  if (physdev_detail.ext_props.count(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME) == 0) {
+    return out;
+  }
+
+  VkPhysicalDeviceBufferDeviceAddressFeaturesKHR supported {};
+  supported.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+  if (!_get_physdev_feat2(inst, physdev_detail, &supported)) { return out; }
+
+  out.bufferDeviceAddress = supported.bufferDeviceAddress;
+  return out;
+}
+
+// Timeline semaphore features to enable. All features are disabled if timeline
+// semaphores are unsupported.
+VkPhysicalDeviceTimelineSemaphoreFeaturesKHR _make_timeline_feat(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail
+) {
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR out {};
+  out.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  if (physdev_detail.ext_props.count(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) {
+    return out;
+  }
+
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR supported {};
+  supported.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  if (!_get_physdev_feat2(inst, physdev_detail, &supported)) { return out; }
+
+  out.timelineSemaphore = supported.timelineSemaphore;
+  return out;
+}
+
+// Performance query features to enable. All features are disabled if
+// performance queries are unsupported.
+VkPhysicalDevicePerformanceQueryFeaturesKHR _make_perf_query_feat(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail
+) {
+  VkPhysicalDevicePerformanceQueryFeaturesKHR out {};
+  out.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PERFORMANCE_QUERY_FEATURES_KHR;
+  if (physdev_detail.ext_props.count(VK_KHR_PERFORMANCE_QUERY_EXTENSION_NAME) == 0) {
+    return out;
+  }
+
+  VkPhysicalDevicePerformanceQueryFeaturesKHR supported {};
+  supported.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PERFORMANCE_QUERY_FEATURES_KHR;
+  if (!_get_physdev_feat2(inst, physdev_detail, &supported)) { return out; }
+
+  out.performanceCounterQueryPools = supported.performanceCounterQueryPools;
+  out.performanceCounterMultipleQueryPools =
+    supported.performanceCounterMultipleQueryPools;
+  return out;
+}
+// Host query reset features to enable. All features are disabled if queries
+// cannot be reset on the host.
+VkPhysicalDeviceHostQueryResetFeaturesEXT _make_host_query_reset_feat(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail
+) {
+  VkPhysicalDeviceHostQueryResetFeaturesEXT out {};
+  out.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+  if (physdev_detail.ext_props.count(VK_EXT_HOST_QUERY_RESET_EXTENSION_NAME) == 0) {
+    return out;
+  }
+
+  VkPhysicalDeviceHostQueryResetFeaturesEXT supported {};
+  supported.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES_EXT;
+  if (!_get_physdev_feat2(inst, physdev_detail, &supported)) { return out; }
+
+  out.hostQueryReset = supported.hostQueryReset;
+  return out;
+}
+// Enumerate the performance counters of the allocated queue families. Not
+// supported if any of the entry points is missing.
+ContextPerformanceQueryDetail _make_perf_query_detail(
+  const Instance& inst,
+  const InstancePhysicalDeviceDetail& physdev_detail,
+  VkDevice dev,
+  const std::set<uint32_t>& qfam_idxs
+) {
+  ContextPerformanceQueryDetail out {};
+  auto enum_counters =
+    (PFN_vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR)
+      vkGetInstanceProcAddr(inst.inst->inst,
+        "vkEnumeratePhysicalDeviceQueueFamilyPerformanceQueryCountersKHR");
+  out.get_npass = (PFN_vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR)
+    vkGetInstanceProcAddr(inst.inst->inst,
+      "vkGetPhysicalDeviceQueueFamilyPerformanceQueryPassesKHR");
+  out.acquire_profiling_lock = (PFN_vkAcquireProfilingLockKHR)
+    vkGetDeviceProcAddr(dev, "vkAcquireProfilingLockKHR");
+  out.release_profiling_lock = (PFN_vkReleaseProfilingLockKHR)
+    vkGetDeviceProcAddr(dev, "vkReleaseProfilingLockKHR");
+  out.reset_query_pool = (PFN_vkResetQueryPoolEXT)
+    vkGetDeviceProcAddr(dev, "vkResetQueryPoolEXT");
+  if (enum_counters == nullptr || out.get_npass == nullptr ||
+    out.acquire_profiling_lock == nullptr ||
+    out.release_profiling_lock == nullptr || out.reset_query_pool == nullptr
+  ) {
+    return {};
+  }
+
+  for (uint32_t qfam_idx : qfam_idxs) {
+    uint32_t ncounter = 0;
+    VK_ASSERT << enum_counters(physdev_detail.physdev, qfam_idx, &ncounter,
+      nullptr, nullptr);
+    std::vector<VkPerformanceCounterKHR> counters(ncounter);
+    std::vector<VkPerformanceCounterDescriptionKHR> descs(ncounter);
+    for (uint32_t i = 0; i < ncounter; ++i) {
+      counters[i].sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_KHR;
+      descs[i].sType = VK_STRUCTURE_TYPE_PERFORMANCE_COUNTER_DESCRIPTION_KHR;
+    }
+    VK_ASSERT << enum_counters(physdev_detail.physdev, qfam_idx, &ncounter,
+      counters.data(), descs.data());
+
+    std::vector<ContextPerformanceCounterDetail>& counter_details =
+      out.counters[qfam_idx];
+    for (uint32_t i = 0; i < ncounter; ++i) {
+      ContextPerformanceCounterDetail counter_detail {};
+      counter_detail.counter = counters[i];
+      counter_detail.counter.pNext = nullptr;
+      counter_detail.desc = descs[i];
+      counter_detail.desc.pNext = nullptr;
+      counter_details.emplace_back(std::move(counter_detail));
+    }
+  }
+  out.is_supported = true;
+  return out;
+}
+
+bool _create_ctxt(
   const Instance& inst,
   const std::string& label,
   uint32_t dev_idx,
+  size_t mem_soft_limit,
+  bool is_single_queue,
+  bool is_capturable,
   const sys::SurfaceRef& surf,
   Context& out
 ) {
@@ -225,6 +462,53 @@ void _create_ctxt(
     }
   }
 
+  // Prefer a dedicated transfer-only queue family so that transfers overlap
+  // with compute and graphics work. Queue families with coarse image transfer
+  // granularity are not used because arbitrary image regions are copied.
+  bool is_transfer_dedicated = false;
+  for (uint32_t i = 0; i < qfam_props.size(); ++i) {
+    if (is_single_queue) { break; }
+    const auto& qfam_prop = qfam_props[i];
+    const VkExtent3D& gran = qfam_prop.minImageTransferGranularity;
+    const VkQueueFlags general_flags =
+      VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+    if (
+      qfam_prop.queueCount > 0 &&
+      (qfam_prop.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0 &&
+      (qfam_prop.queueFlags & general_flags) == 0 &&
+      gran.width == 1 && gran.height == 1 && gran.depth == 1
+    ) {
+      queue_allocs[L_SUBMIT_TYPE_TRANSFER] = i;
+      is_transfer_dedicated = true;
+      L_DEBUG("context '", label, "' uses dedicated transfer queue family #",
+        i);
+      break;
+    }
+  }
+
+  // Async compute goes to a compute queue family without graphics capability
+  // so that it runs concurrently with the graphics queue. Otherwise it falls
+  // back to the compute queue and is executed in submission order.
+  queue_allocs[L_SUBMIT_TYPE_ASYNC_COMPUTE] =
+    queue_allocs[L_SUBMIT_TYPE_COMPUTE];
+  bool is_async_compute_dedicated = false;
+  for (uint32_t i = 0; i < qfam_props.size(); ++i) {
+    if (is_single_queue) { break; }
+    const auto& qfam_prop = qfam_props[i];
+    if (
+      qfam_prop.queueCount > 0 &&
+      (qfam_prop.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0 &&
+      (qfam_prop.queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0 &&
+      i != queue_allocs[L_SUBMIT_TYPE_COMPUTE]
+    ) {
+      queue_allocs[L_SUBMIT_TYPE_ASYNC_COMPUTE] = i;
+      is_async_compute_dedicated = true;
+      L_DEBUG("context '", label, "' uses dedicated async compute queue "
+        "family #", i);
+      break;
+    }
+  }
+
   std::set<uint32_t> allocated_qfam_idxs;
   std::vector<VkDeviceQueueCreateInfo> dqcis;
   const float default_queue_prior = 1.0f;
@@ -256,7 +540,73 @@ void _create_ctxt(
   }
   L_DEBUG("enabled device extensions: ", util::join(", ", dev_exts));
 
-  sys::DeviceRef dev = sys::create_dev(physdev_detail.physdev, dqcis, dev_exts, feat);
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT bindless_feat =
+    _make_bindless_feat(inst, physdev_detail);
+  bool is_bindless_supported = bindless_feat.runtimeDescriptorArray == VK_TRUE;
+  if (!is_bindless_supported) {
+    L_WARN("context '", label, "' device does not support descriptor "
+      "indexing, bindless resources are not available");
+  }
+
+  VkPhysicalDeviceBufferDeviceAddressFeaturesKHR dev_addr_feat =
+    _make_dev_addr_feat(inst, physdev_detail);
+  bool is_dev_addr_supported = dev_addr_feat.bufferDeviceAddress == VK_TRUE;
+  if (!is_dev_addr_supported) {
+    L_WARN("context '", label, "' device does not support buffer device "
+      "address, buffers cannot be accessed by pointers");
+  }
+
+  // Submissions are tracked by timeline semaphores.
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_feat =
+    _make_timeline_feat(inst, physdev_detail);
+  if (timeline_feat.timelineSemaphore != VK_TRUE) {
+    L_ERROR("context '", label, "' device does not support timeline "
+      "semaphores");
+    return false;
+  }
+
+  // Performance counters are collected in the command buffers they are reset
+  // in, so the queries are reset on the host.
+  VkPhysicalDevicePerformanceQueryFeaturesKHR perf_query_feat =
+    _make_perf_query_feat(inst, physdev_detail);
+  VkPhysicalDeviceHostQueryResetFeaturesEXT host_query_reset_feat =
+    _make_host_query_reset_feat(inst, physdev_detail);
+  bool is_perf_query_supported =
+    perf_query_feat.performanceCounterQueryPools == VK_TRUE &&
+    host_query_reset_feat.hostQueryReset == VK_TRUE;
+  if (!is_perf_query_supported) {
+    L_WARN("context '", label, "' device does not support performance "
+      "queries, performance counters are not collected");
+  }
+
+  // Chain extended features to enable.
+  void* dev_pnext = &timeline_feat;
+  if (is_perf_query_supported) {
+    perf_query_feat.pNext = dev_pnext;
+    host_query_reset_feat.pNext = &perf_query_feat;
+    dev_pnext = &host_query_reset_feat;
+  }
+  if (is_bindless_supported) {
+    bindless_feat.pNext = dev_pnext;
+    dev_pnext = &bindless_feat;
+  }
+  if (is_dev_addr_supported) {
+    dev_addr_feat.pNext = dev_pnext;
+    dev_pnext = &dev_addr_feat;
+  }
+
+  sys::DeviceRef dev = sys::create_dev(physdev_detail.physdev, dqcis, dev_exts,
+    feat, dev_pnext);
+
+  // One timeline for each queue allocated above.
+  std::map<uint32_t, std::shared_ptr<ContextQueueTimeline>> timelines;
+  for (uint32_t qfam_idx : allocated_qfam_idxs) {
+    ContextQueueTimeline timeline {};
+    timeline.sema = sys::create_timeline_sema(dev->dev, 0);
+    timeline.last_value = 0;
+    timelines[qfam_idx] =
+      std::make_shared<ContextQueueTimeline>(std::move(timeline));
+  }
 
   std::map<SubmitType, ContextSubmitDetail> submit_details;
   for (const auto& pair : queue_allocs) {
@@ -268,6 +618,7 @@ void _create_ctxt(
     ContextSubmitDetail submit_detail {};
     submit_detail.qfam_idx = qfam_idx;
     submit_detail.queue = sys::get_dev_queue(dev->dev, qfam_idx, 0);
+    submit_detail.timeline = timelines.at(qfam_idx);
     submit_details.insert(std::make_pair<SubmitType, ContextSubmitDetail>(
       std::move(submit_ty), std::move(submit_detail)));
   }
@@ -293,9 +644,73 @@ void _create_ctxt(
   allocatorInfo.physicalDevice = physdev;
   allocatorInfo.device = dev->dev;
   allocatorInfo.instance = inst.inst->inst;
+  // Without `VK_EXT_memory_budget`, VMA estimates heap budgets from heap sizes.
+  if (physdev_detail.ext_props.count(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+    allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+  } else {
+    L_WARN("context '", label, "' device does not support memory budget "
+      "queries, heap budgets are estimated");
+  }
+
+  if (is_dev_addr_supported) {
+    allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+  }
 
   sys::AllocatorRef allocator = sys::Allocator::create(&allocatorInfo);
 
+  ContextDeviceAddressDetail dev_addr_detail {};
+  if (is_dev_addr_supported) {
+    dev_addr_detail.get_buf_dev_addr = (PFN_vkGetBufferDeviceAddressKHR)
+      vkGetDeviceProcAddr(dev->dev, "vkGetBufferDeviceAddressKHR");
+  }
+
+  // Draw counts in buffers are core in Vulkan 1.2 and otherwise provided by
+  // `VK_KHR_draw_indirect_count`.
+  ContextDrawIndirectCountDetail draw_indirect_count_detail {};
+  draw_indirect_count_detail.draw_indirect_count =
+    (PFN_vkCmdDrawIndirectCountKHR)vkGetDeviceProcAddr(dev->dev,
+      "vkCmdDrawIndirectCountKHR");
+  draw_indirect_count_detail.draw_idxed_indirect_count =
+    (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(dev->dev,
+      "vkCmdDrawIndexedIndirectCountKHR");
+  if (draw_indirect_count_detail.draw_indirect_count == nullptr ||
+    draw_indirect_count_detail.draw_idxed_indirect_count == nullptr
+  ) {
+    L_WARN("context '", label, "' device does not support draw indirect "
+      "count, indirect draws cannot source draw counts from buffers");
+    draw_indirect_count_detail = {};
+  }
+
+  ContextTimelineDetail timeline_detail {};
+  timeline_detail.get_sema_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)
+    vkGetDeviceProcAddr(dev->dev, "vkGetSemaphoreCounterValueKHR");
+  timeline_detail.wait_semas = (PFN_vkWaitSemaphoresKHR)
+    vkGetDeviceProcAddr(dev->dev, "vkWaitSemaphoresKHR");
+  timeline_detail.signal_sema = (PFN_vkSignalSemaphoreKHR)
+    vkGetDeviceProcAddr(dev->dev, "vkSignalSemaphoreKHR");
+
+  ContextHostImportDetail host_import_detail =
+    _make_host_import_detail(inst, physdev_detail, dev->dev);
+  if (host_import_detail.align == 0) {
+    L_WARN("context '", label, "' device cannot import host memory, imported "
+      "buffers fall back to copies");
+  }
+
+  ContextPerformanceQueryDetail perf_query_detail {};
+  if (is_perf_query_supported) {
+    perf_query_detail = _make_perf_query_detail(inst, physdev_detail,
+      dev->dev, allocated_qfam_idxs);
+    perf_query_detail.is_multi_pool_supported =
+      perf_query_feat.performanceCounterMultipleQueryPools == VK_TRUE;
+  }
+
+  ContextBindlessDetail bindless_detail {};
+  bindless_detail.is_supported = is_bindless_supported;
+
+  ContextMemoryDetail mem_detail {};
+  mem_detail.soft_limit = mem_soft_limit;
+  mem_detail.last_query_time = std::chrono::high_resolution_clock::now();
+
   out.label = label;
   out.iphysdev = dev_idx;
   out.dev = std::move(dev);
@@ -305,38 +720,218 @@ void _create_ctxt(
   out.depth_img_samplers = std::move(depth_img_samplers);
   out.desc_set_detail = {};
   out.cmd_pool_pool = {};
+  out.fence_pool = {};
+  out.sema_pool = {};
   out.query_pool_pool = {};
+  out.defrag_detail = {};
   out.allocator = std::move(allocator);
+  out.mem_detail = std::move(mem_detail);
+  out.host_import_detail = std::move(host_import_detail);
+  out.bindless_detail = std::move(bindless_detail);
+  out.dev_addr_detail = std::move(dev_addr_detail);
+  out.draw_indirect_count_detail = std::move(draw_indirect_count_detail);
+  out.timeline_detail = std::move(timeline_detail);
+  out.perf_query_detail = std::move(perf_query_detail);
+  out.deletion_queue = std::make_unique<ContextDeletionQueue>();
+  for (const auto& pair : timelines) {
+    out.deletion_queue->timelines.emplace_back(pair.second);
+  }
+  out.queue_stats = ContextQueueStatistics {};
+  out.barrier_stats = ContextBarrierStatistics {};
+  out.cache_stats = ContextCacheStatistics {};
+  out.record_stats = ContextRecordStatistics {};
+  out.rsc_stats = ContextResourceStatistics {};
+  out.queue_stats.is_transfer_dedicated = is_transfer_dedicated;
+  out.queue_stats.is_async_compute_dedicated = is_async_compute_dedicated;
+  out.transfer_size_last_query = 0;
+  out.queue_stats_last_query_time = std::chrono::high_resolution_clock::now();
+  out.is_capturable = is_capturable;
 
   L_DEBUG("created vulkan context '", label, "' on device #", dev_idx, ": ",
     inst.physdev_details.at(dev_idx).desc);
+  return true;
 }
 
 bool Context::create(const Instance& inst, const ContextConfig& cfg, Context& out) {
-  _create_ctxt(inst, cfg.label, cfg.dev_idx, VK_NULL_HANDLE, out);
-  return true;
+  return _create_ctxt(inst, cfg.label, cfg.dev_idx, cfg.mem_soft_limit,
+    cfg.is_single_queue, cfg.is_capturable, VK_NULL_HANDLE, out);
 }
 bool Context::create(const Instance& inst, const ContextWindowsConfig& cfg, Context& out) {
   sys::SurfaceRef surf = _create_surf_windows(cfg);
-  _create_ctxt(inst, cfg.label, cfg.dev_idx, surf, out);
-  return true;
+  return _create_ctxt(inst, cfg.label, cfg.dev_idx, cfg.mem_soft_limit,
+    cfg.is_single_queue, cfg.is_capturable, surf, out);
 }
 bool Context::create(const Instance& inst, const ContextAndroidConfig& cfg, Context& out) {
   sys::SurfaceRef surf = _create_surf_android(cfg);
-  _create_ctxt(inst, cfg.label, cfg.dev_idx, surf, out);
-  return true;
+  return _create_ctxt(inst, cfg.label, cfg.dev_idx, cfg.mem_soft_limit,
+    cfg.is_single_queue, cfg.is_capturable, surf, out);
 }
 bool Context::create(const Instance& inst, const ContextMetalConfig& cfg, Context& out) {
   sys::SurfaceRef surf = _create_surf_metal(cfg);
-  _create_ctxt(inst, cfg.label, cfg.dev_idx, surf, out);
-  return true;
+  return _create_ctxt(inst, cfg.label, cfg.dev_idx, cfg.mem_soft_limit,
+    cfg.is_single_queue, cfg.is_capturable, surf, out);
 }
 Context::~Context() {
+  if (deletion_queue) {
+    // Completion callbacks and deleters might drop more resources.
+    reaper.reset();
+    while (!deletion_queue->entries.empty()) {
+      reap_deletions(true);
+    }
+  }
+  if (perf_query_detail.is_locked) {
+    perf_query_detail.release_profiling_lock(*dev);
+  }
+  if (defrag_detail.defrag_ctxt != VK_NULL_HANDLE) {
+    flush_defrag_pass();
+    vmaEndDefragmentation(*allocator, defrag_detail.defrag_ctxt, nullptr);
+  }
   if (dev) {
     L_DEBUG("destroyed vulkan context '", label, "'");
   }
 }
 
+bool Context::alloc_mem(MemoryCategory mem_cat, size_t size) {
+  // Release the memory of dropped resources the device is done with first.
+  if (deletion_queue) {
+    reap_deletions(false);
+  }
+
+  L_ASSERT(mem_cat != L_MEMORY_CATEGORY_DESCRIPTOR,
+    "descriptors must be counted with `alloc_descs`");
+  MemoryCategoryStatistics& cat_stats = mem_detail.cat_stats.at(mem_cat);
+  bool is_over_limit = mem_detail.soft_limit != 0 &&
+    mem_detail.size + size > mem_detail.soft_limit;
+  // Memory still held by resources in flight is only released by waiting.
+  if (is_over_limit && deletion_queue) {
+    reap_deletions(true);
+    is_over_limit = mem_detail.size + size > mem_detail.soft_limit;
+  }
+  if (is_over_limit) {
+    L_ERROR("context '", label, "' cannot allocate ", size, " bytes "
+      "because it would exceed the memory soft limit (", mem_detail.size,
+      " of ", mem_detail.soft_limit, " bytes are already allocated)");
+    return false;
+  }
+  mem_detail.size += size;
+  mem_detail.peak_size.push((int64_t)mem_detail.size);
+  cat_stats.nalloc += 1;
+  cat_stats.nalloc_total += 1;
+  cat_stats.size += size;
+  return true;
+}
+void Context::free_mem(MemoryCategory mem_cat, size_t size) {
+  MemoryCategoryStatistics& cat_stats = mem_detail.cat_stats.at(mem_cat);
+  mem_detail.size -= size;
+  cat_stats.nalloc -= 1;
+  cat_stats.size -= size;
+}
+void Context::alloc_descs(size_t ndesc) {
+  MemoryCategoryStatistics& cat_stats =
+    mem_detail.cat_stats.at(L_MEMORY_CATEGORY_DESCRIPTOR);
+  cat_stats.nalloc += 1;
+  cat_stats.nalloc_total += 1;
+  cat_stats.ndesc += ndesc;
+}
+
+ContextMemoryStatistics Context::get_mem_stats() const {
+  const VkPhysicalDeviceMemoryProperties& mem_prop = physdev_mem_prop();
+
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets {};
+  vmaGetHeapBudgets(*allocator, budgets.data());
+
+  std::vector<MemoryHeapStatistics> heaps;
+  heaps.reserve(mem_prop.memoryHeapCount);
+  for (uint32_t i = 0; i < mem_prop.memoryHeapCount; ++i) {
+    const VmaBudget& budget = budgets[i];
+
+    MemoryHeapStatistics heap {};
+    heap.is_dev_local =
+      (mem_prop.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    heap.usage = budget.usage;
+    heap.budget = budget.budget;
+    heap.nalloc = budget.statistics.allocationCount;
+    heap.alloc_size = budget.statistics.allocationBytes;
+    heaps.emplace_back(std::move(heap));
+  }
+
+  // Allocation rate is sampled on each query and accumulated to the average.
+  uint64_t nalloc_total = 0;
+  for (const auto& cat_stats : mem_detail.cat_stats) {
+    nalloc_total += cat_stats.nalloc_total;
+  }
+  auto now = std::chrono::high_resolution_clock::now();
+  double dt = std::chrono::duration<double>(now - mem_detail.last_query_time).count();
+  double alloc_rate = dt > 0.0 ?
+    (nalloc_total - mem_detail.nalloc_total_last_query) / dt : 0.0;
+  mem_detail.alloc_rate.push(alloc_rate);
+  mem_detail.nalloc_total_last_query = nalloc_total;
+  mem_detail.last_query_time = now;
+
+  ContextMemoryStatistics out {};
+  out.heaps = std::move(heaps);
+  out.bufs = mem_detail.cat_stats.at(L_MEMORY_CATEGORY_BUFFER);
+  out.imgs = mem_detail.cat_stats.at(L_MEMORY_CATEGORY_IMAGE);
+  out.stage_bufs = mem_detail.cat_stats.at(L_MEMORY_CATEGORY_STAGING);
+  out.descs = mem_detail.cat_stats.at(L_MEMORY_CATEGORY_DESCRIPTOR);
+  out.aliased = mem_detail.cat_stats.at(L_MEMORY_CATEGORY_ALIASED);
+  out.size = mem_detail.size;
+  out.peak_size = mem_detail.peak_size.has_value() ?
+    (size_t)(int64_t)mem_detail.peak_size : 0;
+  out.alloc_rate = alloc_rate;
+  out.avg_alloc_rate = mem_detail.alloc_rate;
+  return out;
+}
+ContextQueueStatistics Context::get_queue_stats() const {
+  // Transfer rate is sampled on each query.
+  auto now = std::chrono::high_resolution_clock::now();
+  double dt = std::chrono::duration<double>(
+    now - queue_stats_last_query_time).count();
+  ContextQueueStatistics out = queue_stats;
+  out.transfer_rate = dt > 0.0 ?
+    (queue_stats.transfer_size - transfer_size_last_query) / dt : 0.0;
+  transfer_size_last_query = queue_stats.transfer_size;
+  queue_stats_last_query_time = now;
+  return out;
+}
+ContextBarrierStatistics Context::get_barrier_stats() const {
+  return barrier_stats;
+}
+ContextCacheStatistics Context::get_cache_stats() const {
+  return cache_stats;
+}
+ContextRecordStatistics Context::get_record_stats() const {
+  return record_stats;
+}
+ContextResourceStatistics Context::get_rsc_stats() const {
+  return rsc_stats;
+}
+void Context::reset_stats() {
+  // Queue configuration is not a counter.
+  ContextQueueStatistics queue_stats2 {};
+  queue_stats2.is_transfer_dedicated = queue_stats.is_transfer_dedicated;
+  queue_stats2.is_async_compute_dedicated =
+    queue_stats.is_async_compute_dedicated;
+  queue_stats = queue_stats2;
+  transfer_size_last_query = 0;
+  barrier_stats = {};
+  cache_stats = {};
+  record_stats = {};
+  rsc_stats = {};
+}
+
+bool Context::can_write_directly(VkDeviceSize size) const {
+  const InstancePhysicalDeviceMemoryDetail& physdev_mem = physdev_mem_detail();
+  if (physdev_mem.mem_arch == L_DEVICE_MEMORY_ARCHITECTURE_DISCRETE) {
+    return false;
+  }
+
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets {};
+  vmaGetHeapBudgets(*allocator, budgets.data());
+  const VmaBudget& budget = budgets.at(physdev_mem.direct_write_heap_idx);
+  return budget.usage + size <= budget.budget;
+}
+
 
 sys::DescriptorSetLayoutRef _create_desc_set_layout(
   const Context& ctxt,
@@ -378,10 +973,13 @@ sys::DescriptorSetLayoutRef Context::get_desc_set_layout(
   const std::vector<ResourceType>& rsc_tys
 ) {
   DescriptorSetKey desc_set_key = DescriptorSetKey::create(rsc_tys);
-  auto it = desc_set_detail.desc_set_layouts.find(desc_set_key);
-  if (it != desc_set_detail.desc_set_layouts.end()) {
-    return it->second;
+  sys::DescriptorSetLayoutRef* cached =
+    desc_set_detail.desc_set_layouts.find(desc_set_key);
+  if (cached != nullptr) {
+    cache_stats.ndesc_set_layout_hit += 1;
+    return *cached;
   } else {
+    cache_stats.ndesc_set_layout_miss += 1;
     sys::DescriptorSetLayoutRef desc_set_layout =
       _create_desc_set_layout(*this, rsc_tys);
     desc_set_detail.desc_set_layouts[desc_set_key] = desc_set_layout;
@@ -453,11 +1051,16 @@ sys::DescriptorSetRef _alloc_desc_set(
 DescriptorSetKey DescriptorSetKey::create(
   const std::vector<ResourceType>& rsc_tys
 ) {
-  std::stringstream ss;
-  for (ResourceType rsc_ty : rsc_tys) {
-    ss << (uint32_t)rsc_ty << ",";
+  DescriptorSetKey out {};
+  out.nbinding = (uint32_t)rsc_tys.size();
+  for (size_t i = 0; i < rsc_tys.size(); ++i) {
+    if (i < DESC_SET_KEY_NINLINE_BINDING) {
+      out.rsc_tys[i] = (uint8_t)rsc_tys[i];
+    } else {
+      out.ext_rsc_tys.emplace_back((uint8_t)rsc_tys[i]);
+    }
   }
-  return { ss.str() };
+  return out;
 }
 
 
@@ -465,12 +1068,15 @@ DescriptorSetPoolItem Context::acquire_desc_set(const std::vector<ResourceType>&
   L_ASSERT(!rsc_tys.empty());
   DescriptorSetKey key = DescriptorSetKey::create(rsc_tys);
   if (desc_set_detail.desc_set_pool.has_free_item(key)) {
+    cache_stats.ndesc_set_hit += 1;
     return desc_set_detail.desc_set_pool.acquire(std::move(key));
   } else {
+    cache_stats.ndesc_set_miss += 1;
     sys::DescriptorPoolRef desc_pool = _create_desc_pool(*this, rsc_tys);
     sys::DescriptorSetLayoutRef desc_set_layout = get_desc_set_layout(rsc_tys);
     sys::DescriptorSetRef desc_set = _alloc_desc_set(*this, desc_pool->desc_pool, desc_set_layout->desc_set_layout);
     desc_set_detail.desc_pools.emplace_back(std::move(desc_pool));
+    alloc_descs(rsc_tys.size());
     return desc_set_detail.desc_set_pool.create(std::move(key), std::move(desc_set));
   }
 }
@@ -484,39 +1090,257 @@ sys::CommandPoolRef _create_cmd_pool(const Context& ctxt, SubmitType submit_ty)
   return sys::CommandPool::create(ctxt.dev->dev, &cpci);
 }
 
+// Whether the commands recorded in the command pool have completed.
+bool _is_cmd_pool_idle(const Context& ctxt, const ContextCommandPool& cmd_pool) {
+  if (cmd_pool.timeline_sema == nullptr) { return true; }
+  uint64_t value = 0;
+  VK_ASSERT << ctxt.timeline_detail.get_sema_counter_value(*ctxt.dev,
+    cmd_pool.timeline_sema->sema, &value);
+  return value >= cmd_pool.timeline_value;
+}
 CommandPoolPoolItem Context::acquire_cmd_pool(SubmitType submit_ty) {
-  if (cmd_pool_pool.has_free_item(submit_ty)) {
+  // The last returned pool is the most recently used one. If it's still in
+  // use, so are the others probably.
+  if (
+    cmd_pool_pool.has_free_item(submit_ty) &&
+    _is_cmd_pool_idle(*this, cmd_pool_pool.inner.items.at(submit_ty).back())
+  ) {
     CommandPoolPoolItem item {};
     item = cmd_pool_pool.acquire(std::move(submit_ty));
-    VK_ASSERT << vkResetCommandPool(*dev, *item.value(), 0);
+    VK_ASSERT << vkResetCommandPool(*dev, *item.value().cmd_pool, 0);
+    item.value().timeline_sema = nullptr;
+    item.value().timeline_value = 0;
     return item;
   } else {
-    sys::CommandPoolRef cmd_pool = _create_cmd_pool(*this, submit_ty);
+    ContextCommandPool cmd_pool {};
+    cmd_pool.cmd_pool = _create_cmd_pool(*this, submit_ty);
+    queue_stats.ncmd_pool_create += 1;
     return cmd_pool_pool.create(std::move(submit_ty), std::move(cmd_pool));
   }
 }
+sys::CommandBufferRef Context::get_cmdbuf(
+  CommandPoolPoolItem& cmd_pool,
+  VkCommandBufferLevel level
+) {
+  sys::CommandBufferRef& cmdbuf = cmd_pool.value().cmdbufs.at(level);
+  if (cmdbuf == nullptr) {
+    VkCommandBufferAllocateInfo cbai {};
+    cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cbai.level = level;
+    cbai.commandBufferCount = 1;
+    cbai.commandPool = *cmd_pool.value().cmd_pool;
+    cmdbuf = sys::CommandBuffer::create(*dev, &cbai);
+    queue_stats.ncmdbuf_alloc += 1;
+  }
+  return cmdbuf;
+}
 
+// Return fences of completed transactions to the pool.
+void _recycle_reaped_fences(Context& ctxt) {
+  if (ctxt.reaper) {
+    // Dropped here, on the thread owning the context.
+    std::vector<FencePoolItem> fences = ctxt.reaper->take_done_fences();
+  }
+}
+FencePoolItem Context::acquire_fence(SubmitType submit_ty) {
+  _recycle_reaped_fences(*this);
 
-sys::QueryPoolRef _create_query_pool(
-  const Context& ctxt,
+  // Fences still waited by the device cannot be reset.
+  if (
+    fence_pool.has_free_item(submit_ty) &&
+    vkGetFenceStatus(*dev, *fence_pool.inner.items.at(submit_ty).back()) ==
+      VK_SUCCESS
+  ) {
+    FencePoolItem item = fence_pool.acquire(std::move(submit_ty));
+    VK_ASSERT << vkResetFences(*dev, 1, &item.value()->fence);
+    return item;
+  } else {
+    sys::FenceRef fence = sys::Fence::create(*dev);
+    queue_stats.nfence_create += 1;
+    return fence_pool.create(std::move(submit_ty), std::move(fence));
+  }
+}
+bool _is_sema_idle(const Context& ctxt, const ContextSemaphore& sema) {
+  if (!sema.fence.is_valid()) { return true; }
+  return vkGetFenceStatus(*ctxt.dev, sema.fence.value()->fence) == VK_SUCCESS;
+}
+SemaphorePoolItem Context::acquire_sema(SubmitType submit_ty) {
+  // Semaphores still waited by the presentation engine cannot be signaled
+  // again.
+  if (
+    sema_pool.has_free_item(submit_ty) &&
+    _is_sema_idle(*this, sema_pool.inner.items.at(submit_ty).back())
+  ) {
+    SemaphorePoolItem item = sema_pool.acquire(std::move(submit_ty));
+    item.value().fence.release();
+    return item;
+  } else {
+    ContextSemaphore sema {};
+    sema.sema = sys::Semaphore::create(*dev);
+    queue_stats.nsema_create += 1;
+    return sema_pool.create(std::move(submit_ty), std::move(sema));
+  }
+}
+
+thread_pool::ThreadPool& Context::get_record_thread_pool() {
+  if (record_thread_pool == nullptr) {
+    // The submitting thread records too.
+    uint32_t nthread = std::thread::hardware_concurrency();
+    nthread = nthread > 1 ? nthread - 1 : 0;
+    record_thread_pool = std::make_unique<thread_pool::ThreadPool>(nthread);
+    L_DEBUG("created ", nthread, " command recording threads for context '",
+      label, "'");
+  }
+  return *record_thread_pool;
+}
+ContextReaper& Context::get_reaper() {
+  if (reaper == nullptr) {
+    reaper = std::make_unique<ContextReaper>(*this);
+    L_DEBUG("created reaper thread for context '", label, "'");
+  }
+  return *reaper;
+}
+
+void Context::defer_deletion(std::function<void()>&& deleter) {
+  ContextDeletionEntry entry {};
+  entry.values.reserve(deletion_queue->timelines.size());
+  for (const auto& timeline : deletion_queue->timelines) {
+    entry.values.emplace_back(timeline->last_value);
+  }
+  entry.deleter = std::move(deleter);
+
+  std::lock_guard<std::mutex> guard(deletion_queue->sync);
+  deletion_queue->entries.emplace_back(std::move(entry));
+}
+std::vector<uint64_t> Context::get_timeline_values() const {
+  std::vector<uint64_t> out;
+  out.reserve(deletion_queue->timelines.size());
+  for (const auto& timeline : deletion_queue->timelines) {
+    out.emplace_back(timeline->last_value);
+  }
+  return out;
+}
+bool Context::is_timeline_passed(
+  const std::vector<uint64_t>& values,
+  bool is_blocking
+) const {
+  const auto& timelines = deletion_queue->timelines;
+  L_ASSERT(values.size() == timelines.size());
+  if (is_blocking) {
+    std::vector<VkSemaphore> semas;
+    semas.reserve(timelines.size());
+    for (const auto& timeline : timelines) {
+      semas.emplace_back(timeline->sema->sema);
+    }
+    VkSemaphoreWaitInfoKHR swi {};
+    swi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    swi.semaphoreCount = (uint32_t)semas.size();
+    swi.pSemaphores = semas.data();
+    swi.pValues = values.data();
+    VK_ASSERT << timeline_detail.wait_semas(*dev, &swi, UINT64_MAX);
+    return true;
+  }
+
+  for (size_t i = 0; i < timelines.size(); ++i) {
+    uint64_t value = 0;
+    VK_ASSERT << timeline_detail.get_sema_counter_value(*dev,
+      timelines.at(i)->sema->sema, &value);
+    if (value < values.at(i)) { return false; }
+  }
+  return true;
+}
+void Context::reap_deletions(bool is_blocking) {
+  _recycle_reaped_fences(*this);
+
+  ContextDeletionQueue& queue = *deletion_queue;
+  std::vector<std::function<void()>> deleters;
+  {
+    std::lock_guard<std::mutex> guard(queue.sync);
+    if (queue.entries.empty()) { return; }
+
+    std::vector<uint64_t> values(queue.timelines.size());
+    if (is_blocking) {
+      // The last entry has the greatest values.
+      const std::vector<uint64_t>& last_values = queue.entries.back().values;
+      std::vector<VkSemaphore> semas;
+      for (const auto& timeline : queue.timelines) {
+        semas.emplace_back(timeline->sema->sema);
+      }
+      VkSemaphoreWaitInfoKHR swi {};
+      swi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+      swi.semaphoreCount = (uint32_t)semas.size();
+      swi.pSemaphores = semas.data();
+      swi.pValues = last_values.data();
+      VK_ASSERT << timeline_detail.wait_semas(*dev, &swi, UINT64_MAX);
+      values = last_values;
+    } else {
+      for (size_t i = 0; i < queue.timelines.size(); ++i) {
+        VK_ASSERT << timeline_detail.get_sema_counter_value(*dev,
+          queue.timelines.at(i)->sema->sema, &values.at(i));
+      }
+    }
+
+    while (!queue.entries.empty()) {
+      const ContextDeletionEntry& entry = queue.entries.front();
+      bool is_done = true;
+      for (size_t i = 0; i < values.size(); ++i) {
+        if (values.at(i) < entry.values.at(i)) {
+          is_done = false;
+          break;
+        }
+      }
+      if (!is_done) { break; }
+      deleters.emplace_back(std::move(queue.entries.front().deleter));
+      queue.entries.pop_front();
+    }
+  }
+
+  // Deleters can drop more resources so they are called without the lock.
+  for (const auto& deleter : deleters) {
+    deleter();
+  }
+}
+
+
+sys::QueryPoolRef Context::create_query_pool(
   VkQueryType query_ty,
-  uint32_t nquery
-) {
+  uint32_t nquery,
+  VkQueryPipelineStatisticFlags pipe_stats_flags,
+  const void* pnext
+) const {
   VkQueryPoolCreateInfo qpci {};
   qpci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  qpci.pNext = pnext;
   qpci.queryType = query_ty;
   qpci.queryCount = nquery;
-  return sys::QueryPool::create(*ctxt.dev, &qpci);
+  qpci.pipelineStatistics = pipe_stats_flags;
+  return sys::QueryPool::create(*dev, &qpci);
 }
 
 QueryPoolPoolItem Context::acquire_query_pool() {
   if (query_pool_pool.has_free_item(0)) {
     return query_pool_pool.acquire(0);
   } else {
-    sys::QueryPoolRef query_pool = _create_query_pool(*this, VK_QUERY_TYPE_TIMESTAMP, 2);
+    sys::QueryPoolRef query_pool = create_query_pool(VK_QUERY_TYPE_TIMESTAMP, 2);
     return query_pool_pool.create(0, std::move(query_pool));
   }
 }
+bool Context::acquire_profiling_lock() {
+  if (perf_query_detail.is_locked) { return true; }
+
+  VkAcquireProfilingLockInfoKHR apli {};
+  apli.sType = VK_STRUCTURE_TYPE_ACQUIRE_PROFILING_LOCK_INFO_KHR;
+  apli.timeout = UINT64_MAX;
+  VkResult err = perf_query_detail.acquire_profiling_lock(*dev, &apli);
+  if (err != VK_SUCCESS) {
+    L_WARN("context '", label, "' cannot acquire the profiling lock, "
+      "performance counters are not collected");
+    return false;
+  }
+  perf_query_detail.is_locked = true;
+  L_DEBUG("context '", label, "' acquired the profiling lock");
+  return true;
+}
 
 } // namespace vk
 } // namespace liong
@@ -0,0 +1,410 @@
+#include <algorithm>
+#include "gft/vk.hpp"
+#include "gft/log.hpp"
+
+namespace liong {
+namespace vk {
+
+// Maximal number of allocations relocated in a single defragmentation pass.
+// Resources of a pass are only swapped in after all its copies complete so
+// this bounds how long a pass stays pending.
+constexpr uint32_t MAX_DEFRAG_PASS_NALLOC = 64;
+
+void _calc_frag(const Context& ctxt, double& frag, uint32_t& nblock) {
+  VmaTotalStatistics stats {};
+  vmaCalculateStatistics(*ctxt.allocator, &stats);
+  const VmaDetailedStatistics& total = stats.total;
+
+  VkDeviceSize free_size =
+    total.statistics.blockBytes - total.statistics.allocationBytes;
+  frag = free_size > 0 ?
+    1.0 - (double)total.unusedRangeSizeMax / (double)free_size : 0.0;
+  frag = std::max(frag, 0.0);
+  nblock = total.statistics.blockCount;
+}
+
+void _record_defrag_copies(
+  VkCommandBuffer cmdbuf,
+  const std::vector<DefragmentationBufferMove>& buf_moves,
+  const std::vector<DefragmentationImageMove>& img_moves
+) {
+  std::vector<VkImageMemoryBarrier> imbs;
+  imbs.reserve(img_moves.size() * 2);
+  for (const auto& img_move : img_moves) {
+    const Image& img = *img_move.img;
+
+    VkImageMemoryBarrier imb {};
+    imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imb.subresourceRange.layerCount = 1;
+    imb.subresourceRange.levelCount = 1;
+
+    imb.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    imb.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imb.oldLayout = img.dyn_detail.layout;
+    imb.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imb.image = img.img->img;
+    imbs.emplace_back(imb);
+
+    imb.srcAccessMask = 0;
+    imb.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imb.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imb.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    imb.image = img_move.new_img;
+    imbs.emplace_back(imb);
+  }
+
+  // Resources can be last written by any command and the host.
+  VkMemoryBarrier mb {};
+  mb.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  mb.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+  mb.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  vkCmdPipelineBarrier(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &mb, 0, nullptr,
+    (uint32_t)imbs.size(), imbs.data());
+
+  for (const auto& buf_move : buf_moves) {
+    VkBufferCopy bc {};
+    bc.size = buf_move.buf->bci.size;
+    vkCmdCopyBuffer(cmdbuf, buf_move.buf->buf->buf, buf_move.new_buf, 1, &bc);
+  }
+  for (const auto& img_move : img_moves) {
+    const Image& img = *img_move.img;
+
+    VkImageCopy ic {};
+    ic.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    ic.srcSubresource.layerCount = 1;
+    ic.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    ic.dstSubresource.layerCount = 1;
+    ic.extent = img.ici.extent;
+    vkCmdCopyImage(cmdbuf,
+      img.img->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      img_move.new_img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      1, &ic);
+  }
+}
+// Submit the copies of the pending pass. The copies wait for all the work
+// submitted to any queue so far because any of it might access the resources.
+void _submit_defrag_copies(Context& ctxt) {
+  ContextDefragmentationDetail& defrag_detail = ctxt.defrag_detail;
+
+  SubmitType submit_ty = ctxt.submit_details.begin()->first;
+  VkQueue queue = ctxt.submit_details.begin()->second.queue;
+  CommandPoolPoolItem cmd_pool = ctxt.acquire_cmd_pool(submit_ty);
+  sys::CommandBufferRef cmdbuf =
+    ctxt.get_cmdbuf(cmd_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+  VkCommandBufferBeginInfo cbbi {};
+  cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cbbi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_ASSERT << vkBeginCommandBuffer(*cmdbuf, &cbbi);
+  _record_defrag_copies(*cmdbuf, defrag_detail.buf_moves,
+    defrag_detail.img_moves);
+  VK_ASSERT << vkEndCommandBuffer(*cmdbuf);
+
+  std::vector<VkSemaphore> wait_semas;
+  std::vector<uint64_t> wait_values;
+  for (const auto& timeline : ctxt.deletion_queue->timelines) {
+    wait_semas.emplace_back(timeline->sema->sema);
+    wait_values.emplace_back(timeline->last_value);
+  }
+  std::vector<VkPipelineStageFlags> wait_stages(wait_semas.size(),
+    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+  ContextQueueTimeline& timeline =
+    *ctxt.submit_details.begin()->second.timeline;
+  uint64_t signal_value = ++timeline.last_value;
+
+  VkTimelineSemaphoreSubmitInfoKHR tssi {};
+  tssi.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+  tssi.waitSemaphoreValueCount = (uint32_t)wait_values.size();
+  tssi.pWaitSemaphoreValues = wait_values.data();
+  tssi.signalSemaphoreValueCount = 1;
+  tssi.pSignalSemaphoreValues = &signal_value;
+
+  VkSubmitInfo submit_info {};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = &tssi;
+  submit_info.waitSemaphoreCount = (uint32_t)wait_semas.size();
+  submit_info.pWaitSemaphores = wait_semas.data();
+  submit_info.pWaitDstStageMask = wait_stages.data();
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &cmdbuf->cmdbuf;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &timeline.sema->sema;
+  VK_ASSERT << vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+
+  cmd_pool.value().timeline_sema = timeline.sema;
+  cmd_pool.value().timeline_value = signal_value;
+  defrag_detail.timeline_sema = timeline.sema;
+  defrag_detail.signal_value = signal_value;
+  defrag_detail.cmd_pool = std::move(cmd_pool);
+}
+// Wait at most `timeout_ns` for the copies of the pending pass. Returns `false`
+// if they are still in flight.
+bool _wait_defrag_copies(Context& ctxt, uint64_t timeout_ns) {
+  ContextDefragmentationDetail& defrag_detail = ctxt.defrag_detail;
+  if (defrag_detail.timeline_sema == nullptr) { return true; }
+
+  VkSemaphoreWaitInfoKHR swi {};
+  swi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+  swi.semaphoreCount = 1;
+  swi.pSemaphores = &defrag_detail.timeline_sema->sema;
+  swi.pValues = &defrag_detail.signal_value;
+  VkResult err = ctxt.timeline_detail.wait_semas(*ctxt.dev, &swi, timeout_ns);
+  if (err == VK_TIMEOUT) { return false; }
+  VK_ASSERT << err;
+  return true;
+}
+
+// Begin a pass and submit copies of the resources it proposes to relocate.
+// Moves of unknown allocations or resources referenced by invocations are
+// ignored. Returns `true` if there is nothing left to move.
+bool _begin_defrag_pass(Context& ctxt, DefragmentationStatistics& stats) {
+  ContextDefragmentationDetail& defrag_detail = ctxt.defrag_detail;
+  VkDevice dev = *ctxt.dev;
+  VmaAllocator allocator = *ctxt.allocator;
+
+  VmaDefragmentationPassMoveInfo pmi {};
+  VkResult res = vmaBeginDefragmentationPass(allocator,
+    defrag_detail.defrag_ctxt, &pmi);
+  if (res == VK_SUCCESS) {
+    return true;
+  } else if (res != VK_INCOMPLETE) {
+    VK_ASSERT << res;
+  }
+
+  // Resources owned by another queue family cannot be read by the copies
+  // without an ownership transfer.
+  uint32_t qfam_idx = ctxt.submit_details.begin()->second.qfam_idx;
+  auto is_foreign_owned = [&](uint32_t owner_qfam_idx) {
+    return owner_qfam_idx != VK_QUEUE_FAMILY_IGNORED &&
+      owner_qfam_idx != qfam_idx;
+  };
+  auto is_pinned = [&](VmaAllocation alloc) {
+    return defrag_detail.npins.find(alloc) != defrag_detail.npins.end();
+  };
+
+  std::vector<DefragmentationBufferMove> buf_moves;
+  std::vector<DefragmentationImageMove> img_moves;
+  for (uint32_t i = 0; i < pmi.moveCount; ++i) {
+    VmaDefragmentationMove& move = pmi.pMoves[i];
+
+    VmaAllocationInfo ai {};
+    vmaGetAllocationInfo(allocator, move.srcAllocation, &ai);
+
+    auto buf_it = defrag_detail.bufs.find(move.srcAllocation);
+    auto img_it = defrag_detail.imgs.find(move.srcAllocation);
+    if (buf_it != defrag_detail.bufs.end()) {
+      Buffer& buf = *buf_it->second;
+      if (
+        is_pinned(move.srcAllocation) ||
+        is_foreign_owned(buf.dyn_detail.qfam_idx)
+      ) {
+        move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+        stats.nskip += 1;
+        continue;
+      }
+
+      DefragmentationBufferMove buf_move {};
+      buf_move.buf = &buf;
+      buf_move.size = ai.size;
+      buf_move.imove = i;
+      VK_ASSERT << vkCreateBuffer(dev, &buf.bci, nullptr, &buf_move.new_buf);
+      VK_ASSERT << vmaBindBufferMemory(allocator, move.dstTmpAllocation,
+        buf_move.new_buf);
+      buf_moves.emplace_back(std::move(buf_move));
+
+    } else if (img_it != defrag_detail.imgs.end()) {
+      Image& img = *img_it->second;
+      if (
+        is_pinned(move.srcAllocation) ||
+        is_foreign_owned(img.dyn_detail.qfam_idx)
+      ) {
+        move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+        stats.nskip += 1;
+        continue;
+      }
+
+      DefragmentationImageMove img_move {};
+      img_move.img = &img;
+      img_move.size = ai.size;
+      img_move.imove = i;
+      VK_ASSERT << vkCreateImage(dev, &img.ici, nullptr, &img_move.new_img);
+      VK_ASSERT << vmaBindImageMemory(allocator, move.dstTmpAllocation,
+        img_move.new_img);
+      img_moves.emplace_back(std::move(img_move));
+
+    } else {
+      move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+    }
+  }
+
+  defrag_detail.is_pass_pending = true;
+  defrag_detail.pmi = pmi;
+  defrag_detail.buf_moves = std::move(buf_moves);
+  defrag_detail.img_moves = std::move(img_moves);
+  defrag_detail.pending_pinned_allocs.clear();
+  if (!defrag_detail.buf_moves.empty() || !defrag_detail.img_moves.empty()) {
+    _submit_defrag_copies(ctxt);
+  }
+  return false;
+}
+// Swap in the relocated resources of the pending pass whose copies have
+// completed, and end the pass. Returns `true` if there is nothing left to move.
+bool _end_defrag_pass(Context& ctxt, DefragmentationStatistics& stats) {
+  ContextDefragmentationDetail& defrag_detail = ctxt.defrag_detail;
+  VkDevice dev = *ctxt.dev;
+  VmaDefragmentationPassMoveInfo& pmi = defrag_detail.pmi;
+  uint32_t qfam_idx = ctxt.submit_details.begin()->second.qfam_idx;
+
+  // Resources referenced since the copies were submitted might have been
+  // written after the copies so the moves are cancelled.
+  auto is_pinned_since_submit = [&](VmaAllocation alloc) {
+    return defrag_detail.pending_pinned_allocs.find(alloc) !=
+      defrag_detail.pending_pinned_allocs.end();
+  };
+
+  // Swap in the new handles in place so that references to the resources
+  // remain valid.
+  for (auto& buf_move : defrag_detail.buf_moves) {
+    Buffer& buf = *buf_move.buf;
+    if (is_pinned_since_submit(buf.buf->alloc)) {
+      vkDestroyBuffer(dev, buf_move.new_buf, nullptr);
+      pmi.pMoves[buf_move.imove].operation =
+        VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      stats.nskip += 1;
+      continue;
+    }
+    vkDestroyBuffer(dev, buf.buf->buf, nullptr);
+    buf.buf->buf = buf_move.new_buf;
+    buf.dyn_detail.stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    buf.dyn_detail.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+    buf.dyn_detail.qfam_idx = qfam_idx;
+    for (const auto& pair : buf.bindless_idxs) {
+      ctxt.write_bindless_desc(pair.first, pair.second, buf);
+    }
+
+    stats.nmove += 1;
+    stats.move_size += buf_move.size;
+    L_DEBUG("relocated buffer '", buf.buf_cfg.label, "'");
+  }
+  for (auto& img_move : defrag_detail.img_moves) {
+    Image& img = *img_move.img;
+    if (is_pinned_since_submit(img.img->alloc)) {
+      vkDestroyImage(dev, img_move.new_img, nullptr);
+      pmi.pMoves[img_move.imove].operation =
+        VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      stats.nskip += 1;
+      continue;
+    }
+    img.ivci.image = img_move.new_img;
+    img.img_view = sys::ImageView::create(dev, &img.ivci);
+    vkDestroyImage(dev, img.img->img, nullptr);
+    img.img->img = img_move.new_img;
+    img.dyn_detail.stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    img.dyn_detail.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+    img.dyn_detail.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    img.dyn_detail.qfam_idx = qfam_idx;
+    for (const auto& pair : img.bindless_idxs) {
+      ctxt.write_bindless_desc(pair.first, pair.second, img);
+    }
+
+    stats.nmove += 1;
+    stats.move_size += img_move.size;
+    L_DEBUG("relocated image '", img.img_cfg.label, "'");
+  }
+
+  VkResult res = vmaEndDefragmentationPass(*ctxt.allocator,
+    defrag_detail.defrag_ctxt, &pmi);
+  if (res != VK_SUCCESS && res != VK_INCOMPLETE) {
+    VK_ASSERT << res;
+  }
+
+  defrag_detail.is_pass_pending = false;
+  defrag_detail.pmi = {};
+  defrag_detail.buf_moves.clear();
+  defrag_detail.img_moves.clear();
+  defrag_detail.pending_pinned_allocs.clear();
+  defrag_detail.timeline_sema = nullptr;
+  defrag_detail.signal_value = 0;
+  defrag_detail.cmd_pool.release();
+  return res == VK_SUCCESS;
+}
+
+void _end_defrag(Context& ctxt) {
+  ContextDefragmentationDetail& defrag_detail = ctxt.defrag_detail;
+  VmaDefragmentationStats ds {};
+  vmaEndDefragmentation(*ctxt.allocator, defrag_detail.defrag_ctxt, &ds);
+  defrag_detail.defrag_ctxt = VK_NULL_HANDLE;
+  L_INFO("finished defragmentation of context '", ctxt.label, "', ",
+    ds.bytesMoved, " bytes in ", ds.allocationsMoved, " allocations were "
+    "moved, ", ds.bytesFreed, " bytes in ", ds.deviceMemoryBlocksFreed,
+    " blocks were freed");
+}
+
+DefragmentationStatistics Context::defrag(double budget_us) {
+  util::Timer timer {};
+  timer.tic();
+
+  DefragmentationStatistics out {};
+  _calc_frag(*this, out.frag_before, out.nblock_before);
+
+  if (defrag_detail.defrag_ctxt == VK_NULL_HANDLE) {
+    VmaDefragmentationInfo di {};
+    di.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    di.maxAllocationsPerPass = MAX_DEFRAG_PASS_NALLOC;
+    VK_ASSERT << vmaBeginDefragmentation(*allocator, &di,
+      &defrag_detail.defrag_ctxt);
+    L_DEBUG("began defragmentation of context '", label, "'");
+  }
+
+  bool is_done = false;
+  for (;;) {
+    // A pass left pending by the last call is resumed first.
+    if (!defrag_detail.is_pass_pending && _begin_defrag_pass(*this, out)) {
+      is_done = true;
+      break;
+    }
+
+    // The host only waits for the copies as long as the budget allows; the
+    // pass is ended by a later call otherwise.
+    timer.toc();
+    double remain_us = std::max(budget_us - timer.us(), 0.0);
+    if (!_wait_defrag_copies(*this, (uint64_t)(remain_us * 1000.0))) {
+      break;
+    }
+    if (_end_defrag_pass(*this, out)) {
+      is_done = true;
+      break;
+    }
+
+    timer.toc();
+    if (timer.us() >= budget_us) { break; }
+  }
+
+  if (is_done) {
+    _end_defrag(*this);
+  }
+
+  _calc_frag(*this, out.frag_after, out.nblock_after);
+  out.is_done = is_done;
+
+  timer.toc();
+  L_DEBUG("defragmentation of context '", label, "' moved ", out.nmove,
+    " allocations (", out.move_size, " bytes) in ", timer.us(), "us, "
+    "fragmentation ", out.frag_before, " -> ", out.frag_after);
+  return out;
+}
+void Context::flush_defrag_pass() {
+  if (!defrag_detail.is_pass_pending) { return; }
+  DefragmentationStatistics stats {};
+  _wait_defrag_copies(*this, UINT64_MAX);
+  _end_defrag_pass(*this, stats);
+}
+
+} // namespace vk
+} // namespace liong
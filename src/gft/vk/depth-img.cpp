@@ -4,10 +4,10 @@
 namespace liong {
 namespace vk {
 
-bool DepthImage::create(
+void _make_depth_ici(
   const Context& ctxt,
   const DepthImageConfig& depth_img_cfg,
-  DepthImage& out
+  VkImageCreateInfo& out
 ) {
   VkFormat fmt = depth_fmt2vk(depth_img_cfg.fmt);
   VkImageUsageFlags usage = 0;
@@ -55,6 +55,29 @@ bool DepthImage::create(
   ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   ici.initialLayout = layout;
 
+  out = ici;
+}
+bool DepthImage::create(
+  const Context& ctxt,
+  const DepthImageConfig& depth_img_cfg,
+  DepthImage& out
+) {
+  VkImageCreateInfo ici {};
+  _make_depth_ici(ctxt, depth_img_cfg, ici);
+  VkFormat fmt = ici.format;
+  VkImageLayout layout = ici.initialLayout;
+
+  // Check the soft limit before anything is allocated.
+  VkMemoryRequirements mr {};
+  if (!DepthImage::get_aliased_mem_req(ctxt, depth_img_cfg, mr)) {
+    return false;
+  }
+  size_t mem_size = mr.size;
+  if (!const_cast<Context&>(ctxt).alloc_mem(L_MEMORY_CATEGORY_IMAGE, mem_size)) {
+    L_ERROR("failed to create depth image '", depth_img_cfg.label, "'");
+    return false;
+  }
+
   bool is_tile_mem = depth_img_cfg.usage & L_DEPTH_IMAGE_USAGE_TILE_MEMORY_BIT;
   sys::ImageRef img;
   VmaAllocationCreateInfo aci {};
@@ -94,17 +117,42 @@ bool DepthImage::create(
   dyn_detail.layout = layout;
   dyn_detail.access = 0;
   dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
+  dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
 
   out.ctxt = &ctxt;
   out.img = std::move(img);
   out.img_view = std::move(img_view);
   out.depth_img_cfg = depth_img_cfg;
+  out.mem_size = mem_size;
   out.dyn_detail = std::move(dyn_detail);
+  const_cast<Context&>(ctxt).rsc_stats.ndepth_img_create += 1;
   L_DEBUG("created depth image '", depth_img_cfg.label, "'");
   return true;
 }
+bool DepthImage::get_aliased_mem_req(
+  const Context& ctxt,
+  const DepthImageConfig& depth_img_cfg,
+  VkMemoryRequirements& out
+) {
+  VkImageCreateInfo ici {};
+  _make_depth_ici(ctxt, depth_img_cfg, ici);
+
+  VkImage img = VK_NULL_HANDLE;
+  VK_ASSERT << vkCreateImage(ctxt.dev->dev, &ici, nullptr, &img);
+  vkGetImageMemoryRequirements(ctxt.dev->dev, img, &out);
+  vkDestroyImage(ctxt.dev->dev, img, nullptr);
+  return true;
+}
 DepthImage::~DepthImage() {
   if (img) {
+    Context* ctxt2 = const_cast<Context*>(ctxt);
+    // The device might still be using the depth image.
+    ctxt2->defer_deletion([ctxt2, mem_size = mem_size, img = std::move(img),
+      img_view = std::move(img_view)]() {
+      if (mem_size != 0) {
+        ctxt2->free_mem(L_MEMORY_CATEGORY_IMAGE, mem_size);
+      }
+    });
     L_DEBUG("destroyed depth image '", depth_img_cfg.label, "'");
   }
 }
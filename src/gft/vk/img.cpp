@@ -4,7 +4,12 @@
 namespace liong {
 namespace vk {
 
-bool Image::create(const Context& ctxt, const ImageConfig& img_cfg, Image& out) {
+void _make_ici(
+  const Context& ctxt,
+  const ImageConfig& img_cfg,
+  VkImageCreateInfo& out,
+  VkImageViewType& out_img_view_ty
+) {
   VkFormat fmt = fmt2vk(img_cfg.fmt, img_cfg.cspace);
   VkImageUsageFlags usage = 0;
   SubmitType init_submit_ty = L_SUBMIT_TYPE_ANY;
@@ -20,6 +25,7 @@ bool Image::create(const Context& ctxt, const ImageConfig& img_cfg, Image& out)
   if (img_cfg.usage & L_IMAGE_USAGE_SAMPLED_BIT) {
     usage |=
       VK_IMAGE_USAGE_SAMPLED_BIT |
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
       VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     init_submit_ty = L_SUBMIT_TYPE_ANY;
   }
@@ -43,6 +49,11 @@ bool Image::create(const Context& ctxt, const ImageConfig& img_cfg, Image& out)
       VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
     init_submit_ty = L_SUBMIT_TYPE_GRAPHICS;
   }
+  // Captured images are read back before submission. Transient attachments
+  // never have content to capture.
+  if (ctxt.is_capturable && !(usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
 
   VkImageType img_ty;
   VkImageViewType img_view_ty;
@@ -79,6 +90,39 @@ bool Image::create(const Context& ctxt, const ImageConfig& img_cfg, Image& out)
   ici.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   ici.initialLayout = layout;
 
+  out = ici;
+  out_img_view_ty = img_view_ty;
+}
+VkImageViewCreateInfo _make_ivci(
+  const VkImageCreateInfo& ici,
+  VkImageViewType img_view_ty,
+  VkImage img
+) {
+  VkImageViewCreateInfo ivci {};
+  ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  ivci.image = img;
+  ivci.viewType = img_view_ty;
+  ivci.format = ici.format;
+  ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  ivci.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  ivci.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+  return ivci;
+}
+bool Image::create(const Context& ctxt, const ImageConfig& img_cfg, Image& out) {
+  VkImageCreateInfo ici {};
+  VkImageViewType img_view_ty;
+  _make_ici(ctxt, img_cfg, ici, img_view_ty);
+  VkImageLayout layout = ici.initialLayout;
+
+  // Check the soft limit before anything is allocated.
+  VkMemoryRequirements mr {};
+  if (!Image::get_aliased_mem_req(ctxt, img_cfg, mr)) { return false; }
+  size_t mem_size = mr.size;
+  if (!const_cast<Context&>(ctxt).alloc_mem(L_MEMORY_CATEGORY_IMAGE, mem_size)) {
+    L_ERROR("failed to create image '", img_cfg.label, "'");
+    return false;
+  }
+
   bool is_tile_mem = img_cfg.usage & L_IMAGE_USAGE_TILE_MEMORY_BIT;
   sys::ImageRef img = nullptr;
   VmaAllocationCreateInfo aci {};
@@ -95,32 +139,137 @@ bool Image::create(const Context& ctxt, const ImageConfig& img_cfg, Image& out)
     img = sys::Image::create(*ctxt.allocator, &ici, &aci);
   }
 
-  VkImageViewCreateInfo ivci {};
-  ivci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-  ivci.image = img->img;
-  ivci.viewType = img_view_ty;
-  ivci.format = fmt;
-  ivci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  ivci.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-  ivci.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-
+  VkImageViewCreateInfo ivci = _make_ivci(ici, img_view_ty, img->img);
   sys::ImageViewRef img_view = sys::ImageView::create(ctxt.dev->dev, &ivci);
 
   ImageDynamicDetail dyn_detail {};
   dyn_detail.layout = layout;
   dyn_detail.access = 0;
   dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
+  dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
 
   out.ctxt = &ctxt;
   out.img = std::move(img);
   out.img_view = std::move(img_view);
   out.img_cfg = img_cfg;
+  out.mem_size = mem_size;
+  out.ici = ici;
+  out.ivci = ivci;
   out.dyn_detail = std::move(dyn_detail);
+  // Attachments are excluded because framebuffers are cached by image view
+  // handles.
+  const VkImageUsageFlags relocate_usage =
+    VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  if ((ici.usage & relocate_usage) == relocate_usage &&
+    (img_cfg.usage & L_IMAGE_USAGE_ATTACHMENT_BIT) == 0
+  ) {
+    const_cast<Context&>(ctxt).defrag_detail.imgs[out.img->alloc] = &out;
+  }
+  const_cast<Context&>(ctxt).rsc_stats.nimg_create += 1;
   L_DEBUG("created image '", img_cfg.label, "'");
   return true;
 }
+bool Image::get_aliased_mem_req(
+  const Context& ctxt,
+  const ImageConfig& img_cfg,
+  VkMemoryRequirements& out
+) {
+  VkImageCreateInfo ici {};
+  VkImageViewType img_view_ty;
+  _make_ici(ctxt, img_cfg, ici, img_view_ty);
+
+  VkImage img = VK_NULL_HANDLE;
+  VK_ASSERT << vkCreateImage(ctxt.dev->dev, &ici, nullptr, &img);
+  vkGetImageMemoryRequirements(ctxt.dev->dev, img, &out);
+  vkDestroyImage(ctxt.dev->dev, img, nullptr);
+  return true;
+}
+bool Image::create_aliased(
+  const Context& ctxt,
+  const ImageConfig& img_cfg,
+  const AliasedMemoryRef& mem,
+  size_t offset,
+  Image& out
+) {
+  if (img_cfg.usage & L_IMAGE_USAGE_TILE_MEMORY_BIT) {
+    L_ERROR("cannot place image '", img_cfg.label, "' in aliased memory "
+      "because it's in tile memory");
+    return false;
+  }
+
+  VkImageCreateInfo ici {};
+  VkImageViewType img_view_ty;
+  _make_ici(ctxt, img_cfg, ici, img_view_ty);
+
+  VkImage img = VK_NULL_HANDLE;
+  VK_ASSERT << vkCreateImage(ctxt.dev->dev, &ici, nullptr, &img);
+
+  VkMemoryRequirements mr {};
+  vkGetImageMemoryRequirements(ctxt.dev->dev, img, &mr);
+  if (offset % mr.alignment != 0 || offset + mr.size > mem->size) {
+    vkDestroyImage(ctxt.dev->dev, img, nullptr);
+    L_ERROR("image '", img_cfg.label, "' cannot be placed in aliased memory "
+      "at offset ", offset);
+    return false;
+  }
+  VK_ASSERT << vmaBindImageMemory2(*ctxt.allocator, mem->alloc, offset, img,
+    nullptr);
+
+  VkImageViewCreateInfo ivci = _make_ivci(ici, img_view_ty, img);
+  sys::ImageViewRef img_view = sys::ImageView::create(ctxt.dev->dev, &ivci);
+
+  ImageDynamicDetail dyn_detail {};
+  dyn_detail.layout = ici.initialLayout;
+  dyn_detail.access = 0;
+  dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
+  dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
+
+  // The memory is accounted for by the aliased memory. Aliasing images are
+  // never relocated.
+  out.ctxt = &ctxt;
+  out.img = std::make_shared<sys::Image>(*ctxt.allocator, img, VK_NULL_HANDLE,
+    true);
+  out.img_view = std::move(img_view);
+  out.img_cfg = img_cfg;
+  out.mem_size = 0;
+  out.ici = ici;
+  out.ivci = ivci;
+  out.aliased_mem = mem;
+  out.dyn_detail = std::move(dyn_detail);
+  const_cast<Context&>(ctxt).rsc_stats.nimg_create += 1;
+  L_DEBUG("created image '", img_cfg.label, "' in aliased memory at offset ",
+    offset);
+  return true;
+}
 Image::~Image() {
   if (img) {
+    Context* ctxt2 = const_cast<Context*>(ctxt);
+    // Swapchain images and aliasing images don't own their memory.
+    if (mem_size != 0) {
+      // The pending defragmentation pass might be relocating the image.
+      if (ctxt2->defrag_detail.is_pass_pending) {
+        ctxt2->flush_defrag_pass();
+      }
+      ctxt2->defrag_detail.imgs.erase(img->alloc);
+    }
+    // Swapchain images are destroyed with the swapchain which handles its
+    // own synchronization. Others might still be used by the device.
+    if (mem_size != 0 || aliased_mem != nullptr) {
+      ctxt2->defer_deletion([ctxt2, mem_size = mem_size, img = std::move(img),
+        img_view = std::move(img_view), aliased_mem = std::move(aliased_mem),
+        bindless_idxs = bindless_idxs]() {
+        if (mem_size != 0) {
+          ctxt2->free_mem(L_MEMORY_CATEGORY_IMAGE, mem_size);
+        }
+        for (const auto& pair : bindless_idxs) {
+          ctxt2->free_bindless_idx(pair.first, pair.second);
+        }
+      });
+    } else {
+      for (const auto& pair : bindless_idxs) {
+        ctxt2->free_bindless_idx(pair.first, pair.second);
+      }
+    }
     L_DEBUG("destroyed image '", img_cfg.label, "'");
   }
 }
@@ -148,6 +297,27 @@ ImageView Image::view(
   return out;
 }
 
+uint32_t _get_bindless_idx(const Image& img, BindlessBinding binding) {
+  auto it = img.bindless_idxs.find(binding);
+  if (it != img.bindless_idxs.end()) { return it->second; }
+
+  Context& ctxt = const_cast<Context&>(*img.ctxt);
+  uint32_t idx = ctxt.alloc_bindless_idx(binding);
+  ctxt.write_bindless_desc(binding, idx, img);
+  const_cast<Image&>(img).bindless_idxs[binding] = idx;
+  return idx;
+}
+uint32_t Image::get_bindless_sampled_idx() const {
+  L_ASSERT(img_cfg.usage & L_IMAGE_USAGE_SAMPLED_BIT, "image '",
+    img_cfg.label, "' cannot be bindless without sampled usage");
+  return _get_bindless_idx(*this, L_BINDLESS_BINDING_SAMPLED_IMAGE);
+}
+uint32_t Image::get_bindless_storage_idx() const {
+  L_ASSERT(img_cfg.usage & L_IMAGE_USAGE_STORAGE_BIT, "image '",
+    img_cfg.label, "' cannot be bindless without storage usage");
+  return _get_bindless_idx(*this, L_BINDLESS_BINDING_STORAGE_IMAGE);
+}
+
 void map_img_mem(
   const ImageView& img,
   MemoryAccess map_access,
@@ -1,15 +1,23 @@
+#include <algorithm>
+#include <set>
 #include "gft/vk.hpp"
 #include "gft/log.hpp"
 
 namespace liong {
 namespace vk {
 
+// Write the descriptors of bindings in `[ibeg, iend)`; all bindings if `iend`
+// is zero.
 void _update_desc_set(
   const Context& ctxt,
   VkDescriptorSet desc_set,
   const std::vector<ResourceType>& rsc_tys,
-  const std::vector<ResourceView>& rsc_views
+  const std::vector<ResourceView>& rsc_views,
+  uint32_t ibeg = 0,
+  uint32_t iend = 0
 ) {
+  if (iend == 0) { iend = (uint32_t)rsc_views.size(); }
+
   std::vector<VkDescriptorBufferInfo> dbis;
   std::vector<VkDescriptorImageInfo> diis;
   std::vector<VkWriteDescriptorSet> wdss;
@@ -60,7 +68,7 @@ void _update_desc_set(
     return &diis.back();
   };
 
-  for (uint32_t i = 0; i < rsc_views.size(); ++i) {
+  for (uint32_t i = ibeg; i < iend; ++i) {
     const ResourceView& rsc_view = rsc_views[i];
 
     VkWriteDescriptorSet wds {};
@@ -95,6 +103,7 @@ void _update_desc_set(
 
   vkUpdateDescriptorSets(ctxt.dev->dev, (uint32_t)wdss.size(), wdss.data(), 0,
     nullptr);
+  const_cast<Context&>(ctxt).record_stats.ndesc_write += wdss.size();
 }
 void _collect_task_invoke_transit(
   const std::vector<ResourceView> rsc_views,
@@ -172,12 +181,20 @@ void _merge_subinvoke_transits(
   std::vector<const Invocation*> subinvokes { subinvoke };
   _merge_subinvoke_transits(subinvokes, transit_detail);
 }
+// Async compute subinvocations don't decide the submit type unless there is
+// nothing else, so that work around them is not dragged to the async compute
+// queue.
 SubmitType _infer_submit_ty(const std::vector<const Invocation*>& subinvokes) {
+  SubmitType out = L_SUBMIT_TYPE_ANY;
   for (size_t i = 0; i < subinvokes.size(); ++i) {
     SubmitType submit_ty = subinvokes[i]->submit_ty;
-    if (submit_ty != L_SUBMIT_TYPE_ANY) { return submit_ty; }
+    if (submit_ty == L_SUBMIT_TYPE_ASYNC_COMPUTE) {
+      out = submit_ty;
+    } else if (submit_ty != L_SUBMIT_TYPE_ANY) {
+      return submit_ty;
+    }
   }
-  return L_SUBMIT_TYPE_ANY;
+  return out;
 }
 VkBufferCopy _make_bc(const BufferView& src, const BufferView& dst) {
   VkBufferCopy bc {};
@@ -190,8 +207,10 @@ VkImageCopy _make_ic(const ImageView& src, const ImageView& dst) {
   VkImageCopy ic {};
   ic.srcOffset.x = src.x_offset;
   ic.srcOffset.y = src.y_offset;
+  ic.srcOffset.z = src.z_offset;
   ic.dstOffset.x = dst.x_offset;
   ic.dstOffset.y = dst.y_offset;
+  ic.dstOffset.z = dst.z_offset;
   ic.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   ic.srcSubresource.baseArrayLayer = 0;
   ic.srcSubresource.layerCount = 1;
@@ -205,132 +224,659 @@ VkImageCopy _make_ic(const ImageView& src, const ImageView& dst) {
   ic.extent.depth = dst.depth == 0 ? 1 : dst.depth;
   return ic;
 }
-VkBufferImageCopy _make_bic(const BufferView& buf, const ImageView& img) {
+VkImageBlit _make_ib(const ImageView& src, const ImageView& dst) {
+  VkImageBlit ib {};
+  ib.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  ib.srcSubresource.baseArrayLayer = 0;
+  ib.srcSubresource.layerCount = 1;
+  ib.srcSubresource.mipLevel = 0;
+  ib.srcOffsets[0].x = src.x_offset;
+  ib.srcOffsets[0].y = src.y_offset;
+  ib.srcOffsets[0].z = src.z_offset;
+  ib.srcOffsets[1].x = src.x_offset + src.width;
+  ib.srcOffsets[1].y = src.y_offset + (src.height == 0 ? 1 : src.height);
+  ib.srcOffsets[1].z = src.z_offset + (src.depth == 0 ? 1 : src.depth);
+  ib.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  ib.dstSubresource.baseArrayLayer = 0;
+  ib.dstSubresource.layerCount = 1;
+  ib.dstSubresource.mipLevel = 0;
+  ib.dstOffsets[0].x = dst.x_offset;
+  ib.dstOffsets[0].y = dst.y_offset;
+  ib.dstOffsets[0].z = dst.z_offset;
+  ib.dstOffsets[1].x = dst.x_offset + dst.width;
+  ib.dstOffsets[1].y = dst.y_offset + (dst.height == 0 ? 1 : dst.height);
+  ib.dstOffsets[1].z = dst.z_offset + (dst.depth == 0 ? 1 : dst.depth);
+  return ib;
+}
+VkBufferImageCopy _make_bic(
+  const BufferView& buf,
+  const ImageView& img,
+  uint32_t buf_row_len = 0,
+  uint32_t buf_img_height = 0
+) {
   VkBufferImageCopy bic {};
   bic.bufferOffset = buf.offset;
-  bic.bufferRowLength = 0;
-  bic.bufferImageHeight = (uint32_t)img.img->img_cfg.height;
+  bic.bufferRowLength = buf_row_len;
+  bic.bufferImageHeight = buf_img_height != 0 ?
+    buf_img_height : (uint32_t)img.img->img_cfg.height;
   bic.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   bic.imageSubresource.mipLevel = 0;
   bic.imageSubresource.baseArrayLayer = 0;
   bic.imageSubresource.layerCount = 1;
   bic.imageOffset.x = img.x_offset;
   bic.imageOffset.y = img.y_offset;
+  bic.imageOffset.z = img.z_offset;
   bic.imageExtent.width = img.width;
   bic.imageExtent.height = img.height == 0 ? 1 : img.height;
   bic.imageExtent.depth = img.depth == 0 ? 1 : img.depth;
   return bic;
 }
+// Source and destination views of all regions of a transfer invocation. All
+// the regions are between the same pair of resources.
+std::vector<TransferRegionConfig> _collect_transfer_regions(
+  const TransferInvocationConfig& cfg
+) {
+  std::vector<TransferRegionConfig> out;
+  out.reserve(cfg.regions.size() + 1);
+  TransferRegionConfig region {};
+  region.src_rsc_view = cfg.src_rsc_view;
+  region.dst_rsc_view = cfg.dst_rsc_view;
+  out.emplace_back(std::move(region));
+  out.insert(out.end(), cfg.regions.begin(), cfg.regions.end());
+
+  auto get_rsc = [](const ResourceView& rsc_view) -> const void* {
+    switch (rsc_view.rsc_view_ty) {
+    case L_RESOURCE_VIEW_TYPE_BUFFER: return rsc_view.buf_view.buf;
+    case L_RESOURCE_VIEW_TYPE_IMAGE: return rsc_view.img_view.img;
+    case L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE: return rsc_view.depth_img_view.depth_img;
+    default: unreachable();
+    }
+  };
+  for (const TransferRegionConfig& region : out) {
+    L_ASSERT(get_rsc(region.src_rsc_view) == get_rsc(cfg.src_rsc_view) &&
+      get_rsc(region.dst_rsc_view) == get_rsc(cfg.dst_rsc_view),
+      "transfer invocation '", cfg.label, "' regions must be between the "
+      "same resources");
+  }
+  return out;
+}
 void _fill_transfer_b2b_invoke(
-  const BufferView& src,
-  const BufferView& dst,
+  const std::vector<TransferRegionConfig>& regions,
   Invocation& out
 ) {
   InvocationCopyBufferToBufferDetail b2b_detail {};
-  b2b_detail.bc = _make_bc(src, dst);
-  b2b_detail.src = src.buf->buf;
-  b2b_detail.dst = dst.buf->buf;
+  for (const TransferRegionConfig& region : regions) {
+    const BufferView& src = region.src_rsc_view.buf_view;
+    const BufferView& dst = region.dst_rsc_view.buf_view;
+    b2b_detail.bcs.emplace_back(_make_bc(src, dst));
+    out.transit_detail.reg(src, L_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    out.transit_detail.reg(dst, L_BUFFER_USAGE_TRANSFER_DST_BIT);
+  }
+  b2b_detail.src = regions.front().src_rsc_view.buf_view.buf->buf;
+  b2b_detail.dst = regions.front().dst_rsc_view.buf_view.buf->buf;
 
   out.b2b_detail =
     std::make_unique<InvocationCopyBufferToBufferDetail>(std::move(b2b_detail));
-
-  out.transit_detail.reg(src, L_BUFFER_USAGE_TRANSFER_SRC_BIT);
-  out.transit_detail.reg(dst, L_BUFFER_USAGE_TRANSFER_DST_BIT);
 }
 void _fill_transfer_b2i_invoke(
-  const BufferView& src,
-  const ImageView& dst,
+  const std::vector<TransferRegionConfig>& regions,
+  const TransferInvocationConfig& cfg,
   Invocation& out
 ) {
   InvocationCopyBufferToImageDetail b2i_detail {};
-  b2i_detail.bic = _make_bic(src, dst);
-  b2i_detail.src = src.buf->buf;
-  b2i_detail.dst = dst.img->img;
+  for (const TransferRegionConfig& region : regions) {
+    const BufferView& src = region.src_rsc_view.buf_view;
+    const ImageView& dst = region.dst_rsc_view.img_view;
+    b2i_detail.bics.emplace_back(
+      _make_bic(src, dst, cfg.buf_row_len, cfg.buf_img_height));
+    out.transit_detail.reg(src, L_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    out.transit_detail.reg(dst, L_IMAGE_USAGE_TRANSFER_DST_BIT);
+  }
+  b2i_detail.src = regions.front().src_rsc_view.buf_view.buf->buf;
+  b2i_detail.dst = regions.front().dst_rsc_view.img_view.img->img;
 
   out.b2i_detail =
     std::make_unique<InvocationCopyBufferToImageDetail>(std::move(b2i_detail));
-
-  out.transit_detail.reg(src, L_BUFFER_USAGE_TRANSFER_SRC_BIT);
-  out.transit_detail.reg(dst, L_IMAGE_USAGE_TRANSFER_DST_BIT);
 }
 void _fill_transfer_i2b_invoke(
-  const ImageView& src,
-  const BufferView& dst,
+  const std::vector<TransferRegionConfig>& regions,
+  const TransferInvocationConfig& cfg,
   Invocation& out
 ) {
   InvocationCopyImageToBufferDetail i2b_detail {};
-  i2b_detail.bic = _make_bic(dst, src);
-  i2b_detail.src = src.img->img;
-  i2b_detail.dst = dst.buf->buf;
+  for (const TransferRegionConfig& region : regions) {
+    const ImageView& src = region.src_rsc_view.img_view;
+    const BufferView& dst = region.dst_rsc_view.buf_view;
+    i2b_detail.bics.emplace_back(
+      _make_bic(dst, src, cfg.buf_row_len, cfg.buf_img_height));
+    out.transit_detail.reg(src, L_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    out.transit_detail.reg(dst, L_BUFFER_USAGE_TRANSFER_DST_BIT);
+  }
+  i2b_detail.src = regions.front().src_rsc_view.img_view.img->img;
+  i2b_detail.dst = regions.front().dst_rsc_view.buf_view.buf->buf;
 
   out.i2b_detail =
     std::make_unique<InvocationCopyImageToBufferDetail>(std::move(i2b_detail));
-
-  out.transit_detail.reg(src, L_IMAGE_USAGE_TRANSFER_SRC_BIT);
-  out.transit_detail.reg(dst, L_BUFFER_USAGE_TRANSFER_DST_BIT);
 }
 void _fill_transfer_i2i_invoke(
-  const ImageView& src,
-  const ImageView& dst,
+  const std::vector<TransferRegionConfig>& regions,
   Invocation& out
 ) {
   InvocationCopyImageToImageDetail i2i_detail {};
-  i2i_detail.ic = _make_ic(src, dst);
-  i2i_detail.src = src.img->img;
-  i2i_detail.dst = dst.img->img;
+  for (const TransferRegionConfig& region : regions) {
+    const ImageView& src = region.src_rsc_view.img_view;
+    const ImageView& dst = region.dst_rsc_view.img_view;
+    i2i_detail.ics.emplace_back(_make_ic(src, dst));
+    out.transit_detail.reg(src, L_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    out.transit_detail.reg(dst, L_IMAGE_USAGE_TRANSFER_DST_BIT);
+  }
+  i2i_detail.src = regions.front().src_rsc_view.img_view.img->img;
+  i2i_detail.dst = regions.front().dst_rsc_view.img_view.img->img;
 
   out.i2i_detail =
     std::make_unique<InvocationCopyImageToImageDetail>(std::move(i2i_detail));
-
-  out.transit_detail.reg(src, L_IMAGE_USAGE_TRANSFER_SRC_BIT);
-  out.transit_detail.reg(dst, L_IMAGE_USAGE_TRANSFER_DST_BIT);
+}
+// Unlike copies, blits are only supported by some formats and linear
+// filtering by even fewer.
+bool _check_blit_fmts(
+  const Context& ctxt,
+  const std::vector<TransferRegionConfig>& regions
+) {
+  auto get_fmt_feats = [&](const ImageConfig& img_cfg) {
+    VkFormatProperties fmt_prop {};
+    vkGetPhysicalDeviceFormatProperties(ctxt.physdev(),
+      fmt2vk(img_cfg.fmt, img_cfg.cspace), &fmt_prop);
+    return fmt_prop.optimalTilingFeatures;
+  };
+  bool is_linear =
+    regions.front().src_rsc_view.img_view.sampler != L_IMAGE_SAMPLER_NEAREST;
+
+  for (const TransferRegionConfig& region : regions) {
+    const ImageConfig& src_cfg = region.src_rsc_view.img_view.img->img_cfg;
+    const ImageConfig& dst_cfg = region.dst_rsc_view.img_view.img->img_cfg;
+    VkFormatFeatureFlags src_feats = get_fmt_feats(src_cfg);
+    VkFormatFeatureFlags dst_feats = get_fmt_feats(dst_cfg);
+    if ((src_feats & VK_FORMAT_FEATURE_BLIT_SRC_BIT) == 0) {
+      L_ERROR("format of image '", src_cfg.label, "' cannot be blitted from");
+      return false;
+    }
+    if ((dst_feats & VK_FORMAT_FEATURE_BLIT_DST_BIT) == 0) {
+      L_ERROR("format of image '", dst_cfg.label, "' cannot be blitted to");
+      return false;
+    }
+    if (
+      is_linear &&
+      (src_feats & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) == 0
+    ) {
+      L_ERROR("format of image '", src_cfg.label, "' cannot be blitted with "
+        "linear filtering");
+      return false;
+    }
+  }
+  return true;
+}
+void _fill_transfer_blit_invoke(
+  const std::vector<TransferRegionConfig>& regions,
+  Invocation& out
+) {
+  InvocationBlitImageDetail blit_detail {};
+  for (const TransferRegionConfig& region : regions) {
+    const ImageView& src = region.src_rsc_view.img_view;
+    const ImageView& dst = region.dst_rsc_view.img_view;
+    blit_detail.ibs.emplace_back(_make_ib(src, dst));
+    out.transit_detail.reg(src, L_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    out.transit_detail.reg(dst, L_IMAGE_USAGE_TRANSFER_DST_BIT);
+  }
+  const ImageView& src = regions.front().src_rsc_view.img_view;
+  blit_detail.filter = src.sampler == L_IMAGE_SAMPLER_NEAREST ?
+    VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+  blit_detail.src = src.img->img;
+  blit_detail.dst = regions.front().dst_rsc_view.img_view.img->img;
+
+  out.blit_detail =
+    std::make_unique<InvocationBlitImageDetail>(std::move(blit_detail));
+}
+// Bytes written to the destination of a transfer region.
+size_t _get_transfer_dst_size(const ResourceView& dst_rsc_view) {
+  switch (dst_rsc_view.rsc_view_ty) {
+  case L_RESOURCE_VIEW_TYPE_BUFFER:
+    return dst_rsc_view.buf_view.size;
+  case L_RESOURCE_VIEW_TYPE_IMAGE:
+  {
+    const ImageView& img_view = dst_rsc_view.img_view;
+    size_t ntexel = (size_t)img_view.width *
+      (img_view.height == 0 ? 1 : img_view.height) *
+      (img_view.depth == 0 ? 1 : img_view.depth);
+    return ntexel * fmt::get_fmt_size(img_view.img->img_cfg.fmt);
+  }
+  default:
+    unreachable();
+  }
+  return 0;
+}
+// Timestamp query pools are reset in the recorded command buffer, which isn't
+// allowed on a dedicated transfer queue, so timed transfers are submitted to
+// the compute queue instead.
+SubmitType _get_transfer_submit_ty(const Context& ctxt, bool is_timed) {
+  return is_timed && ctxt.queue_stats.is_transfer_dedicated ?
+    L_SUBMIT_TYPE_COMPUTE : L_SUBMIT_TYPE_TRANSFER;
+}
+// Indirect command and count buffers are read at 4-byte aligned offsets.
+void _check_indirect_buf(const BufferView& buf_view, size_t size) {
+  const Buffer& buf = *buf_view.buf;
+  L_ASSERT(buf.buf_cfg.usage & L_BUFFER_USAGE_INDIRECT_BIT, "buffer '",
+    buf.buf_cfg.label, "' is not created for indirect commands");
+  L_ASSERT(buf_view.offset % 4 == 0, "indirect command offset must be "
+    "aligned to 4 bytes");
+  L_ASSERT(buf_view.size >= size, "indirect command buffer view is too small "
+    "(", buf_view.size, " < ", size, " bytes)");
+}
+// Keep the config of an invocation created in a capturable context.
+template<typename TConfig>
+void _keep_capture_cfg(
+  const Context& ctxt,
+  TConfig InvocationCaptureDetail::*cfg_field,
+  const TConfig& cfg,
+  Invocation& out
+) {
+  if (!ctxt.is_capturable) { return; }
+  out.capture_detail = std::make_unique<InvocationCaptureDetail>();
+  (*out.capture_detail).*cfg_field = cfg;
 }
 bool Invocation::create(
   const Context& ctxt,
   const TransferInvocationConfig& cfg,
   Invocation& out
 ) {
-  const ResourceView& src_rsc_view = cfg.src_rsc_view;
-  const ResourceView& dst_rsc_view = cfg.dst_rsc_view;
-  ResourceViewType src_rsc_view_ty = src_rsc_view.rsc_view_ty;
-  ResourceViewType dst_rsc_view_ty = dst_rsc_view.rsc_view_ty;
+  std::vector<TransferRegionConfig> regions = _collect_transfer_regions(cfg);
+  ResourceViewType src_rsc_view_ty = cfg.src_rsc_view.rsc_view_ty;
+  ResourceViewType dst_rsc_view_ty = cfg.dst_rsc_view.rsc_view_ty;
+  if (cfg.is_blit) {
+    L_ASSERT(src_rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE &&
+      dst_rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE,
+      "blit is only allowed between images");
+    if (!_check_blit_fmts(ctxt, regions)) {
+      L_ERROR("cannot create blit invocation '", cfg.label, "'");
+      return false;
+    }
+  }
 
   out.label = cfg.label;
   out.ctxt = &ctxt;
-  out.submit_ty = L_SUBMIT_TYPE_TRANSFER;
+  out.submit_ty = cfg.is_blit ?
+    L_SUBMIT_TYPE_GRAPHICS : _get_transfer_submit_ty(ctxt, cfg.is_timed);
   out.query_pool = cfg.is_timed ? const_cast<Context&>(ctxt).acquire_query_pool() : QueryPoolPoolItem {};
 
-  if (
+  if (cfg.is_blit) {
+    _fill_transfer_blit_invoke(regions, out);
+  } else if (
     src_rsc_view_ty == L_RESOURCE_VIEW_TYPE_BUFFER &&
     dst_rsc_view_ty == L_RESOURCE_VIEW_TYPE_BUFFER
   ) {
-    _fill_transfer_b2b_invoke(
-      src_rsc_view.buf_view, dst_rsc_view.buf_view, out);
+    _fill_transfer_b2b_invoke(regions, out);
   } else if (
     src_rsc_view_ty == L_RESOURCE_VIEW_TYPE_BUFFER &&
     dst_rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE
   ) {
-    _fill_transfer_b2i_invoke(
-      src_rsc_view.buf_view, dst_rsc_view.img_view, out);
+    _fill_transfer_b2i_invoke(regions, cfg, out);
   } else if (
     src_rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE &&
     dst_rsc_view_ty == L_RESOURCE_VIEW_TYPE_BUFFER
   ) {
-    _fill_transfer_i2b_invoke(
-      src_rsc_view.img_view, dst_rsc_view.buf_view, out);
+    _fill_transfer_i2b_invoke(regions, cfg, out);
   } else if (
     src_rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE &&
     dst_rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE
   ) {
-    _fill_transfer_i2i_invoke(
-      src_rsc_view.img_view, dst_rsc_view.img_view, out);
+    _fill_transfer_i2i_invoke(regions, out);
   } else {
     panic("depth image cannot be transferred");
   }
+  out.transfer_size = 0;
+  for (const TransferRegionConfig& region : regions) {
+    out.transfer_size += _get_transfer_dst_size(region.dst_rsc_view);
+  }
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::transfer_cfg, cfg, out);
 
   L_DEBUG("created transfer invocation");
   return true;
 }
+bool Invocation::create(
+  const Context& ctxt,
+  const FillInvocationConfig& cfg,
+  Invocation& out
+) {
+  const BufferView& dst = cfg.dst_buf_view;
+  L_ASSERT(dst.offset % 4 == 0 && dst.size % 4 == 0,
+    "fill offset and size must be multiples of 4");
+
+  out.label = cfg.label;
+  out.ctxt = &ctxt;
+  out.submit_ty = _get_transfer_submit_ty(ctxt, cfg.is_timed);
+  out.query_pool = cfg.is_timed ? const_cast<Context&>(ctxt).acquire_query_pool() : QueryPoolPoolItem {};
+
+  InvocationFillBufferDetail fill_detail {};
+  fill_detail.dst = dst.buf->buf;
+  fill_detail.offset = dst.offset;
+  fill_detail.size = dst.size;
+  fill_detail.value = cfg.value;
+
+  out.fill_detail =
+    std::make_unique<InvocationFillBufferDetail>(std::move(fill_detail));
+  out.transit_detail.reg(dst, L_BUFFER_USAGE_TRANSFER_DST_BIT);
+  out.transfer_size = dst.size;
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::fill_cfg, cfg, out);
+
+  L_DEBUG("created fill invocation");
+  return true;
+}
+bool Invocation::create(
+  const Context& ctxt,
+  const UpdateInvocationConfig& cfg,
+  Invocation& out
+) {
+  const BufferView& dst = cfg.dst_buf_view;
+  L_ASSERT(dst.offset % 4 == 0 && cfg.data.size() % 4 == 0,
+    "update offset and size must be multiples of 4");
+  L_ASSERT(cfg.data.size() <= 65536, "update cannot write more than 65536 "
+    "bytes, use upload invocations instead");
+  L_ASSERT(cfg.data.size() <= dst.size, "update data overflows the buffer "
+    "view");
+
+  out.label = cfg.label;
+  out.ctxt = &ctxt;
+  out.submit_ty = _get_transfer_submit_ty(ctxt, cfg.is_timed);
+  out.query_pool = cfg.is_timed ? const_cast<Context&>(ctxt).acquire_query_pool() : QueryPoolPoolItem {};
+
+  InvocationUpdateBufferDetail update_detail {};
+  update_detail.dst = dst.buf->buf;
+  update_detail.offset = dst.offset;
+  update_detail.data = cfg.data;
+
+  out.update_detail =
+    std::make_unique<InvocationUpdateBufferDetail>(std::move(update_detail));
+  out.transit_detail.reg(dst, L_BUFFER_USAGE_TRANSFER_DST_BIT);
+  out.transfer_size = cfg.data.size();
+  out.upload_size = cfg.data.size();
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::update_cfg, cfg, out);
+
+  L_DEBUG("created update invocation");
+  return true;
+}
+
+// Maximal size of a staging chunk of an upload invocation. Writes larger than
+// this are staged in dedicated chunks.
+constexpr size_t MAX_UPLOAD_CHUNK_SIZE = 16 * 1024 * 1024;
+// Alignment of staged writes in a staging chunk.
+constexpr size_t UPLOAD_STAGE_ALIGN = 16;
+
+size_t _get_upload_stride(const UploadWriteConfig& write) {
+  return write.elem_stride == 0 ? write.elem_size : write.elem_stride;
+}
+size_t _get_upload_size(const UploadWriteConfig& write) {
+  return (write.nelem - 1) * _get_upload_stride(write) + write.elem_size;
+}
+// Buffer-image copy offsets must be multiples of 4 and of the texel size.
+size_t _get_upload_align(const UploadWriteConfig& write) {
+  size_t align = UPLOAD_STAGE_ALIGN;
+  if (write.dst_rsc_view.rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE) {
+    while (align % write.elem_size != 0) { align += UPLOAD_STAGE_ALIGN; }
+  }
+  return align;
+}
+void _copy_upload_data(const UploadWriteConfig& write, uint8_t* dst) {
+  size_t stride = _get_upload_stride(write);
+  if (stride == write.elem_size) {
+    std::memcpy(dst, write.data, write.nelem * write.elem_size);
+  } else {
+    const uint8_t* src = (const uint8_t*)write.data;
+    for (size_t i = 0; i < write.nelem; ++i) {
+      std::memcpy(dst + i * stride, src + i * write.elem_size, write.elem_size);
+    }
+  }
+}
+bool Invocation::create(
+  const Context& ctxt,
+  const UploadInvocationConfig& cfg,
+  Invocation& out
+) {
+  const std::vector<UploadWriteConfig>& writes = cfg.writes;
+
+  // Pack writes into staging chunks. A chunk is closed once the next write
+  // doesn't fit in, so chunks are no larger than they need to be.
+  std::vector<size_t> chunk_sizes;
+  std::vector<std::pair<size_t, size_t>> placements;
+  placements.reserve(writes.size());
+  for (const UploadWriteConfig& write : writes) {
+    L_ASSERT(write.nelem > 0 && write.elem_size > 0,
+      "upload write cannot be empty");
+    size_t size = _get_upload_size(write);
+
+    size_t offset = chunk_sizes.empty() ?
+      0 : util::align_up(chunk_sizes.back(), _get_upload_align(write));
+    if (chunk_sizes.empty() || offset + size > MAX_UPLOAD_CHUNK_SIZE) {
+      chunk_sizes.emplace_back(0);
+      offset = 0;
+    }
+    placements.emplace_back(chunk_sizes.size() - 1, offset);
+    chunk_sizes.back() = offset + size;
+  }
+
+  InvocationUploadDetail upload_detail {};
+  for (size_t i = 0; i < chunk_sizes.size(); ++i) {
+    BufferConfig buf_cfg {};
+    buf_cfg.label = util::format(cfg.label, " (staging chunk #", i, ")");
+    buf_cfg.host_access = L_MEMORY_ACCESS_WRITE_BIT;
+    buf_cfg.size = chunk_sizes[i];
+    buf_cfg.usage = L_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    std::unique_ptr<Buffer> stage_buf = std::make_unique<Buffer>();
+    if (!Buffer::create(ctxt, buf_cfg, *stage_buf)) {
+      L_ERROR("failed to create upload invocation '", cfg.label, "'");
+      return false;
+    }
+    upload_detail.stage_bufs.emplace_back(std::move(stage_buf));
+  }
+
+  // Copy host data to staging chunks.
+  std::vector<uint8_t*> mappeds(chunk_sizes.size());
+  for (size_t i = 0; i < chunk_sizes.size(); ++i) {
+    mappeds[i] =
+      (uint8_t*)upload_detail.stage_bufs[i]->map(L_MEMORY_ACCESS_WRITE_BIT);
+  }
+  for (size_t i = 0; i < writes.size(); ++i) {
+    _copy_upload_data(writes[i],
+      mappeds[placements[i].first] + placements[i].second);
+  }
+  for (size_t i = 0; i < chunk_sizes.size(); ++i) {
+    upload_detail.stage_bufs[i]->unmap(mappeds[i]);
+  }
+
+  // Group copy regions by staging chunk and destination.
+  InvocationTransitionDetail transit_detail {};
+  for (const auto& stage_buf : upload_detail.stage_bufs) {
+    transit_detail.reg(stage_buf->view(0, stage_buf->buf_cfg.size),
+      L_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  }
+  std::map<std::pair<size_t, VkBuffer>, size_t> buf_upload_idxs;
+  std::map<std::pair<size_t, VkImage>, size_t> img_upload_idxs;
+  for (size_t i = 0; i < writes.size(); ++i) {
+    const UploadWriteConfig& write = writes[i];
+    const ResourceView& dst_rsc_view = write.dst_rsc_view;
+    size_t ichunk = placements[i].first;
+    BufferView src {};
+    src.buf = upload_detail.stage_bufs[ichunk].get();
+    src.offset = placements[i].second;
+    src.size = _get_upload_size(write);
+
+    if (dst_rsc_view.rsc_view_ty == L_RESOURCE_VIEW_TYPE_BUFFER) {
+      const BufferView& dst = dst_rsc_view.buf_view;
+      L_ASSERT(src.size <= dst.size, "upload write overflows the destination "
+        "buffer view");
+      auto key = std::make_pair(ichunk, dst.buf->buf->buf);
+      auto it = buf_upload_idxs.find(key);
+      if (it == buf_upload_idxs.end()) {
+        InvocationUploadBufferDetail buf_upload {};
+        buf_upload.src = src.buf->buf;
+        buf_upload.dst = dst.buf->buf;
+        it = buf_upload_idxs.emplace(key, upload_detail.buf_uploads.size()).first;
+        upload_detail.buf_uploads.emplace_back(std::move(buf_upload));
+      }
+      VkBufferCopy bc {};
+      bc.srcOffset = src.offset;
+      bc.dstOffset = dst.offset;
+      bc.size = src.size;
+      upload_detail.buf_uploads[it->second].bcs.emplace_back(bc);
+      transit_detail.reg(dst, L_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+    } else if (dst_rsc_view.rsc_view_ty == L_RESOURCE_VIEW_TYPE_IMAGE) {
+      const ImageView& dst = dst_rsc_view.img_view;
+      L_ASSERT(_get_upload_stride(write) == write.elem_size, "upload write "
+        "to image cannot be strided");
+      uint32_t height = dst.height == 0 ? 1 : dst.height;
+      uint32_t depth = dst.depth == 0 ? 1 : dst.depth;
+      L_ASSERT(write.nelem == (size_t)dst.width * height * depth, "upload "
+        "write to image must have exactly one element per texel of the "
+        "destination image view");
+      auto key = std::make_pair(ichunk, dst.img->img->img);
+      auto it = img_upload_idxs.find(key);
+      if (it == img_upload_idxs.end()) {
+        InvocationUploadImageDetail img_upload {};
+        img_upload.src = src.buf->buf;
+        img_upload.dst = dst.img->img;
+        it = img_upload_idxs.emplace(key, upload_detail.img_uploads.size()).first;
+        upload_detail.img_uploads.emplace_back(std::move(img_upload));
+      }
+      // Texels are tightly packed in the view's extent.
+      upload_detail.img_uploads[it->second].bics.emplace_back(
+        _make_bic(src, dst, 0, height));
+      transit_detail.reg(dst, L_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+    } else {
+      panic("depth image cannot be uploaded");
+    }
+  }
+
+  out.label = cfg.label;
+  out.ctxt = &ctxt;
+  out.submit_ty = _get_transfer_submit_ty(ctxt, cfg.is_timed);
+  out.query_pool = cfg.is_timed ? const_cast<Context&>(ctxt).acquire_query_pool() : QueryPoolPoolItem {};
+  out.transit_detail = std::move(transit_detail);
+  out.upload_detail =
+    std::make_unique<InvocationUploadDetail>(std::move(upload_detail));
+  out.transfer_size = 0;
+  out.upload_size = 0;
+  for (const UploadWriteConfig& write : writes) {
+    out.transfer_size += _get_upload_size(write);
+    out.upload_size += write.nelem * write.elem_size;
+  }
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::upload_cfg, cfg, out);
+  if (out.capture_detail != nullptr) {
+    InvocationCaptureDetail& capture_detail = *out.capture_detail;
+    for (UploadWriteConfig& write : capture_detail.upload_cfg.writes) {
+      const uint8_t* data = (const uint8_t*)write.data;
+      capture_detail.upload_data.emplace_back(data,
+        data + write.nelem * write.elem_size);
+      write.data = nullptr;
+    }
+  }
+
+  L_DEBUG("created upload invocation with ", writes.size(), " writes in ",
+    chunk_sizes.size(), " staging chunks");
+  return true;
+}
+std::unique_ptr<InvocationPipelineStatisticsDetail> _create_pipe_stats_detail(
+  const Context& ctxt,
+  const std::string& label,
+  VkQueryPipelineStatisticFlags flags
+) {
+  if (ctxt.physdev_feat().pipelineStatisticsQuery == VK_FALSE) {
+    L_WARN("pipeline statistics of invocation '", label, "' are not "
+      "collected because the device does not support them");
+    return nullptr;
+  }
+  // Statistics of unsupported shader stages cannot be queried.
+  if (ctxt.physdev_feat().geometryShader == VK_FALSE) {
+    flags &= ~(VkQueryPipelineStatisticFlags)(
+      VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES_BIT);
+  }
+  if (ctxt.physdev_feat().tessellationShader == VK_FALSE) {
+    flags &= ~(VkQueryPipelineStatisticFlags)(
+      VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_CONTROL_SHADER_PATCHES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT);
+  }
+
+  InvocationPipelineStatisticsDetail out {};
+  out.query_pool = ctxt.create_query_pool(
+    VK_QUERY_TYPE_PIPELINE_STATISTICS, 1, flags);
+  out.flags = flags;
+  return std::make_unique<InvocationPipelineStatisticsDetail>(std::move(out));
+}
+// Only counters measured per command and collected in a single pass are
+// supported, so that the counters can be collected in any command buffer
+// without resubmission.
+std::unique_ptr<InvocationPerformanceQueryDetail> _create_perf_query_detail(
+  const Context& ctxt,
+  const std::string& label,
+  SubmitType submit_ty,
+  const std::vector<std::string>& counter_names
+) {
+  if (counter_names.empty()) { return nullptr; }
+  const ContextPerformanceQueryDetail& perf_query_detail =
+    ctxt.perf_query_detail;
+  if (!perf_query_detail.is_supported) { return nullptr; }
+
+  uint32_t qfam_idx = ctxt.submit_details.at(submit_ty).qfam_idx;
+  auto it = perf_query_detail.counters.find(qfam_idx);
+  if (it == perf_query_detail.counters.end()) { return nullptr; }
+  const std::vector<ContextPerformanceCounterDetail>& counters = it->second;
+
+  std::vector<uint32_t> icounters;
+  for (const std::string& counter_name : counter_names) {
+    uint32_t icounter = 0;
+    for (; icounter < counters.size(); ++icounter) {
+      if (counter_name == counters.at(icounter).desc.name) { break; }
+    }
+    if (icounter == counters.size()) {
+      L_WARN("performance counter '", counter_name, "' of invocation '",
+        label, "' is ignored because it is unavailable on the device");
+      continue;
+    }
+    if (counters.at(icounter).counter.scope !=
+      VK_PERFORMANCE_COUNTER_SCOPE_COMMAND_KHR
+    ) {
+      L_WARN("performance counter '", counter_name, "' of invocation '",
+        label, "' is ignored because it is not measured per command");
+      continue;
+    }
+    icounters.emplace_back(icounter);
+  }
+  if (icounters.empty()) { return nullptr; }
+
+  VkQueryPoolPerformanceCreateInfoKHR qppci {};
+  qppci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_PERFORMANCE_CREATE_INFO_KHR;
+  qppci.queueFamilyIndex = qfam_idx;
+  qppci.counterIndexCount = (uint32_t)icounters.size();
+  qppci.pCounterIndices = icounters.data();
+
+  uint32_t npass = 0;
+  perf_query_detail.get_npass(ctxt.physdev(), &qppci, &npass);
+  if (npass > 1) {
+    L_WARN("performance counters of invocation '", label, "' are not "
+      "collected because they take ", npass, " passes");
+    return nullptr;
+  }
+  // The lock MUST be held before command buffers using the queries are begun.
+  if (!const_cast<Context&>(ctxt).acquire_profiling_lock()) { return nullptr; }
+
+  InvocationPerformanceQueryDetail out {};
+  out.query_pool = ctxt.create_query_pool(
+    VK_QUERY_TYPE_PERFORMANCE_QUERY_KHR, 1, 0, &qppci);
+  out.qfam_idx = qfam_idx;
+  out.icounters = std::move(icounters);
+  return std::make_unique<InvocationPerformanceQueryDetail>(std::move(out));
+}
 bool Invocation::create(
   const Task& task,
   const ComputeInvocationConfig& cfg,
@@ -338,15 +884,27 @@ bool Invocation::create(
 ) {
   L_ASSERT(task.rsc_detail.rsc_tys.size() == cfg.rsc_views.size());
   L_ASSERT(task.submit_ty == L_SUBMIT_TYPE_COMPUTE);
+  L_ASSERT(task.rsc_detail.push_const_size == cfg.push_consts.size(),
+    "push constant size mismatched");
   const Context& ctxt = *task.ctxt;
 
   out.label = cfg.label;
   out.ctxt = &ctxt;
-  out.submit_ty = L_SUBMIT_TYPE_COMPUTE;
+  out.submit_ty =
+    cfg.is_async ? L_SUBMIT_TYPE_ASYNC_COMPUTE : L_SUBMIT_TYPE_COMPUTE;
   out.query_pool = cfg.is_timed ? const_cast<Context&>(ctxt).acquire_query_pool() : QueryPoolPoolItem {};
 
   InvocationTransitionDetail transit_detail {};
   _collect_task_invoke_transit(cfg.rsc_views, task.rsc_detail.rsc_tys, transit_detail);
+  _collect_task_invoke_transit(cfg.bindless_rsc_views, cfg.bindless_rsc_tys,
+    transit_detail);
+  // Queue family ownership of depth images is not tracked.
+  L_ASSERT(!cfg.is_async || transit_detail.depth_img_transit.empty(),
+    "async compute invocation '", cfg.label, "' cannot access depth images");
+  if (cfg.indirect_buf.buf != nullptr) {
+    _check_indirect_buf(cfg.indirect_buf, sizeof(VkDispatchIndirectCommand));
+    transit_detail.reg(cfg.indirect_buf, L_BUFFER_USAGE_INDIRECT_BIT);
+  }
   out.transit_detail = std::move(transit_detail);
 
   InvocationComputeDetail comp_detail {};
@@ -358,10 +916,23 @@ bool Invocation::create(
     _update_desc_set(ctxt, comp_detail.desc_set.value()->desc_set,
       task.rsc_detail.rsc_tys, cfg.rsc_views);
   }
+  comp_detail.rsc_views = cfg.rsc_views;
+  comp_detail.push_consts = cfg.push_consts;
   comp_detail.workgrp_count = cfg.workgrp_count;
+  if (cfg.indirect_buf.buf != nullptr) {
+    comp_detail.indirect_buf = cfg.indirect_buf.buf->buf;
+    comp_detail.indirect_buf_offset = cfg.indirect_buf.offset;
+  }
 
   out.comp_detail =
     std::make_unique<InvocationComputeDetail>(std::move(comp_detail));
+  if (cfg.is_pipe_stats_collected) {
+    out.pipe_stats_detail = _create_pipe_stats_detail(ctxt, cfg.label,
+      VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT);
+  }
+  out.perf_query_detail = _create_perf_query_detail(ctxt, cfg.label,
+    out.submit_ty, cfg.perf_counter_names);
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::comp_cfg, cfg, out);
 
   L_DEBUG("created compute invocation");
   return true;
@@ -373,8 +944,28 @@ bool Invocation::create(
 ) {
   L_ASSERT(task.rsc_detail.rsc_tys.size() == cfg.rsc_views.size());
   L_ASSERT(task.submit_ty == L_SUBMIT_TYPE_GRAPHICS);
+  L_ASSERT(task.rsc_detail.push_const_size == cfg.push_consts.size(),
+    "push constant size mismatched");
   const Context& ctxt = *task.ctxt;
 
+  bool is_indirect = cfg.indirect_buf.buf != nullptr;
+  bool is_idxed = is_indirect ? cfg.idx_buf.buf != nullptr : cfg.nidx > 0;
+  uint32_t ndraw = cfg.ndraw == 0 ? 1 : cfg.ndraw;
+  if (is_indirect) {
+    if (ndraw > 1 && ctxt.physdev_feat().multiDrawIndirect == VK_FALSE) {
+      L_ERROR("cannot create graphics invocation '", cfg.label, "' with ",
+        ndraw, " indirect draws because multi-draw indirect is unsupported");
+      return false;
+    }
+    if (cfg.count_buf.buf != nullptr &&
+      ctxt.draw_indirect_count_detail.draw_indirect_count == nullptr
+    ) {
+      L_ERROR("cannot create graphics invocation '", cfg.label, "' with a "
+        "draw count buffer because draw indirect count is unsupported");
+      return false;
+    }
+  }
+
   out.label = cfg.label;
   out.ctxt = &ctxt;
   out.submit_ty = L_SUBMIT_TYPE_GRAPHICS;
@@ -382,12 +973,23 @@ bool Invocation::create(
 
   InvocationTransitionDetail transit_detail {};
   _collect_task_invoke_transit(cfg.rsc_views, task.rsc_detail.rsc_tys, transit_detail);
+  _collect_task_invoke_transit(cfg.bindless_rsc_views, cfg.bindless_rsc_tys,
+    transit_detail);
   for (size_t i = 0; i < cfg.vert_bufs.size(); ++i) {
     transit_detail.reg(cfg.vert_bufs[i], L_BUFFER_USAGE_VERTEX_BIT);
   }
-  if (cfg.nidx > 0) {
+  if (is_idxed) {
     transit_detail.reg(cfg.idx_buf, L_BUFFER_USAGE_INDEX_BIT);
   }
+  if (is_indirect) {
+    _check_indirect_buf(cfg.indirect_buf, ndraw * (is_idxed ?
+      sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand)));
+    transit_detail.reg(cfg.indirect_buf, L_BUFFER_USAGE_INDIRECT_BIT);
+    if (cfg.count_buf.buf != nullptr) {
+      _check_indirect_buf(cfg.count_buf, sizeof(uint32_t));
+      transit_detail.reg(cfg.count_buf, L_BUFFER_USAGE_INDIRECT_BIT);
+    }
+  }
   out.transit_detail = std::move(transit_detail);
 
   std::vector<sys::BufferRef> vert_bufs;
@@ -409,6 +1011,8 @@ bool Invocation::create(
     _update_desc_set(ctxt, graph_detail.desc_set.value()->desc_set,
       task.rsc_detail.rsc_tys, cfg.rsc_views);
   }
+  graph_detail.rsc_views = cfg.rsc_views;
+  graph_detail.push_consts = cfg.push_consts;
   graph_detail.vert_bufs = std::move(vert_bufs);
   graph_detail.vert_buf_offsets = std::move(vert_buf_offsets);
   if (cfg.idx_buf.buf != VK_NULL_HANDLE) {
@@ -419,9 +1023,34 @@ bool Invocation::create(
   graph_detail.nvert = cfg.nvert;
   graph_detail.idx_ty = cfg.idx_ty;
   graph_detail.nidx = cfg.nidx;
+  if (is_indirect) {
+    graph_detail.indirect_buf = cfg.indirect_buf.buf->buf;
+    graph_detail.indirect_buf_offset = cfg.indirect_buf.offset;
+    graph_detail.ndraw = ndraw;
+    if (cfg.count_buf.buf != nullptr) {
+      graph_detail.count_buf = cfg.count_buf.buf->buf;
+      graph_detail.count_buf_offset = cfg.count_buf.offset;
+    }
+  }
 
   out.graph_detail =
     std::make_unique<InvocationGraphicsDetail>(std::move(graph_detail));
+  if (cfg.is_pipe_stats_collected) {
+    out.pipe_stats_detail = _create_pipe_stats_detail(ctxt, cfg.label,
+      VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_CONTROL_SHADER_PATCHES_BIT |
+      VK_QUERY_PIPELINE_STATISTIC_TESSELLATION_EVALUATION_SHADER_INVOCATIONS_BIT);
+  }
+  out.perf_query_detail = _create_perf_query_detail(ctxt, cfg.label,
+    out.submit_ty, cfg.perf_counter_names);
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::graph_cfg, cfg, out);
 
   L_DEBUG("created graphics invocation");
   return true;
@@ -453,15 +1082,15 @@ bool Invocation::create(
     default: panic("render pass attachment must be image or depth image");
     }
   }
+  InvocationTransitionDetail attm_transit_detail = transit_detail;
   _merge_subinvoke_transits(cfg.invokes, transit_detail);
   out.transit_detail = std::move(transit_detail);
 
   InvocationRenderPassDetail pass_detail {};
   pass_detail.pass = &pass;
   pass_detail.framebuf = const_cast<RenderPass&>(pass).acquire_framebuf(cfg.attms);
-  // TODO: (penguinliong) Command buffer baking.
-  pass_detail.is_baked = false;
   pass_detail.subinvokes = cfg.invokes;
+  pass_detail.attm_transit_detail = std::move(attm_transit_detail);
 
   for (size_t i = 0; i < cfg.invokes.size(); ++i) {
     const Invocation& invoke = *cfg.invokes[i];
@@ -471,6 +1100,7 @@ bool Invocation::create(
 
   out.pass_detail =
     std::make_unique<InvocationRenderPassDetail>(std::move(pass_detail));
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::pass_cfg, cfg, out);
 
   L_DEBUG("created render pass invocation");
   return true;
@@ -516,21 +1146,79 @@ bool Invocation::create(
 
   InvocationTransitionDetail transit_detail {};
   _merge_subinvoke_transits(cfg.invokes, transit_detail);
+  if (cfg.is_async) {
+    for (const Invocation* subinvoke : cfg.invokes) {
+      L_ASSERT(subinvoke->submit_ty != L_SUBMIT_TYPE_GRAPHICS &&
+        subinvoke->submit_ty != L_SUBMIT_TYPE_PRESENT,
+        "async composite invocation '", cfg.label, "' can only contain "
+        "compute and transfer invocations");
+    }
+    L_ASSERT(transit_detail.depth_img_transit.empty(),
+      "async composite invocation '", cfg.label, "' cannot access depth "
+      "images");
+    out.submit_ty = L_SUBMIT_TYPE_ASYNC_COMPUTE;
+  }
   out.transit_detail = std::move(transit_detail);
+  out.transfer_size = 0;
+  out.upload_size = 0;
+  for (const Invocation* subinvoke : cfg.invokes) {
+    out.transfer_size += subinvoke->transfer_size;
+    out.upload_size += subinvoke->upload_size;
+  }
 
   InvocationCompositeDetail composite_detail {};
   composite_detail.subinvokes = cfg.invokes;
+  composite_detail.is_async = cfg.is_async;
+  for (const ResourceView& rsc_view : cfg.discard_rsc_views) {
+    switch (rsc_view.rsc_view_ty) {
+    case L_RESOURCE_VIEW_TYPE_BUFFER:
+      composite_detail.discard_bufs.emplace_back(rsc_view.buf_view.buf);
+      break;
+    case L_RESOURCE_VIEW_TYPE_IMAGE:
+      composite_detail.discard_imgs.emplace_back(rsc_view.img_view.img);
+      break;
+    case L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE:
+      composite_detail.discard_depth_imgs.emplace_back(
+        rsc_view.depth_img_view.depth_img);
+      break;
+    default: unreachable();
+    }
+  }
 
   out.composite_detail =
     std::make_unique<InvocationCompositeDetail>(std::move(composite_detail));
+  _keep_capture_cfg(ctxt, &InvocationCaptureDetail::composite_cfg, cfg, out);
 
   L_DEBUG("created composition invocation");
   return true;
 }
+// Baked command buffers might still be executed by pending submissions, so
+// their command pools go back to the pool after the device is done with them.
+void _drop_bake_detail(Invocation& invoke) {
+  if (!invoke.bake_detail) { return; }
+  const_cast<Context*>(invoke.ctxt)->defer_deletion([
+    bake_detail = std::shared_ptr<InvocationBakingDetail>(
+      std::move(invoke.bake_detail))]() {});
+}
+void _drop_primary_bake_detail(Invocation& invoke) {
+  if (!invoke.primary_bake_detail) { return; }
+  const_cast<Context*>(invoke.ctxt)->defer_deletion([
+    primary_bake_detail = std::shared_ptr<InvocationPrimaryBakingDetail>(
+      std::move(invoke.primary_bake_detail))]() {});
+}
 Invocation::~Invocation() {
-  if (b2b_detail || b2i_detail || i2b_detail || i2i_detail) {
+  if (b2b_detail || b2i_detail || i2b_detail || i2i_detail || blit_detail) {
     L_DEBUG("destroyed transfer invocation '", label, "'");
   }
+  if (fill_detail) {
+    L_DEBUG("destroyed fill invocation '", label, "'");
+  }
+  if (update_detail) {
+    L_DEBUG("destroyed update invocation '", label, "'");
+  }
+  if (upload_detail) {
+    L_DEBUG("destroyed upload invocation '", label, "'");
+  }
   if (comp_detail) {
     L_DEBUG("destroyed compute invocation '", label, "'");
   }
@@ -544,96 +1232,164 @@ Invocation::~Invocation() {
     L_DEBUG("destroyed composite invocation '", label, "'");
   }
 
-  if (bake_detail) {
+  if (bake_detail || primary_bake_detail) {
+    _drop_bake_detail(*this);
+    _drop_primary_bake_detail(*this);
     L_DEBUG("destroyed baking artifacts");
   }
+  if (pipe_stats_detail || perf_query_detail) {
+    // The device might still be writing the queries.
+    const_cast<Context*>(ctxt)->defer_deletion([
+      pipe_stats_detail = std::shared_ptr<InvocationPipelineStatisticsDetail>(
+        std::move(pipe_stats_detail)),
+      perf_query_detail = std::shared_ptr<InvocationPerformanceQueryDetail>(
+        std::move(perf_query_detail))]() {});
+  }
 }
 
 
 
-void _begin_cmdbuf(const TransactionSubmitDetail& submit_detail) {
+// Baked primary command buffers are submitted again before the previous
+// submission completes, so they are begun for simultaneous use.
+void _begin_cmdbuf(
+  const TransactionSubmitDetail& submit_detail,
+  const VkCommandBufferInheritanceInfo* pass_cbii = nullptr,
+  bool is_simultaneous = false
+) {
   VkCommandBufferInheritanceInfo cbii {};
   cbii.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
 
   VkCommandBufferBeginInfo cbbi {};
   cbbi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  if (submit_detail.submit_ty == L_SUBMIT_TYPE_GRAPHICS) {
+  // Only secondary command buffers executed in a render pass continue it.
+  if (pass_cbii != nullptr) {
     cbbi.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
   }
-  cbbi.pInheritanceInfo = &cbii;
+  if (is_simultaneous) {
+    cbbi.flags |= VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+  }
+  cbbi.pInheritanceInfo = pass_cbii != nullptr ? pass_cbii : &cbii;
   VK_ASSERT << vkBeginCommandBuffer(submit_detail.cmdbuf->cmdbuf, &cbbi);
 }
 void _end_cmdbuf(const TransactionSubmitDetail& submit_detail) {
   VK_ASSERT << vkEndCommandBuffer(submit_detail.cmdbuf->cmdbuf);
 }
 
-sys::CommandBufferRef _alloc_cmdbuf(
-  const Context& ctxt,
-  VkCommandPool cmd_pool,
-  VkCommandBufferLevel level
-) {
-  VkCommandBufferAllocateInfo cbai {};
-  cbai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cbai.level = level;
-  cbai.commandBufferCount = 1;
-  cbai.commandPool = cmd_pool;
-
-  return sys::CommandBuffer::create(ctxt.dev->dev, &cbai);
-}
-
 void _push_transact_submit_detail(
   const Context& ctxt,
   std::vector<TransactionSubmitDetail>& submit_details,
   SubmitType submit_ty,
   VkCommandBufferLevel level
 ) {
-  auto cmd_pool = const_cast<Context&>(ctxt).acquire_cmd_pool(submit_ty);
-  auto cmdbuf = _alloc_cmdbuf(ctxt, *cmd_pool.value(), level);
+  Context& ctxt2 = const_cast<Context&>(ctxt);
+  auto cmd_pool = ctxt2.acquire_cmd_pool(submit_ty);
+  auto cmdbuf = ctxt2.get_cmdbuf(cmd_pool, level);
+  ctxt2.record_stats.ncmdbuf_record += 1;
 
   TransactionSubmitDetail submit_detail {};
   submit_detail.submit_ty = submit_ty;
   submit_detail.cmd_pool = cmd_pool;
   submit_detail.cmdbuf = cmdbuf;
   submit_detail.queue = ctxt.submit_details.at(submit_detail.submit_ty).queue;
-  submit_detail.wait_sema = submit_details.empty() ?
-    VK_NULL_HANDLE : submit_details.back().signal_sema;
-  if (level == VK_COMMAND_BUFFER_LEVEL_SECONDARY) {
-    submit_detail.signal_sema = VK_NULL_HANDLE;
-  } else {
-    submit_detail.signal_sema = sys::Semaphore::create(ctxt.dev->dev);
+  submit_detail.is_async = submit_ty == L_SUBMIT_TYPE_ASYNC_COMPUTE &&
+    ctxt.queue_stats.is_async_compute_dedicated;
+  if (level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
+    submit_detail.timeline_sema =
+      ctxt.submit_details.at(submit_detail.submit_ty).timeline->sema;
   }
 
   submit_details.emplace_back(std::move(submit_detail));
 }
 void _submit_cmdbuf(
   TransactionLike& transact,
-  sys::FenceRef fence
+  SemaphorePoolItem&& present_sema
 ) {
   const Context& ctxt = *transact.ctxt;
   TransactionSubmitDetail& submit_detail = transact.submit_details.back();
+  ContextQueueTimeline& timeline =
+    *ctxt.submit_details.at(submit_detail.submit_ty).timeline;
 
   VkPipelineStageFlags stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  submit_detail.signal_value = ++timeline.last_value;
+
+  std::array<VkSemaphore, 2> signal_semas {
+    submit_detail.timeline_sema->sema,
+    VK_NULL_HANDLE,
+  };
+  // The second value is ignored by the binary present semaphore.
+  std::array<uint64_t, 2> signal_values { submit_detail.signal_value, 0 };
+  uint32_t nsignal_sema = 1;
+  if (present_sema.is_valid()) {
+    signal_semas[nsignal_sema++] = present_sema.value().sema->sema;
+    submit_detail.present_sema = std::move(present_sema);
+  }
+
+  VkTimelineSemaphoreSubmitInfoKHR tssi {};
+  tssi.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+  tssi.signalSemaphoreValueCount = nsignal_sema;
+  tssi.pSignalSemaphoreValues = signal_values.data();
 
   VkSubmitInfo submit_info {};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = &tssi;
   submit_info.commandBufferCount = 1;
   submit_info.pCommandBuffers = &submit_detail.cmdbuf->cmdbuf;
-  submit_info.signalSemaphoreCount = 1;
-  if (submit_detail.wait_sema != VK_NULL_HANDLE) {
-    // Wait for the last submitted command buffer on the device side.
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &submit_detail.wait_sema->sema;
-    submit_info.pWaitDstStageMask = &stage_mask;
+  submit_info.signalSemaphoreCount = nsignal_sema;
+  submit_info.pSignalSemaphores = signal_semas.data();
+
+  // Wait for the last submitted command buffer on the device side. Async
+  // compute submissions are skipped so that they overlap with the following
+  // submissions, unless they are joined by releasing resources to other
+  // queues.
+  std::vector<VkSemaphore> wait_semas;
+  std::vector<uint64_t> wait_values;
+  for (size_t i = transact.submit_details.size() - 1; i > 0; --i) {
+    const TransactionSubmitDetail& last_submit_detail =
+      transact.submit_details.at(i - 1);
+    bool is_skipped = !submit_detail.is_async && last_submit_detail.is_async;
+    if (!is_skipped || last_submit_detail.is_joined) {
+      wait_semas.emplace_back(last_submit_detail.timeline_sema->sema);
+      wait_values.emplace_back(last_submit_detail.signal_value);
+    }
+    if (!is_skipped) { break; }
+  }
+  std::vector<VkPipelineStageFlags> wait_stages(wait_semas.size(),
+    stage_mask);
+  if (!wait_semas.empty()) {
+    submit_info.waitSemaphoreCount = (uint32_t)wait_semas.size();
+    submit_info.pWaitSemaphores = wait_semas.data();
+    submit_info.pWaitDstStageMask = wait_stages.data();
+    tssi.waitSemaphoreValueCount = (uint32_t)wait_values.size();
+    tssi.pWaitSemaphoreValues = wait_values.data();
   }
-  submit_info.pSignalSemaphores = &submit_detail.signal_sema->sema;
 
   // Finish recording and submit the command buffer to the device.
-  VK_ASSERT << vkQueueSubmit(submit_detail.queue, 1, &submit_info, fence->fence);
+  VK_ASSERT << vkQueueSubmit(submit_detail.queue, 1, &submit_info,
+    VK_NULL_HANDLE);
 
   submit_detail.is_submitted = true;
+  // The command pool is recycled only after the submitted commands complete.
+  submit_detail.cmd_pool.value().timeline_sema = submit_detail.timeline_sema;
+  submit_detail.cmd_pool.value().timeline_value = submit_detail.signal_value;
+  for (auto& cmd_pool : transact.secondary_cmd_pools) {
+    if (cmd_pool.value().timeline_sema != nullptr) { continue; }
+    cmd_pool.value().timeline_sema = submit_detail.timeline_sema;
+    cmd_pool.value().timeline_value = submit_detail.signal_value;
+  }
+
+  ContextQueueStatistics& queue_stats =
+    const_cast<Context&>(ctxt).queue_stats;
+  queue_stats.nsubmit += 1;
+  if (submit_detail.queue ==
+    ctxt.submit_details.at(L_SUBMIT_TYPE_TRANSFER).queue
+  ) {
+    queue_stats.ntransfer_submit += 1;
+    queue_stats.transfer_size += submit_detail.transfer_size;
+  }
+  if (submit_detail.is_async) {
+    queue_stats.nasync_submit += 1;
+  }
 }
-// `is_fenced` means that the command buffer is waited by the host so no
-// semaphore signaling should be scheduled.
 void _seal_cmdbuf(TransactionLike& transact) {
   if (!transact.submit_details.empty()) {
     // Do nothing if the queue is unchanged. It means that the commands can
@@ -645,15 +1401,27 @@ void _seal_cmdbuf(TransactionLike& transact) {
     // End the command buffer and, it it's a primary command buffer, submit the
     // recorded commands.
     _end_cmdbuf(last_submit);
-    if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
-      _submit_cmdbuf(transact, VK_NULL_HANDLE);
+    if (
+      transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+      !transact.is_baking
+    ) {
+      _submit_cmdbuf(transact, {});
     }
   }
 }
-VkCommandBuffer _get_cmdbuf(
-  TransactionLike& transact,
+SubmitType _resolve_submit_ty(
+  const TransactionLike& transact,
   SubmitType submit_ty
 ) {
+  // Everything but graphics is redirected to the async compute queue in async
+  // composite invocations.
+  if (transact.is_async && (
+    submit_ty == L_SUBMIT_TYPE_ANY ||
+    submit_ty == L_SUBMIT_TYPE_COMPUTE ||
+    submit_ty == L_SUBMIT_TYPE_TRANSFER
+  )) {
+    return L_SUBMIT_TYPE_ASYNC_COMPUTE;
+  }
   if (submit_ty == L_SUBMIT_TYPE_ANY) {
     if (transact.submit_details.empty()) {
       submit_ty = transact.ctxt->submit_details.begin()->first;
@@ -661,6 +1429,29 @@ VkCommandBuffer _get_cmdbuf(
       submit_ty = transact.submit_details.back().submit_ty;
     }
   }
+  return submit_ty;
+}
+// Untagged invocations don't follow async compute invocations to the async
+// compute queue.
+SubmitType _redirect_untagged_submit_ty(
+  const TransactionLike& transact,
+  SubmitType submit_ty
+) {
+  if (
+    submit_ty == L_SUBMIT_TYPE_ANY &&
+    !transact.is_async &&
+    !transact.submit_details.empty() &&
+    transact.submit_details.back().submit_ty == L_SUBMIT_TYPE_ASYNC_COMPUTE
+  ) {
+    return L_SUBMIT_TYPE_COMPUTE;
+  }
+  return submit_ty;
+}
+VkCommandBuffer _get_cmdbuf(
+  TransactionLike& transact,
+  SubmitType submit_ty
+) {
+  submit_ty = _resolve_submit_ty(transact, submit_ty);
   const auto& submit_detail = transact.ctxt->submit_details.at(submit_ty);
   auto queue = submit_detail.queue;
   auto qfam_idx = submit_detail.qfam_idx;
@@ -680,7 +1471,7 @@ VkCommandBuffer _get_cmdbuf(
 
   _push_transact_submit_detail(*transact.ctxt, transact.submit_details,
     submit_ty, transact.level);
-  _begin_cmdbuf(transact.submit_details.back());
+  _begin_cmdbuf(transact.submit_details.back(), nullptr, transact.is_baking);
   return transact.submit_details.back().cmdbuf->cmdbuf;
 }
 
@@ -720,6 +1511,10 @@ void _make_buf_barrier_params(
     access = VK_ACCESS_INDEX_READ_BIT;
     stage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
     break;
+  case L_BUFFER_USAGE_INDIRECT_BIT:
+    access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    stage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    break;
   default:
     panic("destination usage cannot be a set of bits");
   }
@@ -813,22 +1608,288 @@ void _make_depth_img_barrier_params(
     panic("destination usage cannot be a set of bits");
   }
 }
+// Queue family of the command buffer being recorded.
+uint32_t _get_cur_qfam_idx(const TransactionLike& transact) {
+  SubmitType submit_ty = transact.submit_details.back().submit_ty;
+  return transact.ctxt->submit_details.at(submit_ty).qfam_idx;
+}
+// Whether a resource owned by `qfam_idx` has to be acquired by the queue family
+// of the command buffer being recorded. Ownership is not tracked in baked
+// command buffers.
+bool _is_ownership_acquired(
+  const TransactionLike& transact,
+  uint32_t qfam_idx
+) {
+  return transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+    qfam_idx != VK_QUEUE_FAMILY_IGNORED &&
+    qfam_idx != _get_cur_qfam_idx(transact);
+}
+SubmitType _get_qfam_submit_ty(const Context& ctxt, uint32_t qfam_idx) {
+  for (const auto& pair : ctxt.submit_details) {
+    if (pair.second.qfam_idx == qfam_idx) { return pair.first; }
+  }
+  panic("queue family #", qfam_idx, " is not used by the context");
+  return L_SUBMIT_TYPE_ANY;
+}
+// Release resources owned by other queue families to the queue family the
+// invocation is going to be recorded on. Releases are recorded on the owning
+// queues before the transaction switches to the new queue, and the
+// transaction's semaphores order them before the acquires in `_transit_rsc`.
+void _release_rscs(
+  TransactionLike& transact,
+  SubmitType submit_ty,
+  const InvocationTransitionDetail& transit_detail
+) {
+  if (transact.level != VK_COMMAND_BUFFER_LEVEL_PRIMARY) { return; }
+  const Context& ctxt = *transact.ctxt;
+  uint32_t dst_qfam_idx =
+    ctxt.submit_details.at(_resolve_submit_ty(transact, submit_ty)).qfam_idx;
+
+  struct ReleaseBarriers {
+    VkPipelineStageFlags src_stage;
+    std::vector<VkBufferMemoryBarrier> bmbs;
+    std::vector<VkImageMemoryBarrier> imbs;
+  };
+  std::map<uint32_t, ReleaseBarriers> releases;
+  std::set<const void*> released_rscs;
+
+  for (const auto& pair : transit_detail.buf_transit) {
+    const Buffer& buf = *pair.first.buf;
+    const BufferDynamicDetail& dyn_detail = buf.dyn_detail;
+    if (dyn_detail.qfam_idx == VK_QUEUE_FAMILY_IGNORED) { continue; }
+    if (dyn_detail.qfam_idx == dst_qfam_idx) { continue; }
+    if (!released_rscs.emplace(&buf).second) { continue; }
+
+    VkBufferMemoryBarrier bmb {};
+    bmb.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bmb.buffer = buf.buf->buf;
+    bmb.srcAccessMask = dyn_detail.access;
+    bmb.dstAccessMask = 0;
+    bmb.srcQueueFamilyIndex = dyn_detail.qfam_idx;
+    bmb.dstQueueFamilyIndex = dst_qfam_idx;
+    bmb.offset = 0;
+    bmb.size = VK_WHOLE_SIZE;
+
+    ReleaseBarriers& release = releases[dyn_detail.qfam_idx];
+    release.src_stage |= dyn_detail.stage;
+    release.bmbs.emplace_back(std::move(bmb));
+  }
+  for (const auto& pair : transit_detail.img_transit) {
+    const Image& img = *pair.first.img;
+    const ImageDynamicDetail& dyn_detail = img.dyn_detail;
+    if (dyn_detail.qfam_idx == VK_QUEUE_FAMILY_IGNORED) { continue; }
+    if (dyn_detail.qfam_idx == dst_qfam_idx) { continue; }
+    if (!released_rscs.emplace(&img).second) { continue; }
+
+    VkAccessFlags dst_access = 0;
+    VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkImageLayout dst_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    _make_img_barrier_params(pair.second, dst_access, dst_stage, dst_layout);
+
+    VkImageMemoryBarrier imb {};
+    imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imb.image = img.img->img;
+    imb.srcAccessMask = dyn_detail.access;
+    imb.dstAccessMask = 0;
+    imb.oldLayout = dyn_detail.layout;
+    imb.newLayout = dst_layout;
+    imb.srcQueueFamilyIndex = dyn_detail.qfam_idx;
+    imb.dstQueueFamilyIndex = dst_qfam_idx;
+    imb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imb.subresourceRange.baseArrayLayer = 0;
+    imb.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    imb.subresourceRange.baseMipLevel = 0;
+    imb.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+
+    ReleaseBarriers& release = releases[dyn_detail.qfam_idx];
+    release.src_stage |= dyn_detail.stage;
+    release.imbs.emplace_back(std::move(imb));
+  }
+  for (const auto& pair : transit_detail.depth_img_transit) {
+    const DepthImage& depth_img = *pair.first.depth_img;
+    const DepthImageDynamicDetail& dyn_detail = depth_img.dyn_detail;
+    if (dyn_detail.qfam_idx == VK_QUEUE_FAMILY_IGNORED) { continue; }
+    if (dyn_detail.qfam_idx == dst_qfam_idx) { continue; }
+    if (!released_rscs.emplace(&depth_img).second) { continue; }
+
+    VkAccessFlags dst_access = 0;
+    VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkImageLayout dst_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    _make_depth_img_barrier_params(pair.second, dst_access, dst_stage,
+      dst_layout);
+
+    VkImageMemoryBarrier imb {};
+    imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imb.image = depth_img.img->img;
+    imb.srcAccessMask = dyn_detail.access;
+    imb.dstAccessMask = 0;
+    imb.oldLayout = dyn_detail.layout;
+    imb.newLayout = dst_layout;
+    imb.srcQueueFamilyIndex = dyn_detail.qfam_idx;
+    imb.dstQueueFamilyIndex = dst_qfam_idx;
+    imb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    imb.subresourceRange.baseArrayLayer = 0;
+    imb.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    imb.subresourceRange.baseMipLevel = 0;
+    imb.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+
+    ReleaseBarriers& release = releases[dyn_detail.qfam_idx];
+    release.src_stage |= dyn_detail.stage;
+    release.imbs.emplace_back(std::move(imb));
+  }
+
+  for (const auto& pair : releases) {
+    const ReleaseBarriers& release = pair.second;
+    // Releases are recorded on the owning queue even in async composite
+    // invocations.
+    bool is_async = transact.is_async;
+    transact.is_async = false;
+    VkCommandBuffer cmdbuf =
+      _get_cmdbuf(transact, _get_qfam_submit_ty(ctxt, pair.first));
+    transact.is_async = is_async;
+    // Work on other queues depending on the released resources must wait for
+    // the async compute submission.
+    transact.submit_details.back().is_joined = true;
+    vkCmdPipelineBarrier(
+      cmdbuf,
+      release.src_stage,
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+      0,
+      0, nullptr,
+      (uint32_t)release.bmbs.size(), release.bmbs.data(),
+      (uint32_t)release.imbs.size(), release.imbs.data());
+
+    const_cast<Context&>(ctxt).queue_stats.nownership_transfer +=
+      release.bmbs.size() + release.imbs.size();
+    const_cast<Context&>(ctxt).barrier_stats.nbarrier_call += 1;
+    const_cast<Context&>(ctxt).barrier_stats.nbarrier +=
+      release.bmbs.size() + release.imbs.size();
+    L_DEBUG("released ", release.bmbs.size() + release.imbs.size(),
+      " resources from queue family #", pair.first, " to #", dst_qfam_idx);
+  }
+}
+constexpr VkAccessFlags WRITE_ACCESS_MASK =
+  VK_ACCESS_SHADER_WRITE_BIT |
+  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+  VK_ACCESS_TRANSFER_WRITE_BIT |
+  VK_ACCESS_HOST_WRITE_BIT |
+  VK_ACCESS_MEMORY_WRITE_BIT;
+
+// Pending resource transitions issued in a single `vkCmdPipelineBarrier` at
+// the next dependency point.
+struct BarrierBatch {
+  VkPipelineStageFlags src_stage;
+  VkPipelineStageFlags dst_stage;
+  std::vector<VkBufferMemoryBarrier> bmbs;
+  std::vector<VkImageMemoryBarrier> imbs;
+  // Resources with pending barriers. Barriers in a single call are unordered,
+  // so a resource transitioned again has to wait for the next call.
+  std::set<const void*> rscs;
+};
+void _flush_barriers(TransactionLike& transact, BarrierBatch& batch) {
+  if (batch.bmbs.empty() && batch.imbs.empty()) { return; }
+
+  VkCommandBuffer cmdbuf = _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
+  vkCmdPipelineBarrier(
+    cmdbuf,
+    batch.src_stage != 0 ? batch.src_stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+    batch.dst_stage != 0 ? batch.dst_stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+    0,
+    0, nullptr,
+    (uint32_t)batch.bmbs.size(), batch.bmbs.data(),
+    (uint32_t)batch.imbs.size(), batch.imbs.data());
+
+  ContextBarrierStatistics& barrier_stats =
+    const_cast<Context&>(*transact.ctxt).barrier_stats;
+  barrier_stats.nbarrier_call += 1;
+  barrier_stats.nbarrier += batch.bmbs.size() + batch.imbs.size();
+  if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
+    L_DEBUG("inserted ", batch.bmbs.size(), " buffer barriers and ",
+      batch.imbs.size(), " image barriers");
+  }
+
+  batch = BarrierBatch {};
+}
+// Resolve the access state of a resource after a transition. Returns `false`
+// if the transition has no hazard to resolve so the barrier can be dropped.
+bool _resolve_transit(
+  TransactionLike& transact,
+  BarrierBatch& batch,
+  const void* rsc,
+  bool is_acquire,
+  bool is_layout_changed,
+  VkAccessFlags& access,
+  VkPipelineStageFlags& stage,
+  VkAccessFlags dst_access,
+  VkPipelineStageFlags dst_stage
+) {
+  bool is_src_write = (access & WRITE_ACCESS_MASK) != 0;
+  bool is_dst_write = (dst_access & WRITE_ACCESS_MASK) != 0;
+  bool is_visible =
+    (dst_access & ~access) == 0 && (dst_stage & ~stage) == 0;
+
+  bool need_barrier;
+  if (is_acquire || is_layout_changed) {
+    need_barrier = true;
+  } else if (dst_access == 0 || access == 0) {
+    // Nothing to wait for or to make visible.
+    need_barrier = false;
+  } else if (is_src_write || is_dst_write) {
+    need_barrier = true;
+  } else {
+    // Reads after reads only need the earlier writes to be visible to the new
+    // readers.
+    need_barrier = !is_visible;
+  }
+
+  if (!need_barrier) {
+    ContextBarrierStatistics& barrier_stats =
+      const_cast<Context&>(*transact.ctxt).barrier_stats;
+    barrier_stats.nbarrier_elide += 1;
+    if (access == 0) {
+      access = dst_access;
+      stage = dst_stage;
+    } else if (dst_access != 0) {
+      access |= dst_access;
+      stage |= dst_stage;
+    }
+    return false;
+  }
+
+  if (batch.rscs.count(rsc) != 0) {
+    _flush_barriers(transact, batch);
+  }
+  batch.rscs.emplace(rsc);
+  return true;
+}
+
 const BufferView& _transit_rsc(
   TransactionLike& transact,
+  BarrierBatch& batch,
   const BufferView& buf_view,
   BufferUsage dst_usage
 ) {
   auto& dyn_detail = (BufferDynamicDetail&)buf_view.buf->dyn_detail;
-  auto cmdbuf = _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
+  // Make sure there is a command buffer to transition the resource in.
+  _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
+  uint32_t qfam_idx = _get_cur_qfam_idx(transact);
+  uint32_t src_qfam_idx = dyn_detail.qfam_idx;
+  bool is_acquire = _is_ownership_acquired(transact, src_qfam_idx);
 
-  VkAccessFlags src_access = dyn_detail.access;
-  VkPipelineStageFlags src_stage = dyn_detail.stage;
+  VkAccessFlags src_access = is_acquire ? 0 : dyn_detail.access;
+  VkPipelineStageFlags src_stage = is_acquire ?
+    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : dyn_detail.stage;
 
   VkAccessFlags dst_access = 0;
   VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
   _make_buf_barrier_params(dst_usage, dst_access, dst_stage);
 
-  if (src_access == dst_access && src_stage == dst_stage) {
+  if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
+    dyn_detail.qfam_idx = qfam_idx;
+  }
+  if (!_resolve_transit(transact, batch, buf_view.buf, is_acquire, false,
+    dyn_detail.access, dyn_detail.stage, dst_access, dst_stage)) {
     return buf_view;
   }
 
@@ -837,39 +1898,45 @@ const BufferView& _transit_rsc(
   bmb.buffer = buf_view.buf->buf->buf;
   bmb.srcAccessMask = src_access;
   bmb.dstAccessMask = dst_access;
-  bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  bmb.offset = buf_view.offset;
-  bmb.size = buf_view.size;
-
-  vkCmdPipelineBarrier(
-    cmdbuf,
-    src_stage,
-    dst_stage,
-    0,
-    0, nullptr,
-    1, &bmb,
-    0, nullptr);
-
-  if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
-    L_DEBUG("inserted buffer barrier");
+  if (is_acquire) {
+    // Ownership is transferred for the entire buffer, matching the release.
+    bmb.srcQueueFamilyIndex = src_qfam_idx;
+    bmb.dstQueueFamilyIndex = qfam_idx;
+    bmb.offset = 0;
+    bmb.size = VK_WHOLE_SIZE;
+  } else {
+    bmb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bmb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bmb.offset = buf_view.offset;
+    bmb.size = buf_view.size;
   }
+  batch.src_stage |= src_stage;
+  batch.dst_stage |= dst_stage;
+  batch.bmbs.emplace_back(std::move(bmb));
 
-  dyn_detail.access = dst_access;
-  dyn_detail.stage = dst_stage;
+  // Readers accumulate so that the next writer waits for all of them.
+  bool is_read_only = ((src_access | dst_access) & WRITE_ACCESS_MASK) == 0;
+  dyn_detail.access = is_read_only ? (src_access | dst_access) : dst_access;
+  dyn_detail.stage = is_read_only ? (src_stage | dst_stage) : dst_stage;
 
   return buf_view;
 }
 const ImageView& _transit_rsc(
   TransactionLike& transact,
+  BarrierBatch& batch,
   const ImageView& img_view,
   ImageUsage dst_usage
 ) {
   auto& dyn_detail = (ImageDynamicDetail&)img_view.img->dyn_detail;
-  auto cmdbuf = _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
-
-  VkAccessFlags src_access = dyn_detail.access;
-  VkPipelineStageFlags src_stage = dyn_detail.stage;
+  // Make sure there is a command buffer to transition the resource in.
+  _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
+  uint32_t qfam_idx = _get_cur_qfam_idx(transact);
+  uint32_t src_qfam_idx = dyn_detail.qfam_idx;
+  bool is_acquire = _is_ownership_acquired(transact, src_qfam_idx);
+
+  VkAccessFlags src_access = is_acquire ? 0 : dyn_detail.access;
+  VkPipelineStageFlags src_stage = is_acquire ?
+    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : dyn_detail.stage;
   VkImageLayout src_layout = dyn_detail.layout;
 
   VkAccessFlags dst_access = 0;
@@ -877,11 +1944,12 @@ const ImageView& _transit_rsc(
   VkImageLayout dst_layout = VK_IMAGE_LAYOUT_UNDEFINED;
   _make_img_barrier_params(dst_usage, dst_access, dst_stage, dst_layout);
 
-  if (
-    src_access == dst_access &&
-    src_stage == dst_stage &&
-    src_layout == dst_layout
-  ) {
+  if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
+    dyn_detail.qfam_idx = qfam_idx;
+  }
+  if (!_resolve_transit(transact, batch, img_view.img, is_acquire,
+    src_layout != dst_layout, dyn_detail.access, dyn_detail.stage, dst_access,
+    dst_stage)) {
     return img_view;
   }
 
@@ -892,45 +1960,44 @@ const ImageView& _transit_rsc(
   imb.dstAccessMask = dst_access;
   imb.oldLayout = src_layout;
   imb.newLayout = dst_layout;
-  imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  // The layout transition is shared with the matching release.
+  imb.srcQueueFamilyIndex = is_acquire ? src_qfam_idx : VK_QUEUE_FAMILY_IGNORED;
+  imb.dstQueueFamilyIndex = is_acquire ? qfam_idx : VK_QUEUE_FAMILY_IGNORED;
   imb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   // TODO: (penguinliong) Multi-layer image. 
   imb.subresourceRange.baseArrayLayer = 0;
   imb.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
   imb.subresourceRange.baseMipLevel = 0;
   imb.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-
-  vkCmdPipelineBarrier(
-    cmdbuf,
-    src_stage,
-    dst_stage,
-    0,
-    0, nullptr,
-    0, nullptr,
-    1, &imb);
-
-  if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
-    L_DEBUG("inserted image barrier");
-  }
-
-  dyn_detail.access = dst_access;
-  dyn_detail.stage = dst_stage;
+  batch.src_stage |= src_stage;
+  batch.dst_stage |= dst_stage;
+  batch.imbs.emplace_back(std::move(imb));
+
+  bool is_read_only = src_layout == dst_layout &&
+    ((src_access | dst_access) & WRITE_ACCESS_MASK) == 0;
+  dyn_detail.access = is_read_only ? (src_access | dst_access) : dst_access;
+  dyn_detail.stage = is_read_only ? (src_stage | dst_stage) : dst_stage;
   dyn_detail.layout = dst_layout;
 
   return img_view;
 }
 const DepthImageView& _transit_rsc(
   TransactionLike& transact,
+  BarrierBatch& batch,
   const DepthImageView& depth_img_view,
   DepthImageUsage dst_usage
 ) {
   auto& dyn_detail =
     (DepthImageDynamicDetail&)depth_img_view.depth_img->dyn_detail;
-  auto cmdbuf = _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
-
-  VkAccessFlags src_access = dyn_detail.access;
-  VkPipelineStageFlags src_stage = dyn_detail.stage;
+  // Make sure there is a command buffer to transition the resource in.
+  _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
+  uint32_t qfam_idx = _get_cur_qfam_idx(transact);
+  uint32_t src_qfam_idx = dyn_detail.qfam_idx;
+  bool is_acquire = _is_ownership_acquired(transact, src_qfam_idx);
+
+  VkAccessFlags src_access = is_acquire ? 0 : dyn_detail.access;
+  VkPipelineStageFlags src_stage = is_acquire ?
+    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT : dyn_detail.stage;
   VkImageLayout src_layout = dyn_detail.layout;
 
   VkAccessFlags dst_access = 0;
@@ -938,11 +2005,12 @@ const DepthImageView& _transit_rsc(
   VkImageLayout dst_layout = VK_IMAGE_LAYOUT_UNDEFINED;
   _make_depth_img_barrier_params(dst_usage, dst_access, dst_stage, dst_layout);
 
-  if (
-    src_access == dst_access &&
-    src_stage == dst_stage &&
-    src_layout == dst_layout
-  ) {
+  if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
+    dyn_detail.qfam_idx = qfam_idx;
+  }
+  if (!_resolve_transit(transact, batch, depth_img_view.depth_img, is_acquire,
+    src_layout != dst_layout, dyn_detail.access, dyn_detail.stage, dst_access,
+    dst_stage)) {
     return depth_img_view;
   }
 
@@ -953,29 +2021,22 @@ const DepthImageView& _transit_rsc(
   imb.dstAccessMask = dst_access;
   imb.oldLayout = src_layout;
   imb.newLayout = dst_layout;
-  imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  // The layout transition is shared with the matching release.
+  imb.srcQueueFamilyIndex = is_acquire ? src_qfam_idx : VK_QUEUE_FAMILY_IGNORED;
+  imb.dstQueueFamilyIndex = is_acquire ? qfam_idx : VK_QUEUE_FAMILY_IGNORED;
   imb.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
   imb.subresourceRange.baseArrayLayer = 0;
   imb.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
   imb.subresourceRange.baseMipLevel = 0;
   imb.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-
-  vkCmdPipelineBarrier(
-    cmdbuf,
-    src_stage,
-    dst_stage,
-    0,
-    0, nullptr,
-    0, nullptr,
-    1, &imb);
-
-  if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
-    L_DEBUG("inserted depth image barrier");
-  }
-
-  dyn_detail.access = dst_access;
-  dyn_detail.stage = dst_stage;
+  batch.src_stage |= src_stage;
+  batch.dst_stage |= dst_stage;
+  batch.imbs.emplace_back(std::move(imb));
+
+  bool is_read_only = src_layout == dst_layout &&
+    ((src_access | dst_access) & WRITE_ACCESS_MASK) == 0;
+  dyn_detail.access = is_read_only ? (src_access | dst_access) : dst_access;
+  dyn_detail.stage = is_read_only ? (src_stage | dst_stage) : dst_stage;
   dyn_detail.layout = dst_layout;
 
   return depth_img_view;
@@ -984,20 +2045,399 @@ void _transit_rscs(
   TransactionLike& transact,
   const InvocationTransitionDetail& transit_detail
 ) {
-  // Transition all referenced resources.
+  // Transition all referenced resources in as few barriers as possible.
+  BarrierBatch batch {};
   for (auto& pair : transit_detail.buf_transit) {
-    _transit_rsc(transact, pair.first, pair.second);
+    _transit_rsc(transact, batch, pair.first, pair.second);
   }
   for (auto& pair : transit_detail.img_transit) {
-    _transit_rsc(transact, pair.first, pair.second);
+    _transit_rsc(transact, batch, pair.first, pair.second);
   }
   for (auto& pair : transit_detail.depth_img_transit) {
-    _transit_rsc(transact, pair.first, pair.second);
+    _transit_rsc(transact, batch, pair.first, pair.second);
+  }
+  _flush_barriers(transact, batch);
+}
+// Forget the content and access states of resources so that their next use
+// waits for all previous device work, which might have accessed the same
+// memory through aliasing resources. Discarded resources are owned by no queue
+// family so no ownership transfer is needed either.
+void _discard_rscs(const InvocationCompositeDetail& composite_detail) {
+  for (const Buffer* buf : composite_detail.discard_bufs) {
+    auto& dyn_detail = (BufferDynamicDetail&)buf->dyn_detail;
+    dyn_detail.stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    dyn_detail.access = VK_ACCESS_MEMORY_WRITE_BIT;
+    dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
   }
+  for (const Image* img : composite_detail.discard_imgs) {
+    auto& dyn_detail = (ImageDynamicDetail&)img->dyn_detail;
+    dyn_detail.stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    dyn_detail.access = VK_ACCESS_MEMORY_WRITE_BIT;
+    dyn_detail.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
+  }
+  for (const DepthImage* depth_img : composite_detail.discard_depth_imgs) {
+    auto& dyn_detail = (DepthImageDynamicDetail&)depth_img->dyn_detail;
+    dyn_detail.stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    dyn_detail.access = VK_ACCESS_MEMORY_WRITE_BIT;
+    dyn_detail.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
+  }
+}
+void _bind_bindless_desc_set(
+  VkCommandBuffer cmdbuf,
+  VkPipelineBindPoint bind_pt,
+  const Task& task
+) {
+  if (!task.rsc_detail.is_bindless) { return; }
+  VkDescriptorSet desc_set =
+    task.ctxt->bindless_detail.desc_set->desc_set;
+  vkCmdBindDescriptorSets(cmdbuf, bind_pt,
+    task.rsc_detail.pipe_layout->pipe_layout, 1, 1, &desc_set, 0, nullptr);
+}
+void _push_consts(
+  VkCommandBuffer cmdbuf,
+  const Task& task,
+  const std::vector<uint8_t>& push_consts
+) {
+  if (push_consts.empty()) { return; }
+  vkCmdPushConstants(cmdbuf, task.rsc_detail.pipe_layout->pipe_layout,
+    task.rsc_detail.push_const_stage, 0, (uint32_t)push_consts.size(),
+    push_consts.data());
 }
 
 // Return true if the invocation forces an termination.
-std::vector<sys::FenceRef> _record_invoke_impl(
+std::vector<FencePoolItem> _record_invoke_impl(
+  TransactionLike& transact,
+  const Invocation& invoke);
+
+typedef std::vector<const Invocation*>::const_iterator SubinvocationIterator;
+// Whether the invocation can be recorded into a secondary command buffer on
+// a recording thread. Invocations with nested invocations are recorded on the
+// submitting thread so that barriers between the nested invocations are kept.
+bool _is_parallel_recordable(const Invocation& invoke) {
+  return invoke.present_detail == nullptr &&
+    invoke.pass_detail == nullptr &&
+    invoke.composite_detail == nullptr &&
+    !invoke.query_pool.is_valid();
+}
+bool _can_record_in_parallel(
+  const TransactionLike& transact,
+  SubinvocationIterator beg,
+  SubinvocationIterator end
+) {
+  if (!transact.is_parallel) { return false; }
+  if (transact.level != VK_COMMAND_BUFFER_LEVEL_PRIMARY) { return false; }
+  if (end - beg < 2) { return false; }
+  for (auto it = beg; it != end; ++it) {
+    L_ASSERT(*it != nullptr, "null subinvocation is not allowed");
+    if (!_is_parallel_recordable(**it)) { return false; }
+  }
+  return true;
+}
+// Find the end of consecutive subinvocations recordable in parallel and
+// executed on the same queue since `beg`. Subinvocations are grouped by the
+// queues they are resolved to, so that recording threads never switch queues.
+SubinvocationIterator _find_parallel_subinvokes_end(
+  const TransactionLike& transact,
+  SubinvocationIterator beg,
+  SubinvocationIterator end
+) {
+  if (!transact.is_parallel) { return beg; }
+  const auto& submit_details = transact.ctxt->submit_details;
+
+  VkQueue queue = VK_NULL_HANDLE;
+  bool has_untagged = false;
+  bool has_async = false;
+  auto it = beg;
+  for (; it != end; ++it) {
+    const Invocation* subinvoke = *it;
+    if (subinvoke == nullptr || !_is_parallel_recordable(*subinvoke)) { break; }
+    SubmitType submit_ty = subinvoke->submit_ty;
+    if (transact.is_async) {
+      submit_ty = _resolve_submit_ty(transact, submit_ty);
+    }
+    // Untagged subinvocations follow the others, except to the async compute
+    // queue.
+    if (submit_ty == L_SUBMIT_TYPE_ANY) {
+      if (has_async) { break; }
+      has_untagged = true;
+      continue;
+    }
+    if (submit_ty == L_SUBMIT_TYPE_ASYNC_COMPUTE && !transact.is_async) {
+      if (has_untagged) { break; }
+      has_async = true;
+    }
+
+    VkQueue queue2 = submit_details.at(submit_ty).queue;
+    if (queue == VK_NULL_HANDLE) {
+      queue = queue2;
+    } else if (queue != queue2) {
+      break;
+    }
+  }
+  return it;
+}
+// Number of profiler scopes of an invocation tree. Baked invocations are
+// executed as they were recorded and presentation is submitted on its own, so
+// neither is timed.
+uint32_t _count_profiler_scopes(const Invocation& invoke) {
+  if (invoke.bake_detail || invoke.present_detail) { return 0; }
+
+  const std::vector<const Invocation*>* subinvokes = nullptr;
+  if (invoke.composite_detail) {
+    subinvokes = &invoke.composite_detail->subinvokes;
+  } else if (invoke.pass_detail) {
+    subinvokes = &invoke.pass_detail->subinvokes;
+  }
+  uint32_t out = 1;
+  if (subinvokes != nullptr) {
+    for (const Invocation* subinvoke : *subinvokes) {
+      out += _count_profiler_scopes(*subinvoke);
+    }
+  }
+  return out;
+}
+// Record subinvocations into secondary command buffers on the context's
+// recording threads and execute them in order in the current primary command
+// buffer. `pass_cbii` is given if the subinvocations are recorded in a render
+// pass, whose resources have been transitioned with the render pass.
+void _record_subinvokes_parallel(
+  TransactionLike& transact,
+  SubinvocationIterator beg,
+  SubinvocationIterator end,
+  const VkCommandBufferInheritanceInfo* pass_cbii
+) {
+  Context& ctxt = const_cast<Context&>(*transact.ctxt);
+  const size_t nsubinvoke = end - beg;
+
+  // Ownership transfers are recorded on other queues so they go before the
+  // primary command buffer of the subinvocations is taken. Releases of all the
+  // subinvocations are batched in one barrier per queue.
+  std::vector<const Invocation*> subinvokes(beg, end);
+  SubmitType submit_ty =
+    _redirect_untagged_submit_ty(transact, _infer_submit_ty(subinvokes));
+  if (pass_cbii == nullptr) {
+    InvocationTransitionDetail transit_detail {};
+    _merge_subinvoke_transits(subinvokes, transit_detail);
+    _release_rscs(transact, submit_ty, transit_detail);
+  }
+  VkCommandBuffer cmdbuf = _get_cmdbuf(transact, submit_ty);
+  submit_ty = transact.submit_details.back().submit_ty;
+
+  // Context state is not thread-safe so every secondary command buffer is
+  // allocated here, each with a command pool of its own. Baked subinvocations
+  // are executed directly.
+  std::vector<TransactionLike> subtransacts;
+  std::vector<const Invocation*> recorded_subinvokes;
+  subtransacts.reserve(nsubinvoke);
+  recorded_subinvokes.reserve(nsubinvoke);
+  for (size_t i = 0; i < nsubinvoke; ++i) {
+    if (beg[i]->bake_detail) { continue; }
+
+    TransactionLike subtransact(ctxt, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    subtransact.is_transit_external = true;
+    subtransact.is_async = transact.is_async;
+    subtransact.is_baking = transact.is_baking;
+    // Scopes have been reserved by the outermost invocation. Each recording
+    // thread takes those of its own subinvocation.
+    if (transact.profiler != nullptr) {
+      uint32_t nscope = _count_profiler_scopes(*beg[i]);
+      subtransact.profiler = transact.profiler;
+      subtransact.profile_iscope = transact.profile_iscope;
+      subtransact.profile_iscope_end = transact.profile_iscope + nscope;
+      subtransact.profile_iparent = transact.profile_iparent;
+      transact.profile_iscope += nscope;
+    }
+    _push_transact_submit_detail(ctxt, subtransact.submit_details, submit_ty,
+      VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    _begin_cmdbuf(subtransact.submit_details.back(), pass_cbii,
+      transact.is_baking);
+
+    subtransacts.emplace_back(std::move(subtransact));
+    recorded_subinvokes.emplace_back(beg[i]);
+  }
+
+  util::Timer timer {};
+  timer.tic();
+  ctxt.get_record_thread_pool().parallel_for(subtransacts.size(),
+    [&](size_t i) {
+      TransactionLike& subtransact = subtransacts[i];
+      _record_invoke_impl(subtransact, *recorded_subinvokes[i]);
+      L_ASSERT(subtransact.submit_details.size() == 1, "subinvocation '",
+        recorded_subinvokes[i]->label, "' switched queues while recorded in "
+        "parallel");
+      _end_cmdbuf(subtransact.submit_details.back());
+    });
+  timer.toc();
+  for (const TransactionLike& subtransact : subtransacts) {
+    transact.npipe_bind += subtransact.npipe_bind;
+    transact.upload_size += subtransact.upload_size;
+    transact.submit_details.back().transfer_size +=
+      subtransact.submit_details.back().transfer_size;
+  }
+
+  size_t isubtransact = 0;
+  for (size_t i = 0; i < nsubinvoke; ++i) {
+    const Invocation& subinvoke = *beg[i];
+    VkCommandBuffer subcmdbuf;
+    if (subinvoke.bake_detail) {
+      subcmdbuf = subinvoke.bake_detail->cmdbuf->cmdbuf;
+    } else {
+      TransactionSubmitDetail& submit_detail =
+        subtransacts[isubtransact++].submit_details.back();
+      subcmdbuf = submit_detail.cmdbuf->cmdbuf;
+      transact.secondary_cmd_pools.emplace_back(
+        std::move(submit_detail.cmd_pool));
+    }
+
+    // Barriers are not allowed in render passes without self-dependencies.
+    if (pass_cbii == nullptr) {
+      _transit_rscs(transact, subinvoke.transit_detail);
+    }
+    vkCmdExecuteCommands(cmdbuf, 1, &subcmdbuf);
+  }
+
+  L_DEBUG("recorded ", subtransacts.size(), " subinvocations in parallel in ",
+    timer.us(), "us");
+}
+
+// Draw with parameters in a buffer of tightly packed draw commands. The draw
+// count is taken from the count buffer if there is one.
+void _draw_indirect(
+  const Context& ctxt,
+  VkCommandBuffer cmdbuf,
+  const InvocationGraphicsDetail& graph_detail,
+  bool is_idxed
+) {
+  const auto& count_detail = ctxt.draw_indirect_count_detail;
+  VkBuffer indirect_buf = graph_detail.indirect_buf->buf;
+  VkDeviceSize offset = graph_detail.indirect_buf_offset;
+  uint32_t stride = is_idxed ?
+    sizeof(VkDrawIndexedIndirectCommand) : sizeof(VkDrawIndirectCommand);
+
+  if (graph_detail.count_buf != nullptr) {
+    VkBuffer count_buf = graph_detail.count_buf->buf;
+    VkDeviceSize count_offset = graph_detail.count_buf_offset;
+    if (is_idxed) {
+      count_detail.draw_idxed_indirect_count(cmdbuf, indirect_buf, offset,
+        count_buf, count_offset, graph_detail.ndraw, stride);
+    } else {
+      count_detail.draw_indirect_count(cmdbuf, indirect_buf, offset,
+        count_buf, count_offset, graph_detail.ndraw, stride);
+    }
+  } else if (is_idxed) {
+    vkCmdDrawIndexedIndirect(cmdbuf, indirect_buf, offset, graph_detail.ndraw,
+      stride);
+  } else {
+    vkCmdDrawIndirect(cmdbuf, indirect_buf, offset, graph_detail.ndraw,
+      stride);
+  }
+}
+
+// Write the begin timestamp of the profiler scope of `invoke` and make it the
+// parent of the scopes recorded after. Returns `NO_PROFILER_SCOPE` if the
+// invocation is not timed.
+uint32_t _begin_profiler_scope(
+  TransactionLike& transact,
+  const Invocation& invoke,
+  VkCommandBuffer cmdbuf
+) {
+  Profiler* profiler = transact.profiler;
+  if (profiler == nullptr) { return NO_PROFILER_SCOPE; }
+
+  const Context& ctxt = *transact.ctxt;
+  SubmitType submit_ty = transact.submit_details.back().submit_ty;
+  uint32_t qfam_idx = ctxt.submit_details.at(submit_ty).qfam_idx;
+  const VkQueueFamilyProperties& qfam_prop =
+    get_inst().physdev_details.at(ctxt.iphysdev).qfam_props.at(qfam_idx);
+
+  // Queries cannot be reset in render passes, so the outermost invocation
+  // resets the queries of the entire tree at once. Resets are only allowed on
+  // graphics and compute queues.
+  if (transact.profile_iscope == transact.profile_iscope_end) {
+    bool can_reset =
+      (qfam_prop.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+    uint32_t nscope = _count_profiler_scopes(invoke);
+    uint32_t iscope = can_reset ?
+      profiler->reserve_scopes(cmdbuf, nscope) : NO_PROFILER_SCOPE;
+    if (iscope == NO_PROFILER_SCOPE) {
+      transact.profiler = nullptr;
+      return NO_PROFILER_SCOPE;
+    }
+    transact.profile_iscope = iscope;
+    transact.profile_iscope_end = iscope + nscope;
+  }
+  uint32_t iscope = transact.profile_iscope++;
+
+  // Some queues, usually transfer-only ones, cannot write timestamps. The
+  // queries of the scope are left unavailable.
+  if (qfam_prop.timestampValidBits == 0) { return NO_PROFILER_SCOPE; }
+
+  profiler->begin_scope(cmdbuf, iscope, transact.profile_iparent, invoke.label);
+  transact.profile_iparent = iscope;
+  return iscope;
+}
+
+// Begin the counter queries of a compute or graphics invocation. Returns
+// `true` if the performance query is begun. Queries cannot be reset in render
+// passes, so pipeline statistics of graphics invocations are reset by their
+// render pass invocations.
+bool _begin_counter_queries(
+  TransactionLike& transact,
+  const Invocation& invoke,
+  VkCommandBuffer cmdbuf
+) {
+  if (invoke.pipe_stats_detail) {
+    VkQueryPool query_pool = *invoke.pipe_stats_detail->query_pool;
+    if (invoke.comp_detail) {
+      vkCmdResetQueryPool(cmdbuf, query_pool, 0, 1);
+    }
+    vkCmdBeginQuery(cmdbuf, query_pool, 0, 0);
+  }
+
+  // Performance queries are reset on the host before submission, and are only
+  // recorded in primary command buffers.
+  if (
+    invoke.perf_query_detail == nullptr ||
+    transact.level != VK_COMMAND_BUFFER_LEVEL_PRIMARY
+  ) {
+    return false;
+  }
+  if (
+    transact.is_perf_query_used &&
+    !transact.ctxt->perf_query_detail.is_multi_pool_supported
+  ) {
+    L_WARN("performance counters of invocation '", invoke.label, "' are not "
+      "collected because the device cannot collect performance counters of "
+      "multiple invocations in a transaction");
+    return false;
+  }
+  // Performance query pools are created for a queue family.
+  if (invoke.perf_query_detail->qfam_idx != _get_cur_qfam_idx(transact)) {
+    L_WARN("performance counters of invocation '", invoke.label, "' are not "
+      "collected because it's recorded on another queue family than the "
+      "counters are queried for");
+    return false;
+  }
+  vkCmdBeginQuery(cmdbuf, *invoke.perf_query_detail->query_pool, 0, 0);
+  transact.is_perf_query_used = true;
+  return true;
+}
+void _end_counter_queries(
+  const Invocation& invoke,
+  VkCommandBuffer cmdbuf,
+  bool is_perf_query_begun
+) {
+  if (is_perf_query_begun) {
+    vkCmdEndQuery(cmdbuf, *invoke.perf_query_detail->query_pool, 0);
+  }
+  if (invoke.pipe_stats_detail) {
+    vkCmdEndQuery(cmdbuf, *invoke.pipe_stats_detail->query_pool, 0);
+  }
+}
+
+std::vector<FencePoolItem> _record_invoke_impl(
   TransactionLike& transact,
   const Invocation& invoke
 ) {
@@ -1017,12 +2457,14 @@ std::vector<sys::FenceRef> _record_invoke_impl(
     const Image& img = swapchain.dyn_detail->imgs[img_idx];
     ImageView img_view = img.view(0, 0, 0, img.img_cfg.width,
       img.img_cfg.height, img.img_cfg.depth, L_IMAGE_SAMPLER_NEAREST);
-    _transit_rsc(transact, img_view, L_IMAGE_USAGE_PRESENT_BIT);
+    BarrierBatch batch {};
+    _transit_rsc(transact, batch, img_view, L_IMAGE_USAGE_PRESENT_BIT);
+    _flush_barriers(transact, batch);
 
 
     // Present the rendered image.
-    sys::FenceRef present_fence = sys::Fence::create(ctxt.dev->dev);
-    sys::FenceRef acquire_fence = sys::Fence::create(ctxt.dev->dev);
+    FencePoolItem acquire_fence =
+      const_cast<Context&>(ctxt).acquire_fence(L_SUBMIT_TYPE_PRESENT);
 
     VkResult present_res = VK_SUCCESS;
     VkPresentInfoKHR pi {};
@@ -1036,10 +2478,19 @@ std::vector<sys::FenceRef> _record_invoke_impl(
       L_ASSERT(!last_submit.is_submitted);
 
       _end_cmdbuf(last_submit);
-      _submit_cmdbuf(transact, present_fence);
+      _submit_cmdbuf(transact,
+        const_cast<Context&>(ctxt).acquire_sema(L_SUBMIT_TYPE_PRESENT));
 
       pi.waitSemaphoreCount = 1;
-      pi.pWaitSemaphores = &transact.submit_details.back().signal_sema->sema;
+      pi.pWaitSemaphores =
+        &transact.submit_details.back().present_sema.value().sema->sema;
+
+      // The presentation engine waits for the semaphore until the image is
+      // acquired again.
+      SwapchainDynamicDetail& dyn_detail = *swapchain.dyn_detail;
+      dyn_detail.present_semas.resize(dyn_detail.imgs.size());
+      dyn_detail.present_semas.at(img_idx) =
+        transact.submit_details.back().present_sema;
     }
 
     VkQueue queue = ctxt.submit_details.at(L_SUBMIT_TYPE_PRESENT).queue;
@@ -1051,24 +2502,50 @@ std::vector<sys::FenceRef> _record_invoke_impl(
     }
     VK_ASSERT << res;
 
+    // Block until the index of the next image is known. The image might
+    // still be in use by the presentation engine until the fence is signaled.
     img_idx = ~0u;
-    res = VK_NOT_READY;
-    do {
-      res = vkAcquireNextImageKHR(ctxt.dev->dev, *swapchain.swapchain,
-        SPIN_INTERVAL, VK_NULL_HANDLE, acquire_fence->fence, &img_idx);
-      if (res == VK_NOT_READY) {
-        L_DEBUG("failed to acquire image immediately");
-      }
-    } while (res == VK_TIMEOUT);
+    res = vkAcquireNextImageKHR(ctxt.dev->dev, *swapchain.swapchain,
+      UINT64_MAX, VK_NULL_HANDLE, acquire_fence.value()->fence, &img_idx);
     VK_ASSERT << res;
 
+    // The last presentation of the acquired image is done with its semaphore
+    // once the image is acquired.
+    if (swapchain.dyn_detail != nullptr) {
+      auto& present_semas = swapchain.dyn_detail->present_semas;
+      if (img_idx < present_semas.size() && present_semas[img_idx].is_valid()) {
+        present_semas[img_idx].value().fence = acquire_fence;
+        present_semas[img_idx].release();
+      }
+    }
+
     transact.is_frozen = true;
 
     L_DEBUG("applied presentation invocation (image #", img_idx, ")");
-    return { present_fence, acquire_fence };
+    return { acquire_fence };
   }
 
-  VkCommandBuffer cmdbuf = _get_cmdbuf(transact, invoke.submit_ty);
+  SubmitType submit_ty =
+    _redirect_untagged_submit_ty(transact, invoke.submit_ty);
+
+  // Subinvocations of composite invocations might be recorded on different
+  // queues, so they release their own resources right before they are
+  // recorded.
+  if (!invoke.bake_detail) {
+    if (invoke.composite_detail) {
+      _discard_rscs(*invoke.composite_detail);
+    } else {
+      _release_rscs(transact, submit_ty, invoke.transit_detail);
+    }
+  }
+  VkCommandBuffer cmdbuf = _get_cmdbuf(transact, submit_ty);
+
+  // Subinvocations of composite invocations count their own transfers, unless
+  // they have been baked together.
+  if (invoke.bake_detail || !invoke.composite_detail) {
+    transact.submit_details.back().transfer_size += invoke.transfer_size;
+    transact.upload_size += invoke.upload_size;
+  }
 
   // If the invocation has been baked, simply inline the baked secondary command
   // buffer.
@@ -1084,44 +2561,98 @@ std::vector<sys::FenceRef> _record_invoke_impl(
 
     L_DEBUG("invocation '", invoke.label, "' will be timed");
   }
-
-  _transit_rscs(transact, invoke.transit_detail);
+  uint32_t profile_iparent = transact.profile_iparent;
+  uint32_t profile_iscope = _begin_profiler_scope(transact, invoke, cmdbuf);
+
+  // Subinvocations of composite invocations transition their own resources
+  // right before they are recorded, so that resources sharing memory are never
+  // transitioned at the same time.
+  if (!transact.is_transit_external && !invoke.composite_detail) {
+    _transit_rscs(transact, invoke.transit_detail);
+  }
 
   if (invoke.b2b_detail) {
     const InvocationCopyBufferToBufferDetail& b2b_detail =
       *invoke.b2b_detail;
-    vkCmdCopyBuffer(cmdbuf, b2b_detail.src->buf, b2b_detail.dst->buf, 1, &b2b_detail.bc);
+    vkCmdCopyBuffer(cmdbuf, b2b_detail.src->buf, b2b_detail.dst->buf,
+      (uint32_t)b2b_detail.bcs.size(), b2b_detail.bcs.data());
     L_DEBUG("applied transfer invocation '", invoke.label, "'");
 
   } else if (invoke.b2i_detail) {
     const InvocationCopyBufferToImageDetail& b2i_detail = *invoke.b2i_detail;
     vkCmdCopyBufferToImage(cmdbuf, b2i_detail.src->buf, b2i_detail.dst->img,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &b2i_detail.bic);
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)b2i_detail.bics.size(),
+      b2i_detail.bics.data());
     L_DEBUG("applied transfer invocation '", invoke.label, "'");
 
   } else if (invoke.i2b_detail) {
     const InvocationCopyImageToBufferDetail& i2b_detail = *invoke.i2b_detail;
     vkCmdCopyImageToBuffer(cmdbuf, i2b_detail.src->img,
-      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, i2b_detail.dst->buf, 1, &i2b_detail.bic);
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, i2b_detail.dst->buf,
+      (uint32_t)i2b_detail.bics.size(), i2b_detail.bics.data());
     L_DEBUG("applied transfer invocation '", invoke.label, "'");
 
   } else if (invoke.i2i_detail) {
     const InvocationCopyImageToImageDetail& i2i_detail = *invoke.i2i_detail;
     vkCmdCopyImage(cmdbuf, i2i_detail.src->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      i2i_detail.dst->img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &i2i_detail.ic);
+      i2i_detail.dst->img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      (uint32_t)i2i_detail.ics.size(), i2i_detail.ics.data());
+    L_DEBUG("applied transfer invocation '", invoke.label, "'");
+
+  } else if (invoke.blit_detail) {
+    const InvocationBlitImageDetail& blit_detail = *invoke.blit_detail;
+    vkCmdBlitImage(cmdbuf, blit_detail.src->img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      blit_detail.dst->img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      (uint32_t)blit_detail.ibs.size(), blit_detail.ibs.data(),
+      blit_detail.filter);
     L_DEBUG("applied transfer invocation '", invoke.label, "'");
 
+  } else if (invoke.fill_detail) {
+    const InvocationFillBufferDetail& fill_detail = *invoke.fill_detail;
+    vkCmdFillBuffer(cmdbuf, fill_detail.dst->buf, fill_detail.offset,
+      fill_detail.size, fill_detail.value);
+    L_DEBUG("applied fill invocation '", invoke.label, "'");
+
+  } else if (invoke.update_detail) {
+    const InvocationUpdateBufferDetail& update_detail = *invoke.update_detail;
+    vkCmdUpdateBuffer(cmdbuf, update_detail.dst->buf, update_detail.offset,
+      update_detail.data.size(), update_detail.data.data());
+    L_DEBUG("applied update invocation '", invoke.label, "'");
+
+  } else if (invoke.upload_detail) {
+    const InvocationUploadDetail& upload_detail = *invoke.upload_detail;
+    for (const auto& buf_upload : upload_detail.buf_uploads) {
+      vkCmdCopyBuffer(cmdbuf, buf_upload.src->buf, buf_upload.dst->buf,
+        (uint32_t)buf_upload.bcs.size(), buf_upload.bcs.data());
+    }
+    for (const auto& img_upload : upload_detail.img_uploads) {
+      vkCmdCopyBufferToImage(cmdbuf, img_upload.src->buf, img_upload.dst->img,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)img_upload.bics.size(),
+        img_upload.bics.data());
+    }
+    L_DEBUG("applied upload invocation '", invoke.label, "'");
+
   } else if (invoke.comp_detail) {
     const InvocationComputeDetail& comp_detail = *invoke.comp_detail;
     const Task& task = *comp_detail.task;
     const DispatchSize& workgrp_count = comp_detail.workgrp_count;
 
     vkCmdBindPipeline(cmdbuf, comp_detail.bind_pt, task.pipe->pipe);
+    transact.npipe_bind += 1;
     if (comp_detail.desc_set.value()->desc_set != VK_NULL_HANDLE) {
       vkCmdBindDescriptorSets(cmdbuf, comp_detail.bind_pt,
         task.rsc_detail.pipe_layout->pipe_layout, 0, 1, &comp_detail.desc_set.value()->desc_set, 0, nullptr);
     }
-    vkCmdDispatch(cmdbuf, workgrp_count.x, workgrp_count.y, workgrp_count.z);
+    _bind_bindless_desc_set(cmdbuf, comp_detail.bind_pt, task);
+    _push_consts(cmdbuf, task, comp_detail.push_consts);
+    bool is_perf_query_begun = _begin_counter_queries(transact, invoke, cmdbuf);
+    if (comp_detail.indirect_buf != nullptr) {
+      vkCmdDispatchIndirect(cmdbuf, comp_detail.indirect_buf->buf,
+        comp_detail.indirect_buf_offset);
+    } else {
+      vkCmdDispatch(cmdbuf, workgrp_count.x, workgrp_count.y, workgrp_count.z);
+    }
+    _end_counter_queries(invoke, cmdbuf, is_perf_query_begun);
     L_DEBUG("applied compute invocation '", invoke.label, "'");
 
   } else if (invoke.graph_detail) {
@@ -1134,14 +2665,20 @@ std::vector<sys::FenceRef> _record_invoke_impl(
     }
 
     vkCmdBindPipeline(cmdbuf, graph_detail.bind_pt, task.pipe->pipe);
+    transact.npipe_bind += 1;
     if (graph_detail.desc_set.value()->desc_set != VK_NULL_HANDLE) {
       vkCmdBindDescriptorSets(cmdbuf, graph_detail.bind_pt,
         task.rsc_detail.pipe_layout->pipe_layout, 0, 1, &graph_detail.desc_set.value()->desc_set, 0, nullptr);
     }
+    _bind_bindless_desc_set(cmdbuf, graph_detail.bind_pt, task);
+    _push_consts(cmdbuf, task, graph_detail.push_consts);
     // TODO: (penguinliong) Vertex, index buffer transition.
     vkCmdBindVertexBuffers(cmdbuf, 0, (uint32_t)vert_bufs.size(),
       vert_bufs.data(), graph_detail.vert_buf_offsets.data());
-    if (invoke.graph_detail->nidx != 0) {
+    bool is_indirect = graph_detail.indirect_buf != nullptr;
+    bool is_idxed = is_indirect ?
+      graph_detail.idx_buf != nullptr : graph_detail.nidx != 0;
+    if (is_idxed) {
       VkIndexType idx_ty {};
       switch (invoke.graph_detail->idx_ty) {
       case L_INDEX_TYPE_UINT16: idx_ty = VK_INDEX_TYPE_UINT16; break;
@@ -1150,11 +2687,17 @@ std::vector<sys::FenceRef> _record_invoke_impl(
       }
       vkCmdBindIndexBuffer(cmdbuf, graph_detail.idx_buf->buf,
         graph_detail.idx_buf_offset, idx_ty);
+    }
+    bool is_perf_query_begun = _begin_counter_queries(transact, invoke, cmdbuf);
+    if (is_indirect) {
+      _draw_indirect(*transact.ctxt, cmdbuf, graph_detail, is_idxed);
+    } else if (is_idxed) {
       vkCmdDrawIndexed(cmdbuf, graph_detail.nidx, graph_detail.ninst,
         0, 0, 0);
     } else {
       vkCmdDraw(cmdbuf, graph_detail.nvert, graph_detail.ninst, 0, 0);
     }
+    _end_counter_queries(invoke, cmdbuf, is_perf_query_begun);
     L_DEBUG("applied graphics invocation '", invoke.label, "'");
 
   } else if (invoke.pass_detail) {
@@ -1162,9 +2705,12 @@ std::vector<sys::FenceRef> _record_invoke_impl(
     const RenderPass& pass = *pass_detail.pass;
     const std::vector<const Invocation*>& subinvokes = pass_detail.subinvokes;
 
-    VkSubpassContents sc = subinvokes.size() > 0 && subinvokes[0]->bake_detail ?
-      VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS :
-      VK_SUBPASS_CONTENTS_INLINE;
+    bool is_parallel = _can_record_in_parallel(transact, subinvokes.begin(),
+      subinvokes.end());
+    VkSubpassContents sc =
+      is_parallel || (subinvokes.size() > 0 && subinvokes[0]->bake_detail) ?
+        VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS :
+        VK_SUBPASS_CONTENTS_INLINE;
 
     VkRenderPassBeginInfo rpbi {};
     rpbi.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1180,10 +2726,32 @@ std::vector<sys::FenceRef> _record_invoke_impl(
       img_views.at(i) = pass_detail.attms.at(i)->img_view;
     }
 
+    for (const Invocation* subinvoke : subinvokes) {
+      if (subinvoke->pipe_stats_detail) {
+        vkCmdResetQueryPool(cmdbuf,
+          *subinvoke->pipe_stats_detail->query_pool, 0, 1);
+      }
+    }
+
     vkCmdBeginRenderPass(cmdbuf, &rpbi, sc);
     L_DEBUG("render pass invocation '", invoke.label, "' began");
 
-    for (size_t i = 0; i < pass_detail.subinvokes.size(); ++i) {
+    if (is_parallel) {
+      // Subinvocation resources have been transitioned with the render pass.
+      VkCommandBufferInheritanceInfo cbii {};
+      cbii.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      cbii.renderPass = rpbi.renderPass;
+      cbii.subpass = 0;
+      cbii.framebuffer = rpbi.framebuffer;
+      _record_subinvokes_parallel(transact, subinvokes.begin(),
+        subinvokes.end(), &cbii);
+    }
+    // Barriers are not allowed in render passes without self-dependencies, so
+    // subinvocation resources have been transitioned with the render pass
+    // before it began.
+    bool is_transit_external = transact.is_transit_external;
+    transact.is_transit_external = true;
+    for (size_t i = 0; !is_parallel && i < pass_detail.subinvokes.size(); ++i) {
       //if (i > 0) {
       //  sc = subinvokes[i]->bake_detail ?
       //    VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS :
@@ -1195,9 +2763,13 @@ std::vector<sys::FenceRef> _record_invoke_impl(
 
       const Invocation* subinvoke = pass_detail.subinvokes[i];
       L_ASSERT(subinvoke != nullptr, "null subinvocation is not allowed");
-      std::vector<sys::FenceRef> fences = _record_invoke_impl(transact, *subinvoke);
-      if (!fences.empty()) { return fences; }
+      std::vector<FencePoolItem> fences = _record_invoke_impl(transact, *subinvoke);
+      if (!fences.empty()) {
+        transact.is_transit_external = is_transit_external;
+        return fences;
+      }
     }
+    transact.is_transit_external = is_transit_external;
     vkCmdEndRenderPass(cmdbuf);
     L_DEBUG("render pass invocation '", invoke.label, "' ended");
 
@@ -1207,12 +2779,26 @@ std::vector<sys::FenceRef> _record_invoke_impl(
 
     L_DEBUG("composite invocation '", invoke.label, "' began");
 
-    for (size_t i = 0; i < composite_detail.subinvokes.size(); ++i) {
-      const Invocation* subinvoke = composite_detail.subinvokes[i];
+    bool is_async = transact.is_async;
+    transact.is_async = is_async || composite_detail.is_async;
+
+    const std::vector<const Invocation*>& subinvokes =
+      composite_detail.subinvokes;
+    for (auto it = subinvokes.begin(); it != subinvokes.end();) {
+      // Record consecutive independent subinvocations in parallel.
+      auto end = _find_parallel_subinvokes_end(transact, it, subinvokes.end());
+      if (_can_record_in_parallel(transact, it, end)) {
+        _record_subinvokes_parallel(transact, it, end, nullptr);
+        it = end;
+        continue;
+      }
+
+      const Invocation* subinvoke = *it++;
       L_ASSERT(subinvoke != nullptr, "null subinvocation is not allowed");
-      std::vector<sys::FenceRef> fences = _record_invoke_impl(transact, *subinvoke);
+      std::vector<FencePoolItem> fences = _record_invoke_impl(transact, *subinvoke);
       if (!fences.empty()) { return fences; }
     }
+    transact.is_async = is_async;
 
     L_DEBUG("composite invocation '", invoke.label, "' ended");
 
@@ -1229,24 +2815,275 @@ std::vector<sys::FenceRef> _record_invoke_impl(
     vkCmdWriteTimestamp(cmdbuf2, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
       *invoke.query_pool.value(), 1);
   }
+  if (profile_iscope != NO_PROFILER_SCOPE) {
+    VkCommandBuffer cmdbuf2 = _get_cmdbuf(transact, L_SUBMIT_TYPE_ANY);
+    transact.profiler->end_scope(cmdbuf2, profile_iscope);
+    transact.profile_iparent = profile_iparent;
+  }
 
   L_DEBUG("scheduled invocation '", invoke.label, "' for execution");
 
   return {};
 }
+// Merge subinvocation transitions again and bake again the invocations whose
+// subinvocations have been rebound since they were last recorded. Returns the
+// sum of generations of the invocation and its subinvocations.
+uint64_t _sync_invoke(const Invocation& invoke) {
+  const std::vector<const Invocation*>* subinvokes = nullptr;
+  if (invoke.composite_detail) {
+    subinvokes = &invoke.composite_detail->subinvokes;
+  } else if (invoke.pass_detail) {
+    subinvokes = &invoke.pass_detail->subinvokes;
+  }
+
+  uint64_t gen = invoke.gen;
+  if (subinvokes != nullptr) {
+    for (const Invocation* subinvoke : *subinvokes) {
+      L_ASSERT(subinvoke != nullptr, "null subinvocation is not allowed");
+      gen += _sync_invoke(*subinvoke);
+    }
+  }
+  if (gen == invoke.synced_gen) { return gen; }
+
+  Invocation& invoke2 = const_cast<Invocation&>(invoke);
+  if (invoke.composite_detail) {
+    InvocationTransitionDetail transit_detail {};
+    _merge_subinvoke_transits(*subinvokes, transit_detail);
+    invoke2.transit_detail = std::move(transit_detail);
+  } else if (invoke.pass_detail) {
+    InvocationTransitionDetail transit_detail =
+      invoke.pass_detail->attm_transit_detail;
+    _merge_subinvoke_transits(*subinvokes, transit_detail);
+    invoke2.transit_detail = std::move(transit_detail);
+  }
+  invoke2.synced_gen = gen;
+
+  if (invoke.bake_detail) {
+    _drop_bake_detail(invoke2);
+    invoke2.bake();
+    L_DEBUG("rebaked invocation '", invoke.label, "' after rebinding");
+  }
+  if (invoke.primary_bake_detail) {
+    invoke2.bake_primary();
+    L_DEBUG("rebaked invocation '", invoke.label, "' after rebinding");
+  }
+  return gen;
+}
+
+void _snapshot_rsc_states(
+  const InvocationTransitionDetail& transit_detail,
+  InvocationResourceStateDetail& out
+) {
+  out = InvocationResourceStateDetail {};
+  for (const auto& pair : transit_detail.buf_transit) {
+    const Buffer& buf = *pair.first.buf;
+    InvocationBufferState state {};
+    state.buf = &buf;
+    state.handle = buf.buf->buf;
+    state.dyn_detail = buf.dyn_detail;
+    out.buf_states.emplace_back(std::move(state));
+  }
+  for (const auto& pair : transit_detail.img_transit) {
+    const Image& img = *pair.first.img;
+    InvocationImageState state {};
+    state.img = &img;
+    state.handle = img.img_view->img_view;
+    state.dyn_detail = img.dyn_detail;
+    out.img_states.emplace_back(std::move(state));
+  }
+  for (const auto& pair : transit_detail.depth_img_transit) {
+    const DepthImage& depth_img = *pair.first.depth_img;
+    InvocationDepthImageState state {};
+    state.depth_img = &depth_img;
+    state.handle = depth_img.img_view->img_view;
+    state.dyn_detail = depth_img.dyn_detail;
+    out.depth_img_states.emplace_back(std::move(state));
+  }
+}
+// Whether the resources are still in the snapshot states. Relocated or
+// recreated resources, and thus framebuffers made of them, have different
+// handles.
+bool _is_rsc_states_matched(const InvocationResourceStateDetail& states) {
+  for (const auto& state : states.buf_states) {
+    const Buffer& buf = *state.buf;
+    const BufferDynamicDetail& dyn_detail = buf.dyn_detail;
+    if (
+      buf.buf->buf != state.handle ||
+      dyn_detail.stage != state.dyn_detail.stage ||
+      dyn_detail.access != state.dyn_detail.access ||
+      dyn_detail.qfam_idx != state.dyn_detail.qfam_idx
+    ) {
+      return false;
+    }
+  }
+  for (const auto& state : states.img_states) {
+    const Image& img = *state.img;
+    const ImageDynamicDetail& dyn_detail = img.dyn_detail;
+    if (
+      img.img_view->img_view != state.handle ||
+      dyn_detail.stage != state.dyn_detail.stage ||
+      dyn_detail.access != state.dyn_detail.access ||
+      dyn_detail.layout != state.dyn_detail.layout ||
+      dyn_detail.qfam_idx != state.dyn_detail.qfam_idx
+    ) {
+      return false;
+    }
+  }
+  for (const auto& state : states.depth_img_states) {
+    const DepthImage& depth_img = *state.depth_img;
+    const DepthImageDynamicDetail& dyn_detail = depth_img.dyn_detail;
+    if (
+      depth_img.img_view->img_view != state.handle ||
+      dyn_detail.stage != state.dyn_detail.stage ||
+      dyn_detail.access != state.dyn_detail.access ||
+      dyn_detail.layout != state.dyn_detail.layout ||
+      dyn_detail.qfam_idx != state.dyn_detail.qfam_idx
+    ) {
+      return false;
+    }
+  }
+  return true;
+}
+void _restore_rsc_states(const InvocationResourceStateDetail& states) {
+  for (const auto& state : states.buf_states) {
+    ((Buffer*)state.buf)->dyn_detail = state.dyn_detail;
+  }
+  for (const auto& state : states.img_states) {
+    ((Image*)state.img)->dyn_detail = state.dyn_detail;
+  }
+  for (const auto& state : states.depth_img_states) {
+    ((DepthImage*)state.depth_img)->dyn_detail = state.dyn_detail;
+  }
+}
+// Submit baked primary command buffers as they are, after baking them again if
+// the resources have changed since they were baked.
+void _submit_primary_baked_invoke(
+  TransactionLike& transact,
+  const Invocation& invoke
+) {
+  L_ASSERT(transact.submit_details.empty(), "primary baked invocation '",
+    invoke.label, "' must be submitted alone");
+  if (!_is_rsc_states_matched(invoke.primary_bake_detail->init_states)) {
+    const_cast<Invocation&>(invoke).bake_primary();
+    L_DEBUG("rebaked invocation '", invoke.label, "' for changed resource "
+      "states");
+  }
+
+  const InvocationPrimaryBakingDetail& primary_bake_detail =
+    *invoke.primary_bake_detail;
+  for (const auto& baked_submit_detail : primary_bake_detail.submit_details) {
+    TransactionSubmitDetail submit_detail = baked_submit_detail;
+    submit_detail.is_submitted = false;
+    transact.submit_details.emplace_back(std::move(submit_detail));
+    _submit_cmdbuf(transact, {});
+  }
+  _restore_rsc_states(primary_bake_detail.final_states);
+  const_cast<Context&>(*transact.ctxt).rsc_stats.upload_size +=
+    invoke.upload_size;
+
+  L_DEBUG("submitted primary baked invocation '", invoke.label, "'");
+}
+// Reset the performance queries of an invocation tree on the host.
+void _reset_perf_queries(const Invocation& invoke) {
+  if (invoke.perf_query_detail) {
+    const Context& ctxt = *invoke.ctxt;
+    // Queries cannot be reset while the device might still be writing them.
+    const std::vector<uint64_t>& timeline_values =
+      invoke.perf_query_detail->timeline_values;
+    if (
+      !timeline_values.empty() &&
+      !ctxt.is_timeline_passed(timeline_values, false)
+    ) {
+      L_WARN("invocation '", invoke.label, "' is submitted again before its "
+        "performance counters are collected, waiting for the previous "
+        "submission");
+      ctxt.is_timeline_passed(timeline_values, true);
+    }
+    ctxt.perf_query_detail.reset_query_pool(*ctxt.dev,
+      *invoke.perf_query_detail->query_pool, 0, 1);
+  }
+
+  const std::vector<const Invocation*>* subinvokes = nullptr;
+  if (invoke.composite_detail) {
+    subinvokes = &invoke.composite_detail->subinvokes;
+  } else if (invoke.pass_detail) {
+    subinvokes = &invoke.pass_detail->subinvokes;
+  }
+  if (subinvokes != nullptr) {
+    for (const Invocation* subinvoke : *subinvokes) {
+      _reset_perf_queries(*subinvoke);
+    }
+  }
+}
+void _mark_perf_queries_submitted(
+  const Invocation& invoke,
+  const std::vector<uint64_t>& timeline_values
+) {
+  if (invoke.perf_query_detail) {
+    invoke.perf_query_detail->timeline_values = timeline_values;
+  }
+
+  const std::vector<const Invocation*>* subinvokes = nullptr;
+  if (invoke.composite_detail) {
+    subinvokes = &invoke.composite_detail->subinvokes;
+  } else if (invoke.pass_detail) {
+    subinvokes = &invoke.pass_detail->subinvokes;
+  }
+  if (subinvokes != nullptr) {
+    for (const Invocation* subinvoke : *subinvokes) {
+      _mark_perf_queries_submitted(*subinvoke, timeline_values);
+    }
+  }
+}
 void _record_invoke(
   TransactionLike& transact,
   const Invocation& invoke
 ) {
+  _sync_invoke(invoke);
+  if (
+    transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+    !transact.is_baking &&
+    invoke.ctxt->perf_query_detail.is_supported
+  ) {
+    _reset_perf_queries(invoke);
+  }
+  if (
+    invoke.primary_bake_detail &&
+    transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+    !transact.is_baking
+  ) {
+    _submit_primary_baked_invoke(transact, invoke);
+    return;
+  }
+
   transact.fences = _record_invoke_impl(transact, invoke);
-  if (transact.fences.empty()) {
+  Context& ctxt = const_cast<Context&>(*transact.ctxt);
+  ctxt.record_stats.npipe_bind += transact.npipe_bind;
+  // Uploads are counted when they are submitted.
+  if (
+    transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+    !transact.is_baking
+  ) {
+    ctxt.rsc_stats.upload_size += transact.upload_size;
+  }
+  // Presentation has submitted all the recorded commands.
+  if (!transact.is_frozen) {
     _end_cmdbuf(transact.submit_details.back());
-    if (transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY) {
-      sys::FenceRef fence = sys::Fence::create(transact.ctxt->dev->dev);
-      _submit_cmdbuf(transact, fence);
-      transact.fences.emplace_back(std::move(fence));
+    if (
+      transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+      !transact.is_baking
+    ) {
+      _submit_cmdbuf(transact, {});
     }
   }
+  if (
+    transact.level == VK_COMMAND_BUFFER_LEVEL_PRIMARY &&
+    !transact.is_baking &&
+    invoke.ctxt->perf_query_detail.is_supported
+  ) {
+    _mark_perf_queries_submitted(invoke,
+      transact.ctxt->get_timeline_values());
+  }
 }
 
 bool _can_bake_invoke(const Invocation& invoke) {
@@ -1267,32 +3104,228 @@ bool _can_bake_invoke(const Invocation& invoke) {
   return true;
 }
 
+bool _can_bake_primary_invoke(const Invocation& invoke) {
+  // Presentation acquires the next swapchain image on the host.
+  if (invoke.present_detail != nullptr) { return false; }
+
+  const std::vector<const Invocation*>* subinvokes = nullptr;
+  if (invoke.composite_detail) {
+    subinvokes = &invoke.composite_detail->subinvokes;
+  } else if (invoke.pass_detail) {
+    subinvokes = &invoke.pass_detail->subinvokes;
+  }
+  if (subinvokes != nullptr) {
+    for (const Invocation* subinvoke : *subinvokes) {
+      if (!_can_bake_primary_invoke(*subinvoke)) { return false; }
+    }
+  }
+  return true;
+}
+
+// Queries are reset on the host or in the recorded commands, either of which
+// races with baked commands still pending from a previous submission.
+bool _has_queries(const Invocation& invoke) {
+  if (
+    invoke.query_pool.is_valid() ||
+    invoke.pipe_stats_detail != nullptr ||
+    invoke.perf_query_detail != nullptr
+  ) {
+    return true;
+  }
+
+  const std::vector<const Invocation*>* subinvokes = nullptr;
+  if (invoke.composite_detail) {
+    subinvokes = &invoke.composite_detail->subinvokes;
+  } else if (invoke.pass_detail) {
+    subinvokes = &invoke.pass_detail->subinvokes;
+  }
+  if (subinvokes != nullptr) {
+    for (const Invocation* subinvoke : *subinvokes) {
+      if (_has_queries(*subinvoke)) { return true; }
+    }
+  }
+  return false;
+}
+
 void Invocation::record(TransactionLike& transact) const {
   _record_invoke(transact, *this);
 }
 
+// Get the begin and end timestamps of a timed invocation in ticks.
+void _get_timestamps(const Invocation& invoke, uint64_t (&t)[2]) {
+  VK_ASSERT << vkGetQueryPoolResults(invoke.ctxt->dev->dev,
+    *invoke.query_pool.value(), 0, 2, sizeof(uint64_t) * 2, &t,
+    sizeof(uint64_t),
+    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT); // Wait till ready.
+}
+// Total length of the union of intervals.
+uint64_t _measure_intervals(std::vector<std::pair<uint64_t, uint64_t>> intervals) {
+  std::sort(intervals.begin(), intervals.end());
+  uint64_t out = 0;
+  uint64_t end = 0;
+  for (const auto& interval : intervals) {
+    uint64_t beg = std::max(interval.first, end);
+    if (interval.second > beg) {
+      out += interval.second - beg;
+      end = interval.second;
+    }
+  }
+  return out;
+}
+
 double Invocation::get_time_us() const {
   if (!query_pool.is_valid()) { return 0.0; }
   uint64_t t[2];
+  _get_timestamps(*this, t);
+  double ns_per_tick = ctxt->physdev_prop().limits.timestampPeriod;
+  return (t[1] - t[0]) * ns_per_tick / 1000.0;
+}
+InvocationPipelineStatistics Invocation::get_pipe_stats() const {
+  InvocationPipelineStatistics out {};
+  if (pipe_stats_detail == nullptr) { return out; }
+
+  // Statistics in the order of `VkQueryPipelineStatisticFlagBits`.
+  uint64_t* dsts[] = {
+    &out.ninput_vert,
+    &out.ninput_prim,
+    &out.nvert_shader_invoke,
+    &out.ngeom_shader_invoke,
+    &out.ngeom_shader_prim,
+    &out.nclip_invoke,
+    &out.nclip_prim,
+    &out.nfrag_shader_invoke,
+    &out.ntess_ctrl_shader_patch,
+    &out.ntess_eval_shader_invoke,
+    &out.ncomp_shader_invoke,
+  };
+  constexpr uint32_t NSTAT = sizeof(dsts) / sizeof(dsts[0]);
+
+  uint64_t stats[NSTAT] {};
   VK_ASSERT << vkGetQueryPoolResults(ctxt->dev->dev,
-    *query_pool.value(), 0, 2, sizeof(uint64_t) * 2, &t,
-    sizeof(uint64_t),
+    *pipe_stats_detail->query_pool, 0, 1, sizeof(stats), stats,
+    sizeof(stats),
     VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT); // Wait till ready.
+
+  uint32_t istat = 0;
+  for (uint32_t i = 0; i < NSTAT; ++i) {
+    if (pipe_stats_detail->flags & (1 << i)) {
+      *dsts[i] = stats[istat++];
+    }
+  }
+  return out;
+}
+const char* _perf_counter_unit2str(VkPerformanceCounterUnitKHR unit) {
+  switch (unit) {
+  case VK_PERFORMANCE_COUNTER_UNIT_GENERIC_KHR: return "generic";
+  case VK_PERFORMANCE_COUNTER_UNIT_PERCENTAGE_KHR: return "percentage";
+  case VK_PERFORMANCE_COUNTER_UNIT_NANOSECONDS_KHR: return "nanoseconds";
+  case VK_PERFORMANCE_COUNTER_UNIT_BYTES_KHR: return "bytes";
+  case VK_PERFORMANCE_COUNTER_UNIT_BYTES_PER_SECOND_KHR: return "bytes_per_second";
+  case VK_PERFORMANCE_COUNTER_UNIT_KELVIN_KHR: return "kelvin";
+  case VK_PERFORMANCE_COUNTER_UNIT_WATTS_KHR: return "watts";
+  case VK_PERFORMANCE_COUNTER_UNIT_VOLTS_KHR: return "volts";
+  case VK_PERFORMANCE_COUNTER_UNIT_AMPS_KHR: return "amps";
+  case VK_PERFORMANCE_COUNTER_UNIT_HERTZ_KHR: return "hertz";
+  case VK_PERFORMANCE_COUNTER_UNIT_CYCLES_KHR: return "cycles";
+  default: return "unknown";
+  }
+}
+double _perf_counter_result2f(
+  VkPerformanceCounterStorageKHR storage,
+  const VkPerformanceCounterResultKHR& result
+) {
+  switch (storage) {
+  case VK_PERFORMANCE_COUNTER_STORAGE_INT32_KHR: return (double)result.int32;
+  case VK_PERFORMANCE_COUNTER_STORAGE_INT64_KHR: return (double)result.int64;
+  case VK_PERFORMANCE_COUNTER_STORAGE_UINT32_KHR: return (double)result.uint32;
+  case VK_PERFORMANCE_COUNTER_STORAGE_UINT64_KHR: return (double)result.uint64;
+  case VK_PERFORMANCE_COUNTER_STORAGE_FLOAT32_KHR: return (double)result.float32;
+  case VK_PERFORMANCE_COUNTER_STORAGE_FLOAT64_KHR: return result.float64;
+  default: panic("unexpected performance counter storage");
+  }
+  return 0.0;
+}
+std::vector<InvocationPerformanceCounter> Invocation::get_perf_counters() const {
+  if (perf_query_detail == nullptr) { return {}; }
+  const std::vector<ContextPerformanceCounterDetail>& counters =
+    ctxt->perf_query_detail.counters.at(perf_query_detail->qfam_idx);
+  const std::vector<uint32_t>& icounters = perf_query_detail->icounters;
+
+  // The query is not written if the invocation is recorded in a secondary
+  // command buffer, so it's not waited.
+  std::vector<VkPerformanceCounterResultKHR> results(icounters.size());
+  size_t size = results.size() * sizeof(VkPerformanceCounterResultKHR);
+  VkResult err = vkGetQueryPoolResults(ctxt->dev->dev,
+    *perf_query_detail->query_pool, 0, 1, size, results.data(), size, 0);
+  if (err == VK_NOT_READY) { return {}; }
+  VK_ASSERT << err;
+
+  std::vector<InvocationPerformanceCounter> out;
+  out.reserve(icounters.size());
+  for (size_t i = 0; i < icounters.size(); ++i) {
+    const ContextPerformanceCounterDetail& counter =
+      counters.at(icounters.at(i));
+    InvocationPerformanceCounter perf_counter {};
+    perf_counter.name = counter.desc.name;
+    perf_counter.category = counter.desc.category;
+    perf_counter.unit = _perf_counter_unit2str(counter.counter.unit);
+    perf_counter.value =
+      _perf_counter_result2f(counter.counter.storage, results.at(i));
+    out.emplace_back(std::move(perf_counter));
+  }
+  return out;
+}
+double Invocation::get_async_overlap_us() const {
+  if (composite_detail == nullptr) { return 0.0; }
+
+  // Timestamps of queues on the same device are assumed to be in the same
+  // time domain.
+  std::vector<std::pair<uint64_t, uint64_t>> async_intervals;
+  std::vector<std::pair<uint64_t, uint64_t>> other_intervals;
+  for (const Invocation* subinvoke : composite_detail->subinvokes) {
+    if (!subinvoke->query_pool.is_valid()) { continue; }
+    uint64_t t[2];
+    _get_timestamps(*subinvoke, t);
+    bool is_async = subinvoke->submit_ty == L_SUBMIT_TYPE_ASYNC_COMPUTE;
+    (is_async ? async_intervals : other_intervals)
+      .emplace_back(std::make_pair(t[0], t[1]));
+  }
+  if (async_intervals.empty() || other_intervals.empty()) { return 0.0; }
+
+  // The overlapped time is the sum of both minus their union.
+  uint64_t async_ticks = _measure_intervals(async_intervals);
+  uint64_t other_ticks = _measure_intervals(other_intervals);
+  async_intervals.insert(async_intervals.end(), other_intervals.begin(),
+    other_intervals.end());
+  uint64_t union_ticks = _measure_intervals(std::move(async_intervals));
+  uint64_t overlap_ticks = async_ticks + other_ticks - union_ticks;
+
   double ns_per_tick = ctxt->physdev_prop().limits.timestampPeriod;
-  return (t[1] - t[0]) * ns_per_tick / 1000.0;
+  return overlap_ticks * ns_per_tick / 1000.0;
 }
 
 void Invocation::bake() {
   if (!_can_bake_invoke(*this)) { return; }
+  if (_has_queries(*this)) {
+    L_WARN("invocation '", label, "' is timed or queried and cannot be "
+      "baked");
+    return;
+  }
 
+  _drop_bake_detail(*this);
+
+  // Baked secondary command buffers are executed by every transaction using
+  // the invocation, including baked primary command buffers which can be
+  // pending more than once, so they are recorded for simultaneous use.
   TransactionLike transact(*ctxt, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+  transact.is_baking = true;
   record(transact);
   L_ASSERT(transact.fences.empty());
 
   L_ASSERT(transact.submit_details.size() == 1);
   const TransactionSubmitDetail& submit_detail = transact.submit_details[0];
   L_ASSERT(submit_detail.submit_ty == submit_ty);
-  L_ASSERT(submit_detail.signal_sema == VK_NULL_HANDLE);
+  L_ASSERT(submit_detail.timeline_sema == nullptr);
 
   bake_detail = std::make_unique<InvocationBakingDetail>();
   bake_detail->cmd_pool = submit_detail.cmd_pool;
@@ -1300,6 +3333,119 @@ void Invocation::bake() {
 
   L_DEBUG("baked invocation '", label, "'");
 }
+void Invocation::bake_primary() {
+  if (!_can_bake_primary_invoke(*this)) {
+    L_WARN("invocation '", label, "' contains presentation and cannot be "
+      "baked into primary command buffers");
+    return;
+  }
+  if (_has_queries(*this)) {
+    L_WARN("invocation '", label, "' is timed or queried and cannot be "
+      "baked into primary command buffers");
+    return;
+  }
+  _drop_primary_bake_detail(*this);
+  _sync_invoke(*this);
+
+  // Recording updates resource states as if the commands were executed, so
+  // the states are restored until the baked commands are submitted.
+  InvocationPrimaryBakingDetail primary_bake_detail2 {};
+  _snapshot_rsc_states(transit_detail, primary_bake_detail2.init_states);
+
+  TransactionLike transact(*ctxt, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  transact.is_baking = true;
+  record(transact);
+  L_ASSERT(transact.fences.empty());
+
+  _snapshot_rsc_states(transit_detail, primary_bake_detail2.final_states);
+  _restore_rsc_states(primary_bake_detail2.init_states);
+
+  primary_bake_detail2.submit_details = std::move(transact.submit_details);
+  primary_bake_detail2.secondary_cmd_pools =
+    std::move(transact.secondary_cmd_pools);
+  primary_bake_detail = std::make_unique<InvocationPrimaryBakingDetail>(
+    std::move(primary_bake_detail2));
+
+  L_DEBUG("baked invocation '", label, "' into ",
+    primary_bake_detail->submit_details.size(), " primary command buffers");
+}
+
+void Invocation::rebind_rsc(uint32_t i, const ResourceView& rsc_view) {
+  L_ASSERT(comp_detail || graph_detail, "only compute and graphics "
+    "invocations can be rebound");
+  const Task& task = comp_detail ? *comp_detail->task : *graph_detail->task;
+  DescriptorSetPoolItem& desc_set =
+    comp_detail ? comp_detail->desc_set : graph_detail->desc_set;
+  std::vector<ResourceView>& rsc_views =
+    comp_detail ? comp_detail->rsc_views : graph_detail->rsc_views;
+  L_ASSERT(i < rsc_views.size(), "resource index out of range");
+  ResourceViewType rsc_view_ty = rsc_views[i].rsc_view_ty;
+  L_ASSERT(rsc_view.rsc_view_ty == rsc_view_ty, "rebound resource of "
+    "invocation '", label, "' must be of the same view type");
+
+  // Resources in the descriptor set are registered for transition before
+  // anything else, so the `i`-th resource is at the position counted among
+  // the resources of the same view type.
+  size_t itransit = 0;
+  for (uint32_t j = 0; j < i; ++j) {
+    if (rsc_views[j].rsc_view_ty == rsc_view_ty) { ++itransit; }
+  }
+  switch (rsc_view_ty) {
+  case L_RESOURCE_VIEW_TYPE_BUFFER:
+    transit_detail.buf_transit.at(itransit).first = rsc_view.buf_view;
+    transit_detail.buf_refs.at(itransit) = DefragmentationPin<sys::BufferRef>(
+      *rsc_view.buf_view.buf->ctxt, rsc_view.buf_view.buf->buf);
+    break;
+  case L_RESOURCE_VIEW_TYPE_IMAGE:
+    transit_detail.img_transit.at(itransit).first = rsc_view.img_view;
+    transit_detail.img_refs.at(itransit) = DefragmentationPin<sys::ImageRef>(
+      *rsc_view.img_view.img->ctxt, rsc_view.img_view.img->img);
+    break;
+  case L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE:
+    transit_detail.depth_img_transit.at(itransit).first =
+      rsc_view.depth_img_view;
+    break;
+  default: unreachable();
+  }
+
+  rsc_views[i] = rsc_view;
+
+  // Descriptor sets are not updated after bind, and the current one might
+  // still be used by pending submissions. So the resources are written to
+  // another set and the current one goes back to the pool after the device is
+  // done with it.
+  Context& ctxt2 = const_cast<Context&>(*ctxt);
+  DescriptorSetPoolItem desc_set2 =
+    ctxt2.acquire_desc_set(task.rsc_detail.rsc_tys);
+  _update_desc_set(*ctxt, desc_set2.value()->desc_set, task.rsc_detail.rsc_tys,
+    rsc_views);
+  ctxt2.defer_deletion([desc_set = std::move(desc_set)]() {});
+  desc_set = std::move(desc_set2);
+  ++gen;
+
+  L_DEBUG("rebound resource #", i, " of invocation '", label, "'");
+}
+void Invocation::rebind_workgrp_count(const DispatchSize& workgrp_count) {
+  L_ASSERT(comp_detail, "only compute invocations have workgroup counts");
+  L_ASSERT(comp_detail->indirect_buf == nullptr, "workgroup count of "
+    "indirect dispatch invocation '", label, "' is in the indirect buffer");
+  comp_detail->workgrp_count = workgrp_count;
+  ++gen;
+
+  L_DEBUG("rebound workgroup count of invocation '", label, "'");
+}
+void Invocation::rebind_push_consts(const std::vector<uint8_t>& push_consts) {
+  L_ASSERT(comp_detail || graph_detail, "only compute and graphics "
+    "invocations can be rebound");
+  const Task& task = comp_detail ? *comp_detail->task : *graph_detail->task;
+  L_ASSERT(task.rsc_detail.push_const_size == push_consts.size(),
+    "push constant size mismatched");
+  (comp_detail ? comp_detail->push_consts : graph_detail->push_consts) =
+    push_consts;
+  ++gen;
+
+  L_DEBUG("rebound push constants of invocation '", label, "'");
+}
 
 
 } // namespace vk
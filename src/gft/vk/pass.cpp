@@ -184,35 +184,37 @@ FramebufferKey FramebufferKey::create(
   const RenderPass& pass,
   const std::vector<ResourceView>& rsc_views
 ) {
-  std::stringstream ss;
-  ss << *pass.pass;
-  for (const auto& rsc_view : rsc_views) {
+  L_ASSERT(rsc_views.size() <= MAX_FRAMEBUF_NATTM, "framebuffer cannot have "
+    "more than ", MAX_FRAMEBUF_NATTM, " attachments");
+  FramebufferKey out {};
+  out.pass = pass.pass->pass;
+  out.nattm = (uint32_t)rsc_views.size();
+  for (size_t i = 0; i < rsc_views.size(); ++i) {
+    const ResourceView& rsc_view = rsc_views[i];
     switch (rsc_view.rsc_view_ty) {
     case L_RESOURCE_VIEW_TYPE_IMAGE:
-    {
-      VkImageView img_view = rsc_view.img_view.img->img_view->img_view;
-      ss << "," << img_view;
+      out.attms[i] = rsc_view.img_view.img->img_view->img_view;
       break;
-    }
     case L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE:
-    {
-      VkImageView img_view = rsc_view.depth_img_view.depth_img->img_view->img_view;
-      ss << "," << img_view;
+      out.attms[i] = rsc_view.depth_img_view.depth_img->img_view->img_view;
       break;
-    }
     default: L_PANIC("unsupported resource type as an attachment");
     }
   }
-  return { ss.str() };
+  return out;
 }
 
 FramebufferPoolItem RenderPass::acquire_framebuf(
   const std::vector<ResourceView>& attms
 ) {
   FramebufferKey key = FramebufferKey::create(*this, attms);
+  ContextCacheStatistics& cache_stats =
+    const_cast<Context&>(*ctxt).cache_stats;
   if (framebuf_pool.has_free_item(key)) {
+    cache_stats.nframebuf_hit += 1;
     return framebuf_pool.acquire(std::move(key));
   } else {
+    cache_stats.nframebuf_miss += 1;
     return framebuf_pool.create(std::move(key), _create_framebuf(*this, attms));
   }
 }
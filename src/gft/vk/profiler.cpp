@@ -0,0 +1,189 @@
+#include "gft/vk.hpp"
+#include "gft/log.hpp"
+
+namespace liong {
+namespace vk {
+
+bool Profiler::create(const Context& ctxt, const ProfilerConfig& cfg, Profiler& out) {
+  L_ASSERT(cfg.nframe_in_flight > 0, "profiler '", cfg.label, "' must have at "
+    "least one frame in flight");
+  L_ASSERT(cfg.max_nscope > 0, "profiler '", cfg.label, "' must time at least "
+    "one scope per frame");
+
+  std::vector<ProfilerFrameDetail> frames;
+  frames.resize(cfg.nframe_in_flight);
+  for (auto& frame : frames) {
+    frame.query_pool = ctxt.create_query_pool(VK_QUERY_TYPE_TIMESTAMP,
+      cfg.max_nscope * 2);
+    frame.scopes.resize(cfg.max_nscope);
+    frame.nscope = 0;
+  }
+
+  out.ctxt = &ctxt;
+  out.profiler_cfg = cfg;
+  out.frames = std::move(frames);
+  out.iframe = 0;
+  out.ns_per_tick = ctxt.physdev_prop().limits.timestampPeriod;
+  out.nframe = 0;
+  out.nscope_dropped = 0;
+  out.scope_stats.clear();
+  out.scope_stat_idxs.clear();
+  L_DEBUG("created profiler '", cfg.label, "' with ", cfg.nframe_in_flight,
+    " frames in flight and ", cfg.max_nscope, " scopes per frame");
+  return true;
+}
+Profiler::~Profiler() {
+  if (!frames.empty()) {
+    // Timestamps of the frames in flight might still be written.
+    std::vector<sys::QueryPoolRef> query_pools;
+    for (auto& frame : frames) {
+      query_pools.emplace_back(std::move(frame.query_pool));
+    }
+    const_cast<Context*>(ctxt)->defer_deletion(
+      [query_pools = std::move(query_pools)]() {});
+    L_DEBUG("destroyed profiler '", profiler_cfg.label, "'");
+  }
+}
+
+const ProfilerConfig& Profiler::cfg() const {
+  return profiler_cfg;
+}
+
+uint32_t Profiler::reserve_scopes(VkCommandBuffer cmdbuf, uint32_t nscope) {
+  ProfilerFrameDetail& frame = frames.at(iframe);
+  if (frame.nscope + nscope > profiler_cfg.max_nscope) {
+    nscope_dropped += nscope;
+    return NO_PROFILER_SCOPE;
+  }
+  uint32_t iscope = frame.nscope;
+  vkCmdResetQueryPool(cmdbuf, *frame.query_pool, iscope * 2, nscope * 2);
+  frame.nscope += nscope;
+  return iscope;
+}
+void Profiler::begin_scope(
+  VkCommandBuffer cmdbuf,
+  uint32_t iscope,
+  uint32_t iparent,
+  const std::string& label
+) {
+  ProfilerFrameDetail& frame = frames.at(iframe);
+  ProfilerScopeDetail& scope = frame.scopes.at(iscope);
+  scope.label = label;
+  scope.iparent = iparent;
+  vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+    *frame.query_pool, iscope * 2);
+}
+void Profiler::end_scope(VkCommandBuffer cmdbuf, uint32_t iscope) {
+  ProfilerFrameDetail& frame = frames.at(iframe);
+  vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+    *frame.query_pool, iscope * 2 + 1);
+}
+
+// Fold the timestamps of a frame the device has passed into the statistics.
+void _collect_profiler_frame(Profiler& profiler, ProfilerFrameDetail& frame) {
+  const Context& ctxt = *profiler.ctxt;
+
+  // Each query is followed by its availability. Scopes skipped on queues
+  // without timestamp support and scopes of abandoned recordings are never
+  // written and stay unavailable.
+  std::vector<uint64_t> results(frame.nscope * 4);
+  VkResult err = vkGetQueryPoolResults(*ctxt.dev, *frame.query_pool, 0,
+    frame.nscope * 2, results.size() * sizeof(uint64_t), results.data(),
+    sizeof(uint64_t) * 2,
+    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (err != VK_NOT_READY) {
+    VK_ASSERT << err;
+  }
+
+  // Parents are always reserved before their children so the statistics
+  // index of a parent is resolved before any of its children.
+  std::vector<uint32_t> stat_idxs(frame.nscope, NO_PROFILER_SCOPE);
+  for (uint32_t i = 0; i < frame.nscope; ++i) {
+    const uint64_t* t = &results[i * 4];
+    if (t[1] == 0 || t[3] == 0) { continue; }
+    const ProfilerScopeDetail& scope = frame.scopes.at(i);
+
+    uint32_t iparent_stat = NO_PROFILER_SCOPE;
+    if (scope.iparent != NO_PROFILER_SCOPE) {
+      iparent_stat = stat_idxs.at(scope.iparent);
+      // The parent was not timed so neither is the child.
+      if (iparent_stat == NO_PROFILER_SCOPE) { continue; }
+    }
+
+    auto key = std::make_pair(iparent_stat, scope.label);
+    auto it = profiler.scope_stat_idxs.find(key);
+    uint32_t istat;
+    if (it == profiler.scope_stat_idxs.end()) {
+      ProfilerScopeStatisticsDetail stat {};
+      if (iparent_stat == NO_PROFILER_SCOPE) {
+        stat.path = scope.label;
+        stat.depth = 0;
+      } else {
+        const ProfilerScopeStatisticsDetail& parent_stat =
+          profiler.scope_stats.at(iparent_stat);
+        stat.path = parent_stat.path + "/" + scope.label;
+        stat.depth = parent_stat.depth + 1;
+      }
+      istat = (uint32_t)profiler.scope_stats.size();
+      profiler.scope_stats.emplace_back(std::move(stat));
+      profiler.scope_stat_idxs.emplace(std::move(key), istat);
+    } else {
+      istat = it->second;
+    }
+    stat_idxs.at(i) = istat;
+
+    uint64_t nticks = t[2] >= t[0] ? t[2] - t[0] : 0;
+    double time_us = nticks * profiler.ns_per_tick / 1000.0;
+    ProfilerScopeStatisticsDetail& stat = profiler.scope_stats.at(istat);
+    stat.avg_time_us.push(time_us);
+    stat.min_time_us.push(time_us);
+    stat.max_time_us.push(time_us);
+    ++stat.nsample;
+  }
+}
+void Profiler::next_frame() {
+  frames.at(iframe).timeline_values = ctxt->get_timeline_values();
+  iframe = (iframe + 1) % (uint32_t)frames.size();
+
+  // Frames not ended yet have nothing to read back.
+  ProfilerFrameDetail& frame = frames.at(iframe);
+  if (frame.timeline_values.empty()) { return; }
+  if (frame.nscope > 0) {
+    if (!ctxt->is_timeline_passed(frame.timeline_values, false)) {
+      L_DEBUG("profiler '", profiler_cfg.label, "' is waiting for the device "
+        "to catch up with ", profiler_cfg.nframe_in_flight, " frames in "
+        "flight");
+      ctxt->is_timeline_passed(frame.timeline_values, true);
+    }
+    _collect_profiler_frame(*this, frame);
+  }
+  frame.nscope = 0;
+  ++nframe;
+}
+
+ProfilerStatistics Profiler::get_stats() const {
+  ProfilerStatistics out {};
+  out.nframe = nframe;
+  out.nscope_dropped = nscope_dropped;
+  out.scopes.reserve(scope_stats.size());
+  for (const auto& stat : scope_stats) {
+    ProfilerScopeStatistics scope_stat {};
+    scope_stat.path = stat.path;
+    scope_stat.depth = stat.depth;
+    scope_stat.nsample = stat.nsample;
+    scope_stat.avg_time_us = stat.avg_time_us;
+    scope_stat.min_time_us = stat.min_time_us;
+    scope_stat.max_time_us = stat.max_time_us;
+    out.scopes.emplace_back(std::move(scope_stat));
+  }
+  return out;
+}
+void Profiler::reset_stats() {
+  nframe = 0;
+  nscope_dropped = 0;
+  scope_stats.clear();
+  scope_stat_idxs.clear();
+}
+
+} // namespace vk
+} // namespace liong
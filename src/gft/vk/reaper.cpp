@@ -0,0 +1,130 @@
+#include "gft/vk.hpp"
+#include "gft/log.hpp"
+#include "sys.hpp"
+
+namespace liong {
+namespace vk {
+
+bool _is_reaper_entry_done(const Context& ctxt, const ContextReaperEntry& entry) {
+  for (size_t i = 0; i < entry.semas.size(); ++i) {
+    uint64_t value = 0;
+    VK_ASSERT << ctxt.timeline_detail.get_sema_counter_value(*ctxt.dev,
+      entry.semas.at(i), &value);
+    if (value < entry.values.at(i)) { return false; }
+  }
+  // Fences are only used by swapchain image acquisition, which is signaled
+  // shortly after the presented work is done. They are polled so that the
+  // lock is never held while blocking.
+  for (const FencePoolItem& fence : entry.fences) {
+    VkResult err = vkGetFenceStatus(*ctxt.dev, fence.value()->fence);
+    if (err == VK_NOT_READY) { return false; }
+    VK_ASSERT << err;
+  }
+  return true;
+}
+// Fence pool items MUST NOT be dropped on the reaper thread. `reaper.sync` MUST
+// be locked.
+void _move_done_fences(ContextReaper& reaper, ContextReaperEntry& entry) {
+  for (auto& fence : entry.fences) {
+    reaper.done_fences.emplace_back(std::move(fence));
+  }
+  entry.fences.clear();
+}
+void _reap(ContextReaper& reaper) {
+  const Context& ctxt = *reaper.ctxt;
+
+  for (;;) {
+    std::vector<std::function<void()>> callbacks;
+    std::vector<VkSemaphore> semas;
+    std::vector<uint64_t> values;
+    bool is_fence_pending = false;
+    bool is_stopping = false;
+    {
+      std::lock_guard<std::mutex> guard(reaper.sync);
+      auto& entries = reaper.entries;
+      for (auto it = entries.begin(); it != entries.end();) {
+        if (_is_reaper_entry_done(ctxt, *it)) {
+          callbacks.emplace_back(std::move(it->callback));
+          _move_done_fences(reaper, *it);
+          it = entries.erase(it);
+        } else {
+          semas.insert(semas.end(), it->semas.begin(), it->semas.end());
+          values.insert(values.end(), it->values.begin(), it->values.end());
+          is_fence_pending |= !it->fences.empty();
+          ++it;
+        }
+      }
+
+      is_stopping = reaper.is_stopping;
+      if (is_stopping && !entries.empty()) {
+        L_WARN("context reaper stopped with ", entries.size(), " pending "
+          "callbacks dropped");
+        for (auto& entry : entries) {
+          _move_done_fences(reaper, entry);
+        }
+        entries.clear();
+      }
+      semas.emplace_back(reaper.wake_sema->sema);
+      values.emplace_back(reaper.wake_value + 1);
+    }
+
+    // Callbacks can push new entries so they are called without the lock.
+    for (const auto& callback : callbacks) {
+      callback();
+    }
+    if (is_stopping) { break; }
+
+    VkSemaphoreWaitInfoKHR swi {};
+    swi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    swi.flags = VK_SEMAPHORE_WAIT_ANY_BIT_KHR;
+    swi.semaphoreCount = (uint32_t)semas.size();
+    swi.pSemaphores = semas.data();
+    swi.pValues = values.data();
+    VkResult err = ctxt.timeline_detail.wait_semas(*ctxt.dev, &swi,
+      is_fence_pending ? FENCE_POLL_INTERVAL_NS : UINT64_MAX);
+    if (err != VK_TIMEOUT) {
+      VK_ASSERT << err;
+    }
+  }
+}
+
+ContextReaper::ContextReaper(const Context& ctxt) :
+  ctxt(&ctxt),
+  sync(),
+  entries(),
+  done_fences(),
+  wake_sema(sys::create_timeline_sema(ctxt.dev->dev, 0)),
+  wake_value(0),
+  is_stopping(false),
+  thread()
+{
+  thread = std::thread([this]() { _reap(*this); });
+}
+ContextReaper::~ContextReaper() {
+  {
+    std::lock_guard<std::mutex> guard(sync);
+    is_stopping = true;
+    wake();
+  }
+  thread.join();
+}
+
+void ContextReaper::push(ContextReaperEntry&& entry) {
+  std::lock_guard<std::mutex> guard(sync);
+  entries.emplace_back(std::move(entry));
+  wake();
+}
+std::vector<FencePoolItem> ContextReaper::take_done_fences() {
+  std::lock_guard<std::mutex> guard(sync);
+  return std::exchange(done_fences, {});
+}
+void ContextReaper::wake() {
+  VkSemaphoreSignalInfoKHR ssi {};
+  ssi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR;
+  ssi.semaphore = wake_sema->sema;
+  ssi.value = ++wake_value;
+  VK_ASSERT << ctxt->timeline_detail.signal_sema(*ctxt->dev, &ssi);
+}
+
+} // namespace vk
+} // namespace liong
@@ -0,0 +1,433 @@
+#include <set>
+#include <numeric>
+#include <algorithm>
+#include "gft/vk.hpp"
+#include "gft/log.hpp"
+#include "gft/util.hpp"
+#include "gft/hal/render-graph.hpp"
+
+namespace liong {
+namespace vk {
+namespace scoped {
+
+constexpr uint32_t NO_PASS = ~uint32_t(0);
+
+void _validate_graph(const RenderGraphConfig& cfg) {
+  for (size_t i = 0; i < cfg.rscs.size(); ++i) {
+    const RenderGraphResourceConfig& rsc = cfg.rscs[i];
+    L_ASSERT(!rsc.is_transient ||
+      rsc.rsc_view_ty != L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE,
+      "transient depth images are not supported (resource #", i, ")");
+    L_ASSERT(!rsc.is_transient ||
+      rsc.rsc_view_ty != L_RESOURCE_VIEW_TYPE_BUFFER ||
+      (rsc.buf_cfg.host_access == 0 && rsc.buf_cfg.host_ptr == nullptr),
+      "transient buffers cannot be host-accessible (resource #", i, ")");
+  }
+  for (const RenderGraphPassConfig& pass : cfg.passes) {
+    for (RenderGraphResource rsc : pass.reads) {
+      L_ASSERT(rsc < cfg.rscs.size(), "pass '", pass.label, "' reads "
+        "undeclared resource #", rsc);
+    }
+    for (RenderGraphResource rsc : pass.writes) {
+      L_ASSERT(rsc < cfg.rscs.size(), "pass '", pass.label, "' writes "
+        "undeclared resource #", rsc);
+    }
+    L_ASSERT(pass.build_invoke != nullptr, "pass '", pass.label, "' has no "
+      "invocation builder");
+  }
+}
+
+namespace detail {
+
+// Collect the passes each pass has to be executed after, i.e., the previous
+// writers of the resources it accesses and the previous readers of the
+// resources it writes. `producers` only has the previous writers, whose
+// results are consumed by the pass. Writes might not cover the entire
+// resource so a pass writing a resource consumes the previous write too.
+void collect_pass_deps(
+  const RenderGraphConfig& cfg,
+  std::vector<std::set<uint32_t>>& deps,
+  std::vector<std::set<uint32_t>>& producers
+) {
+  const uint32_t npass = (uint32_t)cfg.passes.size();
+  std::vector<uint32_t> last_writers(cfg.rscs.size(), NO_PASS);
+  std::vector<std::vector<uint32_t>> readers(cfg.rscs.size());
+  uint32_t last_kept = NO_PASS;
+
+  deps.resize(npass);
+  producers.resize(npass);
+  for (uint32_t i = 0; i < npass; ++i) {
+    const RenderGraphPassConfig& pass = cfg.passes[i];
+
+    for (RenderGraphResource rsc : pass.reads) {
+      uint32_t writer = last_writers[rsc];
+      if (writer != NO_PASS) {
+        deps[i].emplace(writer);
+        producers[i].emplace(writer);
+      } else if (cfg.rscs[rsc].is_transient) {
+        L_WARN("pass '", pass.label, "' reads transient resource #", rsc,
+          " before it's written");
+      }
+    }
+    for (RenderGraphResource rsc : pass.writes) {
+      uint32_t writer = last_writers[rsc];
+      if (writer != NO_PASS) {
+        deps[i].emplace(writer);
+        producers[i].emplace(writer);
+      }
+      for (uint32_t reader : readers[rsc]) {
+        if (reader != i) { deps[i].emplace(reader); }
+      }
+    }
+    if (pass.is_kept) {
+      if (last_kept != NO_PASS) { deps[i].emplace(last_kept); }
+      last_kept = i;
+    }
+
+    for (RenderGraphResource rsc : pass.reads) {
+      readers[rsc].emplace_back(i);
+    }
+    for (RenderGraphResource rsc : pass.writes) {
+      last_writers[rsc] = i;
+      readers[rsc].clear();
+    }
+  }
+}
+// A pass is executed if it writes an imported resource, is kept, or produces
+// the content consumed by another executed pass.
+std::vector<bool> cull_passes(
+  const RenderGraphConfig& cfg,
+  const std::vector<std::set<uint32_t>>& producers
+) {
+  const uint32_t npass = (uint32_t)cfg.passes.size();
+  std::vector<bool> is_alive(npass);
+  for (uint32_t i = npass; i-- > 0;) {
+    const RenderGraphPassConfig& pass = cfg.passes[i];
+    bool is_alive2 = is_alive[i] || pass.is_kept;
+    for (RenderGraphResource rsc : pass.writes) {
+      is_alive2 |= !cfg.rscs[rsc].is_transient;
+    }
+    if (!is_alive2) { continue; }
+
+    is_alive[i] = true;
+    for (uint32_t producer : producers[i]) {
+      is_alive[producer] = true;
+    }
+  }
+  return is_alive;
+}
+// Topologically sort the executed passes. Among the ready passes, the one
+// whose producers are scheduled the latest goes first, so that results are
+// consumed soon after they are produced and transient resources live short.
+std::vector<uint32_t> schedule_passes(
+  const std::vector<bool>& is_alive,
+  const std::vector<std::set<uint32_t>>& deps,
+  const std::vector<std::set<uint32_t>>& producers
+) {
+  const uint32_t npass = (uint32_t)is_alive.size();
+  const uint32_t nalive =
+    (uint32_t)std::count(is_alive.begin(), is_alive.end(), true);
+
+  std::vector<uint32_t> poses(npass, NO_PASS);
+  std::vector<uint32_t> ipasses;
+  ipasses.reserve(nalive);
+  while (ipasses.size() < nalive) {
+    uint32_t best_ipass = NO_PASS;
+    int64_t best_prio = -2;
+    for (uint32_t i = 0; i < npass; ++i) {
+      if (!is_alive[i] || poses[i] != NO_PASS) { continue; }
+
+      bool is_ready = true;
+      for (uint32_t dep : deps[i]) {
+        if (is_alive[dep] && poses[dep] == NO_PASS) {
+          is_ready = false;
+          break;
+        }
+      }
+      if (!is_ready) { continue; }
+
+      int64_t prio = -1;
+      for (uint32_t producer : producers[i]) {
+        prio = std::max<int64_t>(prio, poses[producer]);
+      }
+      if (prio > best_prio) {
+        best_ipass = i;
+        best_prio = prio;
+      }
+    }
+    L_ASSERT(best_ipass != NO_PASS);
+
+    poses[best_ipass] = (uint32_t)ipasses.size();
+    ipasses.emplace_back(best_ipass);
+  }
+  return ipasses;
+}
+std::vector<RenderGraphTransientDetail> collect_transients(
+  const RenderGraphConfig& cfg,
+  const std::vector<uint32_t>& ipasses
+) {
+  std::vector<RenderGraphTransientDetail> out;
+  std::vector<uint32_t> itransients(cfg.rscs.size(), ~uint32_t(0));
+
+  auto use = [&](RenderGraphResource rsc, uint32_t pos) {
+    if (!cfg.rscs[rsc].is_transient) { return; }
+    uint32_t& itransient = itransients[rsc];
+    if (itransient == ~uint32_t(0)) {
+      RenderGraphTransientDetail transient {};
+      transient.rsc = rsc;
+      transient.first_pos = pos;
+      transient.last_pos = pos;
+      itransient = (uint32_t)out.size();
+      out.emplace_back(std::move(transient));
+    } else {
+      out[itransient].last_pos = pos;
+    }
+  };
+  for (uint32_t pos = 0; pos < ipasses.size(); ++pos) {
+    const RenderGraphPassConfig& pass = cfg.passes[ipasses[pos]];
+    for (RenderGraphResource rsc : pass.reads) { use(rsc, pos); }
+    for (RenderGraphResource rsc : pass.writes) { use(rsc, pos); }
+  }
+  return out;
+}
+// Place transient resources in as little memory as possible. Resources alive
+// at the same time never overlap; larger resources are placed first so that
+// smaller ones fill the gaps.
+std::vector<RenderGraphHeapDetail> place_transients(
+  std::vector<RenderGraphTransientDetail>& transients,
+  size_t granularity
+) {
+  std::vector<uint32_t> order(transients.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return transients[a].size > transients[b].size;
+  });
+
+  std::vector<RenderGraphHeapDetail> heaps;
+  for (uint32_t itransient : order) {
+    RenderGraphTransientDetail& transient = transients[itransient];
+    // Buffers and images are kept apart by the buffer-image granularity.
+    size_t align = std::max<size_t>(transient.align, granularity);
+
+    uint32_t iheap = 0;
+    for (; iheap < heaps.size(); ++iheap) {
+      if (heaps[iheap].mem_ty_bits & transient.mem_ty_bits) { break; }
+    }
+    if (iheap == heaps.size()) {
+      RenderGraphHeapDetail heap {};
+      heap.mem_ty_bits = ~uint32_t(0);
+      heap.align = 1;
+      heaps.emplace_back(std::move(heap));
+    }
+    RenderGraphHeapDetail& heap = heaps[iheap];
+
+    std::vector<std::pair<size_t, size_t>> occupied;
+    for (uint32_t iplaced : heap.itransients) {
+      const RenderGraphTransientDetail& placed = transients[iplaced];
+      if (placed.last_pos < transient.first_pos ||
+        transient.last_pos < placed.first_pos
+      ) {
+        continue;
+      }
+      occupied.emplace_back(placed.offset, placed.offset + placed.size);
+    }
+    std::sort(occupied.begin(), occupied.end());
+
+    size_t offset = 0;
+    for (const auto& range : occupied) {
+      if (range.first >= offset + transient.size) { break; }
+      if (range.second > offset) {
+        offset = util::align_up(range.second, align);
+      }
+    }
+
+    transient.iheap = iheap;
+    transient.offset = offset;
+    heap.mem_ty_bits &= transient.mem_ty_bits;
+    heap.size = std::max<size_t>(heap.size, offset + transient.size);
+    heap.align = std::max<size_t>(heap.align, align);
+    heap.itransients.emplace_back(itransient);
+  }
+  return heaps;
+}
+
+} // namespace detail
+
+RenderGraph::RenderGraph(
+  const scoped::Context& ctxt,
+  RenderGraphConfig&& graph_cfg,
+  bool gc
+) :
+  ctxt(scoped::Context::borrow(ctxt)),
+  cfg(std::move(graph_cfg)),
+  ipasses(),
+  bufs(cfg.rscs.size()),
+  imgs(cfg.rscs.size()),
+  depth_imgs(cfg.rscs.size()),
+  pass_invokes(),
+  invoke(),
+  stats()
+{
+  const vk::Context& ctxt2 = ctxt;
+  _validate_graph(cfg);
+
+  std::vector<std::set<uint32_t>> deps;
+  std::vector<std::set<uint32_t>> producers;
+  detail::collect_pass_deps(cfg, deps, producers);
+  std::vector<bool> is_alive = detail::cull_passes(cfg, producers);
+  ipasses = detail::schedule_passes(is_alive, deps, producers);
+
+  stats.npass = (uint32_t)ipasses.size();
+  stats.npass_culled = (uint32_t)(cfg.passes.size() - ipasses.size());
+  if (ipasses.empty()) {
+    L_WARN("render graph '", cfg.label, "' has no pass writing imported "
+      "resources so all passes are culled");
+  }
+
+  // Place transient resources in aliased memory.
+  std::vector<detail::RenderGraphTransientDetail> transients =
+    detail::collect_transients(cfg, ipasses);
+  for (detail::RenderGraphTransientDetail& transient : transients) {
+    const RenderGraphResourceConfig& rsc = cfg.rscs[transient.rsc];
+    VkMemoryRequirements mr {};
+    bool succ = rsc.rsc_view_ty == L_RESOURCE_VIEW_TYPE_BUFFER ?
+      vk::Buffer::get_aliased_mem_req(ctxt2, rsc.buf_cfg, mr) :
+      vk::Image::get_aliased_mem_req(ctxt2, rsc.img_cfg, mr);
+    L_ASSERT(succ, "cannot query memory requirements of transient resource #",
+      transient.rsc, " in render graph '", cfg.label, "'");
+    transient.size = mr.size;
+    transient.align = mr.alignment;
+    transient.mem_ty_bits = mr.memoryTypeBits;
+    stats.transient_size += mr.size;
+  }
+  std::vector<detail::RenderGraphHeapDetail> heaps =
+    detail::place_transients(transients,
+      ctxt2.physdev_prop().limits.bufferImageGranularity);
+
+  std::vector<vk::AliasedMemoryRef> mems;
+  mems.reserve(heaps.size());
+  for (const detail::RenderGraphHeapDetail& heap : heaps) {
+    VkMemoryRequirements mr {};
+    mr.size = heap.size;
+    mr.alignment = heap.align;
+    mr.memoryTypeBits = heap.mem_ty_bits;
+    vk::AliasedMemoryRef mem = std::make_shared<vk::AliasedMemory>();
+    bool succ = vk::AliasedMemory::create(ctxt2, cfg.label, mr, *mem);
+    L_ASSERT(succ, "cannot allocate transient memory of render graph '",
+      cfg.label, "'");
+    mems.emplace_back(std::move(mem));
+    stats.aliased_size += heap.size;
+  }
+  stats.ntransient = (uint32_t)transients.size();
+
+  ScopedObjectOwnership ownership = gc ?
+    L_SCOPED_OBJECT_OWNERSHIP_OWNED_BY_GC_FRAME :
+    L_SCOPED_OBJECT_OWNERSHIP_OWNED_BY_RAII;
+  for (const detail::RenderGraphTransientDetail& transient : transients) {
+    const RenderGraphResourceConfig& rsc = cfg.rscs[transient.rsc];
+    const vk::AliasedMemoryRef& mem = mems[transient.iheap];
+    if (rsc.rsc_view_ty == L_RESOURCE_VIEW_TYPE_BUFFER) {
+      vk::Buffer* obj = gc ?
+        scoped::Buffer::create_gc_frame_obj() :
+        scoped::Buffer::create_raii_obj();
+      bool succ = vk::Buffer::create_aliased(ctxt2, rsc.buf_cfg, mem,
+        transient.offset, *obj);
+      L_ASSERT(succ);
+      bufs[transient.rsc] = scoped::Buffer(obj, ownership);
+    } else {
+      vk::Image* obj = gc ?
+        scoped::Image::create_gc_frame_obj() :
+        scoped::Image::create_raii_obj();
+      bool succ = vk::Image::create_aliased(ctxt2, rsc.img_cfg, mem,
+        transient.offset, *obj);
+      L_ASSERT(succ);
+      imgs[transient.rsc] = scoped::Image(obj, ownership);
+    }
+  }
+  for (RenderGraphResource i = 0; i < cfg.rscs.size(); ++i) {
+    const RenderGraphResourceConfig& rsc = cfg.rscs[i];
+    if (rsc.is_transient) { continue; }
+    switch (rsc.rsc_view_ty) {
+    case L_RESOURCE_VIEW_TYPE_BUFFER:
+      bufs[i] = scoped::Buffer::borrow(*rsc.buf);
+      break;
+    case L_RESOURCE_VIEW_TYPE_IMAGE:
+      imgs[i] = scoped::Image::borrow(*rsc.img);
+      break;
+    case L_RESOURCE_VIEW_TYPE_DEPTH_IMAGE:
+      depth_imgs[i] = scoped::DepthImage::borrow(*rsc.depth_img);
+      break;
+    default: unreachable();
+    }
+  }
+
+  // Build pass invocations in execution order. Transient resources are
+  // discarded before their first use because their memory might have been
+  // used by other resources.
+  CompositeInvocationBuilder graph_cib(this->ctxt, cfg.label);
+  pass_invokes.reserve(ipasses.size() * 2);
+  for (uint32_t pos = 0; pos < ipasses.size(); ++pos) {
+    const RenderGraphPassConfig& pass = cfg.passes[ipasses[pos]];
+    scoped::Invocation pass_invoke = pass.build_invoke(*this);
+    L_ASSERT(pass_invoke.is_valid(), "pass '", pass.label, "' built no "
+      "invocation");
+
+    CompositeInvocationBuilder cib(this->ctxt, pass.label);
+    bool has_discard = false;
+    for (const detail::RenderGraphTransientDetail& transient : transients) {
+      if (transient.first_pos != pos) { continue; }
+      if (bufs[transient.rsc].is_valid()) {
+        cib.discard(bufs[transient.rsc].view());
+      } else {
+        cib.discard(imgs[transient.rsc].view());
+      }
+      has_discard = true;
+    }
+
+    if (has_discard) {
+      cib.invoke(pass_invoke);
+      pass_invokes.emplace_back(std::move(pass_invoke));
+      pass_invoke = cib.build(gc);
+    }
+    graph_cib.invoke(pass_invoke);
+    pass_invokes.emplace_back(std::move(pass_invoke));
+  }
+  invoke = graph_cib.is_timed(cfg.is_timed).build(gc);
+
+  L_DEBUG("built render graph '", cfg.label, "' with ", stats.npass,
+    " passes (", stats.npass_culled, " culled) and ", stats.ntransient,
+    " transient resources in ", stats.aliased_size, " bytes (",
+    stats.transient_size, " bytes without aliasing)");
+}
+
+const scoped::Buffer& RenderGraph::buf(RenderGraphResource rsc) const {
+  L_ASSERT(rsc < bufs.size() && bufs[rsc].is_valid(), "resource #", rsc,
+    " of render graph '", cfg.label, "' is not a buffer used by any executed "
+    "pass");
+  return bufs[rsc];
+}
+const scoped::Image& RenderGraph::img(RenderGraphResource rsc) const {
+  L_ASSERT(rsc < imgs.size() && imgs[rsc].is_valid(), "resource #", rsc,
+    " of render graph '", cfg.label, "' is not an image used by any executed "
+    "pass");
+  return imgs[rsc];
+}
+const scoped::DepthImage& RenderGraph::depth_img(
+  RenderGraphResource rsc
+) const {
+  L_ASSERT(rsc < depth_imgs.size() && depth_imgs[rsc].is_valid(), "resource #",
+    rsc, " of render graph '", cfg.label, "' is not a depth image");
+  return depth_imgs[rsc];
+}
+
+Transaction RenderGraph::submit(bool gc) {
+  return invoke.submit(gc);
+}
+
+RenderGraph RenderGraphBuilder::build(bool gc) {
+  return RenderGraph(parent, std::move(inner), gc);
+}
+
+} // namespace scoped
+} // namespace vk
+} // namespace liong
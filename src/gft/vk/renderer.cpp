@@ -9,38 +9,95 @@ namespace liong {
 namespace vk {
 namespace scoped {
 
-MeshGpu::MeshGpu(const scoped::Context& ctxt, uint32_t nvert, bool streaming, bool gc) : nvert(nvert) {
+// Host access of buffers written by the host. Buffers that are not streamed
+// are only host-writable if they can still be placed in device-local memory,
+// i.e., on unified memory and resizable-BAR architectures, and the heap has
+// `size` bytes of budget left for them.
+MemoryAccess _get_upload_host_access(
+  const scoped::Context& ctxt,
+  size_t size,
+  bool streaming
+) {
+  const vk::Context& ctxt2 = ctxt;
+  bool can_write_directly = ctxt2.can_write_directly(size);
+  return streaming || can_write_directly ? L_MEMORY_ACCESS_WRITE_BIT : 0;
+}
+// Write `src` to `dst` with each element aligned to `align` bytes. The data is
+// directly written if `dst` is host-visible; otherwise it's batched in `uib` to
+// be uploaded through staging memory.
+template<typename T>
+void _upload_aligned(
+  scoped::UploadInvocationBuilder& uib,
+  const scoped::Buffer& dst,
+  const std::vector<T>& src,
+  size_t align
+) {
+  if (src.empty()) { return; }
+  const vk::Buffer& dst2 = dst;
+  if (dst2.mem_prop_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    dst.map_write().write_aligned(src, align);
+  } else {
+    uib.write_aligned(dst.view(), src, align);
+  }
+}
+template<typename T>
+void _upload(
+  scoped::UploadInvocationBuilder& uib,
+  const scoped::Buffer& dst,
+  const std::vector<T>& src
+) {
+  _upload_aligned(uib, dst, src, sizeof(T));
+}
+// Upload all batched writes in a single submission and wait for completion.
+void _flush_upload(scoped::UploadInvocationBuilder& uib) {
+  if (uib.empty()) { return; }
+  uib.build().submit().wait();
+}
+
+
+
+MeshGpu::MeshGpu(const scoped::Context& ctxt, uint32_t nvert, bool streaming, bool gc) :
+  ctxt(scoped::Context::borrow(ctxt)), nvert(nvert)
+{
+  size_t size = nvert * (sizeof(glm::vec4) * 2 + sizeof(glm::vec2));
+  MemoryAccess host_access = _get_upload_host_access(ctxt, size, streaming);
+
   poses = ctxt.build_buf()
     .size(nvert * sizeof(glm::vec4))
     .vertex()
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(host_access)
     .build(gc);
 
   uvs = ctxt.build_buf()
     .size(nvert * sizeof(glm::vec2))
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(host_access)
     .build(gc);
 
   norms = ctxt.build_buf()
     .size(nvert * sizeof(glm::vec4))
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(host_access)
     .build(gc);
 }
 MeshGpu::MeshGpu(const scoped::Context& ctxt, const mesh::Mesh& mesh, bool gc) :
-  MeshGpu(ctxt, mesh.poses.size(), gc)
+  MeshGpu(ctxt, mesh.poses.size(), false, gc)
 {
   write(mesh);
 }
 void MeshGpu::write(const mesh::Mesh& mesh) {
+  scoped::UploadInvocationBuilder uib = ctxt.build_upload_invoke();
+  write(uib, mesh);
+  _flush_upload(uib);
+}
+void MeshGpu::write(scoped::UploadInvocationBuilder& uib, const mesh::Mesh& mesh) {
   L_ASSERT(nvert == mesh.poses.size());
   L_ASSERT(nvert == mesh.uvs.size());
   L_ASSERT(nvert == mesh.norms.size());
-  poses.map_write().write_aligned(mesh.poses, sizeof(glm::vec4));
-  uvs.map_write().write_aligned(mesh.uvs, sizeof(glm::vec2));
-  norms.map_write().write_aligned(mesh.norms, sizeof(glm::vec4));
+  _upload_aligned(uib, poses, mesh.poses, sizeof(glm::vec4));
+  _upload_aligned(uib, uvs, mesh.uvs, sizeof(glm::vec2));
+  _upload_aligned(uib, norms, mesh.norms, sizeof(glm::vec4));
 }
 
 
@@ -56,18 +113,24 @@ IndexedMeshGpu::IndexedMeshGpu(
     .size(ntri * sizeof(glm::uvec3))
     .index()
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(_get_upload_host_access(ctxt, ntri * sizeof(glm::uvec3),
+      streaming))
     .build(gc);
 }
 IndexedMeshGpu::IndexedMeshGpu(const scoped::Context& ctxt, const mesh::IndexedMesh& idxmesh, bool gc) :
-  IndexedMeshGpu(ctxt, idxmesh.mesh.poses.size(), idxmesh.idxs.size(), gc)
+  IndexedMeshGpu(ctxt, idxmesh.mesh.poses.size(), idxmesh.idxs.size(), false, gc)
 {
   write(idxmesh);
 }
 void IndexedMeshGpu::write(const mesh::IndexedMesh& idxmesh) {
+  scoped::UploadInvocationBuilder uib = mesh.ctxt.build_upload_invoke();
+  write(uib, idxmesh);
+  _flush_upload(uib);
+}
+void IndexedMeshGpu::write(scoped::UploadInvocationBuilder& uib, const mesh::IndexedMesh& idxmesh) {
   L_ASSERT(ntri == idxmesh.idxs.size());
-  mesh.write(idxmesh.mesh);
-  idxs.map_write().write(idxmesh.idxs);
+  mesh.write(uib, idxmesh.mesh);
+  _upload(uib, idxs, idxmesh.idxs);
 }
 
 
@@ -80,32 +143,36 @@ SkinnedMeshGpu::SkinnedMeshGpu(
   bool streaming,
   bool gc
 ) : ctxt(scoped::Context::borrow(ctxt)), idxmesh(ctxt, nvert, ntri, streaming, gc), nbone(nbone) {
+  size_t size = nvert * (sizeof(glm::vec4) * 2 + sizeof(glm::uvec4));
+  MemoryAccess host_access = _get_upload_host_access(ctxt, size, streaming);
+
   rest_poses = ctxt.build_buf()
     .size(nvert * sizeof(glm::vec4))
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(host_access)
     .build();
 
   ibones = ctxt.build_buf()
     .size(nvert * sizeof(glm::uvec4))
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(host_access)
     .build();
 
   bone_weights = ctxt.build_buf()
     .size(nvert * sizeof(glm::vec4))
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(host_access)
     .build();
 
+  // Bone matrices are updated every animated frame.
   bone_mats = ctxt.build_buf()
     .size(nvert * sizeof(glm::mat4))
     .storage()
-    .host_access(streaming ? L_MEMORY_ACCESS_WRITE_BIT : 0)
+    .host_access(L_MEMORY_ACCESS_WRITE_BIT)
     .build();
 }
 SkinnedMeshGpu::SkinnedMeshGpu(const scoped::Context& ctxt, const mesh::SkinnedMesh& skinmesh, bool gc) :
-  SkinnedMeshGpu(ctxt, skinmesh.idxmesh.mesh.poses.size(), skinmesh.idxmesh.idxs.size(), skinmesh.skinning.bones.size(), gc)
+  SkinnedMeshGpu(ctxt, skinmesh.idxmesh.mesh.poses.size(), skinmesh.idxmesh.idxs.size(), skinmesh.skinning.bones.size(), false, gc)
 {
   write(skinmesh);
 }
@@ -155,11 +222,16 @@ scoped::Task create_animate_task(const scoped::Context& ctxt, uint32_t nvert) {
   return task;
 };
 void SkinnedMeshGpu::write(const mesh::SkinnedMesh& skinmesh) {
+  scoped::UploadInvocationBuilder uib = ctxt.build_upload_invoke();
+  write(uib, skinmesh);
+  _flush_upload(uib);
+}
+void SkinnedMeshGpu::write(scoped::UploadInvocationBuilder& uib, const mesh::SkinnedMesh& skinmesh) {
   L_ASSERT(nbone == skinmesh.skinning.bones.size());
-  idxmesh.write(skinmesh.idxmesh);
-  rest_poses.map_write().write_aligned(skinmesh.idxmesh.mesh.poses, sizeof(glm::vec4));
-  ibones.map_write().write(skinmesh.skinning.ibones);
-  bone_weights.map_write().write(skinmesh.skinning.bone_weights);
+  idxmesh.write(uib, skinmesh.idxmesh);
+  _upload_aligned(uib, rest_poses, skinmesh.idxmesh.mesh.poses, sizeof(glm::vec4));
+  _upload(uib, ibones, skinmesh.skinning.ibones);
+  _upload(uib, bone_weights, skinmesh.skinning.bone_weights);
   std::vector<glm::mat4> bone_mats_data(skinmesh.skinning.bones.size(), glm::identity<glm::mat4>());
   bone_mats.map_write().write(bone_mats_data);
 
@@ -207,10 +279,6 @@ TextureGpu::TextureGpu(
     .sampled()
     .storage()
     .build();
-  stage_buf = ctxt.build_buf()
-    .size(sizeof(uint32_t) * width * height)
-    .streaming()
-    .build();
 }
 TextureGpu::TextureGpu(
   const scoped::Context& ctxt,
@@ -222,17 +290,14 @@ TextureGpu::TextureGpu(
   write(pxs);
 }
 void TextureGpu::write(const std::vector<uint32_t>& pxs) {
+  scoped::UploadInvocationBuilder uib = ctxt.build_upload_invoke();
+  write(uib, pxs);
+  _flush_upload(uib);
+}
+void TextureGpu::write(scoped::UploadInvocationBuilder& uib, const std::vector<uint32_t>& pxs) {
   const auto& tex_cfg = tex.cfg();
   L_ASSERT(pxs.size() == tex_cfg.width * tex_cfg.height);
-
-  stage_buf.map_write().write(pxs);
-
-  ctxt.build_trans_invoke()
-    .src(stage_buf.view())
-    .dst(tex.view())
-    .build()
-    .submit()
-    .wait();
+  uib.write(tex.view(), pxs);
 }
 
 
@@ -548,7 +613,8 @@ Renderer& Renderer::draw_idxmesh(const scoped::IndexedMeshGpu& idxmesh) {
   return draw_idxmesh(idxmesh, default_tex);
 }
 Renderer& Renderer::draw_idxmesh(const mesh::IndexedMesh& idxmesh, const scoped::TextureGpu& tex) {
-  scoped::IndexedMeshGpu idxmesh2(ctxt, idxmesh);
+  scoped::IndexedMeshGpu idxmesh2(ctxt, idxmesh.mesh.poses.size(), idxmesh.idxs.size(), true);
+  idxmesh2.write(idxmesh);
   return draw_idxmesh(idxmesh2, tex);
 }
 Renderer& Renderer::draw_idxmesh(const mesh::IndexedMesh& idxmesh) {
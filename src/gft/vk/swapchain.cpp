@@ -121,6 +121,7 @@ sys::SwapchainRef _create_swapchain(
     out.dyn_detail.stage = VK_PIPELINE_STAGE_HOST_BIT;
     out.dyn_detail.layout = VK_IMAGE_LAYOUT_UNDEFINED;
     out.dyn_detail.access = 0;
+    out.dyn_detail.qfam_idx = VK_QUEUE_FAMILY_IGNORED;
 
     swapchain_imgs.emplace_back(std::move(out));
   }
@@ -143,20 +144,16 @@ void _init_swapchain(Swapchain& swapchain) {
   SwapchainDynamicDetail& dyn_detail = *swapchain.dyn_detail;
   dyn_detail.img_idx = std::make_unique<uint32_t>(~0u);
 
-  VkFenceCreateInfo fci {};
-  fci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-
-  VkFence fence;
-  VK_ASSERT << vkCreateFence(ctxt.dev->dev, &fci, nullptr, &fence);
+  FencePoolItem fence_item =
+    const_cast<Context&>(ctxt).acquire_fence(L_SUBMIT_TYPE_PRESENT);
+  VkFence fence = fence_item.value()->fence;
 
   VkResult acq_res = vkAcquireNextImageKHR(ctxt.dev->dev, *swapchain.swapchain,
-    SPIN_INTERVAL, VK_NULL_HANDLE, fence, &*dyn_detail.img_idx);
+    UINT64_MAX, VK_NULL_HANDLE, fence, &*dyn_detail.img_idx);
   L_ASSERT(acq_res >= 0, "failed to initiate swapchain image acquisition");
 
   // Ensure the first image is acquired. It shouldn't take long.
-  VK_ASSERT << vkWaitForFences(ctxt.dev->dev, 1, &fence, VK_TRUE, SPIN_INTERVAL);
-
-  vkDestroyFence(ctxt.dev->dev, fence, nullptr);
+  VK_ASSERT << vkWaitForFences(ctxt.dev->dev, 1, &fence, VK_TRUE, UINT64_MAX);
 }
 bool Swapchain::create(
   const Context& ctxt,
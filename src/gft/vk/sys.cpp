@@ -123,10 +123,12 @@ sys::DeviceRef create_dev(
   VkPhysicalDevice physdev,
   const std::vector<VkDeviceQueueCreateInfo> dqcis,
   const std::vector<const char*> enabled_ext_names,
-  const VkPhysicalDeviceFeatures& enabled_feat
+  const VkPhysicalDeviceFeatures& enabled_feat,
+  const void* pnext
 ) {
   VkDeviceCreateInfo dci {};
   dci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  dci.pNext = pnext;
   dci.pEnabledFeatures = &enabled_feat;
   dci.queueCreateInfoCount = (uint32_t)dqcis.size();
   dci.pQueueCreateInfos = dqcis.data();
@@ -142,6 +144,20 @@ VkQueue get_dev_queue(VkDevice dev, uint32_t qfam_idx, uint32_t queue_idx) {
 }
 
 
+// VkSemaphore
+sys::SemaphoreRef create_timeline_sema(VkDevice dev, uint64_t init_value) {
+  VkSemaphoreTypeCreateInfoKHR stci {};
+  stci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+  stci.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+  stci.initialValue = init_value;
+
+  VkSemaphoreCreateInfo sci {};
+  sci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  sci.pNext = &stci;
+  return sys::Semaphore::create(dev, &sci);
+}
+
+
 // VkSampler
 sys::SamplerRef create_sampler(
   VkDevice dev,
@@ -197,6 +213,20 @@ sys::PipelineLayoutRef create_pipe_layout(
 
   return sys::PipelineLayout::create(dev, &plci);
 }
+sys::PipelineLayoutRef create_pipe_layout(
+  VkDevice dev,
+  const std::vector<VkDescriptorSetLayout>& desc_set_layouts,
+  const std::vector<VkPushConstantRange>& push_const_rngs
+) {
+  VkPipelineLayoutCreateInfo plci {};
+  plci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  plci.setLayoutCount = (uint32_t)desc_set_layouts.size();
+  plci.pSetLayouts = desc_set_layouts.data();
+  plci.pushConstantRangeCount = (uint32_t)push_const_rngs.size();
+  plci.pPushConstantRanges = push_const_rngs.data();
+
+  return sys::PipelineLayout::create(dev, &plci);
+}
 
 
 // VkShaderModule
@@ -27,10 +27,14 @@ extern sys::DeviceRef create_dev(
   VkPhysicalDevice physdev,
   const std::vector<VkDeviceQueueCreateInfo> dqcis,
   const std::vector<const char*> enabled_ext_names,
-  const VkPhysicalDeviceFeatures& enabled_feat
+  const VkPhysicalDeviceFeatures& enabled_feat,
+  const void* pnext
 );
 VkQueue get_dev_queue(VkDevice dev, uint32_t qfam_idx, uint32_t queue_idx);
 
+// VkSemaphore
+extern sys::SemaphoreRef create_timeline_sema(VkDevice dev, uint64_t init_value);
+
 // VkSampler
 extern sys::SamplerRef create_sampler(
   VkDevice dev,
@@ -51,6 +55,11 @@ extern sys::PipelineLayoutRef create_pipe_layout(
   VkDevice dev,
   VkDescriptorSetLayout desc_set_layout
 );
+extern sys::PipelineLayoutRef create_pipe_layout(
+  VkDevice dev,
+  const std::vector<VkDescriptorSetLayout>& desc_set_layouts,
+  const std::vector<VkPushConstantRange>& push_const_rngs
+);
 
 // VkShaderModule
 extern VkShaderModule create_shader_mod(
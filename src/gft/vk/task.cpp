@@ -5,6 +5,40 @@
 namespace liong {
 namespace vk {
 
+// Resources bound by the invocation are at set 0; bindless resources are at set
+// 1 if required. Push constants, if any, are visible to all stages in `stage`.
+sys::PipelineLayoutRef _create_task_pipe_layout(
+  const Context& ctxt,
+  const std::vector<ResourceType>& rsc_tys,
+  bool is_bindless,
+  uint32_t push_const_size,
+  VkShaderStageFlags stage
+) {
+  std::vector<VkDescriptorSetLayout> desc_set_layouts;
+  desc_set_layouts.emplace_back(
+    const_cast<Context&>(ctxt).get_desc_set_layout(rsc_tys)->desc_set_layout);
+  if (is_bindless) {
+    desc_set_layouts.emplace_back(const_cast<Context&>(ctxt)
+      .get_bindless_detail().desc_set_layout->desc_set_layout);
+  }
+
+  std::vector<VkPushConstantRange> push_const_rngs;
+  if (push_const_size > 0) {
+    L_ASSERT(push_const_size % 4 == 0, "push constant size must be a multiple "
+      "of 4 bytes");
+    L_ASSERT(push_const_size <= ctxt.physdev_prop().limits.maxPushConstantsSize,
+      "push constant size exceeds the device limit");
+    VkPushConstantRange pcr {};
+    pcr.stageFlags = stage;
+    pcr.offset = 0;
+    pcr.size = push_const_size;
+    push_const_rngs.emplace_back(pcr);
+  }
+
+  return sys::create_pipe_layout(ctxt.dev->dev, desc_set_layouts,
+    push_const_rngs);
+}
+
 bool Task::create(
   const Context& ctxt,
   const ComputeTaskConfig& cfg,
@@ -13,10 +47,9 @@ bool Task::create(
   L_ASSERT(cfg.workgrp_size.x * cfg.workgrp_size.y * cfg.workgrp_size.z != 0,
     "workgroup size cannot be zero");
   std::vector<VkDescriptorPoolSize> desc_pool_sizes;
-  sys::DescriptorSetLayoutRef desc_set_layout =
-    const_cast<Context&>(ctxt).get_desc_set_layout(cfg.rsc_tys);
-  sys::PipelineLayoutRef pipe_layout = sys::create_pipe_layout(ctxt.dev->dev,
-    desc_set_layout->desc_set_layout);
+  const VkShaderStageFlags stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  sys::PipelineLayoutRef pipe_layout = _create_task_pipe_layout(ctxt,
+    cfg.rsc_tys, cfg.is_bindless, cfg.push_const_size, stage);
   VkShaderModule shader_mod = sys::create_shader_mod(ctxt.dev->dev,
     (const uint32_t*)cfg.code, cfg.code_size);
 
@@ -46,6 +79,9 @@ bool Task::create(
   TaskResourceDetail rsc_detail {};
   rsc_detail.pipe_layout = std::move(pipe_layout);
   rsc_detail.rsc_tys = cfg.rsc_tys;
+  rsc_detail.is_bindless = cfg.is_bindless;
+  rsc_detail.push_const_size = cfg.push_const_size;
+  rsc_detail.push_const_stage = stage;
 
   out.label = cfg.label;
   out.submit_ty = L_SUBMIT_TYPE_COMPUTE;
@@ -54,6 +90,13 @@ bool Task::create(
   out.pipe = std::move(pipe);
   out.workgrp_size = cfg.workgrp_size;
   out.rsc_detail = std::move(rsc_detail);
+  if (ctxt.is_capturable) {
+    const uint8_t* code = (const uint8_t*)cfg.code;
+    out.capture_detail = std::make_unique<TaskCaptureDetail>();
+    out.capture_detail->comp_cfg = cfg;
+    out.capture_detail->comp_cfg.code = nullptr;
+    out.capture_detail->code.assign(code, code + cfg.code_size);
+  }
   L_DEBUG("created compute task '", cfg.label, "'");
   return true;
 }
@@ -68,11 +111,11 @@ bool Task::create(
   const Context& ctxt = *pass.ctxt;
 
   std::vector<VkDescriptorPoolSize> desc_pool_sizes;
-  sys::DescriptorSetLayoutRef desc_set_layout =
-    const_cast<Context&>(ctxt).get_desc_set_layout(cfg.rsc_tys);
 
-  sys::PipelineLayoutRef pipe_layout = sys::create_pipe_layout(ctxt.dev->dev,
-    desc_set_layout->desc_set_layout);
+  const VkShaderStageFlags stage =
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  sys::PipelineLayoutRef pipe_layout = _create_task_pipe_layout(ctxt,
+    cfg.rsc_tys, cfg.is_bindless, cfg.push_const_size, stage);
   VkShaderModule vert_shader_mod = sys::create_shader_mod(ctxt.dev->dev,
     (const uint32_t*)cfg.vert_code, cfg.vert_code_size);
   VkShaderModule frag_shader_mod = sys::create_shader_mod(ctxt.dev->dev,
@@ -136,6 +179,9 @@ bool Task::create(
   TaskResourceDetail rsc_detail {};
   rsc_detail.pipe_layout = std::move(pipe_layout);
   rsc_detail.rsc_tys = cfg.rsc_tys;
+  rsc_detail.is_bindless = cfg.is_bindless;
+  rsc_detail.push_const_size = cfg.push_const_size;
+  rsc_detail.push_const_stage = stage;
 
   out.label = cfg.label;
   out.submit_ty = L_SUBMIT_TYPE_GRAPHICS;
@@ -144,6 +190,18 @@ bool Task::create(
   out.pipe = std::move(pipe);
   out.workgrp_size = {};
   out.rsc_detail = std::move(rsc_detail);
+  if (ctxt.is_capturable) {
+    const uint8_t* vert_code = (const uint8_t*)cfg.vert_code;
+    const uint8_t* frag_code = (const uint8_t*)cfg.frag_code;
+    out.capture_detail = std::make_unique<TaskCaptureDetail>();
+    out.capture_detail->graph_cfg = cfg;
+    out.capture_detail->graph_cfg.vert_code = nullptr;
+    out.capture_detail->graph_cfg.frag_code = nullptr;
+    out.capture_detail->vert_code.assign(vert_code,
+      vert_code + cfg.vert_code_size);
+    out.capture_detail->frag_code.assign(frag_code,
+      frag_code + cfg.frag_code_size);
+  }
   L_DEBUG("created graphics task '", cfg.label, "'");
   return true;
 }
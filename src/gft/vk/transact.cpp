@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <limits>
 #include "gft/vk.hpp"
 #include "gft/log.hpp"
 
@@ -7,7 +9,23 @@ namespace vk {
 bool Transaction::create(const Invocation& invoke, InvocationSubmitTransactionConfig& cfg, Transaction& out) {
   const Context& ctxt = *invoke.ctxt;
 
+  if (!cfg.capture_path.empty()) {
+    L_ASSERT(ctxt.is_capturable, "cannot capture invocation '", invoke.label,
+      "' because context '", ctxt.label, "' is not capturable");
+    if (!capture_invoke(invoke, cfg.capture_path)) {
+      L_ERROR("failed to capture invocation '", invoke.label, "' to '",
+        cfg.capture_path, "'");
+      return false;
+    }
+  }
+
   TransactionLike transact(ctxt, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  transact.is_parallel = cfg.is_parallel;
+  if (cfg.profiler != nullptr) {
+    L_ASSERT(cfg.profiler->ctxt == &ctxt, "profiler '",
+      cfg.profiler->profiler_cfg.label, "' is created on another context");
+    transact.profiler = cfg.profiler;
+  }
   util::Timer timer {};
   timer.tic();
   invoke.record(transact);
@@ -15,19 +33,49 @@ bool Transaction::create(const Invocation& invoke, InvocationSubmitTransactionCo
 
   out.ctxt = &ctxt;
   out.submit_details = std::move(transact.submit_details);
+  out.secondary_cmd_pools = std::move(transact.secondary_cmd_pools);
   out.fences = std::move(transact.fences);
   L_DEBUG("created and submitted transaction for execution, command "
     "recording took ", timer.us(), "us");
   return true;  
 }
 Transaction::~Transaction() {
-  if (fences.size() > 0) {
+  if (!submit_details.empty() || !fences.empty()) {
     L_DEBUG("destroyed transaction");
   }
 }
+// A submitted command buffer waits for all the previous ones in the
+// transaction, except for async compute submissions which are not joined, so
+// the last timeline point of each queue marks the completion of the
+// transaction.
+void _get_last_submits(
+  const Transaction& transact,
+  std::vector<VkSemaphore>& semas,
+  std::vector<uint64_t>& values
+) {
+  for (auto it = transact.submit_details.rbegin();
+    it != transact.submit_details.rend(); ++it) {
+    if (!it->is_submitted) { continue; }
+    VkSemaphore sema = it->timeline_sema->sema;
+    if (std::find(semas.begin(), semas.end(), sema) != semas.end()) {
+      continue;
+    }
+    semas.emplace_back(sema);
+    values.emplace_back(it->signal_value);
+  }
+}
 bool Transaction::is_done() const {
+  std::vector<VkSemaphore> semas;
+  std::vector<uint64_t> values;
+  _get_last_submits(*this, semas, values);
+  for (size_t i = 0; i < semas.size(); ++i) {
+    uint64_t value = 0;
+    VK_ASSERT << ctxt->timeline_detail.get_sema_counter_value(*ctxt->dev,
+      semas.at(i), &value);
+    if (value < values.at(i)) { return false; }
+  }
   for (const auto& fence : fences) {
-    VkResult err = vkGetFenceStatus(*ctxt->dev, fence->fence);
+    VkResult err = vkGetFenceStatus(*ctxt->dev, fence.value()->fence);
     if (err == VK_NOT_READY) {
       return false;
     } else {
@@ -36,28 +84,177 @@ bool Transaction::is_done() const {
   }
   return true;
 }
-void Transaction::wait() const {
-  std::vector<VkFence> fences2(fences.size());
-  for (size_t i = 0; i < fences.size(); ++i) {
-    fences2.at(i) = fences.at(i)->fence;
+// Point of time waits give up. Infinite timeouts never expire.
+struct WaitDeadline {
+  bool is_infinite;
+  std::chrono::steady_clock::time_point time;
+};
+WaitDeadline _make_deadline(double timeout_us) {
+  WaitDeadline out {};
+  // Anything beyond a year is considered infinite.
+  out.is_infinite = !(timeout_us < 365.0 * 24 * 3600 * 1e6);
+  if (!out.is_infinite) {
+    out.time = std::chrono::steady_clock::now() +
+      std::chrono::nanoseconds((int64_t)(std::max(timeout_us, 0.0) * 1000.0));
   }
+  return out;
+}
+uint64_t _get_timeout_ns(const WaitDeadline& deadline) {
+  if (deadline.is_infinite) { return UINT64_MAX; }
+  auto now = std::chrono::steady_clock::now();
+  if (now >= deadline.time) { return 0; }
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+    deadline.time - now).count();
+}
 
-  util::Timer wait_timer {};
-  wait_timer.tic();
-  for (VkResult err;;) {
-    err = vkWaitForFences(*ctxt->dev, fences2.size(), fences2.data(),
-      VK_TRUE, SPIN_INTERVAL);
-    if (err == VK_TIMEOUT) {
-      // L_WARN("timeout after 3000ns");
-    } else {
-      VK_ASSERT << err;
-      break;
+// Block until all the transactions are done. Returns `false` on timeout.
+bool _wait_all(
+  const Context& ctxt,
+  const std::vector<const Transaction*>& transacts,
+  const WaitDeadline& deadline
+) {
+  std::vector<VkSemaphore> semas;
+  std::vector<uint64_t> values;
+  std::vector<VkFence> fences;
+  for (const Transaction* transact : transacts) {
+    L_ASSERT(transact->ctxt == &ctxt,
+      "transactions waited together must be submitted on the same context");
+    std::vector<VkSemaphore> semas2;
+    std::vector<uint64_t> values2;
+    _get_last_submits(*transact, semas2, values2);
+    for (size_t i = 0; i < semas2.size(); ++i) {
+      auto it = std::find(semas.begin(), semas.end(), semas2.at(i));
+      if (it == semas.end()) {
+        semas.emplace_back(semas2.at(i));
+        values.emplace_back(values2.at(i));
+      } else {
+        uint64_t& value = values.at(it - semas.begin());
+        value = std::max(value, values2.at(i));
+      }
+    }
+    for (const auto& fence : transact->fences) {
+      fences.emplace_back(fence.value()->fence);
     }
   }
+
+  if (!semas.empty()) {
+    VkSemaphoreWaitInfoKHR swi {};
+    swi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    swi.semaphoreCount = (uint32_t)semas.size();
+    swi.pSemaphores = semas.data();
+    swi.pValues = values.data();
+    VkResult err = ctxt.timeline_detail.wait_semas(*ctxt.dev, &swi,
+      _get_timeout_ns(deadline));
+    if (err == VK_TIMEOUT) { return false; }
+    VK_ASSERT << err;
+  }
+  if (!fences.empty()) {
+    VkResult err = vkWaitForFences(*ctxt.dev, (uint32_t)fences.size(),
+      fences.data(), VK_TRUE, _get_timeout_ns(deadline));
+    if (err == VK_TIMEOUT) { return false; }
+    VK_ASSERT << err;
+  }
+  return true;
+}
+
+void Transaction::wait() const {
+  util::Timer wait_timer {};
+  wait_timer.tic();
+  _wait_all(*ctxt, { this }, _make_deadline(
+    std::numeric_limits<double>::infinity()));
   wait_timer.toc();
 
   L_DEBUG("command drain returned after ", wait_timer.us(), "us since the "
-    "wait started (spin interval = ", SPIN_INTERVAL / 1000.0, "us");
+    "wait started");
+}
+bool Transaction::wait_for(double timeout_us) const {
+  return _wait_all(*ctxt, { this }, _make_deadline(timeout_us));
+}
+void Transaction::on_done(std::function<void()>&& callback) const {
+  ContextReaperEntry entry {};
+  _get_last_submits(*this, entry.semas, entry.values);
+  entry.fences = fences;
+  entry.callback = std::move(callback);
+  const_cast<Context*>(ctxt)->get_reaper().push(std::move(entry));
+}
+
+size_t wait_any(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us
+) {
+  if (transacts.empty()) { return 0; }
+  const Context& ctxt = *transacts.front()->ctxt;
+  WaitDeadline deadline = _make_deadline(timeout_us);
+
+  for (;;) {
+    // Sleep on the timeline points not reached yet. Transactions only waiting
+    // for swapchain image acquisition are waited with their fences instead.
+    std::vector<VkSemaphore> semas;
+    std::vector<uint64_t> values;
+    std::vector<VkFence> fences;
+    for (size_t i = 0; i < transacts.size(); ++i) {
+      const Transaction& transact = *transacts.at(i);
+      L_ASSERT(transact.ctxt == &ctxt, "transactions waited together must be "
+        "submitted on the same context");
+      if (transact.is_done()) { return i; }
+
+      std::vector<VkSemaphore> semas2;
+      std::vector<uint64_t> values2;
+      _get_last_submits(transact, semas2, values2);
+      bool is_submit_done = true;
+      for (size_t j = 0; j < semas2.size(); ++j) {
+        uint64_t value = 0;
+        VK_ASSERT << ctxt.timeline_detail.get_sema_counter_value(*ctxt.dev,
+          semas2.at(j), &value);
+        if (value < values2.at(j)) {
+          semas.emplace_back(semas2.at(j));
+          values.emplace_back(values2.at(j));
+          is_submit_done = false;
+        }
+      }
+      if (is_submit_done) {
+        for (const auto& fence : transact.fences) {
+          fences.emplace_back(fence.value()->fence);
+        }
+      }
+    }
+
+    // Some transaction has just been finished.
+    if (semas.empty() && fences.empty()) { continue; }
+
+    uint64_t timeout_ns = _get_timeout_ns(deadline);
+    if (timeout_ns == 0) { return transacts.size(); }
+
+    // Fences and timeline semaphores cannot be waited together. If there are
+    // both, sleep on the timeline semaphores and poll the fences so that
+    // neither kind of transaction is left unnoticed.
+    VkResult err;
+    if (semas.empty()) {
+      err = vkWaitForFences(*ctxt.dev, (uint32_t)fences.size(),
+        fences.data(), VK_FALSE, timeout_ns);
+    } else {
+      bool is_polling = !fences.empty() && timeout_ns > FENCE_POLL_INTERVAL_NS;
+      VkSemaphoreWaitInfoKHR swi {};
+      swi.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+      swi.flags = VK_SEMAPHORE_WAIT_ANY_BIT_KHR;
+      swi.semaphoreCount = (uint32_t)semas.size();
+      swi.pSemaphores = semas.data();
+      swi.pValues = values.data();
+      err = ctxt.timeline_detail.wait_semas(*ctxt.dev, &swi,
+        is_polling ? FENCE_POLL_INTERVAL_NS : timeout_ns);
+      if (err == VK_TIMEOUT && is_polling) { continue; }
+    }
+    if (err == VK_TIMEOUT) { return transacts.size(); }
+    VK_ASSERT << err;
+  }
+}
+bool wait_all(
+  const std::vector<const Transaction*>& transacts,
+  double timeout_us
+) {
+  if (transacts.empty()) { return true; }
+  return _wait_all(*transacts.front()->ctxt, transacts,
+    _make_deadline(timeout_us));
 }
 
 } // namespace vk
@@ -72,24 +72,101 @@ void desc_physdev_mem_prop(
       }
     }
     std::string all_flags = flags.empty() ? "0" : util::join(" | ", flags);
-    ss << "  memory type #" << i << " on heap #" << ty.heapIndex << ": " << all_flags;
+    ss << "  memory type #" << i << " on heap #" << ty.heapIndex << ": " << all_flags << std::endl;
   }
 }
+void desc_physdev_mem_detail(
+  std::stringstream& ss,
+  const InstancePhysicalDeviceMemoryDetail& mem_detail
+) {
+  const char* mem_arch_lit;
+  switch (mem_detail.mem_arch) {
+  case L_DEVICE_MEMORY_ARCHITECTURE_DISCRETE: mem_arch_lit = "discrete"; break;
+  case L_DEVICE_MEMORY_ARCHITECTURE_RESIZABLE_BAR: mem_arch_lit = "resizable bar"; break;
+  case L_DEVICE_MEMORY_ARCHITECTURE_UNIFIED: mem_arch_lit = "unified"; break;
+  default: mem_arch_lit = "unknown"; break;
+  }
+  ss << "  memory architecture: " << mem_arch_lit;
+  if (mem_detail.mem_arch == L_DEVICE_MEMORY_ARCHITECTURE_DISCRETE) {
+    ss << " (uploads are staged)";
+  } else {
+    ss << " (uploads directly write memory type #" <<
+      mem_detail.direct_write_mem_ty_idx << " on heap #" <<
+      mem_detail.direct_write_heap_idx << " of " <<
+      (mem_detail.direct_write_heap_size >> 20) << "MB)";
+  }
+}
+
+
+
+InstancePhysicalDeviceMemoryDetail make_physdev_mem_detail(
+  const VkPhysicalDeviceProperties& prop,
+  const VkPhysicalDeviceMemoryProperties& mem_prop
+) {
+  // Host-visible device-local heaps no larger than this are considered legacy
+  // BAR apertures, which are too small to hold bulk uploads.
+  const VkDeviceSize LEGACY_BAR_SIZE = 256 * 1024 * 1024;
+  const VkMemoryPropertyFlags direct_write_flags =
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  const VkMemoryPropertyFlags excluded_flags =
+    VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT |
+    VK_MEMORY_PROPERTY_PROTECTED_BIT;
+
+  InstancePhysicalDeviceMemoryDetail out {};
+  out.mem_arch = L_DEVICE_MEMORY_ARCHITECTURE_DISCRETE;
+  out.direct_write_mem_ty_idx = VK_MAX_MEMORY_TYPES;
+  out.direct_write_heap_idx = VK_MAX_MEMORY_HEAPS;
+  out.direct_write_heap_size = 0;
+
+  // Look for the largest heap the host can directly write to.
+  for (uint32_t i = 0; i < mem_prop.memoryTypeCount; ++i) {
+    const VkMemoryType& ty = mem_prop.memoryTypes[i];
+    if ((ty.propertyFlags & direct_write_flags) != direct_write_flags) {
+      continue;
+    }
+    if ((ty.propertyFlags & excluded_flags) != 0) { continue; }
+
+    VkDeviceSize heap_size = mem_prop.memoryHeaps[ty.heapIndex].size;
+    if (heap_size > out.direct_write_heap_size) {
+      out.direct_write_mem_ty_idx = i;
+      out.direct_write_heap_idx = ty.heapIndex;
+      out.direct_write_heap_size = heap_size;
+    }
+  }
+
+  if (out.direct_write_mem_ty_idx == VK_MAX_MEMORY_TYPES) {
+    return out;
+  }
+  if (
+    prop.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+    prop.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU
+  ) {
+    out.mem_arch = L_DEVICE_MEMORY_ARCHITECTURE_UNIFIED;
+  } else if (out.direct_write_heap_size > LEGACY_BAR_SIZE) {
+    out.mem_arch = L_DEVICE_MEMORY_ARCHITECTURE_RESIZABLE_BAR;
+  }
+  return out;
+}
 
 
 
 InstancePhysicalDeviceDetail make_physdev_detail(VkPhysicalDevice physdev) {
   auto prop = sys::get_physdev_prop(physdev);
   auto mem_prop = sys::get_physdev_mem_prop(physdev);
+  auto mem_detail = make_physdev_mem_detail(prop, mem_prop);
 
   std::stringstream ss {};
   desc_physdev_prop(ss, prop);
   desc_physdev_mem_prop(ss, mem_prop);
+  desc_physdev_mem_detail(ss, mem_detail);
 
   InstancePhysicalDeviceDetail out {};
   out.physdev = physdev;
   out.prop = prop;
   out.mem_prop = mem_prop;
+  out.mem_detail = mem_detail;
   out.feat = sys::get_physdev_feat(physdev);
   out.qfam_props = sys::collect_qfam_props(physdev);
   out.ext_props = sys::collect_physdev_ext_props(physdev);